@@ -0,0 +1,34 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXAudioConversion provides vectorized conversions from the sample formats that BXAudioSources
+//can render, into those that DOSBox's mixer can take.
+
+//The C brace is needed when including this header from an Objective C++ file
+#if __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import "BXAudioSource.h"
+
+/// Converts 32-bit float samples in the range -1.0 to 1.0 into the 32-bit integer samples that
+/// DOSBox's mixer takes, which share the scale of 16-bit samples. Out-of-range samples are clipped,
+/// and NaNs are converted to silence.
+/// @c source and @c destination may be the same buffer, to convert the samples in place.
+void BXAudioConvertFloatToMixerSamples(const float *source, int32_t *destination, NSUInteger numSamples);
+
+/// Converts samples in any @c BXAudioFormat, mono or stereo, into interleaved 16-bit signed stereo
+/// on the same scale as DOSBox's mixer uses. Mono samples are copied to both channels, and 32-bit
+/// integer samples (which are already on the mixer's scale) are clipped. @c destination must have
+/// room for twice @c numFrames samples, and must not overlap @c source.
+void BXAudioConvertToStereo16(const void *source, BXAudioFormat format, int16_t *destination, NSUInteger numFrames);
+
+#if __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXAudioConversion.h"
+#import <simd/simd.h>
+
+
+#define BXMixerSampleScale 32767.0f
+
+
+//Clips a float sample to the range -1.0 to 1.0 and scales it to the mixer's range.
+//NaNs become silence: converting them straight to an integer is undefined.
+static inline int32_t _floatAsMixerSample(float sample)
+{
+    if (sample != sample) return 0;
+    if (sample > 1.0f) sample = 1.0f;
+    else if (sample < -1.0f) sample = -1.0f;
+    
+    return (int32_t)(sample * BXMixerSampleScale);
+}
+
+void BXAudioConvertFloatToMixerSamples(const float *source, int32_t *destination, NSUInteger numSamples)
+{
+    //Eight samples at a time fills a pair of SSE or NEON registers, or a single AVX register.
+    NSUInteger i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        //memcpy rather than casting, as neither buffer is guaranteed to be vector-aligned.
+        simd_float8 samples;
+        memcpy(&samples, source + i, sizeof(samples));
+        
+        //Zero out NaNs before clamping, to match the scalar path.
+        samples = simd_select((simd_float8)0.0f, samples, samples == samples);
+        simd_int8 converted = simd_int(simd_clamp(samples, (simd_float8)-1.0f, (simd_float8)1.0f) * BXMixerSampleScale);
+        memcpy(destination + i, &converted, sizeof(converted));
+    }
+    
+    //Convert any leftover samples the same way, one at a time.
+    for (; i < numSamples; i++)
+        destination[i] = _floatAsMixerSample(source[i]);
+}
+
+static inline int16_t _clipToInt16(int32_t sample)
+{
+    if (sample > INT16_MAX) return INT16_MAX;
+    if (sample < INT16_MIN) return INT16_MIN;
+    return (int16_t)sample;
+}
+
+//Returns the specified sample of the buffer on the scale of a signed 16-bit sample.
+static inline int16_t _sampleAsInt16(const void *buffer, NSUInteger index, BXAudioFormat format)
+{
+    BOOL isUnsigned = (format & BXAudioFormatUnsigned) == BXAudioFormatUnsigned;
+    switch (format & BXAudioFormatSizeMask)
+    {
+        case BXAudioFormat8Bit:
+            if (isUnsigned) return (int16_t)((((const uint8_t *)buffer)[index] ^ 0x80) << 8);
+            else            return (int16_t)(((const int8_t *)buffer)[index] * 256);
+            
+        case BXAudioFormat16Bit:
+            if (isUnsigned) return (int16_t)(((const uint16_t *)buffer)[index] ^ 0x8000);
+            else            return ((const int16_t *)buffer)[index];
+            
+        case BXAudioFormat32Bit:
+            if (format & BXAudioFormatFloat)
+                return (int16_t)_floatAsMixerSample(((const float *)buffer)[index]);
+            else
+                return _clipToInt16(((const int32_t *)buffer)[index]);
+            
+        default:
+            return 0;
+    }
+}
+
+void BXAudioConvertToStereo16(const void *source, BXAudioFormat format, int16_t *destination, NSUInteger numFrames)
+{
+    //The common case needs no conversion at all.
+    if (format == (BXAudioFormat16Bit | BXAudioFormatSigned | BXAudioFormatStereo))
+    {
+        memcpy(destination, source, numFrames * 2 * sizeof(int16_t));
+        return;
+    }
+    
+    BOOL isStereo = (format & BXAudioFormatStereo) == BXAudioFormatStereo;
+    for (NSUInteger i=0; i<numFrames; i++)
+    {
+        if (isStereo)
+        {
+            destination[i * 2]      = _sampleAsInt16(source, i * 2, format);
+            destination[i * 2 + 1]  = _sampleAsInt16(source, i * 2 + 1, format);
+        }
+        else
+        {
+            destination[i * 2] = destination[i * 2 + 1] = _sampleAsInt16(source, i, format);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "BXAudioSource.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The file formats that BXAudioRecorder can write.
+typedef NS_ENUM(NSInteger, BXAudioRecorderFormat) {
+    /// Uncompressed 16-bit stereo PCM in a RIFF WAVE file.
+    BXAudioRecorderFormatWAV,
+    /// Losslessly-compressed 16-bit stereo in a native FLAC file.
+    BXAudioRecorderFormatFLAC,
+};
+
+/// The number of sample frames of audio a recorder can hold while waiting for them to be written.
+/// About 1.4 seconds at 48kHz.
+#define BXAudioRecorderBufferFrames 65536
+
+
+/// @brief BXAudioRecorder records a stream of 16-bit stereo audio to a WAV or FLAC file.
+///
+/// @discussion Samples are added from the emulation thread, which copies them into a lock-free ring buffer
+/// and goes straight back to emulating. A thread of the recorder's own takes them from there, encodes them
+/// and writes them to disk. If that thread falls so far behind that the ring fills up, for instance because
+/// disk I/O has stalled, new samples are dropped (and counted) rather than holding up emulation. Dropped
+/// samples are replaced with silence once there is room again, so the recording keeps in step with the
+/// emulated time it covers.
+///
+/// The sample rate of the first samples added determines the sample rate of the recording:
+/// later samples at a different rate are dropped. The recorder must be finished with
+/// @c finishWithCompletionHandler: for its file to be completed, and to release it.
+@interface BXAudioRecorder : NSObject
+
+/// The location of the file being recorded.
+@property (readonly, copy) NSURL *URL;
+
+/// The format of the file being recorded.
+@property (readonly) BXAudioRecorderFormat format;
+
+/// The number of sample frames written so far, including silence written in place of dropped samples.
+@property (readonly) NSUInteger recordedFrameCount;
+
+/// The number of sample frames that have been dropped because they could not be written in time,
+/// or because they did not match the sample rate of the recording.
+@property (readonly) NSUInteger droppedFrameCount;
+
+/// Whether the recording has been finished.
+@property (readonly, getter=isFinished) BOOL finished;
+
+/// Returns the file extension for recordings of the specified format.
++ (NSString *) fileExtensionForFormat: (BXAudioRecorderFormat)format;
+
+/// Returns the format chosen by the audioRecordingFormat user default,
+/// which may be "wav" or "flac". Defaults to FLAC.
++ (BXAudioRecorderFormat) preferredFormat;
+
+/// Creates a new recording at the specified URL, replacing any existing file there.
+/// Returns @c nil and populates @c outError if the file could not be created.
+- (nullable instancetype) initWithURL: (NSURL *)URL
+                               format: (BXAudioRecorderFormat)format
+                                error: (out NSError **)outError;
+
+/// Queues the specified interleaved 16-bit stereo samples for recording.
+/// Must only be called from one thread at a time.
+- (void) addSamples: (const int16_t *)samples
+             frames: (NSUInteger)numFrames
+         sampleRate: (NSUInteger)sampleRate;
+
+/// Queues the specified samples for recording, converting them from the specified format.
+/// Must only be called from one thread at a time.
+- (void) addSamples: (const void *)samples
+             frames: (NSUInteger)numFrames
+             format: (BXAudioFormat)format
+         sampleRate: (NSUInteger)sampleRate;
+
+/// Queues the specified number of frames of silence for recording.
+/// Must only be called from one thread at a time.
+- (void) addSilenceWithFrames: (NSUInteger)numFrames
+                   sampleRate: (NSUInteger)sampleRate;
+
+/// Writes out any queued samples, completes the file's headers and closes it. Samples added after
+/// this are ignored. The completion handler is called on the main thread.
+- (void) finishWithCompletionHandler: (nullable void (^)(BOOL success, NSError * _Nullable error))completionHandler;
+
+@end
+
+
+//The C brace is needed when including this header from an Objective C++ file
+#if __cplusplus
+extern "C" {
+#endif
+
+/// Writes a 44-byte header for a 16-bit stereo PCM WAV file containing the specified number of bytes of sample data,
+/// at the current position in the specified file.
+void BXWriteWAVHeader(FILE *file, uint32_t sampleRate, uint32_t dataBytes);
+
+#if __cplusplus
+}
+#endif
+
+NS_ASSUME_NONNULL_END
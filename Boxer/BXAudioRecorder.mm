@@ -0,0 +1,422 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXAudioRecorder.h"
+#import "BXAudioConversion.h"
+#import "BXFLACEncoder.h"
+#import "BXSPSCRing.h"
+
+#import <thread>
+#import <vector>
+#import <atomic>
+#import <pthread.h>
+#import <libkern/OSByteOrder.h>
+
+
+//The most sample frames the writer thread takes from the ring at a time.
+#define BXAudioRecorderChunkFrames 4096
+
+//How long the writer thread sleeps between checks for new samples, if it isn't woken sooner.
+#define BXAudioRecorderIdleTimeout (50 * NSEC_PER_MSEC)
+
+//The sample rate to give a recording that finished before any samples were added.
+#define BXAudioRecorderFallbackSampleRate 44100
+
+//WAV files cannot exceed 4GB: stop recording a little before then.
+#define BXWAVMaxDataLength 0xFFFF0000ULL
+
+//A block of silence to copy into the ring in place of dropped samples.
+static const int16_t BXAudioRecorderSilence[BXAudioRecorderChunkFrames * 2] = { 0 };
+
+
+void BXWriteWAVHeader(FILE *file, uint32_t sampleRate, uint32_t dataBytes)
+{
+    UInt8 header[44];
+    memcpy(header, "RIFF", 4);
+    OSWriteLittleInt32(header, 4, 36 + dataBytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    OSWriteLittleInt32(header, 16, 16);                 //Format chunk size
+    OSWriteLittleInt16(header, 20, 1);                  //Integer PCM
+    OSWriteLittleInt16(header, 22, 2);                  //Channels
+    OSWriteLittleInt32(header, 24, sampleRate);
+    OSWriteLittleInt32(header, 28, sampleRate * 4);     //Bytes per second
+    OSWriteLittleInt16(header, 32, 4);                  //Bytes per frame
+    OSWriteLittleInt16(header, 34, 16);                 //Bits per sample
+    memcpy(header + 36, "data", 4);
+    OSWriteLittleInt32(header, 40, dataBytes);
+
+    fwrite(header, sizeof(header), 1, file);
+}
+
+
+@implementation BXAudioRecorder
+{
+    BXSPSCRing<int16_t> *_ring;
+    dispatch_semaphore_t _writeSignal;
+
+    //Shared state
+    std::atomic<bool> _finished;
+    std::atomic<NSUInteger> _sampleRate;
+    std::atomic<NSUInteger> _recordedFrames;
+    std::atomic<NSUInteger> _droppedFrames;
+    void (^_completionHandler)(BOOL, NSError *);
+
+    //Producer-owned state
+    std::vector<int16_t> _conversionBuffer;
+    NSUInteger _silenceFramesOwed;
+
+    //Writer-owned state
+    FILE *_file;
+    BXFLACEncoder *_FLACEncoder;
+    NSMutableData *_encodedData;
+    NSUInteger _fileSampleRate;
+    uint64_t _dataLength;
+    BOOL _outOfSpace;
+    NSError *_writeError;
+}
+
+@synthesize URL = _URL;
+@synthesize format = _format;
+
++ (NSString *) fileExtensionForFormat: (BXAudioRecorderFormat)format
+{
+    switch (format)
+    {
+        case BXAudioRecorderFormatFLAC:
+            return @"flac";
+        case BXAudioRecorderFormatWAV:
+        default:
+            return @"wav";
+    }
+}
+
++ (BXAudioRecorderFormat) preferredFormat
+{
+    NSString *format = [[NSUserDefaults standardUserDefaults] stringForKey: @"audioRecordingFormat"];
+    if ([format caseInsensitiveCompare: @"wav"] == NSOrderedSame)
+        return BXAudioRecorderFormatWAV;
+    else
+        return BXAudioRecorderFormatFLAC;
+}
+
+- (instancetype) initWithURL: (NSURL *)URL
+                      format: (BXAudioRecorderFormat)format
+                       error: (out NSError **)outError
+{
+    if ((self = [super init]))
+    {
+        _URL = [URL copy];
+        _format = format;
+        _encodedData = [NSMutableData data];
+        _conversionBuffer.resize(BXAudioRecorderChunkFrames * 2);
+
+        _file = fopen(URL.fileSystemRepresentation, "wb");
+        if (!_file)
+        {
+            if (outError)
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: URL }];
+            return nil;
+        }
+
+        _ring = new BXSPSCRing<int16_t>(BXAudioRecorderBufferFrames * 2);
+        _writeSignal = dispatch_semaphore_create(0);
+
+        //The thread keeps us alive until it has finished writing the file.
+        BXAudioRecorder *recorder = self;
+        std::thread([recorder] {
+            pthread_setname_np("Boxer audio recorder");
+            @autoreleasepool
+            {
+                [recorder _runWriteLoop];
+            }
+        }).detach();
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_file)
+    {
+        fclose(_file);
+        _file = NULL;
+    }
+
+    delete _ring;
+    _ring = NULL;
+}
+
+- (NSUInteger) recordedFrameCount
+{
+    return _recordedFrames.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger) droppedFrameCount
+{
+    return _droppedFrames.load(std::memory_order_relaxed);
+}
+
+- (BOOL) isFinished
+{
+    return _finished.load(std::memory_order_acquire);
+}
+
+
+#pragma mark - Producer
+
+- (void) addSamples: (const int16_t *)samples
+             frames: (NSUInteger)numFrames
+         sampleRate: (NSUInteger)sampleRate
+{
+    if ([self _makeRoomForFrames: numFrames sampleRate: sampleRate])
+    {
+        _ring->write(samples, numFrames * 2);
+        [self _didAddFrames];
+    }
+}
+
+- (void) addSamples: (const void *)samples
+             frames: (NSUInteger)numFrames
+             format: (BXAudioFormat)format
+         sampleRate: (NSUInteger)sampleRate
+{
+    if (![self _makeRoomForFrames: numFrames sampleRate: sampleRate])
+        return;
+
+    //Convert in chunks, so that the conversion buffer never has to grow on the emulation thread.
+    NSUInteger bytesPerSample = (format & BXAudioFormatSizeMask) == BXAudioFormat8Bit ? 1 : (format & BXAudioFormatSizeMask) == BXAudioFormat16Bit ? 2 : 4;
+    NSUInteger bytesPerFrame = bytesPerSample * ((format & BXAudioFormatStereo) ? 2 : 1);
+
+    const uint8_t *source = (const uint8_t *)samples;
+    NSUInteger framesRemaining = numFrames;
+    while (framesRemaining > 0)
+    {
+        NSUInteger chunkFrames = MIN(framesRemaining, (NSUInteger)BXAudioRecorderChunkFrames);
+        BXAudioConvertToStereo16(source, format, _conversionBuffer.data(), chunkFrames);
+        _ring->write(_conversionBuffer.data(), chunkFrames * 2);
+
+        source += chunkFrames * bytesPerFrame;
+        framesRemaining -= chunkFrames;
+    }
+    [self _didAddFrames];
+}
+
+- (void) addSilenceWithFrames: (NSUInteger)numFrames
+                   sampleRate: (NSUInteger)sampleRate
+{
+    if ([self _makeRoomForFrames: numFrames sampleRate: sampleRate])
+    {
+        [self _writeSilenceFrames: numFrames];
+        [self _didAddFrames];
+    }
+}
+
+//Checks that the specified number of frames can be added to the ring right now, and returns YES if so.
+//Returns NO and counts the frames as dropped if the recording has finished, if the frames are at the wrong
+//sample rate, or if the ring does not have room for them.
+- (BOOL) _makeRoomForFrames: (NSUInteger)numFrames sampleRate: (NSUInteger)sampleRate
+{
+    if (self.isFinished || !numFrames) return NO;
+
+    //The first samples we get decide the rate of the recording.
+    NSUInteger recordingRate = _sampleRate.load(std::memory_order_relaxed);
+    if (!recordingRate)
+    {
+        recordingRate = sampleRate;
+        _sampleRate.store(sampleRate, std::memory_order_release);
+    }
+
+    if (sampleRate != recordingRate)
+    {
+        _droppedFrames.fetch_add(numFrames, std::memory_order_relaxed);
+        return NO;
+    }
+
+    //Make up for any samples we dropped earlier, as far as there is room to.
+    if (_silenceFramesOwed)
+    {
+        NSUInteger silenceFrames = MIN(_silenceFramesOwed, _ring->writeAvailable() / 2);
+        [self _writeSilenceFrames: silenceFrames];
+        _silenceFramesOwed -= silenceFrames;
+    }
+
+    //If the writer thread has fallen too far behind, drop these frames too rather than waiting for it.
+    if (_silenceFramesOwed || _ring->writeAvailable() < numFrames * 2)
+    {
+        _silenceFramesOwed += numFrames;
+        _droppedFrames.fetch_add(numFrames, std::memory_order_relaxed);
+        dispatch_semaphore_signal(_writeSignal);
+        return NO;
+    }
+
+    return YES;
+}
+
+- (void) _writeSilenceFrames: (NSUInteger)numFrames
+{
+    while (numFrames > 0)
+    {
+        NSUInteger chunkFrames = MIN(numFrames, (NSUInteger)BXAudioRecorderChunkFrames);
+        _ring->write(BXAudioRecorderSilence, chunkFrames * 2);
+        numFrames -= chunkFrames;
+    }
+}
+
+- (void) _didAddFrames
+{
+    //Only wake the writer thread once there is enough waiting to be worth writing:
+    //otherwise it will pick up what's there the next time it wakes by itself.
+    if (_ring->readAvailable() >= _ring->capacity() / 4)
+        dispatch_semaphore_signal(_writeSignal);
+}
+
+- (void) finishWithCompletionHandler: (void (^)(BOOL, NSError *))completionHandler
+{
+    if (self.isFinished) return;
+
+    _completionHandler = [completionHandler copy];
+    if (_finished.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    dispatch_semaphore_signal(_writeSignal);
+}
+
+
+#pragma mark - Writing
+
+- (void) _runWriteLoop
+{
+    std::vector<int16_t> chunk(BXAudioRecorderChunkFrames * 2);
+
+    while (true)
+    {
+        //Check whether we've been told to finish before draining the ring,
+        //so that we don't miss any samples added just before we were told.
+        BOOL finishing = _finished.load(std::memory_order_acquire);
+
+        size_t numSamples;
+        while ((numSamples = _ring->read(chunk.data(), chunk.size())) > 0)
+        {
+            [self _writeSamples: chunk.data() frames: numSamples / 2];
+        }
+
+        if (finishing) break;
+
+        dispatch_semaphore_wait(_writeSignal, dispatch_time(DISPATCH_TIME_NOW, BXAudioRecorderIdleTimeout));
+    }
+
+    [self _finalizeFile];
+
+    void (^completionHandler)(BOOL, NSError *) = _completionHandler;
+    _completionHandler = nil;
+    if (completionHandler)
+    {
+        BOOL succeeded = (_writeError == nil);
+        NSError *error = _writeError;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionHandler(succeeded, error);
+        });
+    }
+}
+
+- (void) _writeHeader
+{
+    if (self.format == BXAudioRecorderFormatFLAC)
+    {
+        if (!_FLACEncoder)
+            _FLACEncoder = [[BXFLACEncoder alloc] initWithSampleRate: _fileSampleRate];
+
+        NSData *header = _FLACEncoder.streamHeader;
+        fwrite(header.bytes, header.length, 1, _file);
+    }
+    else
+    {
+        BXWriteWAVHeader(_file, (uint32_t)_fileSampleRate, (uint32_t)_dataLength);
+    }
+}
+
+- (void) _writeSamples: (const int16_t *)samples frames: (NSUInteger)numFrames
+{
+    if (!_file || _writeError || _outOfSpace) return;
+
+    //Write a placeholder header when we get our first samples and know what rate they're at.
+    if (!_fileSampleRate)
+    {
+        _fileSampleRate = _sampleRate.load(std::memory_order_acquire);
+        [self _writeHeader];
+    }
+
+    const void *bytes;
+    NSUInteger length;
+    if (self.format == BXAudioRecorderFormatFLAC)
+    {
+        _encodedData.length = 0;
+        [_FLACEncoder encodeSamples: samples frames: numFrames toBuffer: _encodedData];
+        bytes = _encodedData.bytes;
+        length = _encodedData.length;
+    }
+    else
+    {
+        if (_dataLength + (numFrames * 4) > BXWAVMaxDataLength)
+        {
+            _outOfSpace = YES;
+            return;
+        }
+        bytes = samples;
+        length = numFrames * 4;
+    }
+
+    if (length && fwrite(bytes, length, 1, _file) != 1)
+    {
+        _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+        return;
+    }
+
+    _dataLength += length;
+    _recordedFrames.fetch_add(numFrames, std::memory_order_relaxed);
+}
+
+- (void) _finalizeFile
+{
+    if (!_file) return;
+
+    if (!_writeError)
+    {
+        //If we never got any samples, still leave behind a valid (empty) file.
+        if (!_fileSampleRate)
+        {
+            _fileSampleRate = BXAudioRecorderFallbackSampleRate;
+            [self _writeHeader];
+        }
+
+        if (_FLACEncoder)
+        {
+            _encodedData.length = 0;
+            [_FLACEncoder flushToBuffer: _encodedData];
+            if (_encodedData.length)
+                fwrite(_encodedData.bytes, _encodedData.length, 1, _file);
+        }
+
+        //Now that we know how long the recording is, go back and fill in the header.
+        if (fseeko(_file, 0, SEEK_SET) == 0)
+            [self _writeHeader];
+
+        if (ferror(_file))
+            _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+    }
+
+    if (fclose(_file) != 0 && !_writeError)
+        _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+    _file = NULL;
+
+    _FLACEncoder = nil;
+}
+
+@end
@@ -0,0 +1,78 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "BXAudioSource.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The quality tiers offered by BXAudioResampler. Higher tiers use longer filters with a sharper
+/// cutoff, which keep more of the treble and let through less aliasing at a higher CPU cost.
+typedef NS_ENUM(NSInteger, BXAudioResamplerQuality) {
+    /// 8 taps per output sample.
+    BXAudioResamplerQualityLow,
+    /// 16 taps per output sample.
+    BXAudioResamplerQualityMedium,
+    /// 32 taps per output sample.
+    BXAudioResamplerQualityHigh,
+    /// 64 taps per output sample.
+    BXAudioResamplerQualityBest,
+};
+
+
+/// @brief BXAudioResampler converts a stream of audio from a @c BXAudioSource from one sample rate
+/// to another, using a windowed-sinc polyphase filter.
+///
+/// @discussion The resampler is pull-driven: callers ask it how many input frames it needs to produce
+/// the number of output frames they want, have the source render that many frames into
+/// @c inputBuffer, and then resample them. All memory is allocated up front when the resampler
+/// is created, so resampling is safe on the mixer's thread.
+///
+/// Input may be in any @c BXAudioFormat, mono or stereo. Output is always interleaved stereo,
+/// as the 32-bit integer samples that DOSBox's mixer takes.
+@interface BXAudioResampler : NSObject
+
+@property (readonly, nonatomic) NSUInteger inputRate;
+@property (readonly, nonatomic) NSUInteger outputRate;
+@property (readonly, nonatomic) BXAudioResamplerQuality quality;
+
+/// How far the resampled output lags behind its input, in seconds. The filter is centred on each
+/// output sample, so it has to wait for half its length of input beyond it.
+@property (readonly, nonatomic) NSTimeInterval latency;
+
+/// The most output frames that can be produced by a single call to
+/// @c resampleInputFrames:format:toMixerSamples:frames:.
+@property (readonly, nonatomic) NSUInteger maxOutputFrames;
+
+/// A buffer large enough to hold the input needed for @c maxOutputFrames of output,
+/// in any format. Sources should render their input straight into this.
+@property (readonly, nonatomic) void *inputBuffer NS_RETURNS_INNER_POINTER;
+
+- (instancetype) initWithInputRate: (NSUInteger)inputRate
+                        outputRate: (NSUInteger)outputRate
+                           quality: (BXAudioResamplerQuality)quality
+                   maxOutputFrames: (NSUInteger)maxOutputFrames;
+
+/// Returns the number of input frames that must be supplied to the next call to
+/// @c resampleInputFrames:format:toMixerSamples:frames: to produce the specified number of output frames.
+- (NSUInteger) inputFramesNeededForOutputFrames: (NSUInteger)outputFrames;
+
+/// Consumes the specified number of frames from @c inputBuffer, which must be exactly the number returned
+/// by @c inputFramesNeededForOutputFrames: for @c outputFrames, and writes @c outputFrames frames of
+/// interleaved stereo to @c output.
+- (void) resampleInputFrames: (NSUInteger)inputFrames
+                      format: (BXAudioFormat)format
+              toMixerSamples: (int32_t *)output
+                      frames: (NSUInteger)outputFrames;
+
+/// Discards all buffered input, e.g. after the source has been silent or its stream has been interrupted.
+- (void) reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,348 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXAudioResampler.h"
+#import <simd/simd.h>
+
+
+#pragma mark -
+#pragma mark Constants
+
+//When the ratio between the input and output rates reduced to lowest terms needs more filter phases
+//than this (e.g. 32000Hz -> 49716Hz), each output frame uses the nearest of this many phases instead.
+#define BXAudioResamplerMaxPhases 1024
+
+typedef struct {
+    //The length of the filter: must be a multiple of 8 for the vectorized convolution.
+    NSUInteger taps;
+    //The shape of the Kaiser window: higher values trade a wider transition band for deeper stopband attenuation.
+    double kaiserBeta;
+    //The filter's cutoff as a proportion of the Nyquist frequency.
+    double rolloff;
+} BXAudioResamplerTier;
+
+static const BXAudioResamplerTier BXAudioResamplerTiers[] = {
+    { 8,    5.0,    0.85 },     //BXAudioResamplerQualityLow
+    { 16,   6.5,    0.90 },     //BXAudioResamplerQualityMedium
+    { 32,   8.0,    0.94 },     //BXAudioResamplerQualityHigh
+    { 64,   9.5,    0.96 },     //BXAudioResamplerQualityBest
+};
+
+
+#pragma mark -
+#pragma mark Helper functions
+
+static NSUInteger _greatestCommonDivisor(NSUInteger a, NSUInteger b)
+{
+    while (b)
+    {
+        NSUInteger remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+//The zeroth-order modified Bessel function of the first kind, which defines the Kaiser window.
+static double _besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (NSUInteger k=1; k<64; k++)
+    {
+        double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+//Returns the specified input sample on the scale of a signed 16-bit sample, which is the scale DOSBox's mixer works in.
+//This matches the conversions that DOSBox's own MixerChannel::AddSamples_* functions perform.
+static inline float _sampleInMixerScale(const void *buffer, NSUInteger index, BXAudioFormat format)
+{
+    BOOL isUnsigned = (format & BXAudioFormatUnsigned) == BXAudioFormatUnsigned;
+    switch (format & BXAudioFormatSizeMask)
+    {
+        case BXAudioFormat8Bit:
+            if (isUnsigned) return (SInt8)(((const UInt8 *)buffer)[index] ^ 0x80) * 256.0f;
+            else            return ((const SInt8 *)buffer)[index] * 256.0f;
+
+        case BXAudioFormat16Bit:
+            if (isUnsigned) return (SInt16)(((const UInt16 *)buffer)[index] ^ 0x8000);
+            else            return ((const SInt16 *)buffer)[index];
+
+        case BXAudioFormat32Bit:
+            if (format & BXAudioFormatFloat)    return ((const float *)buffer)[index] * 32767.0f;
+            else                                return ((const SInt32 *)buffer)[index];
+
+        default:
+            return 0;
+    }
+}
+
+//Applies a filter phase to the matching window of each channel's input.
+static inline void _convolve(const float *coefficients,
+                             const float *left, const float *right,
+                             NSUInteger taps,
+                             float *outLeft, float *outRight)
+{
+    simd_float8 leftSum = (simd_float8)0.0f, rightSum = (simd_float8)0.0f;
+    for (NSUInteger i=0; i<taps; i+=8)
+    {
+        //memcpy rather than casting, as the input windows start at arbitrary frames.
+        simd_float8 c, l, r;
+        memcpy(&c, coefficients + i, sizeof(c));
+        memcpy(&l, left + i, sizeof(l));
+        memcpy(&r, right + i, sizeof(r));
+
+        leftSum += c * l;
+        rightSum += c * r;
+    }
+    *outLeft = simd_reduce_add(leftSum);
+    *outRight = simd_reduce_add(rightSum);
+}
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@interface BXAudioResampler ()
+
+- (void) _buildFilterWithTier: (BXAudioResamplerTier)tier;
+- (void) _appendInputFrames: (NSUInteger)numFrames format: (BXAudioFormat)format;
+
+@end
+
+
+@implementation BXAudioResampler
+{
+    NSUInteger _taps;
+
+    //The ratio of input to output rates in lowest terms: each output frame moves
+    //the input position along by _step / _phaseDenominator frames.
+    NSUInteger _step;
+    NSUInteger _phaseDenominator;
+
+    //The position in _history of the input frame at or just before the next output frame,
+    //and how far past that frame the output falls, as a fraction of _phaseDenominator.
+    NSUInteger _position;
+    NSUInteger _phase;
+
+    //Filter coefficients for _numPhases + 1 evenly-spaced positions between one input frame and the next.
+    NSUInteger _numPhases;
+    float *_coefficients;
+
+    //Planar copies of the input, kept for as long as the filter still needs to look back at them.
+    float *_history[2];
+    NSUInteger _historyFrames;
+    NSUInteger _historyCapacity;
+
+    void *_inputBuffer;
+    NSUInteger _maxInputFrames;
+}
+
+@synthesize inputRate = _inputRate;
+@synthesize outputRate = _outputRate;
+@synthesize quality = _quality;
+@synthesize maxOutputFrames = _maxOutputFrames;
+@synthesize inputBuffer = _inputBuffer;
+
+- (instancetype) initWithInputRate: (NSUInteger)inputRate
+                        outputRate: (NSUInteger)outputRate
+                           quality: (BXAudioResamplerQuality)quality
+                   maxOutputFrames: (NSUInteger)maxOutputFrames
+{
+    NSAssert(inputRate > 0 && outputRate > 0, @"Invalid sample rates passed to initWithInputRate:outputRate:quality:maxOutputFrames:");
+    NSAssert(maxOutputFrames > 0, @"maxOutputFrames must be greater than 0.");
+
+    if ((self = [super init]))
+    {
+        _inputRate = inputRate;
+        _outputRate = outputRate;
+        _quality = MAX(BXAudioResamplerQualityLow, MIN(quality, BXAudioResamplerQualityBest));
+        _maxOutputFrames = maxOutputFrames;
+
+        BXAudioResamplerTier tier = BXAudioResamplerTiers[_quality];
+        _taps = tier.taps;
+
+        NSUInteger divisor = _greatestCommonDivisor(inputRate, outputRate);
+        _step = inputRate / divisor;
+        _phaseDenominator = outputRate / divisor;
+        _numPhases = MIN(_phaseDenominator, (NSUInteger)BXAudioResamplerMaxPhases);
+
+        //The most input we could ever be asked for at once: enough to cover the output,
+        //plus a filter's length either side of it.
+        _maxInputFrames = ((maxOutputFrames + 1) * _step + _phaseDenominator - 1) / _phaseDenominator + _taps + 2;
+        _historyCapacity = _taps + _maxInputFrames;
+
+        _history[0] = (float *)calloc(_historyCapacity, sizeof(float));
+        _history[1] = (float *)calloc(_historyCapacity, sizeof(float));
+
+        //Large enough for stereo input in the widest sample format we accept.
+        _inputBuffer = calloc(_maxInputFrames * 2, sizeof(SInt32));
+
+        _coefficients = (float *)calloc((_numPhases + 1) * _taps, sizeof(float));
+        [self _buildFilterWithTier: tier];
+
+        [self reset];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    free(_history[0]);
+    free(_history[1]);
+    free(_inputBuffer);
+    free(_coefficients);
+}
+
+- (void) _buildFilterWithTier: (BXAudioResamplerTier)tier
+{
+    //When downsampling, the cutoff must come down below the output rate's Nyquist frequency too.
+    double cutoff = tier.rolloff * MIN(1.0, (double)_outputRate / (double)_inputRate);
+    double halfTaps = _taps / 2.0;
+    double windowScale = 1.0 / _besselI0(tier.kaiserBeta);
+
+    for (NSUInteger phase = 0; phase <= _numPhases; phase++)
+    {
+        double fraction = (double)phase / (double)_numPhases;
+        float *coefficients = _coefficients + (phase * _taps);
+        double sum = 0;
+
+        for (NSUInteger tap = 0; tap < _taps; tap++)
+        {
+            //How far this tap's input frame lies from the output frame, in input frames.
+            double distance = (double)tap - (halfTaps - 1) - fraction;
+
+            double x = M_PI * cutoff * distance;
+            double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(x) / x;
+
+            double ratio = distance / halfTaps;
+            double window = (fabs(ratio) < 1.0) ? _besselI0(tier.kaiserBeta * sqrt(1.0 - ratio * ratio)) * windowScale : 0.0;
+
+            double value = cutoff * sinc * window;
+            coefficients[tap] = (float)value;
+            sum += value;
+        }
+
+        //Normalize each phase so that it passes DC at unity gain, or the output
+        //would be modulated by the difference in gain between phases.
+        for (NSUInteger tap = 0; tap < _taps; tap++)
+        {
+            coefficients[tap] = (float)(coefficients[tap] / sum);
+        }
+    }
+}
+
+- (NSTimeInterval) latency
+{
+    return (double)(_taps / 2) / _inputRate;
+}
+
+- (void) reset
+{
+    //Start with silence before the first input frame, for the filter to look back into.
+    _historyFrames = _taps / 2 - 1;
+    memset(_history[0], 0, _historyFrames * sizeof(float));
+    memset(_history[1], 0, _historyFrames * sizeof(float));
+
+    _position = _taps / 2 - 1;
+    _phase = 0;
+}
+
+
+#pragma mark -
+#pragma mark Resampling
+
+- (NSUInteger) inputFramesNeededForOutputFrames: (NSUInteger)outputFrames
+{
+    if (!outputFrames) return 0;
+
+    //The last output frame needs half a filter's worth of input after it.
+    NSUInteger lastPosition = _position + (_phase + (outputFrames - 1) * _step) / _phaseDenominator;
+    NSUInteger framesRequired = lastPosition + _taps / 2 + 1;
+
+    return (framesRequired > _historyFrames) ? framesRequired - _historyFrames : 0;
+}
+
+- (void) resampleInputFrames: (NSUInteger)inputFrames
+                      format: (BXAudioFormat)format
+              toMixerSamples: (int32_t *)output
+                      frames: (NSUInteger)outputFrames
+{
+    NSAssert(outputFrames <= _maxOutputFrames, @"More output frames requested than resampler can produce at once.");
+    NSAssert(inputFrames == [self inputFramesNeededForOutputFrames: outputFrames], @"Incorrect number of input frames supplied to resampler.");
+
+    [self _appendInputFrames: inputFrames format: format];
+
+    NSUInteger halfTaps = _taps / 2;
+    NSUInteger position = _position;
+    NSUInteger phase = _phase;
+
+    for (NSUInteger i=0; i<outputFrames; i++)
+    {
+        //Use the precomputed phase nearest to where this output frame falls between input frames.
+        //(When the rates are in a simple enough ratio, this is always the exact phase.)
+        NSUInteger phaseIndex = (phase * _numPhases + _phaseDenominator / 2) / _phaseDenominator;
+        const float *coefficients = _coefficients + (phaseIndex * _taps);
+        NSUInteger start = position - (halfTaps - 1);
+
+        float left, right;
+        _convolve(coefficients, _history[0] + start, _history[1] + start, _taps, &left, &right);
+
+        output[i * 2]       = (int32_t)lrintf(left);
+        output[i * 2 + 1]   = (int32_t)lrintf(right);
+
+        phase += _step;
+        position += phase / _phaseDenominator;
+        phase %= _phaseDenominator;
+    }
+
+    //Drop the input frames that the filter no longer needs to look back at.
+    NSUInteger framesToDrop = MIN(position - (halfTaps - 1), _historyFrames);
+    if (framesToDrop)
+    {
+        NSUInteger framesToKeep = _historyFrames - framesToDrop;
+        memmove(_history[0], _history[0] + framesToDrop, framesToKeep * sizeof(float));
+        memmove(_history[1], _history[1] + framesToDrop, framesToKeep * sizeof(float));
+        _historyFrames = framesToKeep;
+    }
+
+    _position = position - framesToDrop;
+    _phase = phase;
+}
+
+- (void) _appendInputFrames: (NSUInteger)numFrames format: (BXAudioFormat)format
+{
+    NSAssert(_historyFrames + numFrames <= _historyCapacity, @"Resampler input overflowed its history buffer.");
+
+    float *left = _history[0] + _historyFrames;
+    float *right = _history[1] + _historyFrames;
+
+    //Mono input is copied to both channels.
+    if ((format & BXAudioFormatStereo) == BXAudioFormatStereo)
+    {
+        for (NSUInteger i=0; i<numFrames; i++)
+        {
+            left[i] = _sampleInMixerScale(_inputBuffer, i * 2, format);
+            right[i] = _sampleInMixerScale(_inputBuffer, i * 2 + 1, format);
+        }
+    }
+    else
+    {
+        for (NSUInteger i=0; i<numFrames; i++)
+        {
+            left[i] = right[i] = _sampleInMixerScale(_inputBuffer, i, format);
+        }
+    }
+
+    _historyFrames += numFrames;
+}
+
+@end
@@ -20,6 +20,11 @@ typedef NS_OPTIONS(NSUInteger, BXAudioFormat) {
     BXAudioFormatMono       = 1 << 5,
     BXAudioFormatStereo     = 1 << 6,
     
+    /// Samples are floats in the range -1.0 to 1.0. Only valid in combination with @c BXAudioFormat32Bit.
+    /// Float output is converted in place to the mixer's own format, so sources that synthesize
+    /// in floating point should render it directly rather than converting it themselves.
+    BXAudioFormatFloat      = 1 << 7,
+    
     BXAudioFormatSizeMask   = BXAudioFormat8Bit | BXAudioFormat16Bit | BXAudioFormat32Bit,
     BXAudioFormatSignedMask = BXAudioFormatSigned | BXAudioFormatUnsigned,
     BXAudioFormatStereoMask = BXAudioFormatMono | BXAudioFormatStereo
@@ -42,4 +47,22 @@ typedef NS_OPTIONS(NSUInteger, BXAudioFormat) {
                   sampleRate: (NSUInteger *)sampleRate
                       format: (BXAudioFormat *)format;
 
+@optional
+/// Called just before each call to @c renderOutputToBuffer:frames:sampleRate:format: with the
+/// emulated time, in seconds since emulation began, at which the mixer is asking for output.
+/// Sources that play timestamped events use this to work out where in their output each event falls.
+- (void) willRenderOutputAtEmulatedTime: (NSTimeInterval)emulatedTime;
+
+/// The number of sample frames the source has rendered ahead of what the mixer has asked for so far.
+/// Implemented by sources that render ahead on a thread of their own; used to estimate their latency.
+@property (readonly) NSUInteger bufferedFrameCount;
+
+/// The number of events that have been sent to the source but not yet played.
+/// Implemented by sources that queue up timestamped events.
+@property (readonly) NSUInteger pendingEventCount;
+
+/// The number of times the mixer asked for audio that the source had not yet rendered.
+/// Implemented by sources that render ahead on a thread of their own.
+@property (readonly) NSUInteger underrunCount;
+
 @end
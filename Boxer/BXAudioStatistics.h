@@ -0,0 +1,111 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "BXAudioSource.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BXAudioResampler;
+
+/// The number of buckets in each render-time histogram. Bucket 0 counts renders that took less
+/// than a microsecond; each bucket N after that counts renders that took from 2^(N-1) up to 2^N
+/// microseconds, and the last bucket also counts anything slower than that.
+#define BXAudioRenderTimeBucketCount 16
+
+
+/// @brief BXAudioSourceStatistics is a snapshot of how an audio source has been keeping up with
+/// DOSBox's mixer since its statistics were last reset.
+///
+/// @discussion Render times cover everything Boxer does to answer one mixer callback for the source:
+/// handing over pending events, rendering, resampling and passing the output to the mixer.
+/// The estimated latency is how far behind the emulated moment a mixer callback was made
+/// the source's output will be heard, as of the most recent callback: it adds up the audio the
+/// source had buffered ahead, the delay of any resampling filter, and the length of the block itself.
+/// It does not include the buffering done by DOSBox's mixer or the host's audio device after that.
+@interface BXAudioSourceStatistics : NSObject
+
+/// The number of mixer callbacks the source has answered.
+@property (readonly, nonatomic) NSUInteger renderCount;
+
+/// The number of sample frames requested from the source by the mixer, at the mixer channel's rate.
+@property (readonly, nonatomic) NSUInteger framesRendered;
+
+/// The number of callbacks the source could not answer, which were filled with silence instead.
+@property (readonly, nonatomic) NSUInteger silenceInsertions;
+
+/// The number of times the source reported running out of audio it had rendered ahead,
+/// for sources that render ahead of the mixer. Always 0 for other sources.
+@property (readonly, nonatomic) NSUInteger underrunCount;
+
+/// The total, mean and longest time spent answering a single callback, in seconds.
+@property (readonly, nonatomic) NSTimeInterval totalRenderTime;
+@property (readonly, nonatomic) NSTimeInterval meanRenderTime;
+@property (readonly, nonatomic) NSTimeInterval maxRenderTime;
+
+/// The time spent rendering as a fraction of the duration of the audio rendered.
+/// Values approaching 1 mean the source is costing nearly as much time as it plays for.
+@property (readonly, nonatomic) double renderLoad;
+
+/// The number of callbacks that fell into each render-time bucket, as @c BXAudioRenderTimeBucketCount NSNumbers.
+@property (readonly, nonatomic) NSArray<NSNumber *> *renderTimeHistogram;
+
+/// Returns an upper bound on the time taken by the specified percentile (0-100) of callbacks, in seconds,
+/// to the precision of the histogram's buckets. Returns 0 if no callbacks have been recorded.
+- (NSTimeInterval) renderTimeAtPercentile: (double)percentile;
+
+/// The number of events queued up for the source that it had not yet played, after the most recent callback,
+/// and the most that have been queued up after any callback. Always 0 for sources that do not queue events.
+@property (readonly, nonatomic) NSUInteger pendingEventCount;
+@property (readonly, nonatomic) NSUInteger maxPendingEventCount;
+
+/// The number of sample frames the source had rendered ahead, after the most recent callback.
+@property (readonly, nonatomic) NSUInteger bufferedFrames;
+
+/// The components of @c estimatedLatency as of the most recent callback, in seconds:
+/// the audio the source had rendered ahead, the delay introduced by the resampler, and the block length.
+@property (readonly, nonatomic) NSTimeInterval sourceLatency;
+@property (readonly, nonatomic) NSTimeInterval resamplerLatency;
+@property (readonly, nonatomic) NSTimeInterval blockLatency;
+
+/// The estimated output latency of the source as of the most recent callback, in seconds,
+/// and the largest estimate made since the statistics were last reset.
+@property (readonly, nonatomic) NSTimeInterval estimatedLatency;
+@property (readonly, nonatomic) NSTimeInterval maxEstimatedLatency;
+
+@end
+
+
+/// @brief BXAudioStatisticsRecorder accumulates the render statistics of a single audio source.
+///
+/// @discussion Recording is cheap enough to leave on all the time: it takes a lock that is only
+/// ever contended when a snapshot is being taken. Recording and snapshotting are thread-safe.
+@interface BXAudioStatisticsRecorder : NSObject
+
+/// The current time in the timebase used for @c recordRenderOfSource:frames:resampler:startTime:audioRendered:.
++ (uint64_t) currentTime;
+
+/// Records a single mixer callback answered by the specified source. @c startTime is the value
+/// of @c currentTime when the callback began, and is measured up to the time of this call.
+/// @c resampler is the resampler the source's output was passed through, or @c nil if none was used.
+/// @c audioRendered should be @c NO if the callback had to be filled with silence.
+- (void) recordRenderOfSource: (id <BXAudioSource>)source
+                       frames: (NSUInteger)numFrames
+                    resampler: (nullable BXAudioResampler *)resampler
+                    startTime: (uint64_t)startTime
+                audioRendered: (BOOL)audioRendered;
+
+/// Returns a snapshot of the statistics recorded so far.
+- (BXAudioSourceStatistics *) statistics;
+
+/// Clears all recorded statistics.
+- (void) reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,271 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXAudioStatistics.h"
+#import "BXAudioResampler.h"
+#import <mach/mach_time.h>
+#import <os/lock.h>
+
+
+//The raw counters behind a statistics snapshot. Render times are kept in host time units.
+typedef struct {
+    NSUInteger renderCount;
+    NSUInteger framesRendered;
+    NSUInteger silenceInsertions;
+    NSUInteger underrunCount;
+
+    uint64_t totalRenderTicks;
+    uint64_t maxRenderTicks;
+    double audioDuration;
+    uint64_t histogram[BXAudioRenderTimeBucketCount];
+
+    NSUInteger pendingEventCount;
+    NSUInteger maxPendingEventCount;
+    NSUInteger bufferedFrames;
+
+    NSTimeInterval sourceLatency;
+    NSTimeInterval resamplerLatency;
+    NSTimeInterval blockLatency;
+    NSTimeInterval maxEstimatedLatency;
+} BXAudioStatisticsCounters;
+
+
+static double BXAudioSecondsPerTick(void)
+{
+    static double secondsPerTick;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = (double)timebase.numer / (double)timebase.denom / 1000000000.0;
+    });
+    return secondsPerTick;
+}
+
+static NSUInteger BXAudioRenderTimeBucketForMicroseconds(uint64_t microseconds)
+{
+    if (microseconds == 0)
+        return 0;
+
+    NSUInteger bucket = 64 - __builtin_clzll(microseconds);
+    return MIN(bucket, (NSUInteger)BXAudioRenderTimeBucketCount - 1);
+}
+
+
+@interface BXAudioSourceStatistics ()
+
+- (instancetype) initWithCounters: (const BXAudioStatisticsCounters *)counters;
+
+@end
+
+
+@implementation BXAudioSourceStatistics
+{
+    BXAudioStatisticsCounters _counters;
+}
+
+- (instancetype) initWithCounters: (const BXAudioStatisticsCounters *)counters
+{
+    if ((self = [super init]))
+    {
+        _counters = *counters;
+    }
+    return self;
+}
+
+- (NSUInteger) renderCount          { return _counters.renderCount; }
+- (NSUInteger) framesRendered       { return _counters.framesRendered; }
+- (NSUInteger) silenceInsertions    { return _counters.silenceInsertions; }
+- (NSUInteger) underrunCount        { return _counters.underrunCount; }
+- (NSUInteger) pendingEventCount    { return _counters.pendingEventCount; }
+- (NSUInteger) maxPendingEventCount { return _counters.maxPendingEventCount; }
+- (NSUInteger) bufferedFrames       { return _counters.bufferedFrames; }
+
+- (NSTimeInterval) sourceLatency        { return _counters.sourceLatency; }
+- (NSTimeInterval) resamplerLatency     { return _counters.resamplerLatency; }
+- (NSTimeInterval) blockLatency         { return _counters.blockLatency; }
+- (NSTimeInterval) maxEstimatedLatency  { return _counters.maxEstimatedLatency; }
+
+- (NSTimeInterval) estimatedLatency
+{
+    return _counters.sourceLatency + _counters.resamplerLatency + _counters.blockLatency;
+}
+
+- (NSTimeInterval) totalRenderTime
+{
+    return _counters.totalRenderTicks * BXAudioSecondsPerTick();
+}
+
+- (NSTimeInterval) maxRenderTime
+{
+    return _counters.maxRenderTicks * BXAudioSecondsPerTick();
+}
+
+- (NSTimeInterval) meanRenderTime
+{
+    if (!_counters.renderCount) return 0;
+    return self.totalRenderTime / _counters.renderCount;
+}
+
+- (double) renderLoad
+{
+    if (_counters.audioDuration <= 0) return 0;
+    return self.totalRenderTime / _counters.audioDuration;
+}
+
+- (NSArray<NSNumber *> *) renderTimeHistogram
+{
+    NSMutableArray *histogram = [NSMutableArray arrayWithCapacity: BXAudioRenderTimeBucketCount];
+    for (NSUInteger i=0; i<BXAudioRenderTimeBucketCount; i++)
+    {
+        [histogram addObject: @(_counters.histogram[i])];
+    }
+    return histogram;
+}
+
+- (NSTimeInterval) renderTimeAtPercentile: (double)percentile
+{
+    if (!_counters.renderCount) return 0;
+
+    double clampedPercentile = MAX(0.0, MIN(percentile, 100.0));
+    uint64_t target = (uint64_t)ceil((clampedPercentile / 100.0) * _counters.renderCount);
+    if (target == 0) target = 1;
+
+    uint64_t cumulative = 0;
+    for (NSUInteger bucket=0; bucket<BXAudioRenderTimeBucketCount; bucket++)
+    {
+        cumulative += _counters.histogram[bucket];
+        if (cumulative >= target)
+        {
+            //The last bucket has no upper bound of its own, so fall back on the slowest render we saw.
+            if (bucket == BXAudioRenderTimeBucketCount - 1)
+                return self.maxRenderTime;
+
+            return (double)(1ULL << bucket) / 1000000.0;
+        }
+    }
+    return self.maxRenderTime;
+}
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat: @"<%@: %lu renders, %lu silent, %lu underruns, mean %.0fµs, p99 %.0fµs, max %.0fµs, load %.1f%%, %lu events pending, latency %.1fms>",
+            self.class,
+            (unsigned long)self.renderCount,
+            (unsigned long)self.silenceInsertions,
+            (unsigned long)self.underrunCount,
+            self.meanRenderTime * 1000000.0,
+            [self renderTimeAtPercentile: 99] * 1000000.0,
+            self.maxRenderTime * 1000000.0,
+            self.renderLoad * 100.0,
+            (unsigned long)self.pendingEventCount,
+            self.estimatedLatency * 1000.0];
+}
+
+@end
+
+
+@implementation BXAudioStatisticsRecorder
+{
+    os_unfair_lock _lock;
+    BXAudioStatisticsCounters _counters;
+
+    //The source's own underrun count when we last reset, so that we only report underruns since then.
+    NSUInteger _underrunBaseline;
+    BOOL _needsUnderrunBaseline;
+}
+
++ (uint64_t) currentTime
+{
+    return mach_absolute_time();
+}
+
+- (instancetype) init
+{
+    if ((self = [super init]))
+    {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _needsUnderrunBaseline = YES;
+    }
+    return self;
+}
+
+- (void) recordRenderOfSource: (id <BXAudioSource>)source
+                       frames: (NSUInteger)numFrames
+                    resampler: (BXAudioResampler *)resampler
+                    startTime: (uint64_t)startTime
+                audioRendered: (BOOL)audioRendered
+{
+    uint64_t renderTicks = mach_absolute_time() - startTime;
+    uint64_t microseconds = (uint64_t)(renderTicks * BXAudioSecondsPerTick() * 1000000.0);
+
+    //Gather what we need from the source before taking the lock.
+    NSUInteger sourceRate = source.sampleRate;
+    NSUInteger channelRate = (resampler) ? resampler.outputRate : sourceRate;
+
+    NSUInteger pendingEvents = 0, bufferedFrames = 0, underruns = 0;
+    if ([source respondsToSelector: @selector(pendingEventCount)])
+        pendingEvents = source.pendingEventCount;
+    if ([source respondsToSelector: @selector(bufferedFrameCount)])
+        bufferedFrames = source.bufferedFrameCount;
+    if ([source respondsToSelector: @selector(underrunCount)])
+        underruns = source.underrunCount;
+
+    NSTimeInterval sourceLatency = (sourceRate) ? (double)bufferedFrames / sourceRate : 0;
+    NSTimeInterval resamplerLatency = resampler.latency;
+    NSTimeInterval blockLatency = (channelRate) ? (double)numFrames / channelRate : 0;
+
+    os_unfair_lock_lock(&_lock);
+
+    if (_needsUnderrunBaseline)
+    {
+        _underrunBaseline = underruns;
+        _needsUnderrunBaseline = NO;
+    }
+
+    _counters.renderCount++;
+    _counters.framesRendered += numFrames;
+    if (!audioRendered)
+        _counters.silenceInsertions++;
+    _counters.underrunCount = (underruns >= _underrunBaseline) ? underruns - _underrunBaseline : underruns;
+
+    _counters.totalRenderTicks += renderTicks;
+    _counters.maxRenderTicks = MAX(_counters.maxRenderTicks, renderTicks);
+    _counters.audioDuration += blockLatency;
+    _counters.histogram[BXAudioRenderTimeBucketForMicroseconds(microseconds)]++;
+
+    _counters.pendingEventCount = pendingEvents;
+    _counters.maxPendingEventCount = MAX(_counters.maxPendingEventCount, pendingEvents);
+    _counters.bufferedFrames = bufferedFrames;
+
+    _counters.sourceLatency = sourceLatency;
+    _counters.resamplerLatency = resamplerLatency;
+    _counters.blockLatency = blockLatency;
+    _counters.maxEstimatedLatency = MAX(_counters.maxEstimatedLatency, sourceLatency + resamplerLatency + blockLatency);
+
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (BXAudioSourceStatistics *) statistics
+{
+    os_unfair_lock_lock(&_lock);
+    BXAudioStatisticsCounters counters = _counters;
+    os_unfair_lock_unlock(&_lock);
+
+    return [[BXAudioSourceStatistics alloc] initWithCounters: &counters];
+}
+
+- (void) reset
+{
+    os_unfair_lock_lock(&_lock);
+    memset(&_counters, 0, sizeof(_counters));
+    _needsUnderrunBaseline = YES;
+    os_unfair_lock_unlock(&_lock);
+}
+
+@end
@@ -67,16 +67,27 @@ Bitu boxer_prepareForFrameSize(Bitu width, Bitu height, Bitu gfx_flags, double s
 	
 	NSSize outputSize	= NSMakeSize((CGFloat)width, (CGFloat)height);
 	NSSize scale		= NSMakeSize((CGFloat)scalex, (CGFloat)scaley);
-	[[emulator videoHandler] prepareForOutputSize: outputSize atScale: scale withCallback: callback];
+    
+    //gfx_flags will only include GFX_CAN_8 if we asked for it in boxer_idealOutputMode.
+    BOOL indexed = (gfx_flags & GFX_CAN_8) != 0;
+	[[emulator videoHandler] prepareForOutputSize: outputSize
+                                          atScale: scale
+                                          indexed: indexed
+                                     withCallback: callback];
 	
-	return GFX_CAN_32 | GFX_SCALING;
+	return (indexed ? GFX_CAN_8 : GFX_CAN_32) | GFX_SCALING;
 }
 
 Bitu boxer_idealOutputMode(Bitu flags)
 {
 	//Originally this tested various bit depths to find the most appropriate mode for the chosen scaler.
-	//Because OS X always uses a 32bpp context and Boxer always uses RGBA-capable scalers, we ignore the
-	//original function's behaviour altogether and just return something that will keep DOSBox happy.
+	//Because OS X always uses a 32bpp context, we only ever ask for 32bpp output - except when the scaler
+    //can pass through 8-bit palettised output, in which case we take that and leave it to the presenter
+    //to expand the frame through the palette.
+    BXEmulator *emulator = [BXEmulator currentEmulator];
+    if ((flags & GFX_CAN_8) && !(flags & GFX_RGBONLY) && emulator.videoHandler.prefersIndexedColor)
+        return GFX_CAN_8 | GFX_SCALING;
+    
 	return GFX_CAN_32 | GFX_SCALING;
 }
 
@@ -98,6 +109,12 @@ Bitu boxer_getRGBPaletteEntry(Bit8u red, Bit8u green, Bit8u blue)
 	return [[emulator videoHandler] paletteEntryWithRed: red green: green blue: blue];
 }
 
+void boxer_setPalette(Bitu start, Bitu count, GFX_PalEntry *entries)
+{
+	BXEmulator *emulator = [BXEmulator currentEmulator];
+	[[emulator videoHandler] setPaletteEntries: entries startingAt: start count: count];
+}
+
 
 #pragma mark - Shell-related functions
 
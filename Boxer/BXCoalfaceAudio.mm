@@ -9,6 +9,7 @@
 #import "BXEmulatorPrivate.h"
 #import "BXCoalfaceAudio.h"
 #import "RegexKitLite.h"
+#import "pic.h"
 #import <CoreFoundation/CFByteOrder.h>
 
 //MIDI message lengths indexed by status code.
@@ -101,7 +102,12 @@ void boxer_sendMIDIMessage(Bit8u *msg)
     
     if (len)
     {
-        [[BXEmulator currentEmulator] sendMIDIMessage: [NSData dataWithBytesNoCopy: msg length: len freeWhenDone: NO]];
+        //Stamp the message with the emulated time it was sent at, so that synths can play it
+        //at the right point within the block of audio they render next. Messages are batched
+        //up and delivered to the MIDI device together, without wrapping each one in an NSData.
+        [[BXEmulator currentEmulator] _queueMIDIMessage: msg
+                                                 length: len
+                                         atEmulatedTime: PIC_FullIndex() / 1000.0];
     }    
 #ifdef BOXER_DEBUG
     //DOSBox's MIDI event table declares undefined MIDI statuses as having 0 length.
@@ -116,7 +122,8 @@ void boxer_sendMIDIMessage(Bit8u *msg)
 
 void boxer_sendMIDISysex(Bit8u *msg, Bitu len)
 {
-    [[BXEmulator currentEmulator] sendMIDISysex: [NSData dataWithBytesNoCopy: msg length: len freeWhenDone: NO]];
+    [[BXEmulator currentEmulator] sendMIDISysex: [NSData dataWithBytesNoCopy: msg length: len freeWhenDone: NO]
+                                 atEmulatedTime: PIC_FullIndex() / 1000.0];
 }
 
 float boxer_masterVolume(BXAudioChannel channel)
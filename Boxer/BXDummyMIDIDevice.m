@@ -18,6 +18,7 @@
 
 - (void) handleMessage: (NSData *)message {}
 - (void) handleSysex: (NSData *)message {}
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count {}
 
 - (void) pause {}
 - (void) resume {}
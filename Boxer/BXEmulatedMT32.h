@@ -8,7 +8,7 @@
 //BXEmulatedMT32 provides a BXMIDIDevice wrapper for the MUNT MT-32 emulator.
 //It takes an optional delegate to which it sends notifications of LCD display messages.
 //Unlike the other BXMIDIDevice classes, this currently feeds audio output back into
-//DOSBox's own mixer.
+//DOSBox's own mixer. Synthesis happens ahead of time on a thread of its own.
 
 #import <Foundation/Foundation.h>
 #import "BXMIDIDevice.h"
@@ -54,11 +54,16 @@ extern NSErrorUserInfoKey const BXMT32ControlROMTypeKey;
 extern NSErrorUserInfoKey const BXMT32PCMROMTypeKey;
 
 
+/// The most audio the synthesis thread can render ahead of the mixer, in sample frames.
+#define BXMT32MaxPrefillFrames 8192
+
+
 typedef NS_ERROR_ENUM(BXEmulatedMT32ErrorDomain, BXEmulatedMT32Errors) {
     BXEmulatedMT32MissingROM,       //!< No ROMs were specified when initializing.
     BXEmulatedMT32CouldNotReadROM,  //!< A specified ROM could not be opened.
     BXEmulatedMT32InvalidROM,       //!< A specified ROM was not a valid MT-32 ROM.
     BXEmulatedMT32MismatchedROMs,   //!< Control and PCM ROMs aren't from matching versions.
+    BXEmulatedMT32InvalidEventLog,  //!< An event log to be rendered offline was truncated or not an event log.
 };
 
 
@@ -89,10 +94,40 @@ typedef NS_OPTIONS(NSUInteger, BXMT32ROMType) {
 
 @protocol BXEmulatedMT32Delegate;
 
+
+/// Timing and memory measurements from rendering an event log offline.
+@interface BXMT32RenderStatistics : NSObject
+
+/// How many sample frames were rendered, and how long they would take to play.
+@property (readonly) NSUInteger renderedFrames;
+@property (readonly) NSTimeInterval audioDuration;
+
+/// How long the synth spent rendering, excluding file I/O, and how many times faster than realtime that is.
+@property (readonly) NSTimeInterval renderTime;
+@property (readonly) double realtimeFactor;
+
+/// The peak resident memory of the process once rendering had finished, in bytes.
+@property (readonly) NSUInteger peakMemoryBytes;
+
+/// The number of render calls that were made, and the distribution of how long they took.
+@property (readonly) NSUInteger blockCount;
+@property (readonly) NSTimeInterval medianBlockTime;
+@property (readonly) NSTimeInterval p95BlockTime;
+@property (readonly) NSTimeInterval p99BlockTime;
+@property (readonly) NSTimeInterval maxBlockTime;
+
+@end
+
 /// \c BXEmulatedMT32 provides a \c BXMIDIDevice wrapper for the MUNT MT-32 emulator.
 /// It takes an optional delegate to which it sends notifications of LCD display messages.
 /// Unlike the other \c BXMIDIDevice classes, this currently feeds audio output back into
 /// DOSBox's own mixer.
+///
+/// Synthesis runs on a dedicated thread, which renders ahead of the mixer into a lock-free ring:
+/// the mixer callback only copies out what has already been rendered. MIDI messages are queued
+/// to the synthesis thread through a second ring, stamped with the point in the output stream
+/// at which they should take effect. Because of this, delegate messages about LCD output
+/// arrive on the synthesis thread.
 @interface BXEmulatedMT32 : NSObject <BXMIDIDevice, BXAudioSource>
 
 @property (copy, nonatomic) NSURL *PCMROMURL NS_SWIFT_NAME(pcmROMURL);
@@ -100,11 +135,45 @@ typedef NS_OPTIONS(NSUInteger, BXMT32ROMType) {
 @property (weak, nonatomic) id <BXEmulatedMT32Delegate> delegate;
 @property (assign, nonatomic) unsigned int sampleRate;
 
+/// How many sample frames of audio the synthesis thread keeps rendered ahead of the mixer.
+/// This is also the latency between a MIDI message arriving and it being heard.
+/// Defaults to the value of the MT32PrefillFrames user default, or 1024 frames (32ms) if that
+/// is not set, and is capped at @c BXMT32MaxPrefillFrames.
+@property (assign, nonatomic) NSUInteger prefillFrames;
+
+/// The number of times the mixer asked for audio that the synthesis thread had not yet rendered.
+/// Frames it could not provide are filled with silence.
+@property (readonly) NSUInteger underrunCount;
+
+/// If set, every message and sysex the synth is sent is appended to this file, stamped with the
+/// output frame at which it took effect, so that the performance can be replayed offline with
+/// @c renderEventLogAtURL:toWAVFileAtURL:blockFrames:error:. Defaults to the path in the
+/// MT32EventLogPath user default, if that is set.
+@property (copy, nullable, nonatomic) NSURL *eventLogURL;
+
 - (nullable instancetype) initWithPCMROM: (NSURL *)PCMROMURL
                               controlROM: (NSURL *)controlROMURL
                                 delegate: (nullable id <BXEmulatedMT32Delegate>)delegate
                                    error: (NSError **)outError;
 
+/// Returns a synth that renders only when asked to by @c renderEventLogAtURL:toWAVFileAtURL:blockFrames:error:,
+/// rather than on a synthesis thread of its own. Used for measuring synthesis performance in isolation.
+- (nullable instancetype) initForOfflineRenderingWithPCMROM: (NSURL *)PCMROMURL
+                                                 controlROM: (NSURL *)controlROMURL
+                                                      error: (NSError **)outError;
+
+/// Replays the events in the specified event log as fast as possible, writing the output to a
+/// 16-bit stereo WAV file, and measures how long each block of audio took to render.
+/// blockFrames is the most frames rendered in one call, and should match the synthesis thread's
+/// chunk size for results representative of live playback. Only valid for synths created with
+/// @c initForOfflineRenderingWithPCMROM:controlROM:error:. If the synth is closed on another thread
+/// meanwhile, @c close waits for rendering to finish.
+/// Returns @c nil and populates @c outError if the log could not be read or the WAV file could not be written.
+- (nullable BXMT32RenderStatistics *) renderEventLogAtURL: (NSURL *)logURL
+                                           toWAVFileAtURL: (NSURL *)outputURL
+                                              blockFrames: (NSUInteger)blockFrames
+                                                    error: (NSError **)outError;
+
 
 #pragma mark -
 #pragma mark Helper class methods
@@ -8,10 +8,22 @@
 #import "BXEmulatedMT32.h"
 #import "RegexKitLite.h"
 #import "MT32Emu/Synth.h"
-#import "MT32Emu/FileStream.h"
+#import "BXMT32ROM.h"
 #import "BXEmulatedMT32Delegate.h"
 #import "NSError+ADBErrorHelpers.h"
 #import "NSURL+ADBFilesystemHelpers.h"
+#import "BXSPSCRing.h"
+#import "BXAudioRecorder.h"
+#import "BXMT32EventLog.h"
+
+#import <thread>
+#import <mutex>
+#import <vector>
+#import <algorithm>
+#import <pthread.h>
+#import <os/lock.h>
+#import <mach/mach_time.h>
+#import <sys/resource.h>
 
 
 #pragma mark -
@@ -23,6 +35,37 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 #define BXMT32DefaultSampleRate 32000
 
+/// How far the synthesis thread renders ahead of the mixer unless told otherwise.
+#define BXMT32DefaultPrefillFrames 1024
+
+/// The most audio the synthesis thread renders in one go, so that it can refill the ring
+/// promptly without holding up MIDI events that fall due in the meantime.
+#define BXMT32RenderChunkFrames 256
+
+/// How many MIDI events can be waiting for the synthesis thread at once.
+#define BXMT32EventRingCapacity 4096
+
+/// How long the synthesis thread sleeps when the ring is full, if the mixer doesn't wake it sooner.
+#define BXMT32RenderIdleTimeout (5 * NSEC_PER_MSEC)
+
+
+/// How long offline rendering carries on after the last event, to let the final notes decay.
+#define BXMT32OfflineTailDuration 2
+
+
+/// A MIDI message queued for the synthesis thread.
+typedef struct {
+    /// The output frame at which the message should take effect.
+    uint64_t frame;
+    
+    /// A short message packed in MT32Emu's format, if sysexData is NULL.
+    UInt32 packedMessage;
+    
+    /// A copy of a sysex message, which the synthesis thread frees once it has played it.
+    UInt8 *sysexData;
+    UInt32 sysexLength;
+} BXMT32Event;
+
 
 
 #pragma mark -
@@ -33,6 +76,56 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 - (BOOL) _prepareMT32EmulatorWithError: (NSError **)outError;
 
+- (void) _startRenderThread;
+- (void) _stopRenderThread;
+
+/// The output frame at which a message sent now, or at the specified emulated time, should take effect.
+- (uint64_t) _eventFrameForCurrentTime;
+- (uint64_t) _eventFrameForEmulatedTime: (NSTimeInterval)emulatedTime;
+
+- (void) _queueMessage: (NSData *)message atFrame: (uint64_t)frame;
+- (void) _queueMessageBytes: (const UInt8 *)bytes length: (NSUInteger)length atFrame: (uint64_t)frame;
+- (void) _queueSysex: (NSData *)message atFrame: (uint64_t)frame;
+- (void) _queueEvent: (BXMT32Event)event;
+- (void) _logEvent: (BXMT32Event)event;
+
+@end
+
+
+@interface BXMT32RenderStatistics ()
+
+@property (readwrite) NSUInteger renderedFrames;
+@property (readwrite) NSTimeInterval audioDuration;
+@property (readwrite) NSTimeInterval renderTime;
+@property (readwrite) NSUInteger peakMemoryBytes;
+@property (readwrite) NSUInteger blockCount;
+@property (readwrite) NSTimeInterval medianBlockTime;
+@property (readwrite) NSTimeInterval p95BlockTime;
+@property (readwrite) NSTimeInterval p99BlockTime;
+@property (readwrite) NSTimeInterval maxBlockTime;
+
+@end
+
+
+@implementation BXMT32RenderStatistics
+
+- (double) realtimeFactor
+{
+    return (self.renderTime > 0) ? self.audioDuration / self.renderTime : 0;
+}
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat:
+            @"Rendered %.2fs of audio (%lu frames) in %.3fs: %.1fx realtime\n"
+            @"Peak memory: %.1f MB\n"
+            @"Block render times over %lu blocks: median %.1fus, p95 %.1fus, p99 %.1fus, max %.1fus",
+            self.audioDuration, (unsigned long)self.renderedFrames, self.renderTime, self.realtimeFactor,
+            self.peakMemoryBytes / (1024.0 * 1024.0),
+            (unsigned long)self.blockCount,
+            self.medianBlockTime * 1e6, self.p95BlockTime * 1e6, self.p99BlockTime * 1e6, self.maxBlockTime * 1e6];
+}
+
 @end
 
 
@@ -42,11 +135,42 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 @implementation BXEmulatedMT32
 {
 	MT32Emu::Synth *_synth;
+    //Held by close while it tears down the synth, and by offline rendering for as long as it uses it.
+    std::mutex _synthLock;
 	BXEmulatedMT32ReportHandler *_reportHandler;
-	MT32Emu::FileStream *_PCMROMHandle;
-	MT32Emu::FileStream *_controlROMHandle;
-	const MT32Emu::ROMImage *_PCMROMImage;
-	const MT32Emu::ROMImage *_controlROMImage;
+    //Shared with any other synths using the same ROMs.
+    BXMT32ROM *_PCMROM;
+    BXMT32ROM *_controlROM;
+    
+    //Interleaved stereo samples, rendered on the synthesis thread and consumed by the mixer.
+    BXSPSCRing<SInt16> *_outputRing;
+    //MIDI events queued by the emulation thread for the synthesis thread.
+    BXSPSCRing<BXMT32Event> *_eventRing;
+    //Held while the rings are torn down, and while the statistics accessors peek at them
+    //from threads other than the emulation and synthesis threads.
+    os_unfair_lock _ringLock;
+    
+    std::thread _renderThread;
+    std::atomic<bool> _stopRendering;
+    dispatch_semaphore_t _renderSignal;
+    
+    //How many frames the mixer has taken from the ring. Used to timestamp MIDI events.
+    std::atomic<uint64_t> _consumedFrames;
+    //How many frames the synthesis thread has rendered. Only touched on the synthesis thread.
+    uint64_t _renderedFrames;
+    
+    //The open event log, if we're capturing one. Only written on the emulation thread.
+    BXMT32EventLogWriter *_eventLog;
+    
+    std::atomic<NSUInteger> _prefillFrames;
+    std::atomic<NSUInteger> _underrunCount;
+    BOOL _hasWarnedOfDroppedEvents;
+    
+    //The emulated time at which the mixer last asked us for audio, and how many frames
+    //it had taken from the ring by then. Used to place timestamped events.
+    NSTimeInterval _renderAnchorTime;
+    uint64_t _renderAnchorFrame;
+    BOOL _hasRenderAnchor;
 }
 
 #pragma mark - ROM validation methods
@@ -54,57 +178,8 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 + (BXMT32ROMType) typeOfROMAtURL: (NSURL *)URL
                            error: (out NSError **)outError
 {
-    BOOL exists = [URL checkResourceIsReachableAndReturnError: NULL];
-    if (!exists)
-    {
-        if (outError)
-        {
-            NSDictionary *userInfo = nil;
-            if (URL) userInfo = @{ NSURLErrorKey: URL };
-			*outError = [NSError errorWithDomain: BXEmulatedMT32ErrorDomain
-											code: BXEmulatedMT32MissingROM
-										userInfo: userInfo];
-        }
-        return BXMT32ROMTypeUnknown;
-    }
-    
-    MT32Emu::FileStream *file = new MT32Emu::FileStream();
-    bool opened = file->open(URL.fileSystemRepresentation);
-    if (!opened)
-    {
-        delete file;
-        if (outError)
-        {
-			*outError = [NSError errorWithDomain: BXEmulatedMT32ErrorDomain
-											code: BXEmulatedMT32CouldNotReadROM
-										userInfo: @{ NSURLErrorKey: URL }];
-        }
-        return BXMT32ROMTypeUnknown;
-    }
-    
-    const MT32Emu::ROMInfo *info = MT32Emu::ROMInfo::getROMInfo(file);
-    if (info == NULL)
-    {
-        delete file;
-        if (outError)
-        {
-			*outError = [NSError errorWithDomain: BXEmulatedMT32ErrorDomain
-											code: BXEmulatedMT32InvalidROM
-										userInfo: @{ NSURLErrorKey: URL }];
-        }
-        return BXMT32ROMTypeUnknown;
-    }
-    
-    BOOL isControlROM = (info->type == MT32Emu::ROMInfo::Control);
-    BOOL isCM32L = (strstr(info->shortName, "cm32l") != NULL);
-    
-    BXMT32ROMType type = (isControlROM ? BXMT32ROMIsControl : BXMT32ROMIsPCM);
-    type |= (isCM32L ? BXMT32ROMIsCM32L : BXMT32ROMIsMT32);
-    
-    delete file;
-    MT32Emu::ROMInfo::freeROMInfo(info);
-    
-    return type;
+    //The ROM cache remembers the types of files it has seen before, so that we don't need to reread them.
+    return [BXMT32ROM typeOfROMAtURL: URL error: outError];
 }
 
 + (BXMT32ROMType) typeOfROMPairWithControlROMURL: (NSURL *)controlROMURL
@@ -187,6 +262,16 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 #pragma mark -
 #pragma mark Initialization and deallocation
 
+- (instancetype) init
+{
+    self = [super init];
+    if (self)
+    {
+        _ringLock = OS_UNFAIR_LOCK_INIT;
+    }
+    return self;
+}
+
 - (id <BXMIDIDevice>) initWithPCMROM: (NSURL *)PCMROMURL
                           controlROM: (NSURL *)controlROMURL
                             delegate: (id <BXEmulatedMT32Delegate>)delegate
@@ -200,6 +285,34 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
         self.sampleRate = BXMT32DefaultSampleRate;
         self.delegate = delegate;
         
+        NSInteger prefillFrames = [[NSUserDefaults standardUserDefaults] integerForKey: @"MT32PrefillFrames"];
+        self.prefillFrames = (prefillFrames > 0) ? prefillFrames : BXMT32DefaultPrefillFrames;
+        
+        NSString *eventLogPath = [[NSUserDefaults standardUserDefaults] stringForKey: @"MT32EventLogPath"];
+        if (eventLogPath.length)
+            self.eventLogURL = [NSURL fileURLWithPath: eventLogPath.stringByExpandingTildeInPath];
+        
+        if (![self _prepareMT32EmulatorWithError: outError])
+        {
+            return nil;
+        }
+        
+        [self _startRenderThread];
+    }
+    return self;
+}
+
+- (instancetype) initForOfflineRenderingWithPCMROM: (NSURL *)PCMROMURL
+                                        controlROM: (NSURL *)controlROMURL
+                                             error: (NSError **)outError
+{
+    self = [self init];
+    if (self)
+    {
+        self.PCMROMURL = PCMROMURL;
+        self.controlROMURL = controlROMURL;
+        self.sampleRate = BXMT32DefaultSampleRate;
+        
         if (![self _prepareMT32EmulatorWithError: outError])
         {
             return nil;
@@ -210,6 +323,13 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 - (void) close
 {
+    //The synthesis thread must be finished with the synth before we tear it down.
+    [self _stopRenderThread];
+    
+    self.eventLogURL = nil;
+    
+    //Wait for any offline render to finish with the synth, too.
+    std::lock_guard<std::mutex> guard(_synthLock);
     if (_synth)
     {
         _synth->close();
@@ -223,21 +343,8 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
         _reportHandler = NULL;
     }
     
-    if (_PCMROMImage)
-    {
-        MT32Emu::ROMImage::freeROMImage(_PCMROMImage);
-        delete _PCMROMHandle;
-        _PCMROMImage = NULL;
-        _PCMROMHandle = NULL;
-    }
-    
-    if (_controlROMImage)
-    {
-        MT32Emu::ROMImage::freeROMImage(_controlROMImage);
-        delete _controlROMHandle;
-        _controlROMImage = NULL;
-        _controlROMHandle = NULL;
-    }
+    _PCMROM = nil;
+    _controlROM = nil;
 }
 
 - (void) dealloc
@@ -246,21 +353,130 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 }
 
 
+- (NSUInteger) prefillFrames
+{
+    return _prefillFrames.load(std::memory_order_relaxed);
+}
+
+- (void) setPrefillFrames: (NSUInteger)prefillFrames
+{
+    _prefillFrames.store(MAX((NSUInteger)1, MIN(prefillFrames, (NSUInteger)BXMT32MaxPrefillFrames)), std::memory_order_relaxed);
+}
+
+- (NSUInteger) underrunCount
+{
+    return _underrunCount.load(std::memory_order_relaxed);
+}
+
+//These may be polled from the mixer thread while the synth is being closed on another,
+//so they must not look at the rings while close is deleting them.
+- (NSUInteger) bufferedFrameCount
+{
+    os_unfair_lock_lock(&_ringLock);
+    NSUInteger bufferedFrames = (_outputRing) ? _outputRing->readAvailable() / 2 : 0;
+    os_unfair_lock_unlock(&_ringLock);
+    return bufferedFrames;
+}
+
+- (NSUInteger) pendingEventCount
+{
+    os_unfair_lock_lock(&_ringLock);
+    NSUInteger pendingEvents = (_eventRing) ? _eventRing->readAvailable() : 0;
+    os_unfair_lock_unlock(&_ringLock);
+    return pendingEvents;
+}
+
+- (void) setEventLogURL: (NSURL *)URL
+{
+    if (URL == _eventLogURL || [URL isEqual: _eventLogURL])
+        return;
+    
+    [_eventLog close];
+    _eventLog = nil;
+    
+    _eventLogURL = [URL copy];
+    
+    if (URL)
+    {
+        NSError *error = nil;
+        _eventLog = [[BXMT32EventLogWriter alloc] initWithURL: URL sampleRate: self.sampleRate error: &error];
+        if (!_eventLog)
+            NSLog(@"Could not open MT-32 event log at %@: %@", URL.path, error.localizedDescription);
+    }
+}
+
+
 #pragma mark -
 #pragma mark MIDI processing and status
 
 - (BOOL) supportsMT32Music          { return YES; }
 - (BOOL) supportsGeneralMIDIMusic   { return NO; }
 
-//Since we're processing on the same thread, the emulator is always ready to go
+//Messages are queued for the synthesis thread, so we're always ready to accept more
 - (BOOL) isProcessing       { return NO; }
 - (NSDate *) dateWhenReady  { return [NSDate distantPast]; }
 
 
 - (void) handleMessage: (NSData *)message
+{
+    [self _queueMessage: message atFrame: [self _eventFrameForCurrentTime]];
+}
+
+- (void) handleSysex: (NSData *)message
+{
+    [self _queueSysex: message atFrame: [self _eventFrameForCurrentTime]];
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _queueMessage: message atFrame: [self _eventFrameForEmulatedTime: emulatedTime]];
+}
+
+- (void) handleSysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _queueSysex: message atFrame: [self _eventFrameForEmulatedTime: emulatedTime]];
+}
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    for (NSUInteger i=0; i<count; i++)
+    {
+        const BXMIDIEvent &event = events[i];
+        uint64_t frame = (event.emulatedTime < 0) ? [self _eventFrameForCurrentTime] : [self _eventFrameForEmulatedTime: event.emulatedTime];
+        [self _queueMessageBytes: event.bytes length: event.length atFrame: frame];
+    }
+}
+
+- (uint64_t) _eventFrameForCurrentTime
+{
+    //Schedule the event for the point in the output stream that the synthesis thread is rendering
+    //right now, so that every event is delayed by the same amount and keeps its relative timing.
+    return _consumedFrames.load(std::memory_order_acquire) + self.prefillFrames;
+}
+
+- (uint64_t) _eventFrameForEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    if (!_hasRenderAnchor)
+        return [self _eventFrameForCurrentTime];
+    
+    //The mixer consumes our output at exactly our sample rate in emulated time, so an event's
+    //distance in emulated time from the last time the mixer asked for audio tells us exactly
+    //how many frames further along the output stream the event belongs.
+    double offset = (emulatedTime - _renderAnchorTime) * self.sampleRate;
+    offset = MAX(0.0, MIN(offset, (double)BXMT32MaxPrefillFrames));
+    
+    return _renderAnchorFrame + (uint64_t)offset + self.prefillFrames;
+}
+
+- (void) _queueMessage: (NSData *)message atFrame: (uint64_t)frame
+{
+    [self _queueMessageBytes: (const UInt8 *)message.bytes length: message.length atFrame: frame];
+}
+
+- (void) _queueMessageBytes: (const UInt8 *)contents length: (NSUInteger)length atFrame: (uint64_t)frame
 {
     NSAssert(_synth, @"handleMessage: called before successful initialization.");
-    NSAssert(message.length > 0, @"0-length message received by handleMessage:");
+    NSAssert(length > 0, @"0-length message received by handleMessage:");
     
     //MT32Emu's playMsg takes standard 3-byte MIDI messages as a 32-bit integer, which
     //is a terrible idea, but there you go. Thus we pack our byte array into such an
@@ -268,27 +484,59 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
     
     //IMPLEMENTATION NOTE: we use bitwise here, rather than just casting the array
     //to a UInt32, to avoid endianness bugs on PowerPC.
-    UInt8 *contents = (UInt8 *)message.bytes;
     UInt8 status = contents[0];
-    UInt8 data1 = (message.length > 1) ? contents[1] : 0;
-    UInt8 data2 = (message.length > 2) ? contents[2] : 0;
+    UInt8 data1 = (length > 1) ? contents[1] : 0;
+    UInt8 data2 = (length > 2) ? contents[2] : 0;
     
     UInt32 packedMsg = status + (data1 << 8) + (data2 << 16);
     
-    _synth->playMsg(packedMsg);
+    BXMT32Event event = { frame, packedMsg, NULL, 0 };
+    [self _queueEvent: event];
 }
 
-- (void) handleSysex: (NSData *)message
+- (void) _queueSysex: (NSData *)message atFrame: (uint64_t)frame
 {
     NSAssert(_synth, @"handleSysEx: called before successful initialization.");
     NSAssert(message.length > 0, @"0-length message received by handleSysex:");
     
-    _synth->playSysex((UInt8 *)message.bytes, (UInt32)message.length);
+    //The message may be gone by the time the synthesis thread gets to it, so give it a copy.
+    UInt8 *sysexData = (UInt8 *)malloc(message.length);
+    memcpy(sysexData, message.bytes, message.length);
+    
+    BXMT32Event event = { frame, 0, sysexData, (UInt32)message.length };
+    [self _queueEvent: event];
+}
+
+- (void) _queueEvent: (BXMT32Event)event
+{
+    if (_eventLog)
+        [self _logEvent: event];
+    
+    if (!_eventRing->push(event))
+    {
+        //Events only wait in the ring until the synthesis thread reaches them, which is never longer
+        //than the prefill depth: we can only get here if the synthesis thread has stalled altogether.
+        if (!_hasWarnedOfDroppedEvents)
+        {
+            NSLog(@"MT-32 synthesis thread is not keeping up: dropping MIDI events.");
+            _hasWarnedOfDroppedEvents = YES;
+        }
+        free(event.sysexData);
+    }
+}
+
+- (void) _logEvent: (BXMT32Event)event
+{
+    if (event.sysexData)
+        [_eventLog writeSysex: event.sysexData length: event.sysexLength atFrame: event.frame];
+    else
+        [_eventLog writeMessage: event.packedMessage atFrame: event.frame];
 }
 
 - (void) resume
 {
-    //Because BXEmulatedMT32 is mixer-driven, this has no effect
+    //Because BXEmulatedMT32 is mixer-driven, this has no effect:
+    //the synthesis thread idles once it is far enough ahead of the mixer.
 }
 
 - (void) pause
@@ -308,12 +556,30 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
     return 1.0f;
 }
 
+- (void) willRenderOutputAtEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    _renderAnchorTime = emulatedTime;
+    _renderAnchorFrame = _consumedFrames.load(std::memory_order_relaxed);
+    _hasRenderAnchor = YES;
+}
+
 - (BOOL) renderOutputToBuffer: (void *)buffer
                        frames: (NSUInteger)numFrames
                    sampleRate: (NSUInteger *)sampleRate
                        format: (BXAudioFormat *)format
 {
-    _synth->render((SInt16 *)buffer, (UInt32)numFrames);
+    //Take whatever the synthesis thread has rendered so far, and fill any shortfall with silence.
+    NSUInteger numSamples = numFrames * 2;
+    NSUInteger samplesRead = _outputRing->read((SInt16 *)buffer, numSamples);
+    if (samplesRead < numSamples)
+    {
+        memset((SInt16 *)buffer + samplesRead, 0, (numSamples - samplesRead) * sizeof(SInt16));
+        _underrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    //Let the synthesis thread know there's room to render more.
+    _consumedFrames.fetch_add(samplesRead / 2, std::memory_order_release);
+    dispatch_semaphore_signal(_renderSignal);
 
     *sampleRate = self.sampleRate;
     *format = BXAudioFormat16Bit | BXAudioFormatSigned | BXAudioFormatStereo;
@@ -321,6 +587,246 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 }
 
 
+#pragma mark -
+#pragma mark Synthesis thread
+
+- (void) _startRenderThread
+{
+    _outputRing = new BXSPSCRing<SInt16>(BXMT32MaxPrefillFrames * 2);
+    _eventRing = new BXSPSCRing<BXMT32Event>(BXMT32EventRingCapacity);
+    _renderSignal = dispatch_semaphore_create(0);
+    _stopRendering.store(false);
+    _consumedFrames.store(0);
+    _renderedFrames = 0;
+    
+    //The thread does not retain us: close, which our dealloc calls, waits for it to finish.
+    __unsafe_unretained BXEmulatedMT32 *MT32 = self;
+    _renderThread = std::thread([MT32] {
+        pthread_setname_np("Boxer MT-32 synthesis");
+        pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+        @autoreleasepool
+        {
+            [MT32 _runRenderLoop];
+        }
+    });
+}
+
+- (void) _stopRenderThread
+{
+    if (_renderThread.joinable())
+    {
+        _stopRendering.store(true);
+        dispatch_semaphore_signal(_renderSignal);
+        _renderThread.join();
+    }
+    
+    //Detach the rings under the lock, so that no reader can be partway through them,
+    //then free them outside it.
+    os_unfair_lock_lock(&_ringLock);
+    BXSPSCRing<BXMT32Event> *eventRing = _eventRing;
+    BXSPSCRing<SInt16> *outputRing = _outputRing;
+    _eventRing = NULL;
+    _outputRing = NULL;
+    os_unfair_lock_unlock(&_ringLock);
+    
+    if (eventRing)
+    {
+        BXMT32Event event;
+        while (eventRing->pop(event))
+            free(event.sysexData);
+        
+        delete eventRing;
+    }
+    
+    delete outputRing;
+}
+
+- (void) _runRenderLoop
+{
+    SInt16 chunk[BXMT32RenderChunkFrames * 2];
+    
+    while (!_stopRendering.load(std::memory_order_relaxed))
+    {
+        //Play every event that has fallen due, and find out how far we can render before the next one.
+        uint64_t nextEventFrame = UINT64_MAX;
+        const BXMT32Event *event;
+        while ((event = _eventRing->peek()) != NULL)
+        {
+            if (event->frame > _renderedFrames)
+            {
+                nextEventFrame = event->frame;
+                break;
+            }
+            
+            if (event->sysexData)
+            {
+                _synth->playSysex(event->sysexData, event->sysexLength);
+                free(event->sysexData);
+            }
+            else
+            {
+                _synth->playMsg(event->packedMessage);
+            }
+            
+            BXMT32Event playedEvent;
+            _eventRing->pop(playedEvent);
+        }
+        
+        //Keep the ring topped up to the prefill depth, but no further.
+        uint64_t targetFrame = _consumedFrames.load(std::memory_order_acquire) + self.prefillFrames;
+        uint64_t numFrames = 0;
+        if (targetFrame > _renderedFrames)
+        {
+            numFrames = MIN(targetFrame, nextEventFrame) - _renderedFrames;
+            numFrames = MIN(numFrames, (uint64_t)BXMT32RenderChunkFrames);
+            numFrames = MIN(numFrames, (uint64_t)(_outputRing->writeAvailable() / 2));
+        }
+        
+        if (numFrames == 0)
+        {
+            dispatch_semaphore_wait(_renderSignal, dispatch_time(DISPATCH_TIME_NOW, BXMT32RenderIdleTimeout));
+            continue;
+        }
+        
+        _synth->render(chunk, (UInt32)numFrames);
+        _outputRing->write(chunk, (size_t)numFrames * 2);
+        _renderedFrames += numFrames;
+    }
+}
+
+
+#pragma mark -
+#pragma mark Offline rendering
+
+- (BXMT32RenderStatistics *) renderEventLogAtURL: (NSURL *)logURL
+                                  toWAVFileAtURL: (NSURL *)outputURL
+                                     blockFrames: (NSUInteger)blockFrames
+                                           error: (NSError **)outError
+{
+    //Hold on to the synth until we're done, so that close can't tear it down underneath us.
+    std::lock_guard<std::mutex> guard(_synthLock);
+    
+    NSAssert(_synth, @"renderEventLogAtURL:toWAVFileAtURL:blockFrames:error: called before successful initialization.");
+    NSAssert(!_renderThread.joinable(), @"renderEventLogAtURL:toWAVFileAtURL:blockFrames:error: called on a synth that is already rendering live.");
+    
+    blockFrames = MAX((NSUInteger)1, MIN(blockFrames, (NSUInteger)BXMT32MaxPrefillFrames));
+    
+    //Check that this is an event log we understand before we go creating any output.
+    BXMT32EventLogReader *log = [[BXMT32EventLogReader alloc] initWithURL: logURL error: outError];
+    if (!log)
+        return nil;
+    
+    UInt32 sampleRate = log.sampleRate;
+    
+    FILE *output = fopen(outputURL.fileSystemRepresentation, "wb");
+    if (!output)
+    {
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                            code: errno
+                                        userInfo: @{ NSURLErrorKey: outputURL }];
+        }
+        return nil;
+    }
+    
+    //Reserve space for the header, which we fill in properly once we know how much we've rendered.
+    BXWriteWAVHeader(output, sampleRate, 0);
+    
+    std::vector<SInt16> buffer(blockFrames * 2);
+    std::vector<uint64_t> blockTimes;
+    uint64_t renderedFrames = 0;
+    
+    //Render in blocks of at most blockFrames up to the specified frame, timing each call to the synth.
+    //The samples are written out in native byte order, which is little-endian on every Mac we run on.
+    MT32Emu::Synth *synth = _synth;
+    auto renderUntil = [&](uint64_t targetFrame) {
+        while (renderedFrames < targetFrame)
+        {
+            UInt32 numFrames = (UInt32)MIN(targetFrame - renderedFrames, (uint64_t)blockFrames);
+            
+            uint64_t blockStart = mach_absolute_time();
+            synth->render(buffer.data(), numFrames);
+            blockTimes.push_back(mach_absolute_time() - blockStart);
+            
+            fwrite(buffer.data(), sizeof(SInt16) * 2, numFrames, output);
+            renderedFrames += numFrames;
+        }
+    };
+    
+    //Render up to the frame at which each event took effect, then play it.
+    NSError *readError = nil;
+    BOOL isTruncated = ![log readEventsWithHandler: ^(uint64_t frame, UInt32 packedMessage, const UInt8 *sysex, NSUInteger sysexLength) {
+        renderUntil(frame);
+        
+        if (sysex)
+            synth->playSysex(sysex, (UInt32)sysexLength);
+        else
+            synth->playMsg(packedMessage);
+    } error: &readError];
+    
+    if (!isTruncated)
+        renderUntil(renderedFrames + sampleRate * BXMT32OfflineTailDuration);
+    
+    //Now that we know how long the data is, go back and fill in the header.
+    fseek(output, 0, SEEK_SET);
+    BXWriteWAVHeader(output, sampleRate, (UInt32)(renderedFrames * 4));
+    
+    BOOL writeFailed = (ferror(output) != 0);
+    int writeError = errno;
+    fclose(output);
+    
+    if (isTruncated || writeFailed)
+    {
+        if (outError)
+        {
+            if (isTruncated)
+            {
+                *outError = readError;
+            }
+            else
+            {
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: writeError
+                                            userInfo: @{ NSURLErrorKey: outputURL }];
+            }
+        }
+        return nil;
+    }
+    
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double secondsPerTick = (double)timebase.numer / (double)timebase.denom / NSEC_PER_SEC;
+    
+    uint64_t totalTicks = 0;
+    for (uint64_t ticks : blockTimes)
+        totalTicks += ticks;
+    
+    std::sort(blockTimes.begin(), blockTimes.end());
+    auto percentile = [&](double proportion) -> NSTimeInterval {
+        if (blockTimes.empty()) return 0;
+        size_t index = MIN((size_t)(proportion * blockTimes.size()), blockTimes.size() - 1);
+        return blockTimes[index] * secondsPerTick;
+    };
+    
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    
+    BXMT32RenderStatistics *statistics = [[BXMT32RenderStatistics alloc] init];
+    statistics.renderedFrames = (NSUInteger)renderedFrames;
+    statistics.audioDuration = (sampleRate > 0) ? renderedFrames / (NSTimeInterval)sampleRate : 0;
+    statistics.renderTime = totalTicks * secondsPerTick;
+    statistics.peakMemoryBytes = (NSUInteger)usage.ru_maxrss; //Reported in bytes on OS X, unlike on Linux
+    statistics.blockCount = blockTimes.size();
+    statistics.medianBlockTime = percentile(0.5);
+    statistics.p95BlockTime = percentile(0.95);
+    statistics.p99BlockTime = percentile(0.99);
+    statistics.maxBlockTime = percentile(1.0);
+    
+    return statistics;
+}
+
+
 #pragma mark -
 #pragma mark Private methods
 
@@ -338,20 +844,23 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
         return NO;
     }
     
+    //These will come straight from the cache if another synth has already loaded the same ROMs.
+    _controlROM = [BXMT32ROM ROMAtURL: self.controlROMURL error: outError];
+    if (!_controlROM)
+        return NO;
+    
+    _PCMROM = [BXMT32ROM ROMAtURL: self.PCMROMURL error: outError];
+    if (!_PCMROM)
+    {
+        _controlROM = nil;
+        return NO;
+    }
+    
     //Coooool I love really awkward C++ APIs
     _reportHandler = new BXEmulatedMT32ReportHandler(self);
     _synth = new MT32Emu::Synth(_reportHandler);
     
-    _PCMROMHandle = new MT32Emu::FileStream();
-    _PCMROMHandle->open(self.PCMROMURL.fileSystemRepresentation);
-    
-    _controlROMHandle = new MT32Emu::FileStream();
-    _controlROMHandle->open(self.controlROMURL.fileSystemRepresentation);
-    
-    _controlROMImage = MT32Emu::ROMImage::makeROMImage(_controlROMHandle);
-    _PCMROMImage = MT32Emu::ROMImage::makeROMImage(_PCMROMHandle);
-    
-    if (!_synth->open(*_controlROMImage, *_PCMROMImage))
+    if (!_synth->open(*_controlROM.ROMImage, *_PCMROM.ROMImage))
     {
         //Pick up the initialization error we'll have received from
         //the callback, and post it back upstream
@@ -8,6 +8,7 @@
 
 #import "BXEmulator.h"
 #import "BXEmulatedMT32Delegate.h"
+#import "BXAudioStatistics.h"
 
 
 #pragma mark - MIDI device description constants
@@ -58,6 +59,10 @@ extern NSString * const BXMIDIExternalDeviceIndexKey;
 extern NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey;
 
 
+/// The key under which the statistics of in-process MIDI synths are listed in @c audioStatistics.
+extern NSString * const BXMIDIAudioSourceName;
+
+
 #pragma mark - BXEmulator (BXAudio)
 
 @protocol BXMIDIDevice;
@@ -78,8 +83,27 @@ extern NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey;
 /// or \c nil if the device could not be created.
 - (id <BXMIDIDevice>) attachMIDIDeviceForDescription: (NSDictionary *)description;
 
-/// Dispatch the specified MIDI message/sysex onward to the active MIDI device.
+/// Dispatch the specified MIDI message/sysex onward to the active MIDI device
+/// to be played immediately.
 - (void) sendMIDIMessage: (NSData *)message;
 - (void) sendMIDISysex: (NSData *)message;
 
+/// Dispatch the specified MIDI message/sysex onward to the active MIDI device, to be played
+/// at the point in its output that corresponds to the specified emulated time (in seconds since
+/// emulation began.) Devices that cannot schedule messages will play them immediately.
+/// Standard messages are batched up and reach the device within an emulated millisecond.
+- (void) sendMIDIMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime;
+- (void) sendMIDISysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime;
+
+
+#pragma mark - Audio statistics
+
+/// Snapshots of how each audio source that Boxer renders into DOSBox's mixer has been keeping up,
+/// keyed by source name: currently just @c BXMIDIAudioSourceName, for whichever MIDI synth is active.
+/// A source's statistics start afresh whenever it is replaced. Safe to call from any thread.
+@property (readonly) NSDictionary<NSString *, BXAudioSourceStatistics *> *audioStatistics;
+
+/// Clears the statistics of every audio source.
+- (void) resetAudioStatistics;
+
 @end
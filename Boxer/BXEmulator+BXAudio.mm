@@ -9,12 +9,19 @@
 #import "BXEmulatedMT32.h"
 #import "BXExternalMIDIDevice.h"
 #import "BXExternalMT32+BXMT32Sysexes.h"
+#import "BXMT32SysexImage.h"
 #import "BXMIDISynth.h"
 #import "BXAudioSource.h"
+#import "BXAudioConversion.h"
+#import "BXAudioResampler.h"
+#import "BXAudioStatistics.h"
+#import "BXAudioRecorder.h"
 #import "BXDrive.h"
+#import "BXVideoRecorder.h"
 
 #import <SDL2/SDL.h>
 #import "mixer.h"
+#import "pic.h"
 
 
 static const char *BXMIDIChannelName = "MIDI";
@@ -27,6 +34,11 @@ NSString * const BXMIDIExternalDeviceIndexKey       = @"External Device Index";
 NSString * const BXMIDIExternalDeviceUniqueIDKey    = @"External Device Unique ID";
 NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sysex Delays";
 
+NSString * const BXMIDIAudioSourceName = @"MIDI";
+
+//Passed as the emulated time of MIDI messages that should be played as soon as they arrive.
+static const NSTimeInterval BXMIDIImmediateTime = -1;
+
 
 @implementation BXEmulator (BXAudio)
 
@@ -67,19 +79,25 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
 
 - (void) sendMIDIMessage: (NSData *)message
 {
-    //Connect to our requested MIDI device the first time we need one.
-    [self _attachRequestedMIDIDeviceIfNeeded];
-    
-    if (self.activeMIDIDevice)
-    {
-        //If we're not ready to send yet, wait until we are.
-        [self _waitUntilActiveMIDIDeviceIsReady];
-        [self.activeMIDIDevice handleMessage: message];
-    }
+    [self _queueMIDIMessage: (const UInt8 *)message.bytes length: message.length atEmulatedTime: BXMIDIImmediateTime];
+    [self _flushPendingMIDIEvents];
 }
 
 - (void) sendMIDISysex: (NSData *)message
 {
+    [self sendMIDISysex: message atEmulatedTime: BXMIDIImmediateTime];
+}
+
+- (void) sendMIDIMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _queueMIDIMessage: (const UInt8 *)message.bytes length: message.length atEmulatedTime: emulatedTime];
+}
+
+- (void) sendMIDISysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    //Deliver any messages sent before this sysex first, so that everything arrives in order.
+    [self _flushPendingMIDIEvents];
+    
     //Connect to our requested MIDI device the first time we need one.
     [self _attachRequestedMIDIDeviceIfNeeded];
     
@@ -133,11 +151,16 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
         }
     }
 
-    if (self.activeMIDIDevice)
+    id <BXMIDIDevice> device = self.activeMIDIDevice;
+    if (device)
     {
         //If we're not ready to send yet, wait until we are.
         [self _waitUntilActiveMIDIDeviceIsReady];
-        [self.activeMIDIDevice handleSysex: message];
+        
+        if (emulatedTime != BXMIDIImmediateTime && [device respondsToSelector: @selector(handleSysex:atEmulatedTime:)])
+            [device handleSysex: message atEmulatedTime: emulatedTime];
+        else
+            [device handleSysex: message];
     }
 }
 
@@ -147,8 +170,62 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
 #pragma mark -
 #pragma mark Private methods
 
+- (void) _queueMIDIMessage: (const UInt8 *)bytes
+                    length: (NSUInteger)length
+            atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    NSAssert(length > 0 && length <= 3, @"Invalid MIDI message length passed to _queueMIDIMessage:length:atEmulatedTime: %lu", (unsigned long)length);
+    
+    if (_numPendingMIDIEvents >= BXMIDIEventBatchCapacity)
+        [self _flushPendingMIDIEvents];
+    
+    BXMIDIEvent *event = &_pendingMIDIEvents[_numPendingMIDIEvents++];
+    event->emulatedTime = emulatedTime;
+    event->length = (UInt8)length;
+    memcpy(event->bytes, bytes, length);
+}
+
+- (void) _flushPendingMIDIEvents
+{
+    if (!_numPendingMIDIEvents) return;
+    
+    //Connect to our requested MIDI device the first time we need one.
+    [self _attachRequestedMIDIDeviceIfNeeded];
+    
+    id <BXMIDIDevice> device = self.activeMIDIDevice;
+    if (device)
+    {
+        //If we're not ready to send yet, wait until we are.
+        [self _waitUntilActiveMIDIDeviceIsReady];
+        
+        if ([device respondsToSelector: @selector(handleEvents:count:)])
+        {
+            [device handleEvents: _pendingMIDIEvents count: _numPendingMIDIEvents];
+        }
+        //Fall back on delivering messages one at a time to devices that can't take them in bulk.
+        else
+        {
+            BOOL handlesTimedMessages = [device respondsToSelector: @selector(handleMessage:atEmulatedTime:)];
+            for (NSUInteger i=0; i<_numPendingMIDIEvents; i++)
+            {
+                BXMIDIEvent *event = &_pendingMIDIEvents[i];
+                NSData *message = [NSData dataWithBytesNoCopy: event->bytes length: event->length freeWhenDone: NO];
+                
+                if (handlesTimedMessages && event->emulatedTime != BXMIDIImmediateTime)
+                    [device handleMessage: message atEmulatedTime: event->emulatedTime];
+                else
+                    [device handleMessage: message];
+            }
+        }
+    }
+    _numPendingMIDIEvents = 0;
+}
+
 - (void) _suspendAudio
 {
+    //Make sure the device has everything the program sent before it stops.
+    [self _flushPendingMIDIEvents];
+    
     SDL_PauseAudio(YES);
     
 #if !defined(C_SDL2)
@@ -216,28 +293,137 @@ void _renderMIDIOutput(Bitu numFrames)
 
 - (void) _renderMIDIOutputToChannel: (MixerChannel *)channel frames: (NSUInteger)numFrames
 {
+    uint64_t startTime = [BXAudioStatisticsRecorder currentTime];
+    
+    //Hand over any messages that should be heard in this block before the device renders it.
+    [self _flushPendingMIDIEvents];
+    
     id <BXAudioSource> source = (id <BXAudioSource>)self.activeMIDIDevice;
     
     NSAssert1([source conformsToProtocol: @protocol(BXAudioSource)], @"_renderMIDIOutputToChannel:length: called for MIDI device that does not implement BXAudioSource: %@", source);
     
-    [self _renderOutputFromSource: source toChannel: channel frames: numFrames];
+    BXAudioRecorder *recorder = self.sourceAudioRecorders[BXMIDIAudioSourceName];
+    BOOL audioRendered = [self _renderOutputFromSource: source
+                                             toChannel: channel
+                                                frames: numFrames
+                                             resampler: _MIDIResampler
+                                              recorder: recorder];
+    
+    [_MIDIAudioStatistics recordRenderOfSource: source
+                                        frames: numFrames
+                                     resampler: _MIDIResampler
+                                     startTime: startTime
+                                 audioRendered: audioRendered];
+}
+
+- (NSDictionary<NSString *, BXAudioSourceStatistics *> *) audioStatistics
+{
+    return @{ BXMIDIAudioSourceName: _MIDIAudioStatistics.statistics };
+}
+
+- (void) resetAudioStatistics
+{
+    [_MIDIAudioStatistics reset];
+}
+
+- (NSUInteger) _prepareMIDIResamplerForSource: (id <BXAudioSource>)source
+{
+    NSUInteger sourceRate = source.sampleRate;
+    NSInteger quality = [[NSUserDefaults standardUserDefaults] integerForKey: @"audioResamplingQuality"];
+    
+    //Leave it to DOSBox's mixer if the source already runs at the mixer's rate, or if we've been told to.
+    if (sourceRate == _mixerSampleRate || quality < 0)
+    {
+        _MIDIResampler = nil;
+        return sourceRate;
+    }
+    
+    BOOL resamplerMatches = (_MIDIResampler.inputRate == sourceRate &&
+                             _MIDIResampler.outputRate == _mixerSampleRate &&
+                             _MIDIResampler.quality == quality);
+    
+    if (!resamplerMatches)
+    {
+        //The output is written to MixTemp as 32-bit stereo, so we can produce at most this many frames at a time.
+        _MIDIResampler = [[BXAudioResampler alloc] initWithInputRate: sourceRate
+                                                          outputRate: _mixerSampleRate
+                                                             quality: (BXAudioResamplerQuality)quality
+                                                     maxOutputFrames: MIXER_BUFSIZE / (2 * sizeof(Bit32s))];
+    }
+    return _mixerSampleRate;
 }
 
-- (void) _renderOutputFromSource: (id <BXAudioSource>)source
+- (BOOL) _renderOutputFromSource: (id <BXAudioSource>)source
                        toChannel: (MixerChannel *)channel
                           frames: (NSUInteger)numFrames
+                       resampler: (BXAudioResampler *)resampler
+                        recorder: (BXAudioRecorder *)recorder
 {
     NSUInteger sampleRate = 0;
     BXAudioFormat format = BXAudioFormatAny;
     
+    //Let the source place any timestamped events it has been sent within this block.
+    if ([source respondsToSelector: @selector(willRenderOutputAtEmulatedTime:)])
+        [source willRenderOutputAtEmulatedTime: PIC_FullIndex() / 1000.0];
+    
+    if (resampler)
+    {
+        NSUInteger framesRemaining = numFrames;
+        while (framesRemaining > 0)
+        {
+            NSUInteger outputFrames = MIN(framesRemaining, resampler.maxOutputFrames);
+            NSUInteger inputFrames = [resampler inputFramesNeededForOutputFrames: outputFrames];
+            
+            //The resampler may already have all the input it needs for a very short block.
+            BOOL audioRendered = YES;
+            if (inputFrames > 0)
+            {
+                audioRendered = [source renderOutputToBuffer: resampler.inputBuffer
+                                                      frames: inputFrames
+                                                  sampleRate: &sampleRate
+                                                      format: &format];
+            }
+            
+            if (!audioRendered)
+            {
+                //Whatever the resampler was holding is no longer continuous with what comes next.
+                [resampler reset];
+                channel->AddSilence();
+                [recorder addSilenceWithFrames: framesRemaining sampleRate: resampler.outputRate];
+                return NO;
+            }
+            
+            Bit32s *output = (Bit32s *)MixTemp;
+            [resampler resampleInputFrames: inputFrames
+                                    format: format
+                            toMixerSamples: output
+                                    frames: outputFrames];
+            
+            [recorder addSamples: output
+                          frames: outputFrames
+                          format: BXAudioFormat32Bit | BXAudioFormatSigned | BXAudioFormatStereo
+                      sampleRate: resampler.outputRate];
+            
+            channel->AddSamples_s32(outputFrames, output);
+            framesRemaining -= outputFrames;
+        }
+        return YES;
+    }
+    
     void *buffer = (void *)MixTemp;
     BOOL audioRendered = [source renderOutputToBuffer: buffer
                                                frames: numFrames
                                            sampleRate: &sampleRate
                                                format: &format];
     
+    if (!sampleRate)
+        sampleRate = source.sampleRate;
+    
     if (audioRendered)
     {
+        //Record the samples before they're handed to the mixer, as float samples are converted in place.
+        [recorder addSamples: buffer frames: numFrames format: format sampleRate: sampleRate];
+        
         [self _renderBuffer: MixTemp
                   toChannel: channel
                      frames: numFrames
@@ -246,7 +432,9 @@ void _renderMIDIOutput(Bitu numFrames)
     else
     {
         channel->AddSilence();
+        [recorder addSilenceWithFrames: numFrames sampleRate: sampleRate];
     }
+    return audioRendered;
 }
 
 - (void) _renderBuffer: (void *)buffer
@@ -287,6 +475,13 @@ void _renderMIDIOutput(Bitu numFrames)
             break;
             
         case BXAudioFormat32Bit:
+            //Float samples are converted in place into the integer samples that the mixer takes.
+            if (format & BXAudioFormatFloat)
+            {
+                NSUInteger numSamples = (isStereo) ? numFrames * 2 : numFrames;
+                BXAudioConvertFloatToMixerSamples((const float *)buffer, (int32_t *)buffer, numSamples);
+            }
+            
             if (isStereo)       channel->AddSamples_s32(numFrames, (const Bit32s *)buffer);
             else                channel->AddSamples_m32(numFrames, (const Bit32s *)buffer);
     }
@@ -294,6 +489,7 @@ void _renderMIDIOutput(Bitu numFrames)
 
 - (void) _resetMIDIDevice
 {
+    [self _flushPendingMIDIEvents];
     [self _clearPendingSysexMessages];
     
     //Clear the active MIDI device so that we can redetect it next time
@@ -305,15 +501,16 @@ void _renderMIDIOutput(Bitu numFrames)
 
 - (void) _queueSysexMessage: (NSData *)message
 {
-    //Copy the message before queuing, as it may be backed by a buffer we don't own.
-    [_pendingSysexMessages addObject: [NSData dataWithData: message]];
+    //Rather than keeping the message itself, apply it to our image of the MT-32's memory:
+    //this keeps only the latest value for each address however many messages we receive.
+    [_pendingMT32State recordSysex: message];
 }
 
 - (void) _flushPendingSysexMessages
 {
-    if (self.activeMIDIDevice)
+    if (self.activeMIDIDevice && !_pendingMT32State.isEmpty)
     {
-        for (NSData *message in _pendingSysexMessages)
+        for (NSData *message in [_pendingMT32State sysexesForReplay])
         {
             //If we're not ready to send yet, wait until we are.
             [self _waitUntilActiveMIDIDeviceIsReady];
@@ -325,7 +522,7 @@ void _renderMIDIOutput(Bitu numFrames)
 
 - (void) _clearPendingSysexMessages
 {
-    [_pendingSysexMessages removeAllObjects];
+    [_pendingMT32State clear];
 }
 
 - (void) _waitUntilActiveMIDIDeviceIsReady
@@ -89,9 +89,15 @@ extern NSStringEncoding BXDirectStringEncoding;
 @class BXEmulatedMouse;
 @class BXEmulatedPrinter;
 @class BXKeyBuffer;
+@class BXVideoRecorder;
+@class BXAudioRecorder;
+@class BXAudioResampler;
+@class BXAudioStatisticsRecorder;
+@class BXMT32SysexImage;
 @class BXDrive;
 
 @protocol BXEmulatedJoystick;
+@protocol BXFrameSink;
 @protocol BXEmulatedPrinterDelegate;
 @protocol BXEmulatorDelegate;
 @protocol BXEmulatorFileSystemDelegate;
@@ -147,13 +153,21 @@ extern NSStringEncoding BXDirectStringEncoding;
     //Managed by BXShell.
 	NSMutableArray<NSString*> *_commandQueue;
     BXKeyBuffer *_keyBuffer;
+    BXVideoRecorder *_videoRecorder;
+    id <BXFrameSink> _frameSink;
+    NSDictionary<NSString *, BXAudioRecorder *> *_sourceAudioRecorders;
     NSTimeInterval _keyBufferLastCheckTime;
     NSTimeInterval _lastRunLoopTime;
     
     //Managed by BXAudio.
     id <BXMIDIDevice> _activeMIDIDevice;
     NSDictionary<NSString *,id> *_requestedMIDIDeviceDescription;
-    NSMutableArray *_pendingSysexMessages;
+    BXMT32SysexImage *_pendingMT32State;
+    struct BXMIDIEvent *_pendingMIDIEvents;
+    NSUInteger _numPendingMIDIEvents;
+    BXAudioResampler *_MIDIResampler;
+    BXAudioStatisticsRecorder *_MIDIAudioStatistics;
+    NSUInteger _mixerSampleRate;
     BOOL _autodetectsMT32;
     
     //Used by BXDOSFilesystem to track drives while they're being mounted.
@@ -184,6 +198,19 @@ extern NSStringEncoding BXDirectStringEncoding;
 /// The keybuffer used for pasting text into DOS.
 @property (readonly, retain) BXKeyBuffer *keyBuffer;
 
+/// The recorder capturing this session's video output, or @c nil if none is in progress.
+/// The recorder is fed from the emulation thread as frames are rendered.
+@property (retain, nullable) BXVideoRecorder *videoRecorder;
+
+/// If set, every frame the emulator renders is passed to this sink on the emulation thread,
+/// whether or not the frame is delivered to the delegate.
+@property (retain, nullable) id <BXFrameSink> frameSink;
+
+/// Recorders capturing the output of individual audio sources before it is mixed, keyed by source name
+/// as in @c audioStatistics. Sources without a recorder are not recorded. The recorders are fed from
+/// the emulation thread as each source renders.
+@property (copy, nullable) NSDictionary<NSString *, BXAudioRecorder *> *sourceAudioRecorders;
+
 /// The OS X filesystem location to which the emulator should resolve relative local filesystem paths.
 /// This is used by DOSBox commands like @c MOUNT, @c IMGMOUNT and @c CONFIG and is directly equivalent
 /// to the current process's working directory: indeed, changing this will change the working
@@ -7,6 +7,8 @@
 
 #import "BXEmulatorPrivate.h"
 #import "NSObject+ADBPerformExtensions.h"
+#import "BXMT32SysexImage.h"
+#import "BXAudioStatistics.h"
 
 #import <SDL2/SDL.h>
 #import "cpu.h"
@@ -106,6 +108,9 @@ void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 @synthesize autodetectsMT32 = _autodetectsMT32;
 @synthesize masterVolume = _masterVolume;
 @synthesize keyBuffer = _keyBuffer;
+@synthesize videoRecorder = _videoRecorder;
+@synthesize frameSink = _frameSink;
+@synthesize sourceAudioRecorders = _sourceAudioRecorders;
 @synthesize waitingForCommandInput = _waitingForCommandInput;
 
 
@@ -183,7 +188,10 @@ static BOOL _hasStartedEmulator = NO;
         _runningProcesses       = [[NSMutableArray alloc] initWithCapacity: 1];
 		_commandQueue           = [[NSMutableArray alloc] initWithCapacity: 4];
 		_driveCache             = [[NSMutableDictionary alloc] initWithCapacity: DOS_DRIVES];
-		_pendingSysexMessages   = [[NSMutableArray alloc] initWithCapacity: 4];
+		_pendingMT32State       = [[BXMT32SysexImage alloc] init];
+        _pendingMIDIEvents      = (BXMIDIEvent *)calloc(BXMIDIEventBatchCapacity, sizeof(BXMIDIEvent));
+        _MIDIAudioStatistics    = [[BXAudioStatisticsRecorder alloc] init];
+        _mixerSampleRate        = BXMixerDefaultSampleRate;
         
         self.masterVolume = 1.0f;
 		
@@ -213,13 +221,21 @@ static BOOL _hasStartedEmulator = NO;
     self.mouse = nil;
     self.joystick = nil;
     self.printer = nil;
+    //Frame deliveries may still be queued up for the video handler on the main thread
+    self.videoHandler.emulator = nil;
     self.videoHandler = nil;
     self.keyBuffer = nil;
+    self.videoRecorder = nil;
+    self.frameSink = nil;
+    self.sourceAudioRecorders = nil;
     
     [_runningProcesses release]; _runningProcesses = nil;
     [_driveCache release]; _driveCache = nil;
     [_commandQueue release]; _commandQueue = nil;
-    [_pendingSysexMessages release]; _pendingSysexMessages = nil;
+    [_pendingMT32State release]; _pendingMT32State = nil;
+    free(_pendingMIDIEvents); _pendingMIDIEvents = NULL;
+    [_MIDIResampler release]; _MIDIResampler = nil;
+    [_MIDIAudioStatistics release]; _MIDIAudioStatistics = nil;
 	
 	[super dealloc];
 #pragma clang diagnostic pop
@@ -787,16 +803,21 @@ static BOOL _hasStartedEmulator = NO;
     {
         [_activeMIDIDevice release];
         _activeMIDIDevice = [device retain];
+        
+        //Statistics are per-source, so start afresh with the new device.
+        [_MIDIAudioStatistics reset];
 
         //If the device supports mixing, create a DOSBox mixer channel for it.
         if ([device conformsToProtocol: @protocol(BXAudioSource)])
         {
-            [self _addMIDIMixerChannelWithSampleRate: [(id <BXAudioSource>)device sampleRate]];
+            [self _addMIDIMixerChannelWithSampleRate: [self _prepareMIDIResamplerForSource: (id <BXAudioSource>)device]];
         }
         //Otherwise, disable and remove any existing mixer channel.
         else
         {
             [self _removeMIDIMixerChannel];
+            [_MIDIResampler release];
+            _MIDIResampler = nil;
         }
         
 #ifdef BOXER_DEBUG
@@ -930,6 +951,12 @@ static BOOL _hasStartedEmulator = NO;
 
 - (void) _processEvents
 {
+    //DOSBox calls this once every emulated millisecond, which is as long as we let MIDI messages wait.
+    [self _flushPendingMIDIEvents];
+    
+    //Likewise for data sent to the printer.
+    [self.printer flushPendingData];
+    
     //Let our delegate process events for us if we don't have our own thread
     if (!self.isConcurrent)
     {
@@ -1024,6 +1051,12 @@ static BOOL _hasStartedEmulator = NO;
             //Initialise each DOSBox module based on the loaded configuration.
             control->Init();
             
+            //Resample MIDI to whatever rate the loaded configuration set the mixer to:
+            //the mixer has no way of telling us its rate once it's running.
+            Section_prop *mixerSection = static_cast<Section_prop *>(control->GetSection("mixer"));
+            if (mixerSection && mixerSection->Get_int("rate") > 0)
+                _mixerSampleRate = (NSUInteger)mixerSection->Get_int("rate");
+            
             [self _didInitialize];
 		
         [pool drain];
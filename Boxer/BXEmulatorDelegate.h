@@ -112,9 +112,12 @@ extern NSString * const BXEmulatorExitDateKey;
 /// May return nil or an empty array, which will cause no configuration files to be loaded.
 - (nullable NSArray<NSURL*> *) configurationURLsForEmulator: (BXEmulator *)emulator;
 
-/// Called after every frame is finished to provide the delegate with the newly-rendered frame.
+/// Called on the main thread after every frame is finished to provide the delegate with the newly-rendered frame.
+/// If several frames are finished before the main thread can deliver them, only the newest is delivered.
 /// @param emulator The emulator which has rendered the frame.
-/// @param frame    The frame that was just rendered. This may be the same instance as the previous frame that was rendered.
+/// @param frame    The frame that was just rendered. The emulator will not write into this frame again
+///                 until the next frame has been delivered, but the same instance will be reused for later frames.
+///                 Compare @c frameNumber with that of the previous frame to tell whether any frames were skipped.
 - (void) emulator: (BXEmulator *)emulator didFinishFrame: (BXVideoFrame *)frame;
 
 /// Called at the very start of AUTOEXEC.BAT to let the delegate mount drives and configure the DOSBox environment.
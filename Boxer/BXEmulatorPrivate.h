@@ -202,7 +202,8 @@ typedef NS_ERROR_ENUM(BXDOSBoxMountErrorDomain, BXDOSBoxMountErrors) {
 /// This resyncs the emulator's cached notions of the DOSBox state and posts notifications properties that have changed.
 - (void) _didChangeEmulationState;
 
-/// Called by videoHandler when each new frame is ready. Passes the frame on to the emulator's delegate.
+/// Called by videoHandler on the main thread when each new frame is ready. Passes the frame on to the emulator's delegate.
+/// The frame belongs to the main thread until the next frame is delivered.
 - (void) _didFinishFrame: (BXVideoFrame *)frame;
 
 @end
@@ -565,6 +566,10 @@ typedef NS_ERROR_ENUM(BXDOSBoxMountErrorDomain, BXDOSBoxMountErrors) {
 
 #pragma mark - Audio-related internal methods
 
+/// The output rate we assume DOSBox's mixer is running at if the configuration doesn't say otherwise.
+/// This matches the rate set in Preflight.conf.
+#define BXMixerDefaultSampleRate 44100
+
 @interface BXEmulator (BXAudioInternals)
 
 /// Suspend audio emulation and stop all playback. Called when the emulator is paused to prevent hanging notes.
@@ -573,14 +578,27 @@ typedef NS_ERROR_ENUM(BXDOSBoxMountErrorDomain, BXDOSBoxMountErrors) {
 /// Resume audio emulation and playback. Called when the emulator is resumed.
 - (void) _resumeAudio;
 
-/// Used during MIDI input format detection to queue up copies of sysex messages that we received before deciding on a MIDI device.
-/// If a more appropriate MIDI device is later detected, these queued messages will be delivered to the new device.
+/// Adds a standard MIDI message of 1-3 bytes to the batch waiting to be delivered to the active MIDI device.
+/// This copies the message and allocates nothing, so it is cheap enough to call for every message the
+/// emulated program sends. The batch is delivered by @c _flushPendingMIDIEvents, or as soon as it fills up.
+- (void) _queueMIDIMessage: (const UInt8 *)bytes
+                    length: (NSUInteger)length
+            atEmulatedTime: (NSTimeInterval)emulatedTime;
+
+/// Delivers all batched MIDI messages to the active MIDI device, attaching one first if necessary.
+/// Called once per emulated millisecond, whenever the MIDI device is about to render output, and before
+/// any sysex is sent so that messages arrive in the order they were sent.
+- (void) _flushPendingMIDIEvents;
+
+/// Used during MIDI input format detection to record the effect of sysex messages that we received before deciding on a MIDI device.
+/// If a more appropriate MIDI device is later detected, the recorded state will be replayed to the new device.
+/// Only MT-32 data set sysexes are recorded, and only the latest value written to each address is kept.
 /// @note This is primarily for the benefit of MT-32 autodetection: a game may send a sequence of ambiguous MIDI sysex messages
 /// followed by one that conclusively determines that it thinks it's talking to an MT-32, at which point MT-32 emulation is enabled
 /// and all previous sysex messages should be delivered to the MT-32 to ensure it's properly initialized.
 - (void) _queueSysexMessage: (NSData *)message;
 
-/// Deliver queued sysex messages to the active MIDI device, and empty the sysex message queue.
+/// Deliver the minimal set of sysexes that recreates the recorded MT-32 state to the active MIDI device, and clear the recorded state.
 /// Called when switching to a more appropriate MIDI emulation mode.
 /// @see _queueSysexMessage: and _clearPendingSysexMessages:
 - (void) _flushPendingSysexMessages;
@@ -598,6 +616,8 @@ typedef NS_ERROR_ENUM(BXDOSBoxMountErrorDomain, BXDOSBoxMountErrors) {
 /// If the current MIDI device is busy processing previous MIDI messages, pauses the emulation thread until
 /// the active MIDI device is ready to receive messages again.
 /// Used when talking to a real MIDI device to avoid flooding it with MIDI messages it can't process in time.
+/// External devices pace their own sends, and only report themselves as busy once they have fallen
+/// too far behind: so in practice this only blocks during very long sysex uploads.
 - (void) _waitUntilActiveMIDIDeviceIsReady;
 
 /// If no MIDI device is currently attached, creates and attaches a new MIDI device matching the requested MIDI device description.
@@ -616,15 +636,25 @@ typedef NS_ERROR_ENUM(BXDOSBoxMountErrorDomain, BXDOSBoxMountErrors) {
 /// Disables and removes the current MIDI mixer channel, if one exists.
 - (void) _removeMIDIMixerChannel;
 
-/// Renders the active MIDI device's MIDI output to the specified channel.
-/// Will raise an assertion if the current MIDI source does not support mixing.
+/// Renders the active MIDI device's MIDI output to the specified channel, and records how long it took
+/// in the MIDI audio statistics. Will raise an assertion if the current MIDI source does not support mixing.
 - (void) _renderMIDIOutputToChannel: (MixerChannel *)channel
                              frames: (NSUInteger)numFrames;
 
+/// Creates, replaces or discards the resampler for the specified MIDI audio source, depending on whether
+/// its sample rate differs from the mixer's and on the audioResamplingQuality user default (negative to
+/// leave resampling to DOSBox's mixer.) Returns the sample rate the source's mixer channel should run at.
+- (NSUInteger) _prepareMIDIResamplerForSource: (id <BXAudioSource>)source;
+
 /// Render the specified number of output frames from the specified audio source to the specified output channel.
-- (void) _renderOutputFromSource: (id <BXAudioSource>)source
+/// If a resampler is provided, the source will be resampled through it to the channel's rate.
+/// If a recorder is provided, it will be sent a copy of what the channel is given.
+/// Returns @c NO if the source had no audio to give and silence was added to the channel instead.
+- (BOOL) _renderOutputFromSource: (id <BXAudioSource>)source
                        toChannel: (MixerChannel *)channel
-                          frames: (NSUInteger)numFrames;
+                          frames: (NSUInteger)numFrames
+                       resampler: (nullable BXAudioResampler *)resampler
+                        recorder: (nullable BXAudioRecorder *)recorder;
 
 /// Render the specified audio data buffer to the specified channel.
 - (void) _renderBuffer: (void *)buffer
@@ -20,13 +20,17 @@ NS_ASSUME_NONNULL_BEGIN
 #define BXVolumeSyncDelay 0.05
 
 /// BXExternalMIDIDevice represents a connection to an external MIDI device (such as a real MT-32.)
+/// Everything sent to the device goes out in order through a @c BXMIDISendQueue, which allows the device
+/// time to process each sysex without blocking the emulation. The device only reports itself as
+/// processing once that queue has fallen more than @c maxSendBacklog behind.
 @interface BXExternalMIDIDevice : NSObject <BXMIDIDevice>
 
 /// The destination this device is connecting to. Set at initialization time.
 @property (readonly, nonatomic) MIDIEndpointRef destination;
 
-/// Declared as settable for the benefit of our subclasses
-@property (copy, readwrite, nonatomic) NSDate *dateWhenReady;
+/// How far behind the device may fall in processing what it has been sent, before it reports itself
+/// as processing and the emulation must wait for it. Defaults to @c BXMIDISendQueueDefaultMaxBacklog.
+@property (assign, nonatomic) NSTimeInterval maxSendBacklog;
 
 /// The master volume assigned by the application, from 0.0 to 1.0.
 @property (assign, nonatomic) float volume;
@@ -48,10 +52,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 /// Returns how many seconds to allow for the external device to process the specified sysex.
 /// This is based on the time reported by the destination.
-/// Used to calculate dateWhenReady when sending sysex commands.
+/// Used to pace the sysexes that follow this one.
 - (NSTimeInterval) processingDelayForSysex: (NSData *)sysex;
 
-/// Sends specified the sysex message on its way to the external device.
+/// Queues the specified sysex message to be sent on its way to the external device.
 /// Called by handleSysex after volume-related preprocessing, and called instead of handleSysex
 /// by certain internal methods in order to bypass that preprocessing. Should not be called
 /// directly by other classes unless you know what you're doing.
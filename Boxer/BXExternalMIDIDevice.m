@@ -7,6 +7,7 @@
 
 #import "BXExternalMIDIDevice.h"
 #import "BXExternalMIDIDevice+BXGeneralMIDISysexes.h"
+#import "BXMIDISendQueue.h"
 
 #pragma mark -
 #pragma mark Private method declarations
@@ -22,6 +23,9 @@
 - (BOOL) _connectToDestinationAtUniqueID: (MIDIUniqueID)uniqueID
                                    error: (NSError **)outError;
 
+//Sends the specified data to the destination immediately. Called on our send queue's thread.
+static void _BXExternalMIDIDeviceSend(MIDIPortRef port, MIDIEndpointRef destination, const UInt8 *bytes, NSUInteger length);
+
 //The callback for our volume synchronization timer.
 //Calls syncVolume and invalidates the timer.
 - (void) _performVolumeSync: (NSTimer *)timer;
@@ -38,6 +42,8 @@
 	MIDIClientRef _client;
 	
 	NSTimer *_volumeSyncTimer;
+    
+    BXMIDISendQueue *_sendQueue;
 }
 
 #pragma mark -
@@ -65,7 +71,7 @@
         //Don't use setVolume:, as it will try to send a message.
         _volume = 1.0f;
         _requestedVolume = 1.0f;
-        self.dateWhenReady = [NSDate distantPast];
+        _maxSendBacklog = BXMIDISendQueueDefaultMaxBacklog;
         _secondsPerByte = BXExternalMIDIDeviceDefaultSysexRate;
     }
     return self;
@@ -127,8 +133,12 @@
 {
     if (_port)
     {
-        //Ensure the device stops playing notes when closing
+        //Ensure the device stops playing notes when closing. Drop anything still waiting to be sent
+        //so that this goes out as soon as the device is ready for it, and wait until it has.
+        [_sendQueue cancelPendingSends];
         [self pause];
+        [_sendQueue close];
+        _sendQueue = nil;
         
         MIDIPortDispose(_port);
         _port = (MIDIObjectRef)NULL;
@@ -181,6 +191,14 @@
         _secondsPerByte = 1.0f / (NSTimeInterval)maxSysexSpeed;
     }
     
+    //Capture the port and destination rather than ourselves, as the queue will outlive any reference
+    //to us that it might hold.
+    MIDIPortRef port = _port;
+    _sendQueue = [[BXMIDISendQueue alloc] initWithSendHandler: ^(const UInt8 *bytes, NSUInteger length) {
+        _BXExternalMIDIDeviceSend(port, destination, bytes, length);
+    }];
+    _sendQueue.maxBacklog = self.maxSendBacklog;
+    
     return YES;
 }
 
@@ -252,23 +270,78 @@
 
 - (BOOL) isProcessing
 {
-    //We're still processing if our readiness date is in the future
-    return self.dateWhenReady.timeIntervalSinceNow > 0;
+    //We only make the emulation wait for us once our send queue has fallen too far behind:
+    //otherwise it can keep sending and the queue will pace the data out to the device.
+    return _sendQueue.isOverLimit;
+}
+
+- (NSDate *) dateWhenReady
+{
+    return (_sendQueue) ? _sendQueue.dateWhenBelowLimit : [NSDate distantPast];
 }
 
+- (void) setMaxSendBacklog: (NSTimeInterval)backlog
+{
+    _maxSendBacklog = backlog;
+    _sendQueue.maxBacklog = backlog;
+}
+
+
+//The size of the buffer to use for messages that fit on the stack.
+#define MAX_STACK_PACKET_LIST_SIZE 1024
+
+static void _BXExternalMIDIDeviceSend(MIDIPortRef port, MIDIEndpointRef destination, const UInt8 *bytes, NSUInteger length)
+{
+    //Leave room for the packet list and packet headers.
+    NSUInteger bufferSize = length + sizeof(MIDIPacketList);
+    
+    UInt8 stackBuffer[MAX_STACK_PACKET_LIST_SIZE];
+    UInt8 *buffer = (bufferSize <= sizeof(stackBuffer)) ? stackBuffer : (UInt8 *)malloc(bufferSize);
+    
+    MIDIPacketList *packetList = (MIDIPacketList *)buffer;
+	MIDIPacket *currentPacket = MIDIPacketListInit(packetList);
+    
+    //A single packet may hold several complete MIDI messages, or one sysex.
+    MIDIPacketListAdd(packetList, bufferSize, currentPacket, (MIDITimeStamp)0, length, bytes);
+    
+    MIDISend(port, destination, packetList);
+    
+    if (buffer != stackBuffer)
+        free(buffer);
+}
 
 - (void) handleMessage: (NSData *)message
 {
     NSAssert(_port && _destination, @"handleMessage: called before successful initialization.");
     NSAssert(message.length > 0, @"0-length message received by handleMessage:");
     
-    UInt8 buffer[sizeof(MIDIPacketList)];
-    MIDIPacketList *packetList = (MIDIPacketList *)buffer;
-	MIDIPacket *currentPacket = MIDIPacketListInit(packetList);
+    [_sendQueue sendBytes: message.bytes length: message.length processingDelay: 0];
+}
+
+//Large enough to hold a few hundred standard MIDI messages in a single packet.
+#define MAX_EVENT_BATCH_SIZE 1024
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    NSAssert(_port && _destination, @"handleEvents:count: called before successful initialization.");
     
-    MIDIPacketListAdd(packetList, sizeof(buffer), currentPacket, (MIDITimeStamp)0, message.length, (UInt8 *)message.bytes);
+    //Join the whole batch into a single packet, so that it goes out to the device in a single send.
+    UInt8 buffer[MAX_EVENT_BATCH_SIZE];
+    NSUInteger length = 0;
     
-    MIDISend(_port, _destination, packetList);
+    for (NSUInteger i=0; i<count; i++)
+    {
+        if (length + events[i].length > sizeof(buffer))
+        {
+            [_sendQueue sendBytes: buffer length: length processingDelay: 0];
+            length = 0;
+        }
+        memcpy(buffer + length, events[i].bytes, events[i].length);
+        length += events[i].length;
+    }
+    
+    if (length)
+        [_sendQueue sendBytes: buffer length: length processingDelay: 0];
 }
 
 - (void) handleSysex: (NSData *)message
@@ -303,26 +376,13 @@
 
 - (void) dispatchSysex: (NSData *)message
 {
-//The same length as DOSBox's MIDI message buffer, plus padding for extra data used by the packet list.
-//(Technically a sysex message could be much longer than 1024 bytes, but it would be truncated by DOSBox
-//before it ever reaches us.)
-#define MAX_SYSEX_PACKET_SIZE 1024 * 4
-
-    NSAssert(_port && _destination, @"handleMessage: called before successful initialization.");
-    NSAssert(message.length > 0, @"0-length message received by handleMessage:");
-
-    UInt8 buffer[MAX_SYSEX_PACKET_SIZE];
-    MIDIPacketList *packetList = (MIDIPacketList *)buffer;
-	MIDIPacket *currentPacket = MIDIPacketListInit(packetList);
-    
-    MIDIPacketListAdd(packetList, sizeof(buffer), currentPacket, (MIDITimeStamp)0, message.length, (UInt8 *)message.bytes);
-    
-    MIDISend(_port, _destination, packetList);
+    NSAssert(_port && _destination, @"dispatchSysex: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by dispatchSysex:");
     
-    //Now, calculate how long it should take the device to process all that
-    NSTimeInterval processingDelay = [self processingDelayForSysex: message];
-    if (processingDelay > 0)
-        self.dateWhenReady = [NSDate dateWithTimeIntervalSinceNow: processingDelay];
+    //The queue will hold off on sending anything else until the device has had time to process this.
+    [_sendQueue sendBytes: message.bytes
+                   length: message.length
+          processingDelay: [self processingDelayForSysex: message]];
 }
 
 - (void) pause
@@ -375,7 +435,7 @@
     //If we already have a timer in progress, don't reschedule.
     if (!_volumeSyncTimer)
     {
-        NSTimeInterval timeUntilReady = MAX(0.0, self.dateWhenReady.timeIntervalSinceNow);
+        NSTimeInterval timeUntilReady = MAX(0.0, _sendQueue.dateWhenIdle.timeIntervalSinceNow);
         NSTimeInterval syncDelay = timeUntilReady + BXVolumeSyncDelay;
         
         //No need to retain it, since it'll be retained by the runloop until it fires
@@ -396,8 +456,8 @@
     //Only try to sync the volume if we're still connected.
     if (_port && _destination)
     {   
-        //If we're still busy processing, then defer the sync until after another delay.
-        if (self.isProcessing)
+        //If we're still busy sending or processing, then defer the sync until after another delay.
+        if (!_sendQueue.isIdle)
             [self scheduleVolumeSync];
         else
             [self syncVolume];
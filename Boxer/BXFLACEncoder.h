@@ -0,0 +1,52 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The number of sample frames in each FLAC frame the encoder produces, except the last.
+#define BXFLACBlockSize 4096
+
+/// @brief BXFLACEncoder encodes 16-bit stereo audio into a lossless FLAC stream.
+///
+/// @discussion Each block is encoded with whichever of FLAC's fixed polynomial predictors
+/// and stereo decorrelation modes comes out smallest, with partitioned Rice coding of the
+/// residual. This trades a little compression against libFLAC's LPC modes for an encoder
+/// that is small and cheap enough to keep up with live audio on a single background thread.
+///
+/// The stream header depends on the whole stream, so callers should write a placeholder
+/// header first and rewrite it once they have flushed the last of their samples.
+/// The encoder is not thread-safe, and is intended to be driven from a single background thread.
+@interface BXFLACEncoder : NSObject
+
+/// The sample rate of the stream.
+@property (readonly) NSUInteger sampleRate;
+
+/// The number of sample frames encoded into FLAC frames so far.
+@property (readonly) uint64_t encodedFrameCount;
+
+- (instancetype) initWithSampleRate: (NSUInteger)sampleRate;
+
+/// Returns the "fLaC" marker and STREAMINFO block that begin the stream, describing everything
+/// encoded so far. The header is always the same length.
+- (NSData *) streamHeader;
+
+/// Encodes the specified interleaved 16-bit stereo samples, appending any FLAC frames that
+/// were completed to @c output. Samples that do not fill a whole block are held back
+/// until more samples arrive, or until @c flushToBuffer: is called.
+- (void) encodeSamples: (const int16_t *)samples
+                frames: (NSUInteger)numFrames
+              toBuffer: (NSMutableData *)output;
+
+/// Encodes any samples held back as a final, shorter FLAC frame, and appends it to @c output.
+- (void) flushToBuffer: (NSMutableData *)output;
+
+@end
+
+NS_ASSUME_NONNULL_END
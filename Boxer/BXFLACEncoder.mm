@@ -0,0 +1,584 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXFLACEncoder.h"
+#import <vector>
+
+
+#pragma mark - Constants
+
+//The highest fixed predictor order FLAC defines.
+#define BXFLACMaxFixedOrder 4
+
+//The most times each block's residual may be split for Rice coding: 4096 >> 6 leaves 64 samples per partition.
+#define BXFLACMaxPartitionOrder 6
+
+//The largest Rice parameter that can be stored in 4 bits: 15 is reserved as an escape code.
+#define BXFLACMaxRiceParameter 14
+
+//The length of the STREAMINFO metadata block.
+#define BXFLACStreamInfoLength 34
+
+typedef NS_ENUM(NSUInteger, BXFLACChannelAssignment) {
+    BXFLACChannelsIndependent   = 0x1,
+    BXFLACChannelsLeftSide      = 0x8,
+    BXFLACChannelsSideRight     = 0x9,
+    BXFLACChannelsMidSide       = 0xA,
+};
+
+typedef NS_ENUM(NSUInteger, BXFLACSubframeType) {
+    BXFLACSubframeConstant,
+    BXFLACSubframeVerbatim,
+    BXFLACSubframeFixed,
+};
+
+
+#pragma mark - Bit writing
+
+//Packs values MSB-first into a growing byte buffer, as FLAC requires.
+class BXFLACBitWriter
+{
+public:
+    void reset()
+    {
+        _bytes.clear();
+        _accumulator = 0;
+        _bitCount = 0;
+    }
+
+    //Writes the low bits of the specified value. At most 32 bits may be written at a time.
+    void write(uint32_t value, unsigned bits)
+    {
+        if (!bits) return;
+
+        uint64_t mask = (bits == 32) ? 0xFFFFFFFFULL : ((1ULL << bits) - 1);
+        _accumulator = (_accumulator << bits) | (value & mask);
+        _bitCount += bits;
+        while (_bitCount >= 8)
+        {
+            _bitCount -= 8;
+            _bytes.push_back((uint8_t)(_accumulator >> _bitCount));
+        }
+    }
+
+    void writeSigned(int32_t value, unsigned bits)
+    {
+        write((uint32_t)value, bits);
+    }
+
+    //Writes the specified number of zero bits followed by a one.
+    void writeUnary(uint32_t zeros)
+    {
+        while (zeros >= 32)
+        {
+            write(0, 32);
+            zeros -= 32;
+        }
+        write(1, zeros + 1);
+    }
+
+    void writeRice(int32_t value, unsigned parameter)
+    {
+        //Fold the sign into the lowest bit, so that small magnitudes of either sign stay small.
+        uint32_t folded = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        writeUnary(folded >> parameter);
+        write(folded, parameter);
+    }
+
+    void alignToByte()
+    {
+        if (_bitCount) write(0, 8 - _bitCount);
+    }
+
+    const std::vector<uint8_t> &bytes() const { return _bytes; }
+
+private:
+    std::vector<uint8_t> _bytes;
+    uint64_t _accumulator = 0;
+    unsigned _bitCount = 0;
+};
+
+
+#pragma mark - Checksums
+
+static uint8_t _CRC8Table[256];
+static uint16_t _CRC16Table[256];
+
+static void _buildCRCTables(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (unsigned i=0; i<256; i++)
+        {
+            uint8_t crc8 = (uint8_t)i;
+            uint16_t crc16 = (uint16_t)(i << 8);
+            for (unsigned bit=0; bit<8; bit++)
+            {
+                crc8 = (crc8 & 0x80) ? (uint8_t)((crc8 << 1) ^ 0x07) : (uint8_t)(crc8 << 1);
+                crc16 = (crc16 & 0x8000) ? (uint16_t)((crc16 << 1) ^ 0x8005) : (uint16_t)(crc16 << 1);
+            }
+            _CRC8Table[i] = crc8;
+            _CRC16Table[i] = crc16;
+        }
+    });
+}
+
+static uint8_t _CRC8(const uint8_t *bytes, size_t length)
+{
+    uint8_t crc = 0;
+    for (size_t i=0; i<length; i++)
+        crc = _CRC8Table[crc ^ bytes[i]];
+    return crc;
+}
+
+static uint16_t _CRC16(const uint8_t *bytes, size_t length)
+{
+    uint16_t crc = 0;
+    for (size_t i=0; i<length; i++)
+        crc = (uint16_t)((crc << 8) ^ _CRC16Table[(crc >> 8) ^ bytes[i]]);
+    return crc;
+}
+
+
+#pragma mark - Subframe planning
+
+typedef struct {
+    BXFLACSubframeType type;
+    unsigned order;
+    unsigned partitionOrder;
+    uint8_t riceParameters[1 << BXFLACMaxPartitionOrder];
+    uint64_t bits;
+} BXFLACSubframePlan;
+
+//Fills residuals[order..numSamples) with the error of the specified fixed predictor.
+static void _computeFixedResiduals(const int32_t *x, NSUInteger numSamples, unsigned order, int32_t *residuals)
+{
+    NSUInteger i;
+    switch (order)
+    {
+        case 0:
+            for (i=0; i<numSamples; i++) residuals[i] = x[i];
+            break;
+        case 1:
+            for (i=1; i<numSamples; i++) residuals[i] = x[i] - x[i-1];
+            break;
+        case 2:
+            for (i=2; i<numSamples; i++) residuals[i] = x[i] - 2*x[i-1] + x[i-2];
+            break;
+        case 3:
+            for (i=3; i<numSamples; i++) residuals[i] = x[i] - 3*x[i-1] + 3*x[i-2] - x[i-3];
+            break;
+        case 4:
+            for (i=4; i<numSamples; i++) residuals[i] = x[i] - 4*x[i-1] + 6*x[i-2] - 4*x[i-3] + x[i-4];
+            break;
+    }
+}
+
+//Returns the Rice parameter that codes the specified number of residuals, whose folded values
+//add up to the specified sum, in the fewest bits; and the estimated number of bits it takes.
+static unsigned _bestRiceParameter(uint64_t sum, NSUInteger count, uint64_t *outBits)
+{
+    unsigned bestParameter = 0;
+    uint64_t bestBits = UINT64_MAX;
+    for (unsigned parameter=0; parameter<=BXFLACMaxRiceParameter; parameter++)
+    {
+        uint64_t bits = (uint64_t)count * (parameter + 1) + (sum >> parameter);
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            bestParameter = parameter;
+        }
+    }
+    *outBits = bestBits;
+    return bestParameter;
+}
+
+//Chooses the partitioning and Rice parameters for the specified residuals, and returns the
+//estimated size of the coded residual in bits.
+static uint64_t _planResidual(const int32_t *residuals, NSUInteger numSamples, unsigned order,
+                              BXFLACSubframePlan *plan, uint64_t *sums)
+{
+    //Each partition must divide the block evenly, and the first must have room for more than the warm-up samples.
+    unsigned maxPartitionOrder = BXFLACMaxPartitionOrder;
+    while (maxPartitionOrder > 0 &&
+           ((numSamples % (1 << maxPartitionOrder)) != 0 || (numSamples >> maxPartitionOrder) <= order))
+    {
+        maxPartitionOrder--;
+    }
+
+    //Add up the folded residuals of the finest partitions, and merge them for each coarser partitioning in turn.
+    NSUInteger numPartitions = 1 << maxPartitionOrder;
+    NSUInteger partitionSize = numSamples >> maxPartitionOrder;
+    for (NSUInteger p=0; p<numPartitions; p++)
+    {
+        NSUInteger start = MAX(p * partitionSize, (NSUInteger)order);
+        NSUInteger end = (p + 1) * partitionSize;
+        uint64_t sum = 0;
+        for (NSUInteger i=start; i<end; i++)
+        {
+            int32_t value = residuals[i];
+            sum += ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        }
+        sums[p] = sum;
+    }
+
+    uint64_t bestBits = UINT64_MAX;
+    for (int partitionOrder=maxPartitionOrder; partitionOrder>=0; partitionOrder--)
+    {
+        numPartitions = 1 << partitionOrder;
+        partitionSize = numSamples >> partitionOrder;
+
+        uint8_t parameters[1 << BXFLACMaxPartitionOrder];
+        uint64_t bits = 2 + 4;
+        for (NSUInteger p=0; p<numPartitions; p++)
+        {
+            NSUInteger count = (p == 0) ? partitionSize - order : partitionSize;
+            uint64_t partitionBits;
+            parameters[p] = (uint8_t)_bestRiceParameter(sums[p], count, &partitionBits);
+            bits += 4 + partitionBits;
+        }
+
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            plan->partitionOrder = partitionOrder;
+            memcpy(plan->riceParameters, parameters, numPartitions);
+        }
+
+        for (NSUInteger p=0; p<numPartitions / 2; p++)
+            sums[p] = sums[p * 2] + sums[p * 2 + 1];
+    }
+    return bestBits;
+}
+
+static BXFLACSubframePlan _planSubframe(const int32_t *x, NSUInteger numSamples, unsigned bitsPerSample,
+                                        int32_t *residuals, uint64_t *sums)
+{
+    BXFLACSubframePlan bestPlan = {};
+
+    BOOL isConstant = YES;
+    for (NSUInteger i=1; i<numSamples && isConstant; i++)
+        isConstant = (x[i] == x[0]);
+
+    if (isConstant)
+    {
+        bestPlan.type = BXFLACSubframeConstant;
+        bestPlan.bits = 8 + bitsPerSample;
+        return bestPlan;
+    }
+
+    bestPlan.type = BXFLACSubframeVerbatim;
+    bestPlan.bits = 8 + (uint64_t)numSamples * bitsPerSample;
+
+    unsigned maxOrder = (unsigned)MIN((NSUInteger)BXFLACMaxFixedOrder, numSamples - 1);
+    for (unsigned order=0; order<=maxOrder; order++)
+    {
+        BXFLACSubframePlan plan = {};
+        plan.type = BXFLACSubframeFixed;
+        plan.order = order;
+
+        _computeFixedResiduals(x, numSamples, order, residuals);
+        plan.bits = 8 + (uint64_t)order * bitsPerSample + _planResidual(residuals, numSamples, order, &plan, sums);
+
+        if (plan.bits < bestPlan.bits)
+            bestPlan = plan;
+    }
+    return bestPlan;
+}
+
+static void _writeSubframe(BXFLACBitWriter &writer, const int32_t *x, NSUInteger numSamples, unsigned bitsPerSample,
+                           const BXFLACSubframePlan &plan, int32_t *residuals)
+{
+    //A zero padding bit, the 6-bit subframe type, and a zero wasted-bits flag.
+    writer.write(0, 1);
+    switch (plan.type)
+    {
+        case BXFLACSubframeConstant:
+            writer.write(0x00, 6);
+            writer.write(0, 1);
+            writer.writeSigned(x[0], bitsPerSample);
+            break;
+
+        case BXFLACSubframeVerbatim:
+            writer.write(0x01, 6);
+            writer.write(0, 1);
+            for (NSUInteger i=0; i<numSamples; i++)
+                writer.writeSigned(x[i], bitsPerSample);
+            break;
+
+        case BXFLACSubframeFixed:
+        {
+            writer.write(0x08 | plan.order, 6);
+            writer.write(0, 1);
+            for (NSUInteger i=0; i<plan.order; i++)
+                writer.writeSigned(x[i], bitsPerSample);
+
+            _computeFixedResiduals(x, numSamples, plan.order, residuals);
+
+            //Rice coding with 4-bit parameters, then each partition's parameter and residuals.
+            writer.write(0, 2);
+            writer.write(plan.partitionOrder, 4);
+
+            NSUInteger numPartitions = 1 << plan.partitionOrder;
+            NSUInteger partitionSize = numSamples >> plan.partitionOrder;
+            for (NSUInteger p=0; p<numPartitions; p++)
+            {
+                unsigned parameter = plan.riceParameters[p];
+                writer.write(parameter, 4);
+
+                NSUInteger start = MAX(p * partitionSize, (NSUInteger)plan.order);
+                NSUInteger end = (p + 1) * partitionSize;
+                for (NSUInteger i=start; i<end; i++)
+                    writer.writeRice(residuals[i], parameter);
+            }
+            break;
+        }
+    }
+}
+
+//Writes a frame number in the extended UTF-8 coding that FLAC frame headers use.
+static void _writeUTF8Number(BXFLACBitWriter &writer, uint32_t value)
+{
+    if (value < 0x80)
+    {
+        writer.write(value, 8);
+        return;
+    }
+
+    unsigned numBytes = (value < 0x800) ? 2 : (value < 0x10000) ? 3 : (value < 0x200000) ? 4 : (value < 0x4000000) ? 5 : 6;
+    unsigned shift = (numBytes - 1) * 6;
+    writer.write(((0xFF00 >> numBytes) & 0xFF) | (value >> shift), 8);
+    while (shift)
+    {
+        shift -= 6;
+        writer.write(0x80 | ((value >> shift) & 0x3F), 8);
+    }
+}
+
+//Returns the 4-bit code for the specified sample rate in FLAC frame headers, and the 16-bit value
+//that must follow the header for rates that have no code of their own.
+static unsigned _sampleRateCode(NSUInteger sampleRate, unsigned *outExtension)
+{
+    *outExtension = 0;
+    switch (sampleRate)
+    {
+        case 88200:     return 0x1;
+        case 176400:    return 0x2;
+        case 192000:    return 0x3;
+        case 8000:      return 0x4;
+        case 16000:     return 0x5;
+        case 22050:     return 0x6;
+        case 24000:     return 0x7;
+        case 32000:     return 0x8;
+        case 44100:     return 0x9;
+        case 48000:     return 0xA;
+        case 96000:     return 0xB;
+    }
+
+    if (sampleRate <= 0xFFFF)
+    {
+        *outExtension = (unsigned)sampleRate;
+        return 0xD;
+    }
+    if (sampleRate % 10 == 0 && sampleRate / 10 <= 0xFFFF)
+    {
+        *outExtension = (unsigned)(sampleRate / 10);
+        return 0xE;
+    }
+    //Otherwise, leave it to the STREAMINFO block.
+    return 0x0;
+}
+
+
+#pragma mark - Implementation
+
+@implementation BXFLACEncoder
+{
+    std::vector<int32_t> _channels[4];
+    std::vector<int32_t> _residuals;
+    uint64_t _sums[1 << BXFLACMaxPartitionOrder];
+    NSUInteger _bufferedFrames;
+
+    BXFLACBitWriter _writer;
+    uint32_t _frameNumber;
+    NSUInteger _minFrameLength;
+    NSUInteger _maxFrameLength;
+}
+
+@synthesize sampleRate = _sampleRate;
+@synthesize encodedFrameCount = _encodedFrameCount;
+
+- (instancetype) initWithSampleRate: (NSUInteger)sampleRate
+{
+    if ((self = [super init]))
+    {
+        _buildCRCTables();
+
+        _sampleRate = sampleRate;
+        for (NSUInteger c=0; c<4; c++)
+            _channels[c].resize(BXFLACBlockSize);
+        _residuals.resize(BXFLACBlockSize);
+    }
+    return self;
+}
+
+- (NSData *) streamHeader
+{
+    //The block size stays the same throughout, except that the last block may be shorter.
+    NSUInteger blockSize = (_encodedFrameCount >= BXFLACBlockSize) ? BXFLACBlockSize : MAX(_encodedFrameCount, (uint64_t)16);
+
+    BXFLACBitWriter writer;
+    writer.write('f', 8); writer.write('L', 8); writer.write('a', 8); writer.write('C', 8);
+
+    //The last (and only) metadata block, of type STREAMINFO.
+    writer.write(1, 1);
+    writer.write(0, 7);
+    writer.write(BXFLACStreamInfoLength, 24);
+
+    writer.write((uint32_t)blockSize, 16);
+    writer.write((uint32_t)blockSize, 16);
+    writer.write((uint32_t)_minFrameLength, 24);
+    writer.write((uint32_t)_maxFrameLength, 24);
+    writer.write((uint32_t)_sampleRate, 20);
+    writer.write(2 - 1, 3);
+    writer.write(16 - 1, 5);
+    writer.write((uint32_t)(_encodedFrameCount >> 32), 4);
+    writer.write((uint32_t)_encodedFrameCount, 32);
+
+    //The MD5 signature of the audio is optional, and is left as zeroes to mark it as unknown.
+    for (NSUInteger i=0; i<16; i++)
+        writer.write(0, 8);
+
+    const std::vector<uint8_t> &bytes = writer.bytes();
+    return [NSData dataWithBytes: bytes.data() length: bytes.size()];
+}
+
+- (void) encodeSamples: (const int16_t *)samples
+                frames: (NSUInteger)numFrames
+              toBuffer: (NSMutableData *)output
+{
+    while (numFrames > 0)
+    {
+        NSUInteger chunkFrames = MIN(numFrames, BXFLACBlockSize - _bufferedFrames);
+        int32_t *left = _channels[0].data() + _bufferedFrames;
+        int32_t *right = _channels[1].data() + _bufferedFrames;
+        for (NSUInteger i=0; i<chunkFrames; i++)
+        {
+            left[i] = samples[i * 2];
+            right[i] = samples[i * 2 + 1];
+        }
+
+        _bufferedFrames += chunkFrames;
+        samples += chunkFrames * 2;
+        numFrames -= chunkFrames;
+
+        if (_bufferedFrames == BXFLACBlockSize)
+            [self _encodeBufferedFramesToBuffer: output];
+    }
+}
+
+- (void) flushToBuffer: (NSMutableData *)output
+{
+    if (_bufferedFrames)
+        [self _encodeBufferedFramesToBuffer: output];
+}
+
+- (void) _encodeBufferedFramesToBuffer: (NSMutableData *)output
+{
+    NSUInteger numSamples = _bufferedFrames;
+    int32_t *left = _channels[0].data(), *right = _channels[1].data();
+    int32_t *mid = _channels[2].data(), *side = _channels[3].data();
+    for (NSUInteger i=0; i<numSamples; i++)
+    {
+        mid[i] = (left[i] + right[i]) >> 1;
+        side[i] = left[i] - right[i];
+    }
+
+    //Plan every channel, then pick whichever pairing of them codes smallest.
+    //The side channel needs an extra bit to hold the difference between the channels.
+    int32_t *residuals = _residuals.data();
+    BXFLACSubframePlan leftPlan  = _planSubframe(left,  numSamples, 16, residuals, _sums);
+    BXFLACSubframePlan rightPlan = _planSubframe(right, numSamples, 16, residuals, _sums);
+    BXFLACSubframePlan midPlan   = _planSubframe(mid,   numSamples, 16, residuals, _sums);
+    BXFLACSubframePlan sidePlan  = _planSubframe(side,  numSamples, 17, residuals, _sums);
+
+    BXFLACChannelAssignment assignment = BXFLACChannelsIndependent;
+    uint64_t bestBits = leftPlan.bits + rightPlan.bits;
+    if (leftPlan.bits + sidePlan.bits < bestBits)
+    {
+        assignment = BXFLACChannelsLeftSide;
+        bestBits = leftPlan.bits + sidePlan.bits;
+    }
+    if (sidePlan.bits + rightPlan.bits < bestBits)
+    {
+        assignment = BXFLACChannelsSideRight;
+        bestBits = sidePlan.bits + rightPlan.bits;
+    }
+    if (midPlan.bits + sidePlan.bits < bestBits)
+    {
+        assignment = BXFLACChannelsMidSide;
+        bestBits = midPlan.bits + sidePlan.bits;
+    }
+
+    BOOL isFullBlock = (numSamples == BXFLACBlockSize);
+    unsigned sampleRateExtension;
+    unsigned sampleRateCode = _sampleRateCode(_sampleRate, &sampleRateExtension);
+
+    _writer.reset();
+
+    //Frame header: sync code, fixed-size blocks, then the block size, sample rate,
+    //channel assignment and 16-bit sample size codes, and the frame number.
+    _writer.write(0x3FFE, 14);
+    _writer.write(0, 1);
+    _writer.write(0, 1);
+    _writer.write(isFullBlock ? 0xC : 0x7, 4);
+    _writer.write(sampleRateCode, 4);
+    _writer.write(assignment, 4);
+    _writer.write(0x4, 3);
+    _writer.write(0, 1);
+    _writeUTF8Number(_writer, _frameNumber);
+    if (!isFullBlock)
+        _writer.write((uint32_t)(numSamples - 1), 16);
+    if (sampleRateCode == 0xD || sampleRateCode == 0xE)
+        _writer.write(sampleRateExtension, 16);
+    _writer.write(_CRC8(_writer.bytes().data(), _writer.bytes().size()), 8);
+
+    switch (assignment)
+    {
+        case BXFLACChannelsIndependent:
+            _writeSubframe(_writer, left, numSamples, 16, leftPlan, residuals);
+            _writeSubframe(_writer, right, numSamples, 16, rightPlan, residuals);
+            break;
+        case BXFLACChannelsLeftSide:
+            _writeSubframe(_writer, left, numSamples, 16, leftPlan, residuals);
+            _writeSubframe(_writer, side, numSamples, 17, sidePlan, residuals);
+            break;
+        case BXFLACChannelsSideRight:
+            _writeSubframe(_writer, side, numSamples, 17, sidePlan, residuals);
+            _writeSubframe(_writer, right, numSamples, 16, rightPlan, residuals);
+            break;
+        case BXFLACChannelsMidSide:
+            _writeSubframe(_writer, mid, numSamples, 16, midPlan, residuals);
+            _writeSubframe(_writer, side, numSamples, 17, sidePlan, residuals);
+            break;
+    }
+
+    _writer.alignToByte();
+    _writer.write(_CRC16(_writer.bytes().data(), _writer.bytes().size()), 16);
+
+    const std::vector<uint8_t> &bytes = _writer.bytes();
+    [output appendBytes: bytes.data() length: bytes.size()];
+
+    _minFrameLength = (_frameNumber == 0) ? bytes.size() : MIN(_minFrameLength, bytes.size());
+    _maxFrameLength = MAX(_maxFrameLength, bytes.size());
+    _encodedFrameCount += numSamples;
+    _frameNumber++;
+    _bufferedFrames = 0;
+}
+
+@end
@@ -11,6 +11,28 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+#pragma mark -
+#pragma mark Constants
+
+/// A single standard MIDI message, as batched up by BXEmulator and passed to @c handleEvents:count:.
+/// This is plain data so that messages can be queued and delivered without allocating anything.
+typedef struct BXMIDIEvent {
+    /// The emulated time at which the message was sent, in seconds since emulation began,
+    /// or a negative value if the message should be played as soon as it arrives.
+    NSTimeInterval emulatedTime;
+    
+    /// The length of the message in bytes, from 1 to 3.
+    UInt8 length;
+    
+    /// The message itself. Only the first @c length bytes are meaningful.
+    UInt8 bytes[3];
+} BXMIDIEvent;
+
+/// The number of standard MIDI messages that BXEmulator will batch up before it delivers them:
+/// so the most events a device will be passed in one call to @c handleEvents:count:.
+#define BXMIDIEventBatchCapacity 256
+
+
 #pragma mark -
 #pragma mark Protocol declaration
 
@@ -63,6 +85,22 @@ NS_ASSUME_NONNULL_BEGIN
 /// in an unusable state.
 - (void) close;
 
+@optional
+
+/// Handle a MIDI message or sysex that the emulated program sent at the specified point in
+/// emulated time, measured in seconds since emulation began. Devices that implement these
+/// should play each message at the corresponding frame of their output, rather than at the
+/// start of whichever block of audio they happen to render next. Messages will always be
+/// sent in order of emulated time.
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime;
+- (void) handleSysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime;
+
+/// Handle a batch of standard MIDI messages, in the order they were sent.
+/// BXEmulator prefers this to @c handleMessage: where it is available, since it lets messages
+/// reach the device without being wrapped in NSData objects. Devices should honour each event's
+/// emulated time as they would for @c handleMessage:atEmulatedTime:, if they support timing at all.
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count;
+
 @end
 
 NS_ASSUME_NONNULL_END
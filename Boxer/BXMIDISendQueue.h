@@ -0,0 +1,69 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The default limit on how far behind a send queue may fall before it applies back-pressure, in seconds.
+#define BXMIDISendQueueDefaultMaxBacklog 2.0
+
+/// Called on the queue's thread to deliver data to the device.
+typedef void(^BXMIDISendHandler)(const UInt8 *bytes, NSUInteger length);
+
+
+/// @brief BXMIDISendQueue paces outgoing MIDI data to a device that needs time to process each send,
+/// such as a real MT-32 digesting a sysex.
+///
+/// @discussion Data is delivered in order on a dedicated thread. After each send, the queue waits out
+/// that send's processing delay before delivering anything else. This lets the emulation thread carry
+/// on while a long run of sysexes trickles out to the device. Callers only have to wait once the
+/// queue has fallen further behind than @c maxBacklog: see @c isOverLimit and @c dateWhenBelowLimit.
+///
+/// This class is thread-safe.
+@interface BXMIDISendQueue : NSObject
+
+/// The longest the queue may take to catch up with what has been sent to it before @c isOverLimit
+/// returns @c YES. Defaults to @c BXMIDISendQueueDefaultMaxBacklog.
+@property (assign) NSTimeInterval maxBacklog;
+
+/// Whether the queue has fallen more than @c maxBacklog behind.
+@property (readonly, getter=isOverLimit) BOOL overLimit;
+
+/// When the queue will next be within @c maxBacklog, or the distant past if it is now.
+@property (readonly, copy) NSDate *dateWhenBelowLimit;
+
+/// When the queue will have delivered everything it has been sent, and the device will have finished
+/// processing it. Returns the distant past if the queue is already idle.
+@property (readonly, copy) NSDate *dateWhenIdle;
+
+/// Whether there is nothing left to send and the device has finished processing what was last sent.
+@property (readonly, getter=isIdle) BOOL idle;
+
+/// Returns a queue that delivers data with the specified handler on a thread of its own.
+- (instancetype) initWithSendHandler: (BXMIDISendHandler)handler NS_DESIGNATED_INITIALIZER;
+- (instancetype) init NS_UNAVAILABLE;
+
+/// Queues a copy of the specified data to be delivered once everything queued before it has been
+/// delivered and processed. The queue will then wait for @c processingDelay seconds before
+/// delivering anything else.
+- (void) sendBytes: (const UInt8 *)bytes
+            length: (NSUInteger)length
+   processingDelay: (NSTimeInterval)processingDelay;
+
+/// Discards everything that is waiting to be delivered. Data that has already been delivered still
+/// holds up the queue for the rest of its processing delay.
+- (void) cancelPendingSends;
+
+/// Delivers everything remaining in the queue, then stops the queue's thread. Further sends are ignored.
+/// Call @c cancelPendingSends first to stop without delivering them: with nothing left to deliver,
+/// this returns straight away even if the device is still busy with an earlier send.
+- (void) close;
+
+@end
+
+NS_ASSUME_NONNULL_END
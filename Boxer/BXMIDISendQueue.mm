@@ -0,0 +1,205 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMIDISendQueue.h"
+
+#import <thread>
+#import <mutex>
+#import <condition_variable>
+#import <chrono>
+#import <deque>
+#import <vector>
+#import <pthread.h>
+
+
+#pragma mark -
+#pragma mark Private types
+
+typedef std::chrono::steady_clock BXMIDISendClock;
+
+typedef struct BXMIDISend {
+    std::vector<UInt8> bytes;
+    NSTimeInterval processingDelay;
+} BXMIDISend;
+
+
+#pragma mark -
+#pragma mark Private method declarations
+
+@interface BXMIDISendQueue ()
+
+//Runs on the queue's thread until the queue is closed.
+- (void) _deliverSends;
+
+//The point at which the queue will have caught up, relative to now. Must be called with the lock held.
+- (NSTimeInterval) _backlog;
+
+@end
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXMIDISendQueue
+{
+    BXMIDISendHandler _sendHandler;
+    
+    std::mutex _lock;
+    std::condition_variable _condition;
+    std::thread _thread;
+    
+    std::deque<BXMIDISend> _pendingSends;
+    //The sum of the processing delays of everything in _pendingSends.
+    NSTimeInterval _pendingDelay;
+    //When the device will be ready for the next send.
+    BXMIDISendClock::time_point _readyTime;
+    
+    BOOL _isClosing;
+}
+
+- (instancetype) initWithSendHandler: (BXMIDISendHandler)handler
+{
+    self = [super init];
+    if (self)
+    {
+        _sendHandler = [handler copy];
+        _maxBacklog = BXMIDISendQueueDefaultMaxBacklog;
+        _readyTime = BXMIDISendClock::now();
+        
+        //The thread must not retain us, or we would never be deallocated and so never closed.
+        __unsafe_unretained BXMIDISendQueue *queue = self;
+        _thread = std::thread([queue] {
+            pthread_setname_np("Boxer MIDI send queue");
+            //Deliver sends as close to their due time as we can manage.
+            pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+            
+            @autoreleasepool {
+                [queue _deliverSends];
+            }
+        });
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self close];
+}
+
+- (void) close
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _isClosing = YES;
+    }
+    _condition.notify_all();
+    
+    if (_thread.joinable())
+        _thread.join();
+}
+
+- (void) sendBytes: (const UInt8 *)bytes
+            length: (NSUInteger)length
+   processingDelay: (NSTimeInterval)processingDelay
+{
+    if (!length) return;
+    
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_isClosing) return;
+        
+        BXMIDISend send;
+        send.bytes.assign(bytes, bytes + length);
+        send.processingDelay = MAX(0.0, processingDelay);
+        
+        _pendingDelay += send.processingDelay;
+        _pendingSends.push_back(std::move(send));
+    }
+    _condition.notify_one();
+}
+
+- (void) cancelPendingSends
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pendingSends.clear();
+        _pendingDelay = 0;
+    }
+    //Wake the thread if it was waiting to deliver what we just dropped, so that closing doesn't wait on it.
+    _condition.notify_all();
+}
+
+- (void) _deliverSends
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    while (YES)
+    {
+        //Sleep until there's something to send and the device is ready for it.
+        _condition.wait(lock, [self] { return _isClosing || !_pendingSends.empty(); });
+        if (_pendingSends.empty())
+            break;
+        
+        if (BXMIDISendClock::now() < _readyTime)
+        {
+            //Wait for the device to be ready, unless everything waiting for it gets cancelled first:
+            //then there's nothing left to wait for, and a closing queue can finish straight away.
+            _condition.wait_until(lock, _readyTime, [self] { return _pendingSends.empty(); });
+            continue;
+        }
+        
+        BXMIDISend send = std::move(_pendingSends.front());
+        _pendingSends.pop_front();
+        _pendingDelay = MAX(0.0, _pendingDelay - send.processingDelay);
+        
+        //Mark the device as busy from the moment we send, so that the processing delay counts from then.
+        BXMIDISendClock::time_point sendTime = BXMIDISendClock::now();
+        _readyTime = sendTime + std::chrono::duration_cast<BXMIDISendClock::duration>(std::chrono::duration<double>(send.processingDelay));
+        
+        //Don't hold up the emulation thread while the device is being sent to.
+        lock.unlock();
+        _sendHandler(send.bytes.data(), send.bytes.size());
+        lock.lock();
+    }
+}
+
+- (NSTimeInterval) _backlog
+{
+    BXMIDISendClock::time_point now = BXMIDISendClock::now();
+    NSTimeInterval timeUntilReady = 0;
+    if (_readyTime > now)
+        timeUntilReady = std::chrono::duration<double>(_readyTime - now).count();
+    
+    return timeUntilReady + _pendingDelay;
+}
+
+- (BOOL) isIdle
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _pendingSends.empty() && self._backlog <= 0;
+}
+
+- (NSDate *) dateWhenIdle
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    NSTimeInterval backlog = self._backlog;
+    return (backlog > 0) ? [NSDate dateWithTimeIntervalSinceNow: backlog] : [NSDate distantPast];
+}
+
+- (BOOL) isOverLimit
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return self._backlog > self.maxBacklog;
+}
+
+- (NSDate *) dateWhenBelowLimit
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    NSTimeInterval excess = self._backlog - self.maxBacklog;
+    return (excess > 0) ? [NSDate dateWithTimeIntervalSinceNow: excess] : [NSDate distantPast];
+}
+
+@end
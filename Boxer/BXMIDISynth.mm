@@ -0,0 +1,532 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMIDISynth.h"
+#import "BXSPSCRing.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+//How far ahead of the synth's current render position timestamped events are scheduled.
+//This must cover the gap between DOSBox's mixer ticks, or events will arrive too late to place.
+#define BXMIDISynthSchedulingLatency 0.020
+
+//If a timestamped event would land further than this ahead of where it should, relative to the
+//synth's render position, then emulated time has drifted from real time (because emulation
+//was paused, throttled or fast-forwarded) and we re-anchor the two timelines.
+#define BXMIDISynthMaxSchedulingDrift 0.050
+
+#define BXMIDISynthEventRingCapacity 4096
+
+/// A MIDI event waiting to be delivered to the synth unit at a specific render sample time.
+/// Sysex data is owned by the event and handed back to the producer once delivered.
+typedef struct {
+    Float64 sampleTime;
+    UInt8 status;
+    UInt8 data1;
+    UInt8 data2;
+    UInt8 *sysexData;
+    UInt32 sysexLength;
+} BXMIDISynthEvent;
+
+
+#pragma mark -
+#pragma mark Private method declarations
+
+@interface BXMIDISynth ()
+
+@property (readwrite, copy, nonatomic) NSURL *soundFontURL;
+
+- (BOOL) _prepareAudioGraphWithError: (NSError **)outError;
+
+/// Queues the specified event for delivery at the render sample time corresponding to emulatedTime.
+/// Returns NO if the event could not be queued, in which case it should be delivered immediately.
+- (BOOL) _scheduleEvent: (BXMIDISynthEvent)event atEmulatedTime: (NSTimeInterval)emulatedTime;
+
+/// Frees the sysex buffers of events that the render thread has finished with.
+- (void) _freeRetiredSysex;
+
+/// Discards all pending events, freeing their sysex data. Must only be called
+/// once the render notification has been removed.
+- (void) _discardPendingEvents;
+
+@end
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXMIDISynth
+{
+	AUGraph _graph;
+	AudioUnit _synthUnit;
+	AudioUnit _outputUnit;
+    
+    //Timestamped events on their way from the emulation thread to the render thread,
+    //and delivered sysex buffers on their way back again to be freed.
+    BXSPSCRing<BXMIDISynthEvent> *_eventRing;
+    BXSPSCRing<UInt8 *> *_retiredSysexRing;
+    BOOL _hasRenderNotify;
+    
+    //The synth unit's sample rate and the start of the render cycle it is currently in.
+    //The latter is written by the render thread and read by the emulation thread.
+    Float64 _renderSampleRate;
+    std::atomic<Float64> _renderSampleTime;
+    
+    //The emulated time and render sample time that we have matched up, from which we place
+    //subsequent timestamped events. Only accessed on the emulation thread.
+    NSTimeInterval _anchorEmulatedTime;
+    Float64 _anchorSampleTime;
+    BOOL _hasAnchor;
+}
+
+//Called on the render thread before each render cycle of the synth unit, to deliver any
+//queued events that fall within that cycle at their proper offsets.
+static OSStatus _BXMIDISynthRenderNotify(void *inRefCon,
+                                         AudioUnitRenderActionFlags *ioActionFlags,
+                                         const AudioTimeStamp *inTimeStamp,
+                                         UInt32 inBusNumber,
+                                         UInt32 inNumberFrames,
+                                         AudioBufferList *ioData)
+{
+    if (!(*ioActionFlags & kAudioUnitRenderAction_PreRender) || !(inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid))
+        return noErr;
+    
+    __unsafe_unretained BXMIDISynth *synth = (__bridge BXMIDISynth *)inRefCon;
+    
+    Float64 cycleStart = inTimeStamp->mSampleTime;
+    Float64 cycleEnd = cycleStart + inNumberFrames;
+    synth->_renderSampleTime.store(cycleStart, std::memory_order_relaxed);
+    
+    const BXMIDISynthEvent *event;
+    while ((event = synth->_eventRing->peek()) != NULL && event->sampleTime < cycleEnd)
+    {
+        if (event->sysexData)
+        {
+            //Sysex can't be offset within a render cycle, so it takes effect from the start of this one.
+            MusicDeviceSysEx(synth->_synthUnit, event->sysexData, event->sysexLength);
+            
+            //Hand the buffer back to the emulation thread to free, since freeing memory
+            //on the render thread could block it. If the return ring is somehow full,
+            //leaking the buffer is the lesser evil.
+            synth->_retiredSysexRing->push(event->sysexData);
+        }
+        else
+        {
+            //Events that arrived too late for their intended cycle are played at the start of this one.
+            UInt32 offset = (UInt32)MAX(0.0, event->sampleTime - cycleStart);
+            MusicDeviceMIDIEvent(synth->_synthUnit, event->status, event->data1, event->data2, offset);
+        }
+        
+        BXMIDISynthEvent playedEvent;
+        synth->_eventRing->pop(playedEvent);
+    }
+    return noErr;
+}
+
+#pragma mark -
+#pragma mark Initialization and cleanup
+
+- (id <BXMIDIDevice>) initWithError: (NSError **)outError
+{
+    if ((self = [self init]))
+    {
+        _eventRing = new BXSPSCRing<BXMIDISynthEvent>(BXMIDISynthEventRingCapacity);
+        _retiredSysexRing = new BXSPSCRing<UInt8 *>(BXMIDISynthEventRingCapacity);
+        
+        if ([self _prepareAudioGraphWithError: outError])
+        {
+            self.soundFontURL = [self.class defaultSoundFontURL];
+        }
+        else
+        {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self close];
+    
+    if (_eventRing)
+    {
+        delete _eventRing;
+        _eventRing = NULL;
+    }
+    if (_retiredSysexRing)
+    {
+        delete _retiredSysexRing;
+        _retiredSysexRing = NULL;
+    }
+}
+
+- (void) close
+{
+    if (_hasRenderNotify)
+    {
+        AudioUnitRemoveRenderNotify(_synthUnit, _BXMIDISynthRenderNotify, (__bridge void *)self);
+        _hasRenderNotify = NO;
+    }
+    
+    [self _discardPendingEvents];
+    
+    if (_graph)
+    {
+        AUGraphStop(_graph);
+        DisposeAUGraph(_graph);
+    }
+    _graph = NULL;
+    _synthUnit = NULL;
+    _outputUnit = NULL;
+}
+
+
+- (BOOL) _prepareAudioGraphWithError: (NSError **)outError
+{
+    AudioComponentDescription outputDesc, synthDesc;
+    AUNode outputNode, synthNode;
+    
+    //OS X's default CoreAudio output
+    outputDesc.componentType = kAudioUnitType_Output;
+    outputDesc.componentSubType = kAudioUnitSubType_DefaultOutput;
+    outputDesc.componentManufacturer = kAudioUnitManufacturer_Apple;
+    outputDesc.componentFlags = 0;
+    outputDesc.componentFlagsMask = 0;
+    
+    //OS X's built-in MIDI synth
+    synthDesc.componentType = kAudioUnitType_MusicDevice;
+    synthDesc.componentSubType = kAudioUnitSubType_DLSSynth;
+    synthDesc.componentManufacturer = kAudioUnitManufacturer_Apple;
+    synthDesc.componentFlags = 0;
+    synthDesc.componentFlagsMask = 0;
+    
+    OSStatus errCode = noErr;
+    
+#define REQUIRE(result) if ((errCode = result) != noErr) break
+    
+    do {
+        REQUIRE(NewAUGraph(&_graph));
+        //Create nodes for our input synth and our output, and connect them together
+        REQUIRE(AUGraphAddNode(_graph, &outputDesc, &outputNode));
+        REQUIRE(AUGraphAddNode(_graph, &synthDesc, &synthNode));
+        REQUIRE(AUGraphConnectNodeInput(_graph, synthNode, 0, outputNode, 0));
+        
+        //Open and initialize the graph and its units
+        REQUIRE(AUGraphOpen(_graph));
+        REQUIRE(AUGraphInitialize(_graph));
+        
+        //Get proper references to the audio units for the synth.
+        REQUIRE(AUGraphNodeInfo(_graph, synthNode, NULL, &_synthUnit));
+        REQUIRE(AUGraphNodeInfo(_graph, outputNode, NULL, &_outputUnit));
+        
+        //Listen for the start of each render cycle so we can place timestamped events within it.
+        AudioStreamBasicDescription synthFormat;
+        UInt32 formatSize = sizeof(synthFormat);
+        REQUIRE(AudioUnitGetProperty(_synthUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &synthFormat, &formatSize));
+        _renderSampleRate = synthFormat.mSampleRate;
+        _renderSampleTime.store(0, std::memory_order_relaxed);
+        
+        REQUIRE(AudioUnitAddRenderNotify(_synthUnit, _BXMIDISynthRenderNotify, (__bridge void *)self));
+        _hasRenderNotify = YES;
+        
+        //Finally start processing the graph.
+        //(Technically, we could move this to the first time we receive a MIDI message.)
+        REQUIRE(AUGraphStart(_graph));
+    }
+    while (NO);
+    
+    if (errCode != noErr)
+    {
+        //Clean up after ourselves if there was an error
+        if (_graph)
+        {
+            if (_hasRenderNotify)
+            {
+                AudioUnitRemoveRenderNotify(_synthUnit, _BXMIDISynthRenderNotify, (__bridge void *)self);
+                _hasRenderNotify = NO;
+            }
+            DisposeAUGraph(_graph);
+            _graph = NULL;
+            _synthUnit = NULL;
+            _outputUnit = NULL;
+        }
+        
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: NSOSStatusErrorDomain
+                                            code: errCode
+                                        userInfo: nil];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+
+#pragma mark -
+#pragma mark MIDI processing and status
+
+- (BOOL) supportsMT32Music          { return NO; }
+- (BOOL) supportsGeneralMIDIMusic   { return YES; }
+
+
+//The MIDI synth is *always* ready to party
+- (BOOL) isProcessing       { return NO; }
+- (NSDate *) dateWhenReady  { return [NSDate distantPast]; }
+
+- (void) handleMessage: (NSData *)message
+{
+    NSAssert(_synthUnit != NULL, @"handleMessage: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleMessage:");
+    
+    UInt8 *contents = (UInt8 *)message.bytes;
+    UInt8 status = contents[0];
+    UInt8 data1 = (message.length > 1) ? contents[1] : 0;
+    UInt8 data2 = (message.length > 2) ? contents[2] : 0;
+    
+    MusicDeviceMIDIEvent(_synthUnit, status, data1, data2, 0);
+}
+
+- (void) handleSysex: (NSData *)message
+{
+    NSAssert(_synthUnit != NULL, @"handleSysEx: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleSysex:");
+    
+    MusicDeviceSysEx(_synthUnit, (const UInt8 *)message.bytes, (UInt32)message.length);
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    NSAssert(_synthUnit != NULL, @"handleMessage:atEmulatedTime: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleMessage:atEmulatedTime:");
+    
+    UInt8 *contents = (UInt8 *)message.bytes;
+    BXMIDISynthEvent event = {
+        0,
+        contents[0],
+        (UInt8)((message.length > 1) ? contents[1] : 0),
+        (UInt8)((message.length > 2) ? contents[2] : 0),
+        NULL,
+        0
+    };
+    
+    if (![self _scheduleEvent: event atEmulatedTime: emulatedTime])
+        [self handleMessage: message];
+}
+
+- (void) handleSysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    NSAssert(_synthUnit != NULL, @"handleSysex:atEmulatedTime: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleSysex:atEmulatedTime:");
+    
+    //The render thread mustn't touch Objective-C objects, so give it its own copy of the data.
+    UInt8 *sysexData = (UInt8 *)malloc(message.length);
+    memcpy(sysexData, message.bytes, message.length);
+    
+    BXMIDISynthEvent event = { 0, 0, 0, 0, sysexData, (UInt32)message.length };
+    if (![self _scheduleEvent: event atEmulatedTime: emulatedTime])
+    {
+        free(sysexData);
+        [self handleSysex: message];
+    }
+}
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    NSAssert(_synthUnit != NULL, @"handleEvents:count: called before successful initialization.");
+    
+    for (NSUInteger i=0; i<count; i++)
+    {
+        const BXMIDIEvent &event = events[i];
+        BXMIDISynthEvent synthEvent = {
+            0,
+            event.bytes[0],
+            (UInt8)((event.length > 1) ? event.bytes[1] : 0),
+            (UInt8)((event.length > 2) ? event.bytes[2] : 0),
+            NULL,
+            0
+        };
+        
+        if (event.emulatedTime < 0 || ![self _scheduleEvent: synthEvent atEmulatedTime: event.emulatedTime])
+            MusicDeviceMIDIEvent(_synthUnit, synthEvent.status, synthEvent.data1, synthEvent.data2, 0);
+    }
+}
+
+- (BOOL) _scheduleEvent: (BXMIDISynthEvent)event atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _freeRetiredSysex];
+    
+    if (!_hasRenderNotify || _renderSampleRate <= 0)
+        return NO;
+    
+    Float64 renderSampleTime = _renderSampleTime.load(std::memory_order_relaxed);
+    Float64 latency = BXMIDISynthSchedulingLatency * _renderSampleRate;
+    Float64 maxDrift = BXMIDISynthMaxSchedulingDrift * _renderSampleRate;
+    
+    Float64 sampleTime = _anchorSampleTime + (emulatedTime - _anchorEmulatedTime) * _renderSampleRate;
+    
+    //If the event would now arrive too late to be placed, or emulated time has run too far ahead
+    //of the synth's own clock, then start again from this event with our standard latency.
+    Float64 drift = sampleTime - (renderSampleTime + latency);
+    if (!_hasAnchor || drift < -latency || drift > maxDrift)
+    {
+        _anchorEmulatedTime = emulatedTime;
+        _anchorSampleTime = renderSampleTime + latency;
+        _hasAnchor = YES;
+        sampleTime = _anchorSampleTime;
+    }
+    
+    event.sampleTime = sampleTime;
+    return _eventRing->push(event);
+}
+
+- (void) _freeRetiredSysex
+{
+    UInt8 *sysexData;
+    while (_retiredSysexRing->pop(sysexData))
+        free(sysexData);
+}
+
+- (void) _discardPendingEvents
+{
+    if (!_eventRing) return;
+    
+    BXMIDISynthEvent event;
+    while (_eventRing->pop(event))
+    {
+        if (event.sysexData) free(event.sysexData);
+    }
+    [self _freeRetiredSysex];
+    _hasAnchor = NO;
+}
+
+- (void) pause
+{
+    NSAssert(_graph != NULL, @"pause called before successful initialization.");
+    AUGraphStop(_graph);
+}
+
+- (void) resume
+{
+    NSAssert(_graph != NULL, @"resume called before successful initialization.");
+    AUGraphStart(_graph);
+    
+    //The synth's render position has moved on independently of emulated time while we were paused.
+    _hasAnchor = NO;
+}
+
+- (void) setVolume: (float)volume
+{
+    NSAssert(_outputUnit != NULL, @"setVolume: called before successful initialization.");
+    AudioUnitSetParameter(_outputUnit, kHALOutputParam_Volume, kAudioUnitScope_Global, 0, volume, 0);
+}
+
+- (float) volume
+{
+    NSAssert(_outputUnit != NULL, @"volume called before successful initialization.");
+    
+    AudioUnitParameterValue volume;
+    OSStatus errCode = AudioUnitGetParameter(_outputUnit, kHALOutputParam_Volume, kAudioUnitScope_Global, 0, &volume);
+    return (errCode == noErr) ? volume : 0.0f;
+}
+
+
+#pragma mark -
+#pragma mark Soundfonts
+
++ (NSURL *) defaultSoundFontURL
+{
+    NSBundle *coreAudioBundle = [NSBundle bundleWithIdentifier: @"com.apple.audio.units.Components"];
+    NSURL *soundFontURL = [coreAudioBundle URLForResource: @"gs_instruments" withExtension: @"dls"];
+    
+    NSAssert(soundFontURL != nil, @"Default CoreAudio soundfont could not be found.");
+    return soundFontURL;
+}
+
+- (BOOL) loadSoundFontWithContentsOfURL: (NSURL *)URL
+                                  error: (NSError **)outError
+{
+    NSAssert(_synthUnit != NULL, @"loadSoundFontWithContentsOfURL:error: called before successful initialization.");
+    
+    //If we're clearing the soundfont, reset it back to the default system soundfont.
+    if (URL == nil)
+    {
+        URL = [self.class defaultSoundFontURL];
+        //Give up if the default soundfont could not be found.
+        if (URL == nil)
+        {
+            if (outError)
+            {
+                *outError = [NSError errorWithDomain: NSCocoaErrorDomain
+                                                code: NSFileReadNoSuchFileError
+                                            userInfo: nil];
+            }
+            return NO;
+        }
+    }
+    else
+    {
+        URL = URL.URLByStandardizingPath;
+        
+        //Check that the URL even exists before proceeding further.
+        BOOL resourceExists = [URL checkResourceIsReachableAndReturnError: outError];
+        if (!resourceExists) return NO;
+    }
+    
+    if (![URL isEqual: self.soundFontURL])
+    {
+        OSStatus errCode = noErr;
+        
+        CFURLRef cfURL = (__bridge CFURLRef)URL;
+        errCode = AudioUnitSetProperty(_synthUnit,
+                                       kMusicDeviceProperty_SoundBankURL,
+                                       kAudioUnitScope_Global,
+                                       0,
+                                       &cfURL,
+                                       sizeof(cfURL)
+                                       );
+        
+        if (errCode != noErr)
+        {
+            //If the soundfont cannot be loaded (e.g. incompatible file type)
+            //the synth unit may be left in an unusable state. So, reset it
+            //back to the previous soundfont we had, which may be the system soundfont.
+            CFURLRef previousURL = (__bridge CFURLRef)self.soundFontURL;
+            if (previousURL)
+            {
+                AudioUnitSetProperty(_synthUnit,
+                                     kMusicDeviceProperty_SoundBankURL,
+                                     kAudioUnitScope_Global,
+                                     0,
+                                     &previousURL,
+                                     sizeof(previousURL)
+                                     );
+            }
+            
+            if (outError)
+            {
+                NSDictionary *userInfo = @{NSURLErrorKey: URL};
+                *outError = [NSError errorWithDomain: NSOSStatusErrorDomain
+                                                code: errCode
+                                            userInfo: userInfo];
+            }
+            
+            return NO;
+        }
+        else
+        {
+            self.soundFontURL = URL;
+            return YES;
+        }
+    }
+    else return YES;
+}
+
+@end
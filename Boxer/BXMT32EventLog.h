@@ -0,0 +1,70 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// @brief BXMT32EventLogWriter records the MIDI events an emulated MT-32 played, each stamped with
+/// the output frame at which it took effect, so that the performance can be replayed offline.
+///
+/// @discussion Logs begin with the signature "BXMT32EV", then the format version and sample rate as
+/// little-endian UInt32s. Each event follows as a little-endian UInt64 output frame, UInt32 packed
+/// message and UInt32 sysex length, then the sysex data itself if the length is nonzero.
+///
+/// This class is not thread-safe: a log should only be written from one thread at a time.
+@interface BXMT32EventLogWriter : NSObject
+
+/// Creates the log at the specified URL, replacing any file already there, and writes its header.
+/// Returns @c nil and populates @c outError if the file could not be created.
+- (nullable instancetype) initWithURL: (NSURL *)URL
+                           sampleRate: (UInt32)sampleRate
+                                error: (out NSError **)outError NS_DESIGNATED_INITIALIZER;
+- (instancetype) init NS_UNAVAILABLE;
+
+/// The location of the log.
+@property (readonly, nonatomic) NSURL *URL;
+
+/// Appends a short message, packed in MT32Emu's format, that took effect at the specified output frame.
+- (void) writeMessage: (UInt32)packedMessage atFrame: (uint64_t)frame;
+
+/// Appends a sysex message that took effect at the specified output frame.
+- (void) writeSysex: (const UInt8 *)bytes length: (NSUInteger)length atFrame: (uint64_t)frame;
+
+/// Closes the log. Any further events are ignored. Called automatically on dealloc.
+- (void) close;
+
+@end
+
+
+/// Called with each event in a log, in the order they were written. @c sysex is @c NULL for short
+/// messages, and is only valid until the handler returns.
+typedef void (^BXMT32EventLogHandler)(uint64_t frame, UInt32 packedMessage, const UInt8 * _Nullable sysex, NSUInteger sysexLength);
+
+/// @brief BXMT32EventLogReader reads back a log written by @c BXMT32EventLogWriter.
+@interface BXMT32EventLogReader : NSObject
+
+/// Opens the log at the specified URL and checks its header. Returns @c nil and populates @c outError
+/// with a POSIX error if the file could not be opened, or with @c BXEmulatedMT32InvalidEventLog
+/// if it is not an event log of a version we understand.
+- (nullable instancetype) initWithURL: (NSURL *)URL error: (out NSError **)outError NS_DESIGNATED_INITIALIZER;
+- (instancetype) init NS_UNAVAILABLE;
+
+/// The location of the log.
+@property (readonly, nonatomic) NSURL *URL;
+
+/// The sample rate of the synth whose output the events' frames refer to.
+@property (readonly, nonatomic) UInt32 sampleRate;
+
+/// Reads every event remaining in the log, passing each to the handler in turn, and closes the log.
+/// Returns @c NO and populates @c outError with @c BXEmulatedMT32InvalidEventLog if the log ends
+/// partway through an event: any events before that will already have been handled.
+- (BOOL) readEventsWithHandler: (NS_NOESCAPE BXMT32EventLogHandler)handler error: (out NSError **)outError;
+
+@end
+
+NS_ASSUME_NONNULL_END
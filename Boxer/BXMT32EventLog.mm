@@ -0,0 +1,216 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMT32EventLog.h"
+#import "BXEmulatedMT32.h"
+
+#import <vector>
+#import <libkern/OSByteOrder.h>
+
+
+#pragma mark -
+#pragma mark Private constants
+
+#define BXMT32EventLogSignature "BXMT32EV"
+#define BXMT32EventLogSignatureLength 8
+#define BXMT32EventLogVersion 1
+
+
+@implementation BXMT32EventLogWriter
+{
+    FILE *_log;
+}
+
+- (instancetype) initWithURL: (NSURL *)URL
+                  sampleRate: (UInt32)sampleRate
+                       error: (out NSError **)outError
+{
+    self = [super init];
+    if (self)
+    {
+        _URL = [URL copy];
+        _log = fopen(URL.fileSystemRepresentation, "wb");
+        if (!_log)
+        {
+            if (outError)
+            {
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: URL }];
+            }
+            return nil;
+        }
+
+        UInt32 header[2] = {
+            OSSwapHostToLittleInt32(BXMT32EventLogVersion),
+            OSSwapHostToLittleInt32(sampleRate),
+        };
+        fwrite(BXMT32EventLogSignature, 1, BXMT32EventLogSignatureLength, _log);
+        fwrite(header, sizeof(header), 1, _log);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self close];
+}
+
+- (void) close
+{
+    if (_log)
+    {
+        fclose(_log);
+        _log = NULL;
+    }
+}
+
+- (void) _writeFrame: (uint64_t)frame packedMessage: (UInt32)packedMessage sysexLength: (UInt32)sysexLength
+{
+    UInt64 swappedFrame = OSSwapHostToLittleInt64(frame);
+    UInt32 fields[2] = {
+        OSSwapHostToLittleInt32(packedMessage),
+        OSSwapHostToLittleInt32(sysexLength),
+    };
+
+    fwrite(&swappedFrame, sizeof(swappedFrame), 1, _log);
+    fwrite(fields, sizeof(fields), 1, _log);
+}
+
+- (void) writeMessage: (UInt32)packedMessage atFrame: (uint64_t)frame
+{
+    if (!_log) return;
+
+    [self _writeFrame: frame packedMessage: packedMessage sysexLength: 0];
+}
+
+- (void) writeSysex: (const UInt8 *)bytes length: (NSUInteger)length atFrame: (uint64_t)frame
+{
+    if (!_log) return;
+
+    NSAssert(length > 0 && length <= UINT32_MAX, @"Invalid sysex length passed to writeSysex:length:atFrame: %lu", (unsigned long)length);
+
+    [self _writeFrame: frame packedMessage: 0 sysexLength: (UInt32)length];
+    fwrite(bytes, 1, length, _log);
+}
+
+@end
+
+
+@implementation BXMT32EventLogReader
+{
+    FILE *_log;
+}
+
+- (instancetype) initWithURL: (NSURL *)URL error: (out NSError **)outError
+{
+    self = [super init];
+    if (self)
+    {
+        _URL = [URL copy];
+        _log = fopen(URL.fileSystemRepresentation, "rb");
+        if (!_log)
+        {
+            if (outError)
+            {
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: URL }];
+            }
+            return nil;
+        }
+
+        //Check that this is an event log we understand before anyone goes reading events from it.
+        char signature[BXMT32EventLogSignatureLength];
+        UInt32 header[2];
+        BOOL isValidLog = (fread(signature, sizeof(signature), 1, _log) == 1 &&
+                           memcmp(signature, BXMT32EventLogSignature, sizeof(signature)) == 0 &&
+                           fread(header, sizeof(header), 1, _log) == 1 &&
+                           OSSwapLittleToHostInt32(header[0]) == BXMT32EventLogVersion);
+
+        if (!isValidLog)
+        {
+            if (outError)
+                *outError = [self _invalidLogError];
+            return nil;
+        }
+
+        _sampleRate = OSSwapLittleToHostInt32(header[1]);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_log)
+    {
+        fclose(_log);
+        _log = NULL;
+    }
+}
+
+- (NSError *) _invalidLogError
+{
+    return [NSError errorWithDomain: BXEmulatedMT32ErrorDomain
+                               code: BXEmulatedMT32InvalidEventLog
+                           userInfo: @{ NSURLErrorKey: self.URL }];
+}
+
+- (BOOL) readEventsWithHandler: (NS_NOESCAPE BXMT32EventLogHandler)handler error: (out NSError **)outError
+{
+    if (!_log)
+        return YES;
+
+    BOOL isTruncated = NO;
+    std::vector<UInt8> sysex;
+    while (YES)
+    {
+        UInt64 frame;
+        UInt32 fields[2];
+
+        //Running out of events exactly at the start of a record is the expected end of the log.
+        if (fread(&frame, sizeof(frame), 1, _log) != 1)
+            break;
+
+        if (fread(fields, sizeof(fields), 1, _log) != 1)
+        {
+            isTruncated = YES;
+            break;
+        }
+
+        frame = OSSwapLittleToHostInt64(frame);
+        UInt32 packedMessage = OSSwapLittleToHostInt32(fields[0]);
+        UInt32 sysexLength = OSSwapLittleToHostInt32(fields[1]);
+        if (sysexLength)
+        {
+            sysex.resize(sysexLength);
+            if (fread(sysex.data(), 1, sysexLength, _log) != sysexLength)
+            {
+                isTruncated = YES;
+                break;
+            }
+            handler(frame, 0, sysex.data(), sysexLength);
+        }
+        else
+        {
+            handler(frame, packedMessage, NULL, 0);
+        }
+    }
+
+    fclose(_log);
+    _log = NULL;
+
+    if (isTruncated)
+    {
+        if (outError)
+            *outError = [self _invalidLogError];
+        return NO;
+    }
+    return YES;
+}
+
+@end
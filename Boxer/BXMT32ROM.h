@@ -0,0 +1,53 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import <Foundation/Foundation.h>
+#import "BXEmulatedMT32.h"
+
+#ifdef __cplusplus
+    #import "MT32Emu/mt32emu.h"
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// @brief BXMT32ROM is a read-only memory mapping of an MT-32 ROM file, along with the MUNT ROM image
+/// made from it.
+///
+/// @discussion ROMs are cached process-wide: asking for the same file again, or for another copy of
+/// the same ROM elsewhere on disk, returns the existing instance for as long as something still holds
+/// a reference to it. Files are identified by their device, inode, size and modification date, and
+/// their contents by MUNT's SHA1 checksum of them.
+///
+/// The types of the ROMs that have been checked are cached separately and indefinitely, so that
+/// validating the same ROM again does not touch its contents.
+///
+/// This class is thread-safe.
+@interface BXMT32ROM : NSObject
+
+/// Returns a shared ROM for the file at the specified URL, mapping and validating it if it is not
+/// already in the cache. Returns @c nil and populates @c outError with a @c BXEmulatedMT32ErrorDomain
+/// error if the file is missing, could not be read or is not a ROM that MUNT recognises.
++ (nullable BXMT32ROM *) ROMAtURL: (NSURL *)URL error: (out NSError **)outError;
+
+/// Returns the type of the ROM at the specified URL, from the cache if that file has been checked
+/// before. Returns @c BXMT32ROMTypeUnknown and populates @c outError if the type could not be determined.
++ (BXMT32ROMType) typeOfROMAtURL: (NSURL *)URL error: (out NSError **)outError;
+
+/// The location of the file this ROM was first loaded from.
+@property (readonly, nonatomic) NSURL *URL;
+
+/// The type of ROM this is: PCM/Control, MT32/CM32L.
+@property (readonly, nonatomic) BXMT32ROMType type;
+
+#ifdef __cplusplus
+/// The MUNT ROM image for this ROM, which remains valid for as long as the ROM does.
+@property (readonly, nonatomic) const MT32Emu::ROMImage *ROMImage NS_RETURNS_INNER_POINTER;
+#endif
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,242 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMT32ROM.h"
+
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+#pragma mark -
+#pragma mark Private interface
+
+@interface BXMT32ROM ()
+
+@property (readwrite, copy, nonatomic) NSURL *URL;
+@property (readwrite, nonatomic) BXMT32ROMType type;
+
+//Returns a key that identifies the specified file on disk, which changes if the file is modified
+//or replaced. Returns nil if the file could not be found.
++ (nullable NSString *) _identityOfFileAtURL: (NSURL *)URL;
+
++ (NSError *) _errorWithCode: (NSInteger)code URL: (NSURL *)URL;
+
+@end
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXMT32ROM
+{
+    const void *_mappedData;
+    size_t _mappedSize;
+    MT32Emu::ArrayFile *_file;
+    const MT32Emu::ROMImage *_ROMImage;
+}
+
+//Live ROMs keyed by their SHA1 checksum. ROMs are dropped from here when the last synth lets go of them.
+static NSMapTable<NSString *, BXMT32ROM *> *_ROMsByChecksum;
+//The checksums of files we have mapped before, keyed by file identity.
+static NSMutableDictionary<NSString *, NSString *> *_checksumsByIdentity;
+//The ROM types of files we have checked before, keyed by file identity. Includes files that were not ROMs.
+static NSMutableDictionary<NSString *, NSNumber *> *_typesByIdentity;
+
++ (void) initialize
+{
+    if (self == [BXMT32ROM class])
+    {
+        _ROMsByChecksum = [NSMapTable strongToWeakObjectsMapTable];
+        _checksumsByIdentity = [[NSMutableDictionary alloc] init];
+        _typesByIdentity = [[NSMutableDictionary alloc] init];
+    }
+}
+
++ (NSString *) _identityOfFileAtURL: (NSURL *)URL
+{
+    struct stat info;
+    if (stat(URL.fileSystemRepresentation, &info) != 0)
+        return nil;
+    
+    return [NSString stringWithFormat: @"%llu:%llu:%lld:%ld.%ld",
+            (unsigned long long)info.st_dev,
+            (unsigned long long)info.st_ino,
+            (long long)info.st_size,
+            (long)info.st_mtimespec.tv_sec,
+            (long)info.st_mtimespec.tv_nsec];
+}
+
++ (NSError *) _errorWithCode: (NSInteger)code URL: (NSURL *)URL
+{
+    NSDictionary *userInfo = nil;
+    if (URL) userInfo = @{ NSURLErrorKey: URL };
+    return [NSError errorWithDomain: BXEmulatedMT32ErrorDomain
+                               code: code
+                           userInfo: userInfo];
+}
+
++ (BXMT32ROMType) typeOfROMAtURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSString *identity = [self _identityOfFileAtURL: URL];
+    if (identity)
+    {
+        NSNumber *cachedType;
+        @synchronized(self)
+        {
+            cachedType = _typesByIdentity[identity];
+        }
+        
+        if (cachedType)
+        {
+            BXMT32ROMType type = cachedType.unsignedIntegerValue;
+            if (type == BXMT32ROMTypeUnknown && outError)
+                *outError = [self _errorWithCode: BXEmulatedMT32InvalidROM URL: URL];
+            return type;
+        }
+    }
+    
+    //Otherwise, load the ROM to find out: this will record its type for next time.
+    BXMT32ROM *ROM = [self ROMAtURL: URL error: outError];
+    return (ROM) ? ROM.type : BXMT32ROMTypeUnknown;
+}
+
++ (BXMT32ROM *) ROMAtURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSString *identity = [self _identityOfFileAtURL: URL];
+    if (!identity)
+    {
+        if (outError)
+            *outError = [self _errorWithCode: BXEmulatedMT32MissingROM URL: URL];
+        return nil;
+    }
+    
+    //Hold the lock throughout, so that two synths starting at once don't both map the same file.
+    @synchronized(self)
+    {
+        NSString *checksum = _checksumsByIdentity[identity];
+        if (checksum)
+        {
+            BXMT32ROM *ROM = [_ROMsByChecksum objectForKey: checksum];
+            if (ROM)
+                return ROM;
+        }
+        
+        if ([_typesByIdentity[identity] isEqual: @(BXMT32ROMTypeUnknown)])
+        {
+            if (outError)
+                *outError = [self _errorWithCode: BXEmulatedMT32InvalidROM URL: URL];
+            return nil;
+        }
+        
+        NSError *loadError = nil;
+        BXMT32ROM *ROM = [[self alloc] initWithContentsOfURL: URL error: &loadError];
+        if (!ROM)
+        {
+            //Only remember files that we could read but weren't ROMs: other failures may be transient.
+            if (loadError.code == BXEmulatedMT32InvalidROM)
+                _typesByIdentity[identity] = @(BXMT32ROMTypeUnknown);
+            
+            if (outError)
+                *outError = loadError;
+            return nil;
+        }
+        
+        checksum = @((const char *)ROM->_file->getSHA1());
+        _checksumsByIdentity[identity] = checksum;
+        _typesByIdentity[identity] = @(ROM.type);
+        
+        //If we already have the same ROM from another file, share that instead.
+        BXMT32ROM *existingROM = [_ROMsByChecksum objectForKey: checksum];
+        if (existingROM)
+            return existingROM;
+        
+        [_ROMsByChecksum setObject: ROM forKey: checksum];
+        return ROM;
+    }
+}
+
+- (instancetype) initWithContentsOfURL: (NSURL *)URL error: (out NSError **)outError
+{
+    self = [self init];
+    if (self)
+    {
+        self.URL = URL;
+        
+        int fd = open(URL.fileSystemRepresentation, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            if (fd >= 0) close(fd);
+            if (outError)
+                *outError = [self.class _errorWithCode: BXEmulatedMT32CouldNotReadROM URL: URL];
+            return nil;
+        }
+        
+        _mappedSize = (size_t)info.st_size;
+        void *data = mmap(NULL, _mappedSize, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+        
+        //The mapping keeps its own reference to the file, so we can close our descriptor straight away.
+        close(fd);
+        
+        if (data == MAP_FAILED)
+        {
+            if (outError)
+                *outError = [self.class _errorWithCode: BXEmulatedMT32CouldNotReadROM URL: URL];
+            return nil;
+        }
+        
+        _mappedData = data;
+        _file = new MT32Emu::ArrayFile((const MT32Emu::Bit8u *)_mappedData, _mappedSize);
+        _ROMImage = MT32Emu::ROMImage::makeROMImage(_file);
+        
+        const MT32Emu::ROMInfo *info = _ROMImage->getROMInfo();
+        if (info == NULL)
+        {
+            if (outError)
+                *outError = [self.class _errorWithCode: BXEmulatedMT32InvalidROM URL: URL];
+            return nil;
+        }
+        
+        BOOL isControlROM = (info->type == MT32Emu::ROMInfo::Control);
+        BOOL isCM32L = (strstr(info->shortName, "cm32l") != NULL);
+        
+        BXMT32ROMType type = (isControlROM ? BXMT32ROMIsControl : BXMT32ROMIsPCM);
+        type |= (isCM32L ? BXMT32ROMIsCM32L : BXMT32ROMIsMT32);
+        self.type = type;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_ROMImage)
+    {
+        MT32Emu::ROMImage::freeROMImage(_ROMImage);
+        _ROMImage = NULL;
+    }
+    
+    if (_file)
+    {
+        delete _file;
+        _file = NULL;
+    }
+    
+    if (_mappedData)
+    {
+        munmap((void *)_mappedData, _mappedSize);
+        _mappedData = NULL;
+    }
+}
+
+- (const MT32Emu::ROMImage *) ROMImage
+{
+    return _ROMImage;
+}
+
+@end
@@ -0,0 +1,33 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXMT32RenderTool lets Boxer's own binary be run headlessly to render a captured MT-32 event log
+//to a WAV file as fast as possible, and report how long the synth took to do so. This is used
+//for profiling the MT-32 emulation away from the noise of a running emulation session:
+//
+//  Boxer --render-mt32 --control-rom <path> --pcm-rom <path> --events <log> --output <wav> [--block-frames <n>]
+//
+//Event logs are captured from a live session by setting the MT32EventLogPath user default
+//to the path to write to.
+
+//The C brace is needed when including this header from an Objective C++ file
+#if __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+
+/// Returns whether the specified command-line arguments ask for the render tool rather than the app.
+BOOL BXMT32RenderToolWasRequested(int argc, const char *argv[]);
+
+/// Runs the render tool with the specified command-line arguments, and returns the exit status.
+int BXMT32RenderToolMain(int argc, const char *argv[]);
+
+#if __cplusplus
+}
+#endif
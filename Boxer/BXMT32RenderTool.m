@@ -0,0 +1,102 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMT32RenderTool.h"
+#import "BXEmulatedMT32.h"
+#import <sysexits.h>
+
+
+#pragma mark -
+#pragma mark Private constants
+
+#define BXMT32RenderToolFlag "--render-mt32"
+#define BXMT32RenderToolDefaultBlockFrames 256
+
+
+#pragma mark -
+#pragma mark Implementation
+
+static void _printUsage(const char *toolName)
+{
+    fprintf(stderr, "Usage: %s " BXMT32RenderToolFlag " --control-rom <path> --pcm-rom <path> --events <log> --output <wav> [--block-frames <n>]\n", toolName);
+}
+
+BOOL BXMT32RenderToolWasRequested(int argc, const char *argv[])
+{
+    for (int i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i], BXMT32RenderToolFlag) == 0)
+            return YES;
+    }
+    return NO;
+}
+
+int BXMT32RenderToolMain(int argc, const char *argv[])
+{
+    @autoreleasepool {
+        NSURL *controlROMURL = nil, *PCMROMURL = nil, *logURL = nil, *outputURL = nil;
+        NSUInteger blockFrames = BXMT32RenderToolDefaultBlockFrames;
+        
+        for (int i=1; i<argc; i++)
+        {
+            const char *arg = argv[i];
+            if (strcmp(arg, BXMT32RenderToolFlag) == 0)
+                continue;
+            
+            //All our other options take a value.
+            if (i + 1 >= argc)
+            {
+                _printUsage(argv[0]);
+                return EX_USAGE;
+            }
+            
+            const char *value = argv[++i];
+            NSURL *valueURL = [NSURL fileURLWithPath: @(value)];
+            
+            if      (strcmp(arg, "--control-rom") == 0)     controlROMURL = valueURL;
+            else if (strcmp(arg, "--pcm-rom") == 0)         PCMROMURL = valueURL;
+            else if (strcmp(arg, "--events") == 0)          logURL = valueURL;
+            else if (strcmp(arg, "--output") == 0)          outputURL = valueURL;
+            else if (strcmp(arg, "--block-frames") == 0)    blockFrames = (NSUInteger)MAX(0, atoi(value));
+            else
+            {
+                _printUsage(argv[0]);
+                return EX_USAGE;
+            }
+        }
+        
+        if (!controlROMURL || !PCMROMURL || !logURL || !outputURL || !blockFrames)
+        {
+            _printUsage(argv[0]);
+            return EX_USAGE;
+        }
+        
+        NSError *error = nil;
+        BXEmulatedMT32 *synth = [[BXEmulatedMT32 alloc] initForOfflineRenderingWithPCMROM: PCMROMURL
+                                                                               controlROM: controlROMURL
+                                                                                    error: &error];
+        
+        BXMT32RenderStatistics *statistics = nil;
+        if (synth)
+        {
+            statistics = [synth renderEventLogAtURL: logURL
+                                     toWAVFileAtURL: outputURL
+                                        blockFrames: blockFrames
+                                              error: &error];
+            [synth close];
+        }
+        
+        if (!statistics)
+        {
+            fprintf(stderr, "%s\n", error.description.UTF8String);
+            return EXIT_FAILURE;
+        }
+        
+        printf("%s\n", statistics.description.UTF8String);
+        return EXIT_SUCCESS;
+    }
+}
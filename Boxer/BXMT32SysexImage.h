@@ -0,0 +1,50 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The most bytes of MT-32 memory that an image will keep track of. Writes to further addresses are ignored.
+#define BXMT32SysexImageMaxBytes 65536
+
+/// The most data bytes that will be put into a single sysex when replaying an image.
+#define BXMT32SysexImageMaxReplayLength 256
+
+
+/// @brief BXMT32SysexImage records the effect of a stream of MT-32 sysexes on the MT-32's memory,
+/// so that the same state can be recreated on another device with as few sysexes as possible.
+///
+/// @discussion Only the latest value written to each address is kept, and an All Parameters Reset
+/// discards everything written before it. The image therefore never grows larger than the parts
+/// of the MT-32's memory that were actually written, no matter how many sysexes are recorded.
+///
+/// When replayed, contiguous runs of addresses are combined into as few sysexes as possible.
+/// The memory areas are replayed in the order in which they depend on one another: the system
+/// area, then timbre and patch memory, then the temporary areas that refer to them, and lastly
+/// the display.
+@interface BXMT32SysexImage : NSObject
+
+/// Whether no sysexes have been recorded since the image was created or last cleared.
+@property (readonly, getter=isEmpty) BOOL empty;
+
+/// The number of bytes of MT-32 memory the image is tracking.
+@property (readonly) NSUInteger byteCount;
+
+/// Applies the specified sysex to the image. Returns @c YES if it was an MT-32 data set sysex, or
+/// @c NO if it was ignored: e.g. because it was a data request or was addressed to a model other than the MT-32.
+- (BOOL) recordSysex: (NSData *)sysex;
+
+/// Returns the sysexes that will bring a freshly-started MT-32 to the state recorded in the image.
+- (NSArray<NSData *> *) sysexesForReplay;
+
+/// Discards everything recorded so far.
+- (void) clear;
+
+@end
+
+NS_ASSUME_NONNULL_END
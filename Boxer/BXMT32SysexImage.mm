@@ -0,0 +1,206 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMT32SysexImage.h"
+#import "BXExternalMT32+BXMT32Sysexes.h"
+#import "BXMIDIConstants.h"
+
+#import <map>
+#import <bitset>
+#import <vector>
+#import <algorithm>
+#import <iterator>
+
+
+#pragma mark -
+#pragma mark Private constants
+
+//MT-32 addresses are three 7-bit bytes. We track memory in pages of 128 bytes, one per value of the last byte.
+#define BXMT32SysexImagePageSize 128
+
+#define BXMT32SysexAddressTimbreTemp 0x02
+#define BXMT32SysexAddressPatchTemp 0x03
+#define BXMT32SysexAddressRhythmSetupTemp 0x04
+
+//The order in which the base addresses of memory areas are replayed. Any others follow in address order.
+static const UInt8 BXMT32SysexImageReplayOrder[] = {
+    BXMT32SysexAddressSystemArea,
+    BXMT32SysexAddressTimbreMemory,
+    BXMT32SysexAddressPatchMemory,
+    BXMT32SysexAddressTimbreTemp,
+    BXMT32SysexAddressRhythmSetupTemp,
+    BXMT32SysexAddressPatchTemp,
+    BXMT32SysexAddressDisplay,
+};
+
+
+#pragma mark -
+#pragma mark Private types
+
+typedef struct {
+    UInt8 values[BXMT32SysexImagePageSize];
+    std::bitset<BXMT32SysexImagePageSize> written;
+} BXMT32SysexImagePage;
+
+//Converts between three-byte MT-32 addresses and a linear address in which consecutive bytes are adjacent.
+static inline uint32_t _linearAddress(const UInt8 *address)
+{
+    return ((address[0] & BXMIDIBitmask) << 14) | ((address[1] & BXMIDIBitmask) << 7) | (address[2] & BXMIDIBitmask);
+}
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXMT32SysexImage
+{
+    //Pages keyed by linear address divided by the page size.
+    std::map<uint32_t, BXMT32SysexImagePage> _pages;
+    NSUInteger _byteCount;
+    
+    //The most recent All Parameters Reset, which must be replayed before anything else.
+    NSData *_resetSysex;
+}
+
+- (BOOL) isEmpty
+{
+    return _pages.empty() && !_resetSysex;
+}
+
+- (NSUInteger) byteCount
+{
+    return _byteCount;
+}
+
+- (void) clear
+{
+    _pages.clear();
+    _byteCount = 0;
+    _resetSysex = nil;
+}
+
+- (BOOL) recordSysex: (NSData *)sysex
+{
+    BOOL isRequest;
+    if (![BXExternalMT32 isMT32Sysex: sysex matchingAddress: NULL isRequest: &isRequest] || isRequest)
+        return NO;
+    
+    const UInt8 *contents = (const UInt8 *)sysex.bytes;
+    
+    //isMT32Sysex: also lets through sysexes addressed to the D-50, which share the MT-32's layout.
+    //We replay the image with the MT-32's model ID, so we can only track sysexes that used it to begin with.
+    if (contents[3] != BXRolandSysexModelIDMT32)
+        return NO;
+    
+    const UInt8 *address = contents + BXRolandSysexHeaderLength;
+    
+    //A reset wipes everything that came before it.
+    if (address[0] == BXMT32SysexAddressReset)
+    {
+        [self clear];
+        _resetSysex = [sysex copy];
+        return YES;
+    }
+    
+    const UInt8 *data = address + BXRolandSysexAddressLength;
+    NSUInteger dataLength = sysex.length - BXRolandSysexSendMinLength;
+    uint32_t linearAddress = _linearAddress(address);
+    
+    for (NSUInteger i=0; i<dataLength; i++)
+    {
+        uint32_t byteAddress = linearAddress + (uint32_t)i;
+        uint32_t pageIndex = byteAddress / BXMT32SysexImagePageSize;
+        uint32_t offset = byteAddress % BXMT32SysexImagePageSize;
+        
+        auto page = _pages.find(pageIndex);
+        if (page == _pages.end())
+        {
+            //Stop tracking new areas of memory once we've reached our limit. Real MT-32 data
+            //comes nowhere near this: a program sending more than this is sending garbage.
+            if ((_pages.size() + 1) * BXMT32SysexImagePageSize > BXMT32SysexImageMaxBytes)
+                break;
+            
+            page = _pages.emplace(pageIndex, BXMT32SysexImagePage()).first;
+        }
+        
+        if (!page->second.written[offset])
+        {
+            page->second.written[offset] = true;
+            _byteCount++;
+        }
+        page->second.values[offset] = data[i] & BXMIDIBitmask;
+    }
+    
+    return YES;
+}
+
+- (NSArray<NSData *> *) sysexesForReplay
+{
+    NSMutableArray<NSData *> *sysexes = [NSMutableArray arrayWithCapacity: 8];
+    
+    if (_resetSysex)
+        [sysexes addObject: _resetSysex];
+    
+    //Work out which order to replay each base address in.
+    std::vector<UInt8> baseAddresses(std::begin(BXMT32SysexImageReplayOrder), std::end(BXMT32SysexImageReplayOrder));
+    for (UInt8 base=0; base<=BXMIDIBitmask; base++)
+    {
+        if (std::find(baseAddresses.begin(), baseAddresses.end(), base) == baseAddresses.end())
+            baseAddresses.push_back(base);
+    }
+    
+    NSMutableData *run = [NSMutableData dataWithCapacity: BXMT32SysexImageMaxReplayLength];
+    __block uint32_t runStart = 0;
+    
+    void (^flushRun)(void) = ^{
+        if (!run.length) return;
+        
+        UInt8 address[BXRolandSysexAddressLength] = {
+            (UInt8)((runStart >> 14) & BXMIDIBitmask),
+            (UInt8)((runStart >> 7) & BXMIDIBitmask),
+            (UInt8)(runStart & BXMIDIBitmask),
+        };
+        [sysexes addObject: [BXExternalMT32 sysexWithData: run forAddress: address]];
+        run.length = 0;
+    };
+    
+    for (UInt8 base : baseAddresses)
+    {
+        //Each base address covers 128 pages.
+        uint32_t firstPage = base * BXMT32SysexImagePageSize;
+        auto page = _pages.lower_bound(firstPage);
+        auto lastPage = _pages.lower_bound(firstPage + BXMT32SysexImagePageSize);
+        
+        for (; page != lastPage; ++page)
+        {
+            for (uint32_t offset=0; offset<BXMT32SysexImagePageSize; offset++)
+            {
+                if (!page->second.written[offset])
+                {
+                    flushRun();
+                    continue;
+                }
+                
+                uint32_t byteAddress = (page->first * BXMT32SysexImagePageSize) + offset;
+                
+                //Start a new sysex if this byte doesn't follow on from the last, or the current one is full.
+                if (run.length && (byteAddress != runStart + run.length || run.length >= BXMT32SysexImageMaxReplayLength))
+                    flushRun();
+                
+                if (!run.length)
+                    runStart = byteAddress;
+                
+                [run appendBytes: &page->second.values[offset] length: 1];
+            }
+        }
+        flushRun();
+    }
+    
+    return sysexes;
+}
+
+@end
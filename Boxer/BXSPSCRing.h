@@ -0,0 +1,126 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXSPSCRing is a fixed-capacity, lock-free ring buffer for handing plain-old-data values
+//from exactly one producer thread to exactly one consumer thread, without either side
+//ever blocking the other.
+
+#ifndef BXSPSCRing_h
+#define BXSPSCRing_h
+
+#ifdef __cplusplus
+
+#import <atomic>
+#import <vector>
+#import <algorithm>
+#import <type_traits>
+#import <string.h>
+
+/// @brief A fixed-capacity, lock-free ring buffer for handing plain-old-data values
+/// from exactly one producer thread to exactly one consumer thread.
+///
+/// @discussion Only the producer may call write() and push(), and only the consumer may call
+/// read(), pop() and peek(). readAvailable() and writeAvailable() may be called from either side,
+/// but are only exact from the side that would act on them. The capacity is rounded up to
+/// a power of two.
+template <typename T>
+class BXSPSCRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "BXSPSCRing can only hold trivially copyable values.");
+
+public:
+    explicit BXSPSCRing(size_t minimumCapacity)
+    {
+        size_t capacity = 1;
+        while (capacity < minimumCapacity) capacity <<= 1;
+
+        _storage.resize(capacity);
+        _mask = capacity - 1;
+        _readIndex.store(0, std::memory_order_relaxed);
+        _writeIndex.store(0, std::memory_order_relaxed);
+    }
+
+    BXSPSCRing(const BXSPSCRing &) = delete;
+    BXSPSCRing &operator=(const BXSPSCRing &) = delete;
+
+    size_t capacity() const { return _mask + 1; }
+
+    /// The number of values waiting to be read.
+    size_t readAvailable() const
+    {
+        return _writeIndex.load(std::memory_order_acquire) - _readIndex.load(std::memory_order_acquire);
+    }
+
+    /// The number of values that can be written before the ring is full.
+    size_t writeAvailable() const
+    {
+        return capacity() - readAvailable();
+    }
+
+    /// Copies as many of the specified values into the ring as will fit, and returns how many were copied.
+    size_t write(const T *values, size_t count)
+    {
+        size_t writeIndex = _writeIndex.load(std::memory_order_relaxed);
+        size_t readIndex = _readIndex.load(std::memory_order_acquire);
+
+        count = std::min(count, capacity() - (writeIndex - readIndex));
+        if (count)
+        {
+            size_t start = writeIndex & _mask;
+            size_t firstPart = std::min(count, capacity() - start);
+            memcpy(&_storage[start], values, firstPart * sizeof(T));
+            memcpy(&_storage[0], values + firstPart, (count - firstPart) * sizeof(T));
+
+            _writeIndex.store(writeIndex + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// Copies up to the specified number of values out of the ring, and returns how many were copied.
+    size_t read(T *values, size_t count)
+    {
+        size_t readIndex = _readIndex.load(std::memory_order_relaxed);
+        size_t writeIndex = _writeIndex.load(std::memory_order_acquire);
+
+        count = std::min(count, writeIndex - readIndex);
+        if (count)
+        {
+            size_t start = readIndex & _mask;
+            size_t firstPart = std::min(count, capacity() - start);
+            memcpy(values, &_storage[start], firstPart * sizeof(T));
+            memcpy(values + firstPart, &_storage[0], (count - firstPart) * sizeof(T));
+
+            _readIndex.store(readIndex + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    bool push(const T &value)   { return write(&value, 1) == 1; }
+    bool pop(T &value)          { return read(&value, 1) == 1; }
+
+    /// Returns the next value to be read without removing it from the ring, or NULL if the ring is empty.
+    /// The value remains valid until the consumer next calls read() or pop().
+    const T *peek() const
+    {
+        size_t readIndex = _readIndex.load(std::memory_order_relaxed);
+        if (_writeIndex.load(std::memory_order_acquire) == readIndex) return NULL;
+        return &_storage[readIndex & _mask];
+    }
+
+private:
+    std::vector<T> _storage;
+    size_t _mask;
+
+    //Kept on separate cache lines so that the producer and consumer don't contend for them.
+    alignas(64) std::atomic<size_t> _readIndex;
+    alignas(64) std::atomic<size_t> _writeIndex;
+};
+
+#endif
+
+#endif /* BXSPSCRing_h */
@@ -14,6 +14,7 @@
 
 #import "BXEmulatedMT32.h"
 #import "BXMIDISynth.h"
+#import "BXSoundFontSynth.h"
 #import "BXExternalMIDIDevice.h"
 #import "BXExternalMT32.h"
 #import "BXDummyMIDIDevice.h"
@@ -148,6 +149,29 @@
         }
     }
     
+    //If a custom soundfont has been specified, try to play it with our own synth, which renders into
+    //the emulator's mixer. If it's not a soundfont we can handle, the OS X MIDI synth can have a go.
+    NSString *soundfontPath = [[NSUserDefaults standardUserDefaults] objectForKey: @"MIDISoundFontPath"];
+    if (soundfontPath.length > 0)
+    {
+        NSURL *soundfontURL = [NSURL fileURLWithPath: soundfontPath];
+        BXSoundFontSynth *activeSynth = (BXSoundFontSynth *)self.emulator.activeMIDIDevice;
+        if ([activeSynth isKindOfClass: [BXSoundFontSynth class]] && [activeSynth.soundFontURL isEqual: soundfontURL])
+            return activeSynth;
+        
+        NSError *loadError = nil;
+        BXSoundFontSynth *soundFontSynth = [[BXSoundFontSynth alloc] initWithSoundFontAtURL: soundfontURL error: &loadError];
+        if (soundFontSynth)
+        {
+            NSLog(@"Playing soundfont with in-mixer synth: %@", soundfontPath);
+            return soundFontSynth;
+        }
+        else
+        {
+            NSLog(@"Could not play soundfont with in-mixer synth, falling back on OS X synth: %@", loadError);
+        }
+    }
+    
     //If we got this far, we haven't found a more suitable MIDI device:
     //fall back on the good old reliable OS X MIDI synth.
     //Reuse the emulator's existing one if available, otherwise create
@@ -163,7 +187,6 @@
     }
     
     //If a custom soundfont has been specified for the MIDI synth, load that now also.
-    NSString *soundfontPath = [[NSUserDefaults standardUserDefaults] objectForKey: @"MIDISoundFontPath"];
     if (soundfontPath.length > 0)
     {
         NSError *loadError = nil;
@@ -2234,6 +2234,14 @@ static NSArray<NSURL*>* removeUserDirs(NSArray<NSURL*>* oldArrs)
         descriptiveSuffix = @" LPT output";
         extension = @"txt";
     }
+    else if ([typeDescription isEqualToString: @"MIDI Audio Recording"]) //The MIDI track of an audio recording
+    {
+        descriptiveSuffix = @" MIDI";
+    }
+    else if ([typeDescription isEqualToString: @"Frame Timeline"]) //Frame timings exported as a Chrome trace
+    {
+        descriptiveSuffix = @" frame timeline";
+    }
     
     //Work out an appropriate filename, based on the title of the session and the current date and time.
     NSValueTransformer *transformer = [NSValueTransformer valueTransformerForName: @"BXCaptureDateTransformer"];
@@ -54,9 +54,13 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 #pragma mark -
 #pragma mark Properties
 
-/// The number of frames to be skipped for each frame that is played
+/// The number of frames to be skipped for each frame that is played.
+/// When adaptiveFrameskip is enabled, this is the fewest frames that will be skipped.
 @property (assign, nonatomic) NSUInteger frameskip;
 
+/// Whether to skip more frames automatically whenever the host can't keep up with emulation.
+@property (assign, nonatomic, getter=isAdaptiveFrameskip) BOOL adaptiveFrameskip;
+
 /// The CPU speed, as a fixed cycles number or BXAutoSpeed (if autoSpeed is YES).
 @property (assign, nonatomic) NSInteger CPUSpeed;
 
@@ -126,6 +130,9 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 - (IBAction) incrementFrameSkip: (id)sender;
 - (IBAction) decrementFrameSkip: (id)sender;
 
+/// Turn adaptive frameskipping on or off.
+- (IBAction) toggleAdaptiveFrameskip: (id)sender;
+
 /// Increase/decrease the CPU speed by an appropriate increment,
 /// according to incrementAmountForSpeed:goingUp:
 - (IBAction) incrementSpeed: (id)sender;	
@@ -154,6 +161,21 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 /// Save a screenshot to the desktop.
 - (IBAction) saveScreenshot: (id)sender;
 
+/// Start recording the session's video to a new AVI file in the recordings folder,
+/// or finish the current recording if one is already in progress.
+- (IBAction) toggleRecordingVideo: (id)sender;
+
+/// Whether the session's video is currently being recorded.
+@property (readonly, getter=isRecordingVideo) BOOL recordingVideo;
+
+/// Start recording the MIDI synth's output to a new file in the recordings folder, or finish
+/// the current recording if one is already in progress. Recordings are made in the format chosen
+/// by the audioRecordingFormat user default.
+- (IBAction) toggleRecordingAudio: (id)sender;
+
+/// Whether the session's audio is currently being recorded.
+@property (readonly, getter=isRecordingAudio) BOOL recordingAudio;
+
 
 /// Cycle forward/backward through all drive queues.
 - (IBAction) mountNextDrivesInQueues: (id)sender;
@@ -12,6 +12,9 @@
 #import "BXValueTransformers.h"
 #import "BXBaseAppController+BXSupportFiles.h"
 #import "BXVideoHandler.h"
+#import "BXFrameskipGovernor.h"
+#import "BXVideoRecorder.h"
+#import "BXAudioRecorder.h"
 #import "BXDOSWindow.h"
 #import "BXCloseAlert.h"
 #import "BXGamebox.h"
@@ -182,6 +185,39 @@
 	return YES;
 }
 
+- (BOOL) isAdaptiveFrameskip
+{
+    return (self.emulator.videoHandler.frameskipGovernor != nil);
+}
+
+- (void) setAdaptiveFrameskip: (BOOL)adaptive
+{
+    BXVideoHandler *videoHandler = self.emulator.videoHandler;
+    if (adaptive != self.isAdaptiveFrameskip)
+    {
+        [self willChangeValueForKey: @"frameskip"];
+        if (adaptive)
+        {
+            videoHandler.frameskipGovernor = [[BXFrameskipGovernor alloc] initWithMinimumFrameskip: videoHandler.frameskip
+                                                                                  maximumFrameskip: BXMaxFrameskip];
+        }
+        else
+        {
+            videoHandler.frameskipGovernor = nil;
+        }
+        [self didChangeValueForKey: @"frameskip"];
+    }
+    
+    [self.gameSettings setObject: @(adaptive) forKey: @"adaptiveFrameskip"];
+}
+
++ (NSSet *) keyPathsForValuesAffectingAdaptiveFrameskip { return [NSSet setWithObject: @"emulator.videoHandler.frameskipGovernor"]; }
+
+- (IBAction) toggleAdaptiveFrameskip: (id)sender
+{
+    self.adaptiveFrameskip = !self.isAdaptiveFrameskip;
+}
+
 - (IBAction) incrementFrameSkip: (id)sender
 {
 	NSNumber *newFrameskip = @(self.frameskip + 1);
@@ -440,8 +476,11 @@
 
 	if (theAction == @selector(incrementFrameSkip:))	return isShowingDOSView && !self.frameskipAtMaximum;
 	if (theAction == @selector(decrementFrameSkip:))	return isShowingDOSView && !self.frameskipAtMinimum;
+	if (theAction == @selector(toggleAdaptiveFrameskip:))   return isShowingDOSView;
     
 	if (theAction == @selector(saveScreenshot:))        return isShowingDOSView;
+	if (theAction == @selector(toggleRecordingVideo:))  return isShowingDOSView || self.isRecordingVideo;
+	if (theAction == @selector(toggleRecordingAudio:))  return self.isEmulating || self.isRecordingAudio;
     
 	if (theAction == @selector(revertShadowedChanges:)) return self.hasShadowedChanges;
 	if (theAction == @selector(mergeShadowedChanges:))  return self.hasShadowedChanges;
@@ -532,6 +571,21 @@
     {
         return isShowingDOSView;
     }
+    else if (theAction == @selector(toggleRecordingVideo:))
+    {
+        theItem.state = self.isRecordingVideo ? NSControlStateValueOn : NSControlStateValueOff;
+        return self.isEmulating && (isShowingDOSView || self.isRecordingVideo);
+    }
+    else if (theAction == @selector(toggleRecordingAudio:))
+    {
+        theItem.state = self.isRecordingAudio ? NSControlStateValueOn : NSControlStateValueOff;
+        return self.isEmulating || self.isRecordingAudio;
+    }
+    else if (theAction == @selector(toggleAdaptiveFrameskip:))
+    {
+        theItem.state = self.isAdaptiveFrameskip ? NSControlStateValueOn : NSControlStateValueOff;
+        return self.isEmulating && isShowingDOSView;
+    }
     //Menu item to switch to next disc in queue
     else if (theAction == @selector(mountNextDrivesInQueues:))
     {
@@ -724,16 +778,29 @@
 {
 	if (!self.isEmulating) return @"";
 	
+	//Describe the level the governor has actually chosen, rather than the minimum the user chose.
+	BXFrameskipGovernor *governor = self.emulator.videoHandler.frameskipGovernor;
+	NSUInteger frameskip = (governor) ? governor.frameskip : self.frameskip;
+	
 	NSString *format;
-	if (self.frameskip == 0)
-			format = NSLocalizedString(@"Playing every frame",		@"Descriptive text for 0 frameskipping");
-	else	format = NSLocalizedString(@"Playing 1 in %u frames",	@"Descriptive text for >0 frameskipping");
+	if (governor)
+	{
+		if (frameskip == 0)
+				format = NSLocalizedString(@"Playing every frame (adjusting automatically)",	@"Descriptive text for 0 frameskipping when frameskip is adaptive");
+		else	format = NSLocalizedString(@"Playing 1 in %u frames (adjusting automatically)",	@"Descriptive text for >0 frameskipping when frameskip is adaptive");
+	}
+	else
+	{
+		if (frameskip == 0)
+				format = NSLocalizedString(@"Playing every frame",		@"Descriptive text for 0 frameskipping");
+		else	format = NSLocalizedString(@"Playing 1 in %u frames",	@"Descriptive text for >0 frameskipping");
+	}
 	
-	return [NSString stringWithFormat: format, self.frameskip + 1];
+	return [NSString stringWithFormat: format, frameskip + 1];
 }
 
 + (NSSet *) keyPathsForValuesAffectingSpeedDescription		{ return [NSSet setWithObject: @"sliderSpeed"]; }
-+ (NSSet *) keyPathsForValuesAffectingFrameskipDescription	{ return [NSSet setWithObjects: @"emulating", @"frameskip", nil]; }
++ (NSSet *) keyPathsForValuesAffectingFrameskipDescription	{ return [NSSet setWithObjects: @"emulating", @"frameskip", @"emulator.videoHandler.frameskipGovernor.frameskip", nil]; }
 
 
 #pragma mark -
@@ -760,6 +827,128 @@
     }
 }
 
++ (NSSet *) keyPathsForValuesAffectingRecordingVideo
+{
+    return [NSSet setWithObject: @"emulator.videoRecorder"];
+}
+
+- (BOOL) isRecordingVideo
+{
+    return self.emulator.videoRecorder != nil;
+}
+
+- (IBAction) toggleRecordingVideo: (id)sender
+{
+    BXVideoRecorder *recorder = self.emulator.videoRecorder;
+    if (recorder)
+    {
+        //Detach the recorder first so that no more frames or samples reach it,
+        //then let it finish writing out in the background.
+        self.emulator.videoRecorder = nil;
+        [recorder finishWithCompletionHandler: ^(BOOL success, NSError *error) {
+            if (success)
+            {
+                [recorder.URL setResourceValue: @YES forKey: NSURLHasHiddenExtensionKey error: NULL];
+            }
+            else if (error)
+            {
+                [self presentError: error
+                    modalForWindow: self.windowForSheet
+                          delegate: nil
+                didPresentSelector: NULL
+                       contextInfo: NULL];
+            }
+        }];
+    }
+    else if (self.isEmulating)
+    {
+        NSURL *destinationURL = [self URLForCaptureOfType: @"Recording" fileExtension: @"avi"];
+        NSError *recordingError = nil;
+        recorder = [[BXVideoRecorder alloc] initWithURL: destinationURL
+                                              frameRate: self.emulator.videoHandler.refreshRate
+                                                  error: &recordingError];
+        if (recorder)
+        {
+            self.emulator.videoRecorder = recorder;
+        }
+        else if (recordingError)
+        {
+            [self presentError: recordingError
+                modalForWindow: self.windowForSheet
+                      delegate: nil
+            didPresentSelector: NULL
+                   contextInfo: NULL];
+        }
+    }
+}
+
++ (NSSet *) keyPathsForValuesAffectingRecordingAudio
+{
+    return [NSSet setWithObject: @"emulator.sourceAudioRecorders"];
+}
+
+- (BOOL) isRecordingAudio
+{
+    return self.emulator.sourceAudioRecorders.count > 0;
+}
+
+- (IBAction) toggleRecordingAudio: (id)sender
+{
+    //Only the MIDI synth's output can be recorded for now: our DOSBox doesn't hand us its final mix.
+    NSArray *recorders = self.emulator.sourceAudioRecorders.allValues;
+    if (recorders.count)
+    {
+        //Detach the recorders first so that no more samples reach them,
+        //then let them finish writing out in the background.
+        self.emulator.sourceAudioRecorders = nil;
+        for (BXAudioRecorder *recorder in recorders)
+        {
+            [recorder finishWithCompletionHandler: ^(BOOL success, NSError *error) {
+                if (success)
+                {
+                    //Don't leave behind empty files for sources that never played anything.
+                    if (recorder.recordedFrameCount == 0)
+                        [[NSFileManager defaultManager] removeItemAtURL: recorder.URL error: NULL];
+                    else
+                        [recorder.URL setResourceValue: @YES forKey: NSURLHasHiddenExtensionKey error: NULL];
+                }
+                else if (error)
+                {
+                    [self presentError: error
+                        modalForWindow: self.windowForSheet
+                              delegate: nil
+                    didPresentSelector: NULL
+                           contextInfo: NULL];
+                }
+            }];
+        }
+    }
+    else if (self.isEmulating)
+    {
+        BXAudioRecorderFormat format = [BXAudioRecorder preferredFormat];
+        NSString *extension = [BXAudioRecorder fileExtensionForFormat: format];
+        
+        //Record the MIDI synth even if none is attached yet, in case one gets attached while we're recording.
+        NSURL *MIDIURL = [self URLForCaptureOfType: @"MIDI Audio Recording" fileExtension: extension];
+        NSError *recordingError = nil;
+        BXAudioRecorder *MIDIRecorder = [[BXAudioRecorder alloc] initWithURL: MIDIURL
+                                                                      format: format
+                                                                       error: &recordingError];
+        if (MIDIRecorder)
+        {
+            self.emulator.sourceAudioRecorders = @{ BXMIDIAudioSourceName: MIDIRecorder };
+        }
+        else if (recordingError)
+        {
+            [self presentError: recordingError
+                modalForWindow: self.windowForSheet
+                      delegate: nil
+            didPresentSelector: NULL
+                   contextInfo: NULL];
+        }
+    }
+}
+
 
 #pragma mark -
 #pragma mark Filesystem and emulation operations
@@ -81,6 +81,7 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 @class BXDOSWindowController;
 @class BXPrintStatusPanelController;
 @class BXDocumentationPanelController;
+@protocol BXFrameSink;
 
 /// \c BXSession is an \c NSDocument subclass which encapsulates a single DOS emulation session.
 /// It manages an underlying \c BXEmulator (configuring, starting and stopping it), reads and writes
@@ -141,6 +142,8 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
     BXPrintStatusPanelController *_printStatusController;
     
     BXDocumentationPanelController *_documentationPanelController;
+    
+    id <BXFrameSink> _frameSink;
 }
 
 
@@ -158,6 +161,11 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 /// The documentation browser, displayed either as a panel or a popover.
 @property (retain, nonatomic) BXDocumentationPanelController *documentationPanelController;
 
+/// If set, every frame the emulator renders is passed to this sink on the emulation thread, and the session
+/// does not create a DOS window. At startup this is set to a headless sink if the headlessFrameOutputPath
+/// user default is set.
+@property (retain, nonatomic) id <BXFrameSink> frameSink;
+
 /// The gamebox for this session. BXSession retrieves bundled drives, configuration files and
 /// target program from this during emulator configuration.
 /// Will be \c nil if an executable file or folder was opened outside of a gamebox.
@@ -21,6 +21,11 @@
 #import "BXDocumentationPanelController.h"
 #import "BXEmulatorConfiguration.h"
 #import "BXCloseAlert.h"
+#import "BXVideoRecorder.h"
+#import "BXAudioRecorder.h"
+#import "BXHeadlessFrameSink.h"
+#import "BXFrameskipGovernor.h"
+#import "BXFrameTimeline.h"
 
 #import "BXEmulator+BXDOSFileSystem.h"
 #import "BXEmulator+BXShell.h"
@@ -126,6 +131,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 @synthesize DOSWindowController = _DOSWindowController;
 @synthesize printStatusController = _printStatusController;
 @synthesize documentationPanelController = _documentationPanelController;
+@synthesize frameSink = _frameSink;
 
 @synthesize gamebox = _gamebox;
 @synthesize emulator = _emulator;
@@ -221,6 +227,8 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		
 		self.importQueue = [[NSOperationQueue alloc] init];
 		self.scanQueue = [[NSOperationQueue alloc] init];
+        
+        self.frameSink = [BXHeadlessFrameSink sinkFromUserDefaults];
 	}
 	return self;
 }
@@ -262,6 +270,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     self.DOSWindowController = nil;
     self.printStatusController = nil;
     self.documentationPanelController = nil;
+    self.frameSink = nil;
     self.emulator = nil;
     self.gamebox = nil;
     self.gameProfile = nil;
@@ -527,6 +536,15 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     }
 }
 
+- (void) setFrameSink: (id <BXFrameSink>)frameSink
+{
+    if (frameSink != _frameSink)
+    {
+        _frameSink = frameSink;
+        self.emulator.frameSink = frameSink;
+    }
+}
+
 - (void) setEmulator: (BXEmulator *)newEmulator
 {
 	if (self.emulator != newEmulator)
@@ -546,6 +564,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		if (self.emulator)
 		{	
 			self.emulator.delegate = (id)self;
+            self.emulator.frameSink = self.frameSink;
 			
             [self.emulator bind: @"masterVolume"
                        toObject: [NSApp delegate]
@@ -571,6 +590,10 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 - (void) makeWindowControllers
 {
+    //Headless sessions send their frames to the sink instead, and have no window to show them in.
+    if (self.frameSink)
+        return;
+    
 	BXDOSWindowController *controller;
 	controller = [[BXDOSWindowControllerLion alloc] initWithWindowNibName: @"DOSWindow"];
 	
@@ -1193,12 +1216,34 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 	//Clear the final rendered frame
 	[self.DOSWindowController updateWithFrame: nil];
+    
+    if ([self.frameSink respondsToSelector: @selector(finishConsumingFrames)])
+        [self.frameSink finishConsumingFrames];
+    
+    [self _saveFrameTimeline];
 	
 	//Close the document once we're done, if desired
 	if ([self _shouldCloseOnEmulatorExit])
         [self close];
 }
 
+- (void) _saveFrameTimeline
+{
+    BXFrameTimeline *timeline = [BXFrameTimeline sharedTimeline];
+    if (!timeline.isEnabled || ![timeline sampleCountForStage: BXFrameStageFinished])
+        return;
+    
+    NSLog(@"Frame latency for %@:\n%@", self.displayName, timeline.latencySummary);
+    
+    NSURL *traceURL = [self URLForCaptureOfType: @"Frame Timeline" fileExtension: @"json"];
+    NSError *traceError = nil;
+    if (![timeline writeChromeTraceToURL: traceURL error: &traceError])
+        NSLog(@"Could not save frame timeline to %@: %@", traceURL.path, traceError);
+    
+    //Start afresh in case the session is restarted.
+    [timeline reset];
+}
+
 - (NSArray *) configurationURLsForEmulator: (BXEmulator *)emulator
 {
     NSMutableArray *configURLs = [[NSMutableArray alloc] initWithCapacity: 4];
@@ -1321,6 +1366,11 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	NSNumber *frameskip = [self.gameSettings objectForKey: @"frameskip"];
 	if (frameskip && [self validateValue: &frameskip forKey: @"frameskip" error: nil])
 		[self setValue: frameskip forKey: @"frameskip"];
+    
+    //This must come after the frameskip, which becomes the lowest level that adaptive frameskipping will use.
+    NSNumber *adaptiveFrameskip = [self.gameSettings objectForKey: @"adaptiveFrameskip"];
+    if (adaptiveFrameskip)
+        self.adaptiveFrameskip = adaptiveFrameskip.boolValue;
 	
 	
 	//After all preflight configuration has finished, go ahead and open whatever
@@ -1384,7 +1434,18 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 - (void) emulator: (BXEmulator *)theEmulator didFinishFrame: (BXVideoFrame *)frame
 {
-	[self.DOSWindowController updateWithFrame: frame];
+    //Any frame sink has already been given this frame on the emulation thread.
+    [self.DOSWindowController updateWithFrame: frame];
+    
+    //Let adaptive frameskipping know how well the rendering view is keeping up.
+    BXFrameskipGovernor *governor = theEmulator.videoHandler.frameskipGovernor;
+    id <BXFrameRenderingView> renderingView = self.DOSWindowController.renderingView;
+    if (governor && [renderingView respondsToSelector: @selector(presentationTime)])
+    {
+        [governor recordPresentedFrames: renderingView.presentedFrameCount
+                          skippedFrames: renderingView.skippedFrameCount
+                       presentationTime: renderingView.presentationTime];
+    }
 }
 
 - (NSSize) maxFrameSizeForEmulator: (BXEmulator *)theEmulator
@@ -2104,6 +2165,18 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 - (void) _cleanup
 {
+    //Finish off any recordings that were still in progress
+    if (self.emulator.videoRecorder)
+    {
+        [self.emulator.videoRecorder finishWithCompletionHandler: nil];
+        self.emulator.videoRecorder = nil;
+    }
+    
+    for (BXAudioRecorder *recorder in self.emulator.sourceAudioRecorders.allValues)
+        [recorder finishWithCompletionHandler: nil];
+    
+    self.emulator.sourceAudioRecorders = nil;
+    
 	//Delete the temporary folder, if one was created
 	if (self.temporaryFolderURL)
 	{
@@ -118,6 +118,10 @@ extern ADBUserNotificationType const BXGameImportedNotificationType NS_SWIFT_NAM
 /// Cleans up temporary files after the session is closed.
 - (void) _cleanup;
 
+/// Called once the emulator has finished. If the recordFrameTimeline user default is set, logs
+/// a summary of frame latencies and saves the recorded timings to the recordings folder as a Chrome trace.
+- (void) _saveFrameTimeline;
+
 
 /// Called if DOSBox encounters an unrecoverable error and throws an exception.
 - (void) _reportEmulatorException: (NSException *)exception;
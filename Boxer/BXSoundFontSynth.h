@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//BXSoundFontSynth is a General MIDI synth that plays SoundFont 2 banks itself, feeding its output
+//into DOSBox's mixer. Unlike BXMIDISynth, its output follows emulated time and is captured along
+//with the rest of the game's audio.
+
+#import <Foundation/Foundation.h>
+#import "BXMIDIDevice.h"
+#import "BXAudioSource.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+#pragma mark -
+#pragma mark Constants
+
+extern NSErrorDomain const BXSoundFontSynthErrorDomain;
+
+typedef NS_ERROR_ENUM(BXSoundFontSynthErrorDomain, BXSoundFontSynthErrors) {
+    BXSoundFontSynthCouldNotReadSoundFont,  //!< The soundfont file could not be opened.
+    BXSoundFontSynthInvalidSoundFont,       //!< The file was not a SoundFont 2 bank we could play.
+};
+
+/// The most voices a synth can play at once, regardless of its @c polyphony.
+#define BXSoundFontSynthMaxVoices 256
+
+
+#pragma mark -
+#pragma mark Interface declaration
+
+/// \c BXSoundFontSynth provides a General MIDI \c BXMIDIDevice that renders a SoundFont 2 bank
+/// directly into DOSBox's mixer.
+///
+/// The soundfont is mapped into memory rather than read in. Samples are converted to floating point
+/// the first time a program that uses them is selected, on the thread that sends MIDI messages, so
+/// that rendering never has to allocate. Voices come from a pool allocated up front: once all the
+/// voices allowed by @c polyphony are playing, new notes take over the quietest or oldest ones.
+///
+/// Messages are played at the frame of output corresponding to when they were sent in emulated time.
+/// Only the volume envelope is modelled: filters, LFOs and SoundFont modulators are not supported.
+@interface BXSoundFontSynth : NSObject <BXMIDIDevice, BXAudioSource>
+
+/// The soundfont the synth is playing.
+@property (readonly, copy, nonatomic) NSURL *soundFontURL;
+
+/// The rate at which the synth renders. Defaults to 44100Hz.
+@property (assign) unsigned int sampleRate;
+
+/// The most voices that can sound at once, up to @c BXSoundFontSynthMaxVoices. Defaults to 64.
+@property (assign, nonatomic) NSUInteger polyphony;
+
+/// The number of voices that were sounding at the end of the last block the synth rendered.
+@property (readonly) NSUInteger activeVoiceCount;
+
+/// Returns a synth ready to play the SoundFont 2 bank at the specified URL.
+/// Returns @c nil and populates @c outError if the soundfont could not be read or was not valid.
+- (nullable instancetype) initWithSoundFontAtURL: (NSURL *)URL error: (NSError **)outError;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,1310 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXSoundFontSynth.h"
+#import "BXMIDIConstants.h"
+#import "BXSPSCRing.h"
+
+#import <vector>
+#import <memory>
+#import <atomic>
+#import <cmath>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <simd/simd.h>
+#import <libkern/OSByteOrder.h>
+
+
+#pragma mark -
+#pragma mark Private constants
+
+NSString * const BXSoundFontSynthErrorDomain = @"BXSoundFontSynthErrorDomain";
+
+#define BXSoundFontSynthDefaultSampleRate 44100
+#define BXSoundFontSynthDefaultPolyphony 64
+
+//How many frames are rendered between updates to voice pitch and gain.
+//Must be a multiple of 8 for the vectorized mixing loop.
+#define BXSoundFontSynthBlockFrames 64
+
+#define BXSoundFontSynthEventRingCapacity 4096
+
+//The furthest into the next block of output a timestamped event can be placed, in seconds.
+#define BXSoundFontSynthMaxEventOffset 0.1
+
+//Voices are silenced once their envelope falls below this gain (-80dB).
+#define BXSoundFontSynthSilentGain 0.0001f
+
+//How fast voices cut off by another note in the same exclusive class are faded out.
+#define BXSoundFontSynthFastRelease 0.005
+
+//Extra frames of silence after each decoded sample, so that interpolation can read past the end.
+#define BXSoundFontSynthSampleGuardFrames 4
+
+#define BXSoundFontSynthDrumChannel 9
+#define BXSoundFontSynthDrumBank 128
+#define BXSoundFontSynthNumChannels 16
+
+
+//The SoundFont 2 generators we understand. See section 8.1.2 of the SoundFont 2.04 specification.
+enum {
+    BXSF2GenStartAddrsOffset            = 0,
+    BXSF2GenEndAddrsOffset              = 1,
+    BXSF2GenStartloopAddrsOffset        = 2,
+    BXSF2GenEndloopAddrsOffset          = 3,
+    BXSF2GenStartAddrsCoarseOffset      = 4,
+    BXSF2GenEndAddrsCoarseOffset        = 12,
+    BXSF2GenPan                         = 17,
+    BXSF2GenDelayVolEnv                 = 33,
+    BXSF2GenAttackVolEnv                = 34,
+    BXSF2GenHoldVolEnv                  = 35,
+    BXSF2GenDecayVolEnv                 = 36,
+    BXSF2GenSustainVolEnv               = 37,
+    BXSF2GenReleaseVolEnv               = 38,
+    BXSF2GenInstrument                  = 41,
+    BXSF2GenKeyRange                    = 43,
+    BXSF2GenVelRange                    = 44,
+    BXSF2GenStartloopAddrsCoarseOffset  = 45,
+    BXSF2GenInitialAttenuation          = 48,
+    BXSF2GenEndloopAddrsCoarseOffset    = 50,
+    BXSF2GenCoarseTune                  = 51,
+    BXSF2GenFineTune                    = 52,
+    BXSF2GenSampleID                    = 53,
+    BXSF2GenSampleModes                 = 54,
+    BXSF2GenScaleTuning                 = 56,
+    BXSF2GenExclusiveClass              = 57,
+    BXSF2GenOverridingRootKey           = 58,
+
+    BXSF2NumGenerators                  = 61,
+};
+
+//Sample modes
+enum {
+    BXSF2NoLoop             = 0,
+    BXSF2LoopContinuously   = 1,
+    BXSF2LoopUntilRelease   = 3,
+};
+
+//The sizes of the records in the pdta chunk.
+#define BXSF2PresetHeaderSize 38
+#define BXSF2BagSize 4
+#define BXSF2GeneratorSize 4
+#define BXSF2InstrumentHeaderSize 22
+#define BXSF2SampleHeaderSize 46
+
+
+#pragma mark -
+#pragma mark Private types
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t loopStart;
+    uint32_t loopEnd;
+    uint32_t sampleRate;
+    UInt8 originalPitch;
+    SInt8 pitchCorrection;
+} BXSF2Sample;
+
+//A key and velocity range of a preset, with the generators of its preset and instrument zones combined.
+//Offsets and loop points are relative to the start of the sample.
+typedef struct {
+    UInt8 loKey, hiKey, loVel, hiVel;
+    uint32_t sampleIndex;
+    uint32_t start, end, loopStart, loopEnd;
+    int rootKey;
+    int scaleTuning;
+    int tuneCents;
+    int loopMode;
+    int exclusiveClass;
+    float gain;
+    float pan;
+    float delay, attack, hold, decay, release;
+    float sustainLevel;
+} BXSF2Region;
+
+typedef struct {
+    UInt16 bank;
+    UInt16 program;
+    uint32_t firstRegion;
+    uint32_t numRegions;
+} BXSF2Preset;
+
+typedef NS_ENUM(UInt8, BXSoundFontEventType) {
+    BXSoundFontEventMessage,        //A standard MIDI message other than a program change.
+    BXSoundFontEventSelectPreset,   //A program change, resolved to one of our presets.
+    BXSoundFontEventReset,          //A General MIDI or GS reset sysex.
+};
+
+typedef struct {
+    uint64_t frame;
+    BXSoundFontEventType type;
+    UInt8 status;
+    UInt8 data1;
+    UInt8 data2;
+    SInt32 presetIndex;
+} BXSoundFontEvent;
+
+typedef NS_ENUM(UInt8, BXSoundFontEnvelopeStage) {
+    BXSoundFontEnvelopeDelay,
+    BXSoundFontEnvelopeAttack,
+    BXSoundFontEnvelopeHold,
+    BXSoundFontEnvelopeDecay,
+    BXSoundFontEnvelopeSustain,
+    BXSoundFontEnvelopeRelease,
+    BXSoundFontEnvelopeFinished,
+};
+
+typedef struct {
+    BOOL isActive;
+    BOOL isSustained;
+    UInt8 channel;
+    UInt8 key;
+    uint64_t startFrame;
+
+    const BXSF2Region *region;
+    const float *data;
+    double position;
+    double baseStep;
+
+    BXSoundFontEnvelopeStage stage;
+    float envelopeLevel;
+    uint32_t stageFramesRemaining;
+    float attackIncrement;
+    float decayFactor;
+    float releaseFactor;
+
+    //The velocity and region gain, before channel volume and panning.
+    float noteGain;
+    float leftGain;
+    float rightGain;
+} BXSoundFontVoice;
+
+typedef struct {
+    SInt32 presetIndex;
+    float volume;
+    float expression;
+    float pan;
+    float pitchBendCents;
+    float pitchBendRange;
+    BOOL sustain;
+    UInt8 RPNMSB, RPNLSB;
+} BXSoundFontChannel;
+
+
+#pragma mark -
+#pragma mark Private method declarations
+
+@interface BXSoundFontSynth ()
+
+@property (readwrite, copy, nonatomic) NSURL *soundFontURL;
+
+- (BOOL) _loadSoundFontWithError: (NSError **)outError;
+- (BOOL) _parsePresetData: (const UInt8 *)pdta length: (size_t)length;
+
+//Returns the index of the preset that should play the specified program, falling back on the
+//General MIDI bank and then the first preset if the soundfont has no such preset.
+- (SInt32) _presetIndexForBank: (UInt16)bank program: (UInt8)program;
+
+//Converts the samples used by the specified preset into floating point, if not done already.
+- (void) _decodeSamplesForPresetAtIndex: (SInt32)presetIndex;
+
+//Decodes the samples for the programs each channel starts out with, and after a reset.
+- (void) _decodeDefaultPresets;
+
+- (uint64_t) _eventFrameForEmulatedTime: (NSTimeInterval)emulatedTime;
+- (void) _queueMessageBytes: (const UInt8 *)bytes length: (NSUInteger)length atFrame: (uint64_t)frame;
+- (void) _queueSysex: (NSData *)message atFrame: (uint64_t)frame;
+- (void) _queueEvent: (BXSoundFontEvent)event;
+
+//Called on the render thread.
+- (void) _playEvent: (const BXSoundFontEvent &)event;
+- (void) _startNote: (UInt8)key velocity: (UInt8)velocity onChannel: (UInt8)channel;
+- (void) _releaseNote: (UInt8)key onChannel: (UInt8)channel;
+- (void) _releaseSustainedNotesOnChannel: (UInt8)channel;
+- (void) _silenceChannel: (UInt8)channel;
+- (void) _resetChannels;
+- (BXSoundFontVoice *) _freeVoice;
+- (void) _renderFrames: (NSUInteger)numFrames toLeft: (float *)left right: (float *)right;
+
+@end
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXSoundFontSynth
+{
+    const UInt8 *_mappedData;
+    size_t _mappedSize;
+    const SInt16 *_sampleData;
+    uint32_t _numSamplePoints;
+
+    std::vector<BXSF2Sample> _samples;
+    std::vector<BXSF2Region> _regions;
+    std::vector<BXSF2Preset> _presets;
+
+    //Floating-point copies of samples, made on the emulation thread before any event that needs
+    //them is queued. Published to the render thread through the event ring.
+    std::vector<std::unique_ptr<float[]>> _decodedSamples;
+
+    //The bank selected on each channel, tracked on the emulation thread to resolve program changes.
+    UInt16 _selectedBanks[BXSoundFontSynthNumChannels];
+
+    BXSPSCRing<BXSoundFontEvent> *_eventRing;
+
+    //Only touched on the render thread.
+    BXSoundFontChannel _channels[BXSoundFontSynthNumChannels];
+    BXSoundFontVoice *_voices;
+    uint64_t _renderedFrames;
+
+    //The emulated time at which the mixer last asked us for audio, and the frame at which
+    //our output for that point will start.
+    NSTimeInterval _renderAnchorTime;
+    uint64_t _renderAnchorFrame;
+    BOOL _hasRenderAnchor;
+
+    std::atomic<float> _volume;
+    std::atomic<NSUInteger> _polyphony;
+    std::atomic<NSUInteger> _activeVoiceCount;
+}
+
+- (instancetype) initWithSoundFontAtURL: (NSURL *)URL error: (NSError **)outError
+{
+    self = [self init];
+    if (self)
+    {
+        self.soundFontURL = URL;
+        self.sampleRate = BXSoundFontSynthDefaultSampleRate;
+        _volume.store(1.0f);
+        _polyphony.store(BXSoundFontSynthDefaultPolyphony);
+
+        if (![self _loadSoundFontWithError: outError])
+            return nil;
+
+        _voices = (BXSoundFontVoice *)calloc(BXSoundFontSynthMaxVoices, sizeof(BXSoundFontVoice));
+        _eventRing = new BXSPSCRing<BXSoundFontEvent>(BXSoundFontSynthEventRingCapacity);
+
+        for (UInt8 i=0; i<BXSoundFontSynthNumChannels; i++)
+            _selectedBanks[i] = (i == BXSoundFontSynthDrumChannel) ? BXSoundFontSynthDrumBank : 0;
+
+        [self _decodeDefaultPresets];
+        [self _resetChannels];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self close];
+}
+
+- (void) close
+{
+    if (_eventRing)
+    {
+        delete _eventRing;
+        _eventRing = NULL;
+    }
+
+    if (_voices)
+    {
+        free(_voices);
+        _voices = NULL;
+    }
+
+    _decodedSamples.clear();
+    _regions.clear();
+    _presets.clear();
+    _samples.clear();
+
+    if (_mappedData)
+    {
+        munmap((void *)_mappedData, _mappedSize);
+        _mappedData = NULL;
+    }
+}
+
+
+#pragma mark -
+#pragma mark Loading soundfonts
+
+static inline uint32_t _fourCC(const UInt8 *bytes)
+{
+    return OSReadBigInt32(bytes, 0);
+}
+
+- (BOOL) _loadSoundFontWithError: (NSError **)outError
+{
+    NSURL *URL = self.soundFontURL;
+
+    int fd = open(URL.fileSystemRepresentation, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        if (fd >= 0) close(fd);
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: BXSoundFontSynthErrorDomain
+                                            code: BXSoundFontSynthCouldNotReadSoundFont
+                                        userInfo: @{ NSURLErrorKey: URL }];
+        }
+        return NO;
+    }
+
+    _mappedSize = (size_t)info.st_size;
+    void *data = mmap(NULL, _mappedSize, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: BXSoundFontSynthErrorDomain
+                                            code: BXSoundFontSynthCouldNotReadSoundFont
+                                        userInfo: @{ NSURLErrorKey: URL }];
+        }
+        return NO;
+    }
+    _mappedData = (const UInt8 *)data;
+
+    //Walk the RIFF structure looking for the sample data and the preset data.
+    const UInt8 *pdta = NULL;
+    size_t pdtaLength = 0;
+
+    BOOL isValid = (_mappedSize >= 12 &&
+                    _fourCC(_mappedData) == 'RIFF' &&
+                    _fourCC(_mappedData + 8) == 'sfbk');
+
+    size_t riffEnd = MIN(_mappedSize, (size_t)OSReadLittleInt32(_mappedData, 4) + 8);
+    size_t offset = 12;
+    while (isValid && offset + 12 <= riffEnd)
+    {
+        uint32_t chunkID = _fourCC(_mappedData + offset);
+        size_t chunkLength = OSReadLittleInt32(_mappedData, offset + 4);
+        size_t chunkEnd = MIN(riffEnd, offset + 8 + chunkLength);
+
+        if (chunkID == 'LIST')
+        {
+            uint32_t listType = _fourCC(_mappedData + offset + 8);
+            size_t subOffset = offset + 12;
+            while (subOffset + 8 <= chunkEnd)
+            {
+                uint32_t subID = _fourCC(_mappedData + subOffset);
+                size_t subLength = MIN((size_t)OSReadLittleInt32(_mappedData, subOffset + 4), chunkEnd - subOffset - 8);
+                const UInt8 *subData = _mappedData + subOffset + 8;
+
+                if (listType == 'sdta' && subID == 'smpl')
+                {
+                    _sampleData = (const SInt16 *)subData;
+                    _numSamplePoints = (uint32_t)(subLength / sizeof(SInt16));
+                }
+                else if (listType == 'pdta')
+                {
+                    pdta = _mappedData + subOffset;
+                    pdtaLength = chunkEnd - subOffset;
+                    break;
+                }
+
+                //Chunks are padded to an even length.
+                subOffset += 8 + subLength + (subLength & 1);
+            }
+        }
+        offset = chunkEnd + (chunkLength & 1);
+    }
+
+    isValid = isValid && _sampleData && pdta && [self _parsePresetData: pdta length: pdtaLength];
+
+    if (!isValid)
+    {
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: BXSoundFontSynthErrorDomain
+                                            code: BXSoundFontSynthInvalidSoundFont
+                                        userInfo: @{ NSURLErrorKey: URL }];
+        }
+        return NO;
+    }
+
+    _decodedSamples.resize(_samples.size());
+    return YES;
+}
+
+//Applies the generators of a zone on top of the specified values.
+//Returns the value of the zone's terminal generator (instrument or sample ID), or -1 if it has none.
+static int _applyGenerators(const UInt8 *generators, uint32_t first, uint32_t last, int16_t *values, int terminalGenerator)
+{
+    int terminal = -1;
+    for (uint32_t i=first; i<last; i++)
+    {
+        const UInt8 *record = generators + (i * BXSF2GeneratorSize);
+        UInt16 oper = OSReadLittleInt16(record, 0);
+        int16_t amount = (int16_t)OSReadLittleInt16(record, 2);
+
+        if (oper == terminalGenerator)
+        {
+            terminal = (UInt16)amount;
+            //Nothing after the terminal generator counts.
+            break;
+        }
+        else if (oper < BXSF2NumGenerators)
+        {
+            values[oper] = amount;
+        }
+    }
+    return terminal;
+}
+
+static inline float _secondsFromTimecents(int16_t timecents)
+{
+    return MAX(0.001f, powf(2.0f, timecents / 1200.0f));
+}
+
+- (BOOL) _parsePresetData: (const UInt8 *)pdta length: (size_t)length
+{
+    const UInt8 *phdr = NULL, *pbag = NULL, *pgen = NULL, *inst = NULL, *ibag = NULL, *igen = NULL, *shdr = NULL;
+    uint32_t numPresets = 0, numPresetBags = 0, numPresetGens = 0, numInstruments = 0, numInstrumentBags = 0, numInstrumentGens = 0, numSamples = 0;
+
+    size_t offset = 0;
+    while (offset + 8 <= length)
+    {
+        uint32_t chunkID = _fourCC(pdta + offset);
+        size_t chunkLength = MIN((size_t)OSReadLittleInt32(pdta, offset + 4), length - offset - 8);
+        const UInt8 *chunk = pdta + offset + 8;
+
+        switch (chunkID)
+        {
+            case 'phdr': phdr = chunk; numPresets           = (uint32_t)(chunkLength / BXSF2PresetHeaderSize); break;
+            case 'pbag': pbag = chunk; numPresetBags        = (uint32_t)(chunkLength / BXSF2BagSize); break;
+            case 'pgen': pgen = chunk; numPresetGens        = (uint32_t)(chunkLength / BXSF2GeneratorSize); break;
+            case 'inst': inst = chunk; numInstruments       = (uint32_t)(chunkLength / BXSF2InstrumentHeaderSize); break;
+            case 'ibag': ibag = chunk; numInstrumentBags    = (uint32_t)(chunkLength / BXSF2BagSize); break;
+            case 'igen': igen = chunk; numInstrumentGens    = (uint32_t)(chunkLength / BXSF2GeneratorSize); break;
+            case 'shdr': shdr = chunk; numSamples           = (uint32_t)(chunkLength / BXSF2SampleHeaderSize); break;
+        }
+        offset += 8 + chunkLength + (chunkLength & 1);
+    }
+
+    //Every list ends with a terminal record, so a usable soundfont has at least two of each.
+    if (numPresets < 2 || numPresetBags < 2 || !pgen || numInstruments < 2 || numInstrumentBags < 2 || !igen || numSamples < 2)
+        return NO;
+
+    //Sample headers
+    _samples.resize(numSamples - 1);
+    for (uint32_t i=0; i<numSamples - 1; i++)
+    {
+        const UInt8 *record = shdr + (i * BXSF2SampleHeaderSize);
+        BXSF2Sample &sample = _samples[i];
+        sample.start            = OSReadLittleInt32(record, 20);
+        sample.end              = MIN(OSReadLittleInt32(record, 24), _numSamplePoints);
+        sample.loopStart        = OSReadLittleInt32(record, 28);
+        sample.loopEnd          = OSReadLittleInt32(record, 32);
+        sample.sampleRate       = OSReadLittleInt32(record, 36);
+        sample.originalPitch    = record[40];
+        sample.pitchCorrection  = (SInt8)record[41];
+
+        if (sample.start > sample.end) sample.start = sample.end;
+        if (!sample.sampleRate) sample.sampleRate = BXSoundFontSynthDefaultSampleRate;
+    }
+
+    //The default values of each generator, per section 8.1.3 of the specification.
+    int16_t instrumentDefaults[BXSF2NumGenerators] = {0};
+    instrumentDefaults[BXSF2GenDelayVolEnv]         = -12000;
+    instrumentDefaults[BXSF2GenAttackVolEnv]        = -12000;
+    instrumentDefaults[BXSF2GenHoldVolEnv]          = -12000;
+    instrumentDefaults[BXSF2GenDecayVolEnv]         = -12000;
+    instrumentDefaults[BXSF2GenReleaseVolEnv]       = -12000;
+    instrumentDefaults[BXSF2GenKeyRange]            = 0x7F00;
+    instrumentDefaults[BXSF2GenVelRange]            = 0x7F00;
+    instrumentDefaults[BXSF2GenScaleTuning]         = 100;
+    instrumentDefaults[BXSF2GenOverridingRootKey]   = -1;
+
+    //Preset generators are offsets to the instrument's, so only the ranges have defaults.
+    int16_t presetDefaults[BXSF2NumGenerators] = {0};
+    presetDefaults[BXSF2GenKeyRange]                = 0x7F00;
+    presetDefaults[BXSF2GenVelRange]                = 0x7F00;
+
+    for (uint32_t p=0; p<numPresets - 1; p++)
+    {
+        const UInt8 *presetRecord = phdr + (p * BXSF2PresetHeaderSize);
+        BXSF2Preset preset;
+        preset.program  = OSReadLittleInt16(presetRecord, 20);
+        preset.bank     = OSReadLittleInt16(presetRecord, 22);
+        preset.firstRegion = (uint32_t)_regions.size();
+
+        uint32_t firstBag   = OSReadLittleInt16(presetRecord, 24);
+        uint32_t lastBag    = MIN((uint32_t)OSReadLittleInt16(presetRecord + BXSF2PresetHeaderSize, 24), numPresetBags - 1);
+
+        int16_t presetGlobals[BXSF2NumGenerators];
+        memcpy(presetGlobals, presetDefaults, sizeof(presetGlobals));
+
+        for (uint32_t b=firstBag; b<lastBag; b++)
+        {
+            uint32_t firstGen   = OSReadLittleInt16(pbag + (b * BXSF2BagSize), 0);
+            uint32_t lastGen    = MIN((uint32_t)OSReadLittleInt16(pbag + ((b + 1) * BXSF2BagSize), 0), numPresetGens);
+
+            int16_t presetValues[BXSF2NumGenerators];
+            memcpy(presetValues, presetGlobals, sizeof(presetValues));
+            int instrumentIndex = _applyGenerators(pgen, firstGen, lastGen, presetValues, BXSF2GenInstrument);
+
+            //A first zone with no instrument is the global zone, whose values apply to all the others.
+            if (instrumentIndex < 0)
+            {
+                if (b == firstBag)
+                    memcpy(presetGlobals, presetValues, sizeof(presetGlobals));
+                continue;
+            }
+            if (instrumentIndex >= (int)numInstruments - 1)
+                continue;
+
+            const UInt8 *instrumentRecord = inst + (instrumentIndex * BXSF2InstrumentHeaderSize);
+            uint32_t firstInstrumentBag = OSReadLittleInt16(instrumentRecord, 20);
+            uint32_t lastInstrumentBag  = MIN((uint32_t)OSReadLittleInt16(instrumentRecord + BXSF2InstrumentHeaderSize, 20), numInstrumentBags - 1);
+
+            int16_t instrumentGlobals[BXSF2NumGenerators];
+            memcpy(instrumentGlobals, instrumentDefaults, sizeof(instrumentGlobals));
+
+            for (uint32_t ib=firstInstrumentBag; ib<lastInstrumentBag; ib++)
+            {
+                uint32_t firstInstrumentGen = OSReadLittleInt16(ibag + (ib * BXSF2BagSize), 0);
+                uint32_t lastInstrumentGen  = MIN((uint32_t)OSReadLittleInt16(ibag + ((ib + 1) * BXSF2BagSize), 0), numInstrumentGens);
+
+                int16_t values[BXSF2NumGenerators];
+                memcpy(values, instrumentGlobals, sizeof(values));
+                int sampleIndex = _applyGenerators(igen, firstInstrumentGen, lastInstrumentGen, values, BXSF2GenSampleID);
+
+                if (sampleIndex < 0)
+                {
+                    if (ib == firstInstrumentBag)
+                        memcpy(instrumentGlobals, values, sizeof(instrumentGlobals));
+                    continue;
+                }
+                if (sampleIndex >= (int)_samples.size())
+                    continue;
+
+                //Key and velocity ranges are the intersection of the preset's and the instrument's.
+                UInt8 loKey = MAX(values[BXSF2GenKeyRange] & 0xFF, presetValues[BXSF2GenKeyRange] & 0xFF);
+                UInt8 hiKey = MIN((values[BXSF2GenKeyRange] >> 8) & 0xFF, (presetValues[BXSF2GenKeyRange] >> 8) & 0xFF);
+                UInt8 loVel = MAX(values[BXSF2GenVelRange] & 0xFF, presetValues[BXSF2GenVelRange] & 0xFF);
+                UInt8 hiVel = MIN((values[BXSF2GenVelRange] >> 8) & 0xFF, (presetValues[BXSF2GenVelRange] >> 8) & 0xFF);
+                if (loKey > hiKey || loVel > hiVel)
+                    continue;
+
+                //Everything else from the preset adds to the instrument.
+                static const int additiveGenerators[] = {
+                    BXSF2GenPan, BXSF2GenDelayVolEnv, BXSF2GenAttackVolEnv, BXSF2GenHoldVolEnv, BXSF2GenDecayVolEnv,
+                    BXSF2GenSustainVolEnv, BXSF2GenReleaseVolEnv, BXSF2GenInitialAttenuation,
+                    BXSF2GenCoarseTune, BXSF2GenFineTune, BXSF2GenScaleTuning,
+                };
+                for (int gen : additiveGenerators)
+                    values[gen] += presetValues[gen];
+
+                const BXSF2Sample &sample = _samples[sampleIndex];
+                int64_t sampleLength = sample.end - sample.start;
+
+                BXSF2Region region;
+                region.loKey = loKey;
+                region.hiKey = hiKey;
+                region.loVel = loVel;
+                region.hiVel = hiVel;
+                region.sampleIndex = sampleIndex;
+
+                int64_t start       = values[BXSF2GenStartAddrsOffset] + (values[BXSF2GenStartAddrsCoarseOffset] * 32768);
+                int64_t end         = sampleLength + values[BXSF2GenEndAddrsOffset] + (values[BXSF2GenEndAddrsCoarseOffset] * 32768);
+                int64_t loopStart   = (int64_t)sample.loopStart - sample.start + values[BXSF2GenStartloopAddrsOffset] + (values[BXSF2GenStartloopAddrsCoarseOffset] * 32768);
+                int64_t loopEnd     = (int64_t)sample.loopEnd - sample.start + values[BXSF2GenEndloopAddrsOffset] + (values[BXSF2GenEndloopAddrsCoarseOffset] * 32768);
+
+                region.end          = (uint32_t)MAX((int64_t)0, MIN(end, sampleLength));
+                region.start        = (uint32_t)MAX((int64_t)0, MIN(start, (int64_t)region.end));
+                region.loopStart    = (uint32_t)MAX((int64_t)region.start, MIN(loopStart, (int64_t)region.end));
+                region.loopEnd      = (uint32_t)MAX((int64_t)region.loopStart, MIN(loopEnd, (int64_t)region.end));
+
+                region.loopMode = values[BXSF2GenSampleModes] & 3;
+                if (region.loopEnd - region.loopStart < 2)
+                    region.loopMode = BXSF2NoLoop;
+
+                int rootKey = values[BXSF2GenOverridingRootKey];
+                if (rootKey < 0 || rootKey > 127)
+                    rootKey = (sample.originalPitch <= 127) ? sample.originalPitch : 60;
+
+                region.rootKey          = rootKey;
+                region.scaleTuning      = values[BXSF2GenScaleTuning];
+                region.tuneCents        = (values[BXSF2GenCoarseTune] * 100) + values[BXSF2GenFineTune] + sample.pitchCorrection;
+                region.exclusiveClass   = values[BXSF2GenExclusiveClass];
+
+                //Attenuation is in centibels, pan in tenths of a percent either side of center.
+                region.gain     = powf(10.0f, -MAX(0, values[BXSF2GenInitialAttenuation]) / 200.0f);
+                region.pan      = MAX(-500, MIN(values[BXSF2GenPan], 500)) / 500.0f;
+
+                region.delay    = _secondsFromTimecents(values[BXSF2GenDelayVolEnv]);
+                region.attack   = _secondsFromTimecents(values[BXSF2GenAttackVolEnv]);
+                region.hold     = _secondsFromTimecents(values[BXSF2GenHoldVolEnv]);
+                region.decay    = _secondsFromTimecents(values[BXSF2GenDecayVolEnv]);
+                region.release  = _secondsFromTimecents(values[BXSF2GenReleaseVolEnv]);
+                region.sustainLevel = powf(10.0f, -MAX(0, MIN(values[BXSF2GenSustainVolEnv], 1440)) / 200.0f);
+
+                _regions.push_back(region);
+            }
+        }
+
+        preset.numRegions = (uint32_t)_regions.size() - preset.firstRegion;
+        _presets.push_back(preset);
+    }
+
+    return _presets.size() > 0;
+}
+
+- (SInt32) _presetIndexForBank: (UInt16)bank program: (UInt8)program
+{
+    SInt32 fallbackIndex = -1, drumIndex = -1;
+    for (SInt32 i=0; i<(SInt32)_presets.size(); i++)
+    {
+        const BXSF2Preset &preset = _presets[i];
+        if (preset.bank == bank && preset.program == program)
+            return i;
+
+        if (fallbackIndex < 0 && preset.bank == 0 && preset.program == program)
+            fallbackIndex = i;
+
+        if (drumIndex < 0 && preset.bank == BXSoundFontSynthDrumBank && preset.program == 0)
+            drumIndex = i;
+    }
+
+    //Drum kits fall back on the standard kit, everything else on the General MIDI instrument.
+    if (bank == BXSoundFontSynthDrumBank && drumIndex >= 0)
+        return drumIndex;
+
+    return (fallbackIndex >= 0) ? fallbackIndex : 0;
+}
+
+- (void) _decodeSamplesForPresetAtIndex: (SInt32)presetIndex
+{
+    const BXSF2Preset &preset = _presets[presetIndex];
+    for (uint32_t i=preset.firstRegion; i<preset.firstRegion + preset.numRegions; i++)
+    {
+        uint32_t sampleIndex = _regions[i].sampleIndex;
+        if (_decodedSamples[sampleIndex])
+            continue;
+
+        const BXSF2Sample &sample = _samples[sampleIndex];
+        uint32_t length = sample.end - sample.start;
+
+        float *decoded = new float[length + BXSoundFontSynthSampleGuardFrames]();
+        const SInt16 *source = _sampleData + sample.start;
+        for (uint32_t frame=0; frame<length; frame++)
+            decoded[frame] = (SInt16)OSSwapLittleToHostInt16(source[frame]) * (1.0f / 32768.0f);
+
+        _decodedSamples[sampleIndex].reset(decoded);
+    }
+}
+
+- (void) _decodeDefaultPresets
+{
+    [self _decodeSamplesForPresetAtIndex: [self _presetIndexForBank: 0 program: 0]];
+    [self _decodeSamplesForPresetAtIndex: [self _presetIndexForBank: BXSoundFontSynthDrumBank program: 0]];
+}
+
+
+#pragma mark -
+#pragma mark MIDI processing and status
+
+- (BOOL) supportsMT32Music          { return NO; }
+- (BOOL) supportsGeneralMIDIMusic   { return YES; }
+
+//Messages are queued for the renderer, so we're always ready to accept more
+- (BOOL) isProcessing       { return NO; }
+- (NSDate *) dateWhenReady  { return [NSDate distantPast]; }
+
+- (void) handleMessage: (NSData *)message
+{
+    [self _queueMessageBytes: (const UInt8 *)message.bytes length: message.length atFrame: _renderedFrames];
+}
+
+- (void) handleSysex: (NSData *)message
+{
+    [self _queueSysex: message atFrame: _renderedFrames];
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _queueMessageBytes: (const UInt8 *)message.bytes length: message.length atFrame: [self _eventFrameForEmulatedTime: emulatedTime]];
+}
+
+- (void) handleSysex: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    [self _queueSysex: message atFrame: [self _eventFrameForEmulatedTime: emulatedTime]];
+}
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    for (NSUInteger i=0; i<count; i++)
+    {
+        const BXMIDIEvent &event = events[i];
+        uint64_t frame = (event.emulatedTime < 0) ? _renderedFrames : [self _eventFrameForEmulatedTime: event.emulatedTime];
+        [self _queueMessageBytes: event.bytes length: event.length atFrame: frame];
+    }
+}
+
+- (uint64_t) _eventFrameForEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    if (!_hasRenderAnchor)
+        return _renderedFrames;
+
+    //The mixer consumes our output at exactly our sample rate in emulated time, so an event's distance
+    //in emulated time from the last time the mixer asked for audio is its distance in frames from the
+    //start of the next block we render.
+    double offset = (emulatedTime - _renderAnchorTime) * self.sampleRate;
+    offset = MAX(0.0, MIN(offset, BXSoundFontSynthMaxEventOffset * self.sampleRate));
+
+    return _renderAnchorFrame + (uint64_t)offset;
+}
+
+- (void) _queueMessageBytes: (const UInt8 *)bytes length: (NSUInteger)length atFrame: (uint64_t)frame
+{
+    NSAssert(_eventRing, @"handleMessage: called before successful initialization.");
+    NSAssert(length > 0, @"0-length message received by handleMessage:");
+
+    BXSoundFontEvent event = {0};
+    event.frame = frame;
+    event.type = BXSoundFontEventMessage;
+    event.status = bytes[0];
+    event.data1 = (length > 1) ? bytes[1] & BXMIDIBitmask : 0;
+    event.data2 = (length > 2) ? bytes[2] & BXMIDIBitmask : 0;
+
+    UInt8 channel = event.status & 0x0F;
+    switch (event.status & 0xF0)
+    {
+        //Track bank selects ourselves so that we can resolve program changes here.
+        case 0xB0:
+            if (event.data1 == 0)
+                _selectedBanks[channel] = (channel == BXSoundFontSynthDrumChannel) ? BXSoundFontSynthDrumBank : event.data2;
+            break;
+
+        //Prepare the samples for the new program here, so that the render thread never has to.
+        case 0xC0:
+            event.type = BXSoundFontEventSelectPreset;
+            event.presetIndex = [self _presetIndexForBank: _selectedBanks[channel] program: event.data1];
+            [self _decodeSamplesForPresetAtIndex: event.presetIndex];
+            break;
+    }
+
+    [self _queueEvent: event];
+}
+
+- (void) _queueSysex: (NSData *)message atFrame: (uint64_t)frame
+{
+    //The only sysexes we act on are General MIDI and GS resets.
+    static const UInt8 GMReset[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 };
+    static const UInt8 GSReset[] = { 0xF0, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41, 0xF7 };
+
+    BOOL isGMReset = (message.length == sizeof(GMReset) && !memcmp(message.bytes, GMReset, sizeof(GMReset)));
+    BOOL isGSReset = (message.length == sizeof(GSReset) && !memcmp(message.bytes, GSReset, sizeof(GSReset)));
+
+    if (isGMReset || isGSReset)
+    {
+        for (UInt8 i=0; i<BXSoundFontSynthNumChannels; i++)
+            _selectedBanks[i] = (i == BXSoundFontSynthDrumChannel) ? BXSoundFontSynthDrumBank : 0;
+
+        BXSoundFontEvent event = {0};
+        event.frame = frame;
+        event.type = BXSoundFontEventReset;
+        [self _queueEvent: event];
+    }
+}
+
+- (void) _queueEvent: (BXSoundFontEvent)event
+{
+    if (!_eventRing->push(event))
+    {
+        NSLog(@"SoundFont synth event queue is full, dropping MIDI event.");
+    }
+}
+
+- (void) pause
+{
+    //Silence every channel at the start of the next block.
+    for (UInt8 channel=0; channel<BXSoundFontSynthNumChannels; channel++)
+    {
+        UInt8 message[3] = { (UInt8)(BXChannelModeChangePrefix + channel), 0x78, 0 }; //All Sound Off
+        [self _queueMessageBytes: message length: 3 atFrame: _renderedFrames];
+    }
+}
+
+- (void) resume
+{
+    //Emulated time has moved on without us while we were paused.
+    _hasRenderAnchor = NO;
+}
+
+- (void) setVolume: (float)volume
+{
+    _volume.store(MAX(0.0f, MIN(volume, 1.0f)), std::memory_order_relaxed);
+}
+
+- (float) volume
+{
+    return _volume.load(std::memory_order_relaxed);
+}
+
+- (void) setPolyphony: (NSUInteger)polyphony
+{
+    _polyphony.store(MAX((NSUInteger)1, MIN(polyphony, (NSUInteger)BXSoundFontSynthMaxVoices)), std::memory_order_relaxed);
+}
+
+- (NSUInteger) polyphony
+{
+    return _polyphony.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger) activeVoiceCount
+{
+    return _activeVoiceCount.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger) pendingEventCount
+{
+    return (_eventRing) ? _eventRing->readAvailable() : 0;
+}
+
+
+#pragma mark -
+#pragma mark Rendering
+
+- (void) willRenderOutputAtEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    _renderAnchorTime = emulatedTime;
+    _hasRenderAnchor = YES;
+}
+
+- (BOOL) renderOutputToBuffer: (void *)buffer
+                       frames: (NSUInteger)numFrames
+                   sampleRate: (NSUInteger *)sampleRate
+                       format: (BXAudioFormat *)format
+{
+    float *output = (float *)buffer;
+    alignas(32) float left[BXSoundFontSynthBlockFrames];
+    alignas(32) float right[BXSoundFontSynthBlockFrames];
+
+    NSUInteger framesRendered = 0;
+    while (framesRendered < numFrames)
+    {
+        //Play every event that has fallen due, then render up to the next one or the end of the block.
+        NSUInteger framesToRender = MIN(numFrames - framesRendered, (NSUInteger)BXSoundFontSynthBlockFrames);
+        const BXSoundFontEvent *event;
+        while ((event = _eventRing->peek()) != NULL)
+        {
+            if (event->frame > _renderedFrames)
+            {
+                framesToRender = (NSUInteger)MIN((uint64_t)framesToRender, event->frame - _renderedFrames);
+                break;
+            }
+            [self _playEvent: *event];
+            
+            BXSoundFontEvent playedEvent;
+            _eventRing->pop(playedEvent);
+        }
+
+        [self _renderFrames: framesToRender toLeft: left right: right];
+
+        for (NSUInteger i=0; i<framesToRender; i++)
+        {
+            output[(framesRendered + i) * 2]       = left[i];
+            output[(framesRendered + i) * 2 + 1]   = right[i];
+        }
+
+        framesRendered += framesToRender;
+        _renderedFrames += framesToRender;
+    }
+
+    //Events sent before the mixer next asks for audio are placed relative to the end of this block.
+    _renderAnchorFrame = _renderedFrames;
+
+    *sampleRate = self.sampleRate;
+    *format = BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatSigned | BXAudioFormatStereo;
+    return YES;
+}
+
+- (void) _renderFrames: (NSUInteger)numFrames toLeft: (float *)left right: (float *)right
+{
+    memset(left, 0, numFrames * sizeof(float));
+    memset(right, 0, numFrames * sizeof(float));
+
+    alignas(32) float voiceOutput[BXSoundFontSynthBlockFrames];
+    float masterVolume = _volume.load(std::memory_order_relaxed);
+    NSUInteger activeVoices = 0;
+
+    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+    {
+        BXSoundFontVoice &voice = _voices[v];
+        if (!voice.isActive) continue;
+
+        const BXSF2Region &region = *voice.region;
+        const BXSoundFontChannel &channel = _channels[voice.channel];
+
+        double step = voice.baseStep * exp2(channel.pitchBendCents / 1200.0);
+        BOOL isLooping = (region.loopMode == BXSF2LoopContinuously ||
+                          (region.loopMode == BXSF2LoopUntilRelease && voice.stage < BXSoundFontEnvelopeRelease));
+        double loopStart = region.loopStart, loopEnd = region.loopEnd, end = region.end;
+
+        //Produce the voice's output in mono, applying its envelope as we go.
+        NSUInteger frame;
+        for (frame=0; frame<numFrames; frame++)
+        {
+            if (voice.stageFramesRemaining == 0)
+            {
+                switch (voice.stage)
+                {
+                    case BXSoundFontEnvelopeDelay:
+                        voice.stage = BXSoundFontEnvelopeAttack;
+                        voice.stageFramesRemaining = MAX(1U, (uint32_t)(region.attack * self.sampleRate));
+                        voice.attackIncrement = 1.0f / voice.stageFramesRemaining;
+                        break;
+                    case BXSoundFontEnvelopeAttack:
+                        voice.envelopeLevel = 1.0f;
+                        voice.stage = BXSoundFontEnvelopeHold;
+                        voice.stageFramesRemaining = (uint32_t)(region.hold * self.sampleRate);
+                        break;
+                    case BXSoundFontEnvelopeHold:
+                        voice.stage = BXSoundFontEnvelopeDecay;
+                        voice.stageFramesRemaining = UINT32_MAX;
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            switch (voice.stage)
+            {
+                case BXSoundFontEnvelopeAttack:
+                    voice.envelopeLevel = MIN(1.0f, voice.envelopeLevel + voice.attackIncrement);
+                    break;
+                case BXSoundFontEnvelopeDecay:
+                    voice.envelopeLevel *= voice.decayFactor;
+                    if (voice.envelopeLevel <= region.sustainLevel)
+                    {
+                        voice.envelopeLevel = region.sustainLevel;
+                        voice.stage = BXSoundFontEnvelopeSustain;
+                    }
+                    break;
+                case BXSoundFontEnvelopeRelease:
+                    voice.envelopeLevel *= voice.releaseFactor;
+                    if (voice.envelopeLevel < BXSoundFontSynthSilentGain)
+                        voice.stage = BXSoundFontEnvelopeFinished;
+                    break;
+                default:
+                    break;
+            }
+            if (voice.stageFramesRemaining > 0 && voice.stageFramesRemaining != UINT32_MAX)
+                voice.stageFramesRemaining--;
+
+            if (voice.stage == BXSoundFontEnvelopeFinished || voice.position >= end)
+                break;
+
+            //Linear interpolation, wrapping around the loop if we're in it.
+            uint32_t index = (uint32_t)voice.position;
+            float fraction = (float)(voice.position - index);
+            uint32_t nextIndex = index + 1;
+            if (isLooping && nextIndex >= loopEnd)
+                nextIndex -= (uint32_t)(loopEnd - loopStart);
+
+            float sample = voice.data[index] + (voice.data[nextIndex] - voice.data[index]) * fraction;
+            voiceOutput[frame] = sample * voice.envelopeLevel;
+
+            voice.position += step;
+            if (isLooping && voice.position >= loopEnd)
+                voice.position -= (loopEnd - loopStart);
+        }
+
+        //Pad out a voice that ended partway through, so the mixing loop can run over whole vectors.
+        BOOL voiceEnded = (frame < numFrames);
+        for (NSUInteger i=frame; i<numFrames; i++)
+            voiceOutput[i] = 0;
+
+        //Work out the gain we should reach by the end of this block, and ramp to it to avoid zipper noise.
+        float channelGain = channel.volume * channel.volume * channel.expression * channel.expression;
+        float pan = MAX(-1.0f, MIN(region.pan + channel.pan, 1.0f));
+        float angle = (pan + 1.0f) * (float)M_PI_4;
+        float gain = voice.noteGain * channelGain * masterVolume;
+        float targetLeft = gain * cosf(angle);
+        float targetRight = gain * sinf(angle);
+
+        float leftStep = (targetLeft - voice.leftGain) / numFrames;
+        float rightStep = (targetRight - voice.rightGain) / numFrames;
+
+        NSUInteger i = 0;
+        const simd_float8 ramp = { 1, 2, 3, 4, 5, 6, 7, 8 };
+        for (; i + 8 <= numFrames; i += 8)
+        {
+            simd_float8 samples = *(const simd_packed_float8 *)(voiceOutput + i);
+            simd_float8 leftGains = (simd_float8)(voice.leftGain + (i * leftStep)) + ramp * leftStep;
+            simd_float8 rightGains = (simd_float8)(voice.rightGain + (i * rightStep)) + ramp * rightStep;
+
+            *(simd_packed_float8 *)(left + i) += samples * leftGains;
+            *(simd_packed_float8 *)(right + i) += samples * rightGains;
+        }
+        for (; i < numFrames; i++)
+        {
+            left[i]     += voiceOutput[i] * (voice.leftGain + (i + 1) * leftStep);
+            right[i]    += voiceOutput[i] * (voice.rightGain + (i + 1) * rightStep);
+        }
+
+        voice.leftGain = targetLeft;
+        voice.rightGain = targetRight;
+
+        if (voiceEnded)
+            voice.isActive = NO;
+        else
+            activeVoices++;
+    }
+
+    _activeVoiceCount.store(activeVoices, std::memory_order_relaxed);
+}
+
+- (void) _playEvent: (const BXSoundFontEvent &)event
+{
+    UInt8 channelIndex = event.status & 0x0F;
+    BXSoundFontChannel &channel = _channels[channelIndex];
+
+    switch (event.type)
+    {
+        case BXSoundFontEventReset:
+            for (UInt8 i=0; i<BXSoundFontSynthNumChannels; i++)
+                [self _silenceChannel: i];
+            [self _resetChannels];
+            return;
+
+        case BXSoundFontEventSelectPreset:
+            channel.presetIndex = event.presetIndex;
+            return;
+
+        case BXSoundFontEventMessage:
+            break;
+    }
+
+    switch (event.status & 0xF0)
+    {
+        case 0x80: //Note off
+            [self _releaseNote: event.data1 onChannel: channelIndex];
+            break;
+
+        case 0x90: //Note on
+            if (event.data2 > 0)
+                [self _startNote: event.data1 velocity: event.data2 onChannel: channelIndex];
+            else
+                [self _releaseNote: event.data1 onChannel: channelIndex];
+            break;
+
+        case 0xE0: //Pitch bend
+        {
+            NSInteger bend = ((event.data2 << 7) | event.data1) - 8192;
+            channel.pitchBendCents = (bend / 8192.0f) * channel.pitchBendRange;
+            break;
+        }
+
+        case 0xB0: //Control change
+            switch (event.data1)
+            {
+                case 7:     channel.volume = event.data2 / 127.0f; break;
+                case 10:    channel.pan = (event.data2 - 64) / 64.0f; break;
+                case 11:    channel.expression = event.data2 / 127.0f; break;
+                case 64:
+                    channel.sustain = (event.data2 >= 64);
+                    if (!channel.sustain)
+                        [self _releaseSustainedNotesOnChannel: channelIndex];
+                    break;
+                case 100:   channel.RPNLSB = event.data2; break;
+                case 101:   channel.RPNMSB = event.data2; break;
+                case 6:
+                    //Data entry for RPN 0 sets the pitch bend range in semitones.
+                    if (channel.RPNMSB == 0 && channel.RPNLSB == 0)
+                        channel.pitchBendRange = event.data2 * 100.0f;
+                    break;
+                case 120:   //All sound off
+                    [self _silenceChannel: channelIndex];
+                    break;
+                case 121:   //Reset all controllers
+                    channel.expression = 1.0f;
+                    channel.pitchBendCents = 0;
+                    channel.sustain = NO;
+                    channel.RPNMSB = channel.RPNLSB = 0x7F;
+                    [self _releaseSustainedNotesOnChannel: channelIndex];
+                    break;
+                case 123:   //All notes off
+                    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+                    {
+                        BXSoundFontVoice &voice = _voices[v];
+                        if (voice.isActive && voice.channel == channelIndex)
+                            [self _releaseNote: voice.key onChannel: channelIndex];
+                    }
+                    break;
+            }
+            break;
+    }
+}
+
+- (void) _resetChannels
+{
+    for (UInt8 i=0; i<BXSoundFontSynthNumChannels; i++)
+    {
+        BXSoundFontChannel &channel = _channels[i];
+        UInt16 bank = (i == BXSoundFontSynthDrumChannel) ? BXSoundFontSynthDrumBank : 0;
+
+        channel.presetIndex = [self _presetIndexForBank: bank program: 0];
+        channel.volume = 100 / 127.0f;
+        channel.expression = 1.0f;
+        channel.pan = 0;
+        channel.pitchBendCents = 0;
+        channel.pitchBendRange = 200;
+        channel.sustain = NO;
+        channel.RPNMSB = channel.RPNLSB = 0x7F;
+    }
+}
+
+- (BXSoundFontVoice *) _freeVoice
+{
+    NSUInteger polyphony = _polyphony.load(std::memory_order_relaxed);
+    BXSoundFontVoice *unusedVoice = NULL, *quietest = NULL, *oldest = NULL;
+    NSUInteger numActive = 0;
+
+    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+    {
+        BXSoundFontVoice *voice = &_voices[v];
+        if (!voice->isActive)
+        {
+            if (!unusedVoice) unusedVoice = voice;
+            continue;
+        }
+
+        numActive++;
+        if (voice->stage == BXSoundFontEnvelopeRelease && (!quietest || voice->envelopeLevel < quietest->envelopeLevel))
+            quietest = voice;
+        if (!oldest || voice->startFrame < oldest->startFrame)
+            oldest = voice;
+    }
+
+    if (unusedVoice && numActive < polyphony)
+        return unusedVoice;
+
+    //Otherwise steal the quietest releasing voice if there is one, or else the oldest voice.
+    return (quietest) ? quietest : oldest;
+}
+
+- (void) _startNote: (UInt8)key velocity: (UInt8)velocity onChannel: (UInt8)channelIndex
+{
+    const BXSoundFontChannel &channel = _channels[channelIndex];
+    if (channel.presetIndex < 0 || channel.presetIndex >= (SInt32)_presets.size())
+        return;
+
+    const BXSF2Preset &preset = _presets[channel.presetIndex];
+    for (uint32_t r=preset.firstRegion; r<preset.firstRegion + preset.numRegions; r++)
+    {
+        const BXSF2Region &region = _regions[r];
+        if (key < region.loKey || key > region.hiKey || velocity < region.loVel || velocity > region.hiVel)
+            continue;
+
+        const float *data = _decodedSamples[region.sampleIndex].get();
+        if (!data)
+            continue;
+
+        //Cut off any other notes in the same exclusive class, e.g. open and closed hi-hats.
+        if (region.exclusiveClass)
+        {
+            for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+            {
+                BXSoundFontVoice &other = _voices[v];
+                //Leave alone the other halves of this same note, such as the other side of a stereo sample.
+                BOOL isThisNote = (other.key == key && other.startFrame == _renderedFrames);
+                if (other.isActive && !isThisNote && other.channel == channelIndex && other.region->exclusiveClass == region.exclusiveClass)
+                {
+                    other.stage = BXSoundFontEnvelopeRelease;
+                    other.releaseFactor = powf(10.0f, -5.0f / (BXSoundFontSynthFastRelease * self.sampleRate));
+                }
+            }
+        }
+
+        BXSoundFontVoice *voice = [self _freeVoice];
+        if (!voice) return;
+
+        const BXSF2Sample &sample = _samples[region.sampleIndex];
+        double cents = ((key - region.rootKey) * region.scaleTuning) + region.tuneCents;
+
+        voice->isActive = YES;
+        voice->isSustained = NO;
+        voice->channel = channelIndex;
+        voice->key = key;
+        voice->startFrame = _renderedFrames;
+        voice->region = &region;
+        voice->data = data;
+        voice->position = region.start;
+        voice->baseStep = exp2(cents / 1200.0) * sample.sampleRate / self.sampleRate;
+
+        voice->stage = BXSoundFontEnvelopeDelay;
+        voice->envelopeLevel = 0;
+        voice->stageFramesRemaining = (uint32_t)(region.delay * self.sampleRate);
+        voice->attackIncrement = 0;
+        //The decay and release times are how long the envelope would take to fall by 100dB.
+        voice->decayFactor = powf(10.0f, -5.0f / (region.decay * self.sampleRate));
+        voice->releaseFactor = powf(10.0f, -5.0f / (region.release * self.sampleRate));
+
+        //Velocity follows the same concave curve as the SoundFont default modulator, approximately.
+        float velocityGain = velocity / 127.0f;
+        voice->noteGain = region.gain * velocityGain * velocityGain;
+        voice->leftGain = voice->rightGain = 0;
+    }
+}
+
+- (void) _releaseNote: (UInt8)key onChannel: (UInt8)channelIndex
+{
+    BOOL sustain = _channels[channelIndex].sustain;
+    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+    {
+        BXSoundFontVoice &voice = _voices[v];
+        if (!voice.isActive || voice.channel != channelIndex || voice.key != key || voice.stage >= BXSoundFontEnvelopeRelease)
+            continue;
+
+        if (sustain)
+        {
+            voice.isSustained = YES;
+        }
+        else
+        {
+            voice.stage = BXSoundFontEnvelopeRelease;
+            voice.stageFramesRemaining = 0;
+        }
+    }
+}
+
+- (void) _releaseSustainedNotesOnChannel: (UInt8)channelIndex
+{
+    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+    {
+        BXSoundFontVoice &voice = _voices[v];
+        if (voice.isActive && voice.isSustained && voice.channel == channelIndex)
+        {
+            voice.isSustained = NO;
+            if (voice.stage < BXSoundFontEnvelopeRelease)
+            {
+                voice.stage = BXSoundFontEnvelopeRelease;
+                voice.stageFramesRemaining = 0;
+            }
+        }
+    }
+}
+
+- (void) _silenceChannel: (UInt8)channelIndex
+{
+    for (NSUInteger v=0; v<BXSoundFontSynthMaxVoices; v++)
+    {
+        BXSoundFontVoice &voice = _voices[v];
+        if (voice.isActive && voice.channel == channelIndex)
+            voice.isActive = NO;
+    }
+}
+
+@end
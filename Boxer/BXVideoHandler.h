@@ -80,17 +80,22 @@ typedef NS_ENUM(uint8_t, BXCGACompositeMode) {
 
 @class BXEmulator;
 @class BXVideoFrame;
+@class BXVideoFrameRing;
+@class BXFrameskipGovernor;
 
 /// BXVideoHandler manages DOSBox's video and renderer state. Very little of its interface is
 /// exposed to Boxer's high-level Cocoa classes.
 @interface BXVideoHandler : NSObject
 {
 	__unsafe_unretained BXEmulator *_emulator;
-	BXVideoFrame *_currentFrame;
+	BXVideoFrameRing *_frameRing;
+    BXFrameskipGovernor *_frameskipGovernor;
 	
 	NSInteger _currentVideoMode;
 	BXFilterType _filterType;
 	BOOL _frameInProgress;
+    BOOL _prefersIndexedColor;
+    BOOL _capturesTextGrid;
     
     BXHerculesTintMode _herculesTint;
     BXCGACompositeMode _CGAComposite;
@@ -108,8 +113,13 @@ typedef NS_ENUM(uint8_t, BXCGACompositeMode) {
 /// Our parent emulator.
 @property (assign, nonatomic) BXEmulator *emulator;
 
-/// The framebuffer we render our frames into.
-@property (strong, nonatomic) BXVideoFrame *currentFrame;
+/// The ring of framebuffers that we hand finished frames off through.
+/// This is replaced whenever DOSBox changes its output size.
+@property (strong) BXVideoFrameRing *frameRing;
+
+/// The framebuffer DOSBox is currently rendering into. This belongs to the emulation thread:
+/// completed frames are passed to the emulator's delegate on the main thread, from a separate buffer.
+@property (readonly, nonatomic) BXVideoFrame *currentFrame;
 
 /// The current rendering style as a DOSBox filter type constant.
 @property (assign, nonatomic) BXFilterType filterType;
@@ -118,9 +128,30 @@ typedef NS_ENUM(uint8_t, BXCGACompositeMode) {
 @property (assign, nonatomic) BXCGACompositeMode CGAComposite;
 @property (assign, nonatomic) double CGAHueAdjustment;
 
-/// The current DOSBox frameskip setting.
+/// The current DOSBox frameskip setting. While a frameskip governor is in charge,
+/// this is the lowest level the governor may choose.
 @property (assign, nonatomic) NSUInteger frameskip;
 
+/// If set, this adjusts DOSBox's frameskip level from frame to frame to keep emulation
+/// running at full speed, within the bounds of @c frameskip and the governor's maximum.
+/// Set to nil to go back to a fixed frameskip level. This is swapped from the main thread
+/// while the emulation thread reads it once per frame, so access is atomic.
+@property (strong) BXFrameskipGovernor *frameskipGovernor;
+
+/// Whether DOSBox should hand us 8-bit palettised frames in video modes and filters that allow it,
+/// rather than expanding every pixel to 32bpp on the emulation thread. Defaults to YES.
+/// Changing this resets the renderer.
+@property (assign, nonatomic) BOOL prefersIndexedColor;
+
+/// Whether frames of VGA text modes should carry a snapshot of the character grid they were rendered from,
+/// so that presenters can draw them from a glyph atlas instead of uploading their pixels. Defaults to YES.
+@property (assign) BOOL capturesTextGrid;
+
+/// The number of frames DOSBox has finished whose content was identical to the last frame
+/// delivered to the emulator's delegate, and which were therefore never delivered.
+/// This is not KVO-observable, as it changes too often: poll it instead.
+@property (readonly) NSUInteger suppressedFrameCount;
+
 /// Whether the chosen filter is actually being rendered. This will be NO if the current rendered
 /// size is smaller than the minimum size supported by the chosen filter.
 @property (readonly) BOOL filterIsActive;
@@ -135,6 +166,9 @@ typedef NS_ENUM(uint8_t, BXCGACompositeMode) {
 /// Returns the base resolution the DOS game is producing.
 @property (readonly) NSSize resolution;
 
+/// Returns the rate in frames per second at which the emulated video card is refreshing the display.
+@property (readonly) double refreshRate;
+
 
 #pragma mark -
 #pragma mark Control methods
@@ -164,8 +198,14 @@ typedef NS_ENUM(uint8_t, BXCGACompositeMode) {
 							 green: (NSUInteger)green
 							  blue: (NSUInteger)blue;
 
+/// Called by DOSBox to update the palette for 8-bit indexed frames.
+- (void) setPaletteEntries: (const GFX_PalEntry *)entries
+                startingAt: (NSUInteger)start
+                     count: (NSUInteger)count;
+
 - (void) prepareForOutputSize: (NSSize)outputSize
 					  atScale: (NSSize)scale
+                      indexed: (BOOL)indexed
 				 withCallback: (GFX_CallBack_t)newCallback;
 
 - (BOOL) startFrameWithBuffer: (void **)frameBuffer pitch: (int *)pitch;
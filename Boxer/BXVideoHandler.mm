@@ -9,11 +9,48 @@
 #import "BXVideoHandler.h"
 #import "BXEmulatorPrivate.h"
 #import "BXVideoFrame.h"
+#import "BXVideoFrameRing.h"
+#import "BXFrameTimeline.h"
+#import "BXFrameskipGovernor.h"
+#import "BXVideoRecorder.h"
+#import "BXFrameSink.h"
+#import "BXTextGrid.h"
 #import "ADBGeometry.h"
 #import "BXFilterDefinitions.h"
 
 #import "render.h"
 #import "vga.h"
+#import "pic.h"
+
+#import <atomic>
+#import <os/lock.h>
+#import <vector>
+
+
+#pragma mark -
+#pragma mark Frame content hashing
+
+/// Returns a cheap 64-bit hash of the specified bytes, used to tell whether
+/// a line that DOSBox reported as dirty has actually changed.
+static inline uint64_t BXHashBytes(const uint8_t *bytes, NSUInteger length)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = length * multiplier;
+    
+    NSUInteger i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * multiplier;
+    }
+    return hash;
+}
 
 
 #pragma mark -
@@ -39,15 +76,72 @@
 - (void) _syncCGAHueAdjustment;
 - (void) _syncCGAComposite;
 
+/// Acquires the newest published frame and passes it on to the emulator,
+/// on the main thread.
+- (void) _deliverLatestFrame;
+
+/// Hashes the dirty lines of the specified frame and compares them against the lines
+/// of the last frame we published, trimming the frame's dirty regions down to just those
+/// lines that actually differ. Returns NO if the frame is identical to the last one published.
+- (BOOL) _trimUnchangedLinesOfFrame: (BXVideoFrame *)frame;
+
+/// Captures the character grid, font, colors and cursor of the current VGA text mode into the
+/// specified frame's text grid, recording which cells differ from the last grid we published.
+/// Clears the frame's text grid if the display is not in a VGA text mode.
+- (void) _captureTextGridOfFrame: (BXVideoFrame *)frame;
+
+/// Returns the VGA text cursor's location and shape packed into a single value, or 0 if the text grid
+/// would not be captured for the current mode. Used to spot cursor changes that don't alter any pixels.
+- (uint32_t) _textCursorState;
+
 @end
 
 
 @implementation BXVideoHandler
-@synthesize currentFrame = _currentFrame;
+{
+    /// Set while a frame delivery has been queued on the main thread but not yet processed,
+    /// so that a concurrent emulator doesn't flood the main thread with deliveries.
+    std::atomic<bool> _frameDeliveryPending;
+    
+    /// The current BGRA palette for indexed frames, and a counter that's bumped whenever it changes.
+    uint32_t _palette[BXVideoFramePaletteSize];
+    NSUInteger _paletteVersion;
+    
+    /// The hash of each line of the last frame we published, and the palette version it used.
+    std::vector<uint64_t> _lineHashes;
+    NSUInteger _publishedPaletteVersion;
+    
+    /// Set when the framebuffers have been replaced, so that the next frame is published
+    /// regardless of whether its content changed.
+    BOOL _needsFramePublish;
+    
+    /// When DOSBox started rendering the current frame, in BXFrameTimeline's timebase.
+    CFTimeInterval _frameStartTime;
+    
+    /// The number of frames DOSBox has finished rendering, whether or not we published them.
+    NSUInteger _renderedFrameCount;
+    
+    /// The cells and font of the last text grid we published, and a counter that's bumped whenever the font changes.
+    std::vector<uint16_t> _textCells;
+    NSUInteger _textColumns;
+    std::vector<uint8_t> _textFont;
+    NSUInteger _textFontVersion;
+    
+    /// The text cursor state at the time of the last frame we published.
+    uint32_t _publishedCursorState;
+    
+    /// Guards the frameskip governor, which is swapped on the main thread but consulted on the emulation thread.
+    os_unfair_lock _frameskipGovernorLock;
+}
+
+@synthesize frameRing = _frameRing;
 @synthesize emulator = _emulator;
 @synthesize filterType = _filterType;
 @synthesize herculesTint = _herculesTint;
 @synthesize CGAHueAdjustment = _CGAHueAdjustment;
+@synthesize prefersIndexedColor = _prefersIndexedColor;
+@synthesize capturesTextGrid = _capturesTextGrid;
+@synthesize suppressedFrameCount = _suppressedFrameCount;
 
 - (id) init
 {
@@ -58,10 +152,18 @@
         _herculesTint = BXHerculesWhiteTint;
         _CGAComposite = BXCGACompositeAuto;
         _CGAHueAdjustment = 0.0;
+        _prefersIndexedColor = YES;
+        _capturesTextGrid = YES;
+        _frameskipGovernorLock = OS_UNFAIR_LOCK_INIT;
 	}
 	return self;
 }
 
+- (BXVideoFrame *) currentFrame
+{
+    return self.frameRing.writeFrame;
+}
+
 - (NSSize) resolution
 {
 	NSSize size = NSZeroSize;
@@ -119,14 +221,56 @@
     else return NO;
 }
 
+- (double) refreshRate
+{
+    if (self.emulator.isInitialized)
+        return (double)render.src.fps;
+    else return 0;
+}
+
 - (NSUInteger) frameskip
 {
+    BXFrameskipGovernor *governor = self.frameskipGovernor;
+    if (governor)
+        return governor.minimumFrameskip;
 	return (NSUInteger)render.frameskip.max;
 }
 
 - (void) setFrameskip: (NSUInteger)frameskip
 {
-	render.frameskip.max = (Bitu)frameskip;
+    //The governor will bring DOSBox's level up to the new minimum when the next frame finishes.
+    BXFrameskipGovernor *governor = self.frameskipGovernor;
+    if (governor)
+        governor.minimumFrameskip = frameskip;
+    else
+        render.frameskip.max = (Bitu)frameskip;
+}
+
+- (BXFrameskipGovernor *) frameskipGovernor
+{
+    os_unfair_lock_lock(&_frameskipGovernorLock);
+    BXFrameskipGovernor *governor = _frameskipGovernor;
+    os_unfair_lock_unlock(&_frameskipGovernorLock);
+    return governor;
+}
+
+- (void) setFrameskipGovernor: (BXFrameskipGovernor *)governor
+{
+    os_unfair_lock_lock(&_frameskipGovernorLock);
+    BXFrameskipGovernor *oldGovernor = _frameskipGovernor;
+    _frameskipGovernor = governor;
+    os_unfair_lock_unlock(&_frameskipGovernorLock);
+    
+    if (governor != oldGovernor)
+    {
+        //Hand over whatever level the user had chosen as the governor's minimum, and take it back afterwards.
+        NSUInteger frameskip = (oldGovernor) ? oldGovernor.minimumFrameskip : (NSUInteger)render.frameskip.max;
+        
+        if (governor)
+            governor.minimumFrameskip = frameskip;
+        else
+            render.frameskip.max = (Bitu)frameskip;
+    }
 }
 
 //Chooses the specified filter, and resets the renderer to apply the change immediately.
@@ -152,6 +296,15 @@
 	return isActive;
 }
 
+- (void) setPrefersIndexedColor: (BOOL)prefersIndexedColor
+{
+    if (prefersIndexedColor != _prefersIndexedColor)
+    {
+        _prefersIndexedColor = prefersIndexedColor;
+        [self reset];
+    }
+}
+
 - (void) setHerculesTint: (BXHerculesTintMode)tint
 {
     if (tint != _herculesTint)
@@ -235,6 +388,7 @@
 
 - (void) prepareForOutputSize: (NSSize)outputSize
                       atScale: (NSSize)scale
+                      indexed: (BOOL)indexed
                  withCallback: (GFX_CallBack_t)newCallback
 {
 	//Synchronise our record of the current video mode with the new video mode
@@ -250,17 +404,21 @@
 	//If we were in the middle of a frame then cancel it
 	_frameInProgress = NO;
 	
+    //Frame timings from the old mode say nothing about how the new one will perform.
+    [self.frameskipGovernor reset];
+    
 	_callback = newCallback;
 	
-	//Check if we can reuse our existing framebuffer: if not, create a new one
-	if (!NSEqualSizes(outputSize, self.currentFrame.size))
+	//Check if we can reuse our existing framebuffers: if not, create new ones
+    NSUInteger depth = indexed ? 1 : 4;
+	if (!NSEqualSizes(outputSize, self.frameRing.size) || depth != self.frameRing.bytesPerPixel)
 	{
-        self.currentFrame = [BXVideoFrame frameWithSize: outputSize depth: 4];
+        self.frameRing = [BXVideoFrameRing ringWithSize: outputSize depth: depth];
+        
+        _lineHashes.assign((size_t)outputSize.height, 0);
+        _needsFramePublish = YES;
 	}
 	
-    self.currentFrame.baseResolution = self.resolution;
-    self.currentFrame.containsText = nowTextMode;
-	
 	//Send notifications if the display mode has changed
 	
 	if (wasTextMode && !nowTextMode)
@@ -288,23 +446,52 @@
 		return NO;
 	}
 	
-	*buffer	= self.currentFrame.mutableBytes;
-    *pitch	= (int)self.currentFrame.pitch;
+    BXVideoFrame *frame = self.currentFrame;
+    
+    //Bring the framebuffer up to date with the last frame DOSBox drew, since DOSBox will only
+    //redraw the lines that have changed since then.
+    [self.frameRing prepareWriteFrame];
+    
+    frame.baseResolution = self.resolution;
+    frame.containsText = self.isInTextMode;
+    
+    //DOSBox updates the palette just before starting each frame, and doesn't flag any lines
+    //as dirty when it does so: the presenter can tell from the palette version instead.
+    if (frame.isIndexed && frame.paletteVersion != _paletteVersion)
+    {
+        [frame setPalette: _palette version: _paletteVersion];
+    }
     
-    [self.currentFrame clearDirtyRegions];
+	*buffer	= frame.mutableBytes;
+    *pitch	= (int)frame.pitch;
 	
+    _frameStartTime = [BXFrameTimeline currentTime];
 	_frameInProgress = YES;
 	return YES;
 }
 
 - (void) finishFrameWithChanges: (const uint16_t *)dirtyBlocks
 {
-	if (self.currentFrame)
+    //Only publish frames that were actually started: otherwise the framebuffer
+    //may not have been brought up to date with the previous frame.
+	if (self.currentFrame && _frameInProgress)
 	{
+        BXVideoFrame *frame = self.currentFrame;
+        
+        //DOSBox won't have started this frame if it was due to be skipped, so every frame
+        //that gets here was rendered. Let the governor see how long it took to get here.
+        BXFrameskipGovernor *governor = self.frameskipGovernor;
+        if (governor)
+        {
+            NSUInteger frameskip = [governor recordRenderedFrameAtTime: [BXFrameTimeline currentTime]
+                                                           refreshRate: self.refreshRate];
+            render.frameskip.max = (Bitu)frameskip;
+        }
+        
         if (dirtyBlocks)
         {
             //Convert DOSBox's array of dirty blocks into a set of ranges
-            NSUInteger i=0, currentOffset = 0, maxOffset = self.currentFrame.size.height;
+            NSUInteger i=0, currentOffset = 0, maxOffset = frame.size.height;
             while (currentOffset < maxOffset && i < MAX_DIRTY_REGIONS)
             {
                 NSUInteger regionLength = dirtyBlocks[i];
@@ -315,7 +502,7 @@
                 
                 if (isDirtyBlock)
                 {
-                    [self.currentFrame setNeedsDisplayInRegion: NSMakeRange(currentOffset, regionLength)];
+                    [frame setNeedsDisplayInRegion: NSMakeRange(currentOffset, regionLength)];
                 }
                 
                 currentOffset += regionLength;
@@ -323,13 +510,277 @@
             }
         }
         
-        self.currentFrame.timestamp = CFAbsoluteTimeGetCurrent();
-        [self.emulator _didFinishFrame: self.currentFrame];
+        //Many games redraw identical content every frame: if nothing has actually changed
+        //since the last frame we published, don't bother the presenter with this one.
+        //DOSBox will render the next frame into the same buffer.
+        BOOL frameChanged = [self _trimUnchangedLinesOfFrame: frame];
+        
+        //Let any recording take a copy of the changed lines while the frame is still ours.
+        //It sees every frame we render, whether or not we publish it, so that it can place them by emulated time.
+        frame.emulatedTime = PIC_FullIndex() / 1000.0;
+        frame.emulatedFrameNumber = _renderedFrameCount++;
+        [self.emulator.videoRecorder addFrame: frame];
+        
+        //Likewise, a frame sink sees every frame right here on the emulation thread,
+        //rather than whichever published frames the main thread gets round to.
+        [self.emulator.frameSink consumeFrame: frame];
+        
+        //The presenter draws the text cursor itself from the grid, so a cursor that moved or changed shape
+        //needs a new frame even if DOSBox's pixels didn't change: e.g. during the off phase of its blink.
+        uint32_t cursorState = [self _textCursorState];
+        BOOL cursorChanged = (cursorState != _publishedCursorState);
+        
+        if (frameChanged || cursorChanged || _needsFramePublish)
+        {
+            frame.timestamp = CFAbsoluteTimeGetCurrent();
+            _needsFramePublish = NO;
+            _publishedPaletteVersion = frame.paletteVersion;
+            _publishedCursorState = cursorState;
+            
+            [self _captureTextGridOfFrame: frame];
+            
+            //Hand the finished frame off to the presenter: after this point it belongs to the main thread,
+            //and DOSBox will render the next frame into a different buffer.
+            [self.frameRing publishWriteFrame];
+            
+            BXFrameTimeline *timeline = [BXFrameTimeline sharedTimeline];
+            if (timeline.isEnabled)
+            {
+                [timeline recordStage: BXFrameStageStarted ofFrame: frame.frameNumber atTime: _frameStartTime];
+                [timeline recordStage: BXFrameStageFinished ofFrame: frame.frameNumber];
+            }
+            
+            [self _deliverLatestFrame];
+        }
+        else
+        {
+            _suppressedFrameCount++;
+        }
 	}
     
 	_frameInProgress = NO;
 }
 
+- (BOOL) _trimUnchangedLinesOfFrame: (BXVideoFrame *)frame
+{
+    NSUInteger numRegions = frame.numDirtyRegions;
+    if (!numRegions)
+    {
+        //A palette change alters the whole frame even though DOSBox flags no lines for it.
+        return frame.isIndexed && frame.paletteVersion != _publishedPaletteVersion;
+    }
+    
+    NSRange dirtyRegions[MAX_DIRTY_REGIONS];
+    NSUInteger r;
+    for (r = 0; r < numRegions; r++)
+    {
+        dirtyRegions[r] = [frame dirtyRegionAtIndex: r];
+    }
+    [frame clearDirtyRegions];
+    
+    const uint8_t *bytes    = (const uint8_t *)frame.bytes;
+    NSUInteger pitch        = frame.pitch;
+    NSUInteger numLines     = MIN((NSUInteger)frame.size.height, _lineHashes.size());
+    
+    //Collect the runs of lines whose content differs from what we last published.
+    NSRange changedRegions[MAX_DIRTY_REGIONS];
+    NSUInteger numChangedRegions = 0;
+    
+    for (r = 0; r < numRegions; r++)
+    {
+        NSRange region = dirtyRegions[r];
+        NSUInteger line, lastLine = MIN(NSMaxRange(region), numLines);
+        
+        for (line = region.location; line < lastLine; line++)
+        {
+            uint64_t hash = BXHashBytes(bytes + (line * pitch), pitch);
+            if (hash == _lineHashes[line])
+                continue;
+            
+            _lineHashes[line] = hash;
+            
+            //Extend the previous run if this line follows on from it, or if we've run out of room
+            //for new runs; otherwise start a new run.
+            NSRange *lastRun = (numChangedRegions > 0) ? &changedRegions[numChangedRegions - 1] : NULL;
+            if (lastRun && (NSMaxRange(*lastRun) == line || numChangedRegions == MAX_DIRTY_REGIONS))
+            {
+                lastRun->length = line + 1 - lastRun->location;
+            }
+            else
+            {
+                changedRegions[numChangedRegions++] = NSMakeRange(line, 1);
+            }
+        }
+    }
+    
+    for (r = 0; r < numChangedRegions; r++)
+    {
+        [frame setNeedsDisplayInRegion: changedRegions[r]];
+    }
+    
+    if (frame.numDirtyRegions)
+        return YES;
+    
+    return frame.isIndexed && frame.paletteVersion != _publishedPaletteVersion;
+}
+
+- (uint32_t) _textCursorState
+{
+    if (!self.capturesTextGrid || !IS_VGA_ARCH || vga.mode != M_TEXT)
+        return 0;
+    
+    return ((uint32_t)vga.crtc.cursor_location_high << 24) | ((uint32_t)vga.crtc.cursor_location_low << 16) |
+        ((uint32_t)vga.crtc.cursor_start << 8) | (uint32_t)vga.crtc.cursor_end;
+}
+
+- (void) _captureTextGridOfFrame: (BXVideoFrame *)frame
+{
+    //We only know how to read the character grid straight out of VGA memory:
+    //other machines' text modes, and any DOSBox scaling, are left to the pixel path.
+    BOOL canCapture = self.capturesTextGrid && IS_VGA_ARCH && vga.mode == M_TEXT;
+    
+    NSUInteger columns      = (NSUInteger)vga.crtc.horizontal_display_end + 1;
+    NSUInteger glyphHeight  = (NSUInteger)(vga.crtc.maximum_scan_line & 0x1F) + 1;
+    NSUInteger rows         = (NSUInteger)frame.size.height / glyphHeight;
+    NSUInteger rowStride    = (NSUInteger)vga.crtc.offset * 2;
+    
+    //Only VGA's 8- and 9-dot character clocks are supported.
+    NSUInteger glyphWidth = columns ? (NSUInteger)frame.size.width / columns : 0;
+    canCapture = canCapture && (glyphWidth == 8 || glyphWidth == 9) &&
+        columns <= BXTextGridMaxColumns && rows > 0 && rows <= BXTextGridMaxRows &&
+        (glyphWidth * columns) == (NSUInteger)frame.size.width && (glyphHeight * rows) == (NSUInteger)frame.size.height;
+    
+    if (!canCapture)
+    {
+        frame.textGrid = nil;
+        _textCells.clear();
+        return;
+    }
+    
+    BXTextGrid *grid = frame.textGrid;
+    if (!grid)
+    {
+        grid = [[BXTextGrid alloc] init];
+        frame.textGrid = grid;
+    }
+    
+    [grid setColumns: columns rows: rows];
+    grid.glyphHeight = glyphHeight;
+    [grid clearChangedRuns];
+    
+    //If the grid dimensions have changed, every cell counts as changed.
+    NSUInteger numCells = columns * rows;
+    BOOL allChanged = (_textCells.size() != numCells || _textColumns != columns);
+    if (allChanged)
+    {
+        _textCells.assign(numCells, 0);
+        _textColumns = columns;
+    }
+    
+    //Read the cells out of VGA memory, where each character is followed by its attribute.
+    const uint8_t *memory   = (const uint8_t *)vga.mem.linear;
+    NSUInteger memoryMask   = (NSUInteger)vga.vmemwrap - 1;
+    NSUInteger startAddress = ((NSUInteger)vga.crtc.start_address_high << 8) | vga.crtc.start_address_low;
+    uint16_t *cells = grid.mutableCells;
+    
+    NSUInteger row, column, runStart = NSNotFound;
+    for (row = 0; row < rows; row++)
+    {
+        NSUInteger address = startAddress + (row * rowStride);
+        for (column = 0; column < columns; column++)
+        {
+            NSUInteger offset = ((address + column) * 2) & memoryMask;
+            uint16_t cell = memory[offset] | (memory[(offset + 1) & memoryMask] << 8);
+            NSUInteger index = (row * columns) + column;
+            cells[index] = cell;
+            
+            BOOL changed = allChanged || _textCells[index] != cell;
+            if (changed && runStart == NSNotFound)
+            {
+                runStart = index;
+            }
+            else if (!changed && runStart != NSNotFound)
+            {
+                [grid addChangedRun: NSMakeRange(runStart, index - runStart)];
+                runStart = NSNotFound;
+            }
+            _textCells[index] = cell;
+        }
+    }
+    if (runStart != NSNotFound)
+        [grid addChangedRun: NSMakeRange(runStart, numCells - runStart)];
+    
+    //Fonts rarely change, so only bump the version when the contents of font memory actually differ.
+    NSUInteger setLength = (BXTextGridNumGlyphs / 2) * BXTextGridGlyphStride;
+    const uint8_t *firstSet = (const uint8_t *)vga.draw.font_tables[0];
+    const uint8_t *secondSet = (const uint8_t *)vga.draw.font_tables[1];
+    if (_textFont.size() != setLength * 2 ||
+        memcmp(_textFont.data(), firstSet, setLength) != 0 ||
+        memcmp(_textFont.data() + setLength, secondSet, setLength) != 0)
+    {
+        _textFont.resize(setLength * 2);
+        memcpy(_textFont.data(), firstSet, setLength);
+        memcpy(_textFont.data() + setLength, secondSet, setLength);
+        _textFontVersion++;
+    }
+    [grid setFontWithCharacterSet: _textFont.data()
+                     characterSet: _textFont.data() + setLength
+                          version: _textFontVersion];
+    
+    //Map the 16 attribute colors through the attribute controller to the DAC.
+    uint32_t colors[BXTextGridNumColors];
+    NSUInteger i;
+    for (i = 0; i < BXTextGridNumColors; i++)
+    {
+        NSUInteger DACIndex = vga.dac.combine[i];
+        colors[i] = frame.isIndexed ? _palette[DACIndex] : (uint32_t)render.pal.lut.b32[DACIndex];
+    }
+    [grid setColors: colors];
+    
+    grid.blinkEnabled = (vga.attr.mode_control & 0x08) != 0;
+    grid.lineGraphicsEnabled = (vga.attr.mode_control & 0x04) != 0;
+    
+    NSUInteger cursorAddress = ((NSUInteger)vga.crtc.cursor_location_high << 8) | vga.crtc.cursor_location_low;
+    NSUInteger cursorOffset = cursorAddress - startAddress;
+    BOOL cursorVisible = !(vga.crtc.cursor_start & 0x20) && cursorAddress >= startAddress && rowStride > 0 &&
+        (cursorOffset / rowStride) < rows && (cursorOffset % rowStride) < columns;
+    
+    if (cursorVisible)
+    {
+        grid.cursorCell = ((cursorOffset / rowStride) * columns) + (cursorOffset % rowStride);
+        grid.cursorStartLine = vga.crtc.cursor_start & 0x1F;
+        grid.cursorEndLine = vga.crtc.cursor_end & 0x1F;
+    }
+    else
+    {
+        grid.cursorCell = NSNotFound;
+    }
+}
+
+- (void) _deliverLatestFrame
+{
+    //If the emulator is running on its own thread, queue up the delivery on the main thread
+    //and carry on without waiting. Any frames published before the main thread gets round to it
+    //will be coalesced into a single delivery of the newest frame.
+    if (![NSThread isMainThread])
+    {
+        if (!_frameDeliveryPending.exchange(true))
+        {
+            [self performSelectorOnMainThread: _cmd withObject: nil waitUntilDone: NO];
+        }
+        return;
+    }
+    
+    _frameDeliveryPending.store(false);
+    
+    BXVideoFrame *frame = [self.frameRing acquireLatestFrame];
+    if (frame && self.emulator)
+    {
+        [[BXFrameTimeline sharedTimeline] recordStage: BXFrameStageDelivered ofFrame: frame.frameNumber];
+        [self.emulator _didFinishFrame: frame];
+    }
+}
+
 - (NSUInteger) paletteEntryWithRed: (NSUInteger)red
 							 green: (NSUInteger)green
 							  blue: (NSUInteger)blue;
@@ -338,6 +789,24 @@
 	return ((blue << 0) | (green << 8) | (red << 16)) | (255U << 24);
 }
 
+- (void) setPaletteEntries: (const GFX_PalEntry *)entries
+                startingAt: (NSUInteger)start
+                     count: (NSUInteger)count
+{
+    NSAssert2(start + count <= BXVideoFramePaletteSize,
+              @"Palette range out of bounds in setPaletteEntries:startingAt:count: %lu, %lu",
+              (unsigned long)start, (unsigned long)count);
+    
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+    {
+        _palette[start + i] = (uint32_t)[self paletteEntryWithRed: entries[i].r
+                                                             green: entries[i].g
+                                                              blue: entries[i].b];
+    }
+    _paletteVersion++;
+}
+
 
 #pragma mark -
 #pragma mark Rendering strategy
@@ -22,7 +22,8 @@
 #import "YRKSpinningProgressIndicator.h"
 #import "NSView+ADBDrawingHelpers.h"
 
-#import "BXEmulator.h"
+#import "BXEmulator+BXAudio.h"
+#import "BXAudioStatisticsLayer.h"
 
 #import "BXSession+BXUIControls.h"
 #import "BXSession+BXDragDrop.h"
@@ -49,6 +50,9 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
 	
 	NSSize _currentScaledSize;
 	NSSize _currentScaledResolution;
+    
+    BXAudioStatisticsLayer *_audioStatisticsLayer;
+    NSTimer *_audioStatisticsTimer;
 }
 
 
@@ -88,6 +92,7 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
 - (void) dealloc
 {	
     [self _removeObservers];
+    [_audioStatisticsTimer invalidate];
 }
 
 - (void) _addObservers
@@ -203,6 +208,10 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
     
 	//Ensure we get frame resize notifications from the rendering view.
 	self.renderingView.postsFrameChangedNotifications = YES;
+    
+    //Overlay audio diagnostics on the DOS view if we've been asked to.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"showAudioStatistics"])
+        [self _showAudioStatistics];
 	
     //Ensure our loading spinner runs on a separate thread.
     //Disabled as this was causing CATransaction errors.
@@ -250,6 +259,27 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
 }
 
 
+- (void) _showAudioStatistics
+{
+    if (_audioStatisticsLayer) return;
+    
+    _audioStatisticsLayer = [BXAudioStatisticsLayer layer];
+    _audioStatisticsLayer.frame = CGRectMake(8, 8, 520, 48);
+    _audioStatisticsLayer.zPosition = 1;
+    _audioStatisticsLayer.contentsScale = self.window.backingScaleFactor;
+    [self.renderingView.layer addSublayer: _audioStatisticsLayer];
+    
+    __weak BXDOSWindowController *weakSelf = self;
+    _audioStatisticsTimer = [NSTimer scheduledTimerWithTimeInterval: 0.5 repeats: YES block: ^(NSTimer *timer) {
+        BXDOSWindowController *controller = weakSelf;
+        if (!controller) return;
+        
+        BXEmulator *emulator = [(BXSession *)controller.document emulator];
+        controller->_audioStatisticsLayer.statistics = emulator.audioStatistics;
+    }];
+}
+
+
 #pragma mark -
 #pragma mark Syncing window title
 
@@ -69,6 +69,10 @@
 - (void) _addObservers;
 - (void) _removeObservers;
 
+/// Overlays the emulator's audio statistics on the DOS view and refreshes them twice a second.
+/// Called from windowDidLoad if the showAudioStatistics user default is set.
+- (void) _showAudioStatistics;
+
 
 #pragma mark -
 #pragma mark Window sizing
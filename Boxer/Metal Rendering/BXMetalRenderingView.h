@@ -20,6 +20,10 @@ NS_ASSUME_NONNULL_BEGIN
 @property (assign, nonatomic) NSSize maxViewportSize;
 @property (readonly, nonatomic) NSRect viewportRect;
 
+/// A running total of the bytes of pixel data uploaded to the frame texture.
+/// Used to measure how much uploading only the dirty bands of each frame saves.
+@property (readonly, nonatomic) NSUInteger uploadedByteCount;
+
 @end
 
 NS_ASSUME_NONNULL_END
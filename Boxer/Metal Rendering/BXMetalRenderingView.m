@@ -13,6 +13,9 @@
 #import "BXMetalRenderingView+Private.h"
 #import "BXVideoFrame.h"
 #import "BXMetalLayer.h"
+#import "BXFrameTimeline.h"
+#import "BXTextGrid.h"
+#import "BXTextGridShaderTypes.h"
 
 /// Only send 1 frame at once to the GPU.
 /// Since we aren't synced to the display, even one more
@@ -21,6 +24,11 @@
 /// TODO(sgc): implement triple buffering
 #define MAX_INFLIGHT 1
 
+/// How long the text cursor and blinking characters stay in each phase, matching VGA's
+/// 16- and 32-frame blink cycles at its 70Hz text-mode refresh rate.
+#define BXTextCursorBlinkInterval (8.0 / 70.0)
+#define BXTextCharacterBlinkInterval (16.0 / 70.0)
+
 @interface BXMetalRenderingView() {
     
 }
@@ -36,10 +44,29 @@
     
     dispatch_semaphore_t    _inflightSemaphore;
     NSInteger               _skippedFrames;
+    NSUInteger              _presentedFrames;
+    CFTimeInterval          _presentationTime;
+    BOOL                    _needsRedraw;
+    CGSize                  _sourceAspect;
+    NSUInteger              _uploadedFrameNumber;
+    NSUInteger              _uploadedPaletteVersion;
+    NSUInteger              _uploadedBytes;
+    NSMutableData           *_expandedFrameData;
+    
     id<MTLDevice>           _device;
     id<MTLCommandQueue>     _commandQueue;
     MTLClearColor           _clearColor;
     
+    // Text-mode frames are drawn from their character grid by a compute pass.
+    id<MTLComputePipelineState> _textPipeline;
+    BOOL                    _textPipelineUnavailable;
+    id<MTLTexture>          _cellTexture;
+    id<MTLTexture>          _glyphTexture;
+    NSUInteger              _uploadedFontVersion;
+    BXTextGridUniforms      _textUniforms;
+    BOOL                    _renderingText;
+    BOOL                    _needsTextComposite;
+    
     BOOL _inViewportAnimation;
     BOOL _managesViewport;
     NSSize _maxViewportSize;
@@ -50,6 +77,13 @@
 
 @synthesize currentFrame=_currentFrame;
 @synthesize maxFrameSize=_maxFrameSize;
+@synthesize presentedFrameCount=_presentedFrames;
+@synthesize presentationTime=_presentationTime;
+@synthesize uploadedByteCount=_uploadedBytes;
+
+- (NSUInteger)skippedFrameCount {
+    return (NSUInteger)_skippedFrames;
+}
 
 - (instancetype)initWithCoder:(NSCoder *)coder {
     if (self = [super initWithCoder: coder]) {
@@ -132,6 +166,7 @@
     
     [self didChangeValueForKey:@"renderingStyle"];
     
+    _needsRedraw = YES;
     self.parameterGroups = _filterChain.shader.parameterGroups;
 }
 
@@ -139,33 +174,78 @@
     if (frame == nil) {
         _currentFrame = nil;
         _texture      = nil;
+        _expandedFrameData = nil;
+        _cellTexture  = nil;
+        _renderingText = NO;
         return;
     }
     
+    CFTimeInterval startTime = CACurrentMediaTime();
+    
     CGRect sourceRect = CGRectMake(0, 0, frame.size.width, frame.size.height);
     [_filterChain setSourceRect:sourceRect aspect:frame.scaledSize];
+    if (!CGSizeEqualToSize(_sourceAspect, frame.scaledSize)) {
+        _sourceAspect = frame.scaledSize;
+        _needsRedraw = YES;
+    }
     
-    if (frame != _currentFrame) {
-        if (NSIsEmptyRect(self.viewportRect)) {
-            NSRect viewportRect = [self viewportForFrame:frame];
-            [self setViewportRect:viewportRect animated:NO];
-        }
-        
-        // new buffer
-        _currentFrame = frame;
+    if (NSIsEmptyRect(self.viewportRect)) {
+        NSRect viewportRect = [self viewportForFrame:frame];
+        [self setViewportRect:viewportRect animated:NO];
+    }
+    
+    // Frames are recycled by the emulator, so the same few instances will come round
+    // again and again: we only need a new texture when the frame size changes.
+    BOOL needsFullUpload = NO;
+    if (_texture == nil || _texture.width != (NSUInteger)frame.size.width || _texture.height != (NSUInteger)frame.size.height) {
         MTLTextureDescriptor *td =
         [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
                                                            width:frame.size.width
                                                           height:frame.size.height
                                                        mipmapped:NO];
+        // Text-mode frames are written into the texture by a compute pass.
+        td.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
         _texture = [_device newTextureWithDescriptor:td];
         [_filterChain setSourceTexture:_texture];
+        needsFullUpload = YES;
+    }
+    // If we missed any frames in between, we also missed the lines they changed.
+    else if (frame.frameNumber != _uploadedFrameNumber + 1) {
+        needsFullUpload = (frame.frameNumber != _uploadedFrameNumber);
+    }
+    // Palette changes in indexed frames affect every line, whether or not it was flagged as dirty.
+    else if (frame.isIndexed && frame.paletteVersion != _uploadedPaletteVersion) {
+        needsFullUpload = YES;
     }
     
-    [_texture replaceRegion:MTLRegionMake2D(0, 0, sourceRect.size.width, sourceRect.size.height)
-                mipmapLevel:0
-                  withBytes:frame.bytes
-                bytesPerRow:frame.pitch];
+    // Switching between drawing from cells and drawing from pixels invalidates the texture's contents.
+    BXTextGrid *textGrid = [self _drawableTextGridOfFrame:frame];
+    if ((textGrid != nil) != _renderingText) {
+        needsFullUpload = YES;
+    }
+    _renderingText = (textGrid != nil);
+    
+    _currentFrame = frame;
+    
+    if (textGrid) {
+        // Text-mode frames only need their changed cells uploaded: the texture is composited from them on the GPU.
+        if (needsFullUpload || frame.frameNumber != _uploadedFrameNumber) {
+            [self _uploadTextGrid:textGrid ofFrame:frame fully:needsFullUpload];
+        }
+    } else if (needsFullUpload) {
+        // A fresh texture has no valid content yet, so the whole frame must go up
+        // regardless of which lines DOSBox reported as having changed.
+        [self _uploadLines:NSMakeRange(0, frame.size.height) ofFrame:frame];
+    } else if (frame.frameNumber != _uploadedFrameNumber) {
+        // Otherwise, only upload the bands of scanlines that DOSBox reported as dirty.
+        // If nothing changed, the texture is already up to date and we can skip
+        // both the upload and the redraw.
+        [self _uploadDirtyRegionsOfFrame:frame];
+    }
+    _uploadedFrameNumber = frame.frameNumber;
+    _uploadedPaletteVersion = frame.paletteVersion;
+    [[BXFrameTimeline sharedTimeline] recordStage:BXFrameStageUploaded ofFrame:frame.frameNumber];
+    _presentationTime += CACurrentMediaTime() - startTime;
     
     // If the frame changes size or aspect ratio, and we're responsible for the viewport ourselves,
     // then smoothly animate the transition to the new size.
@@ -175,21 +255,227 @@
     }
 }
 
+#pragma mark - Text-mode rendering
+
+/// Returns the frame's text grid if we can draw the frame from it, or nil if it must be drawn from its pixels.
+- (BXTextGrid *)_drawableTextGridOfFrame:(BXVideoFrame *)frame {
+    BXTextGrid *textGrid = frame.textGrid;
+    if (textGrid == nil || textGrid.columns == 0 || textGrid.rows == 0) {
+        return nil;
+    }
+    
+    NSUInteger glyphWidth = (NSUInteger)frame.size.width / textGrid.columns;
+    if (glyphWidth * textGrid.columns != (NSUInteger)frame.size.width ||
+        textGrid.glyphHeight * textGrid.rows != (NSUInteger)frame.size.height) {
+        return nil;
+    }
+    
+    return (self.textPipeline != nil) ? textGrid : nil;
+}
+
+- (id<MTLComputePipelineState>)textPipeline {
+    if (_textPipeline == nil && !_textPipelineUnavailable) {
+        NSError *error = nil;
+        id<MTLLibrary> library = [_device newDefaultLibrary];
+        id<MTLFunction> function = [library newFunctionWithName:@"BXRenderTextGrid"];
+        if (function != nil) {
+            _textPipeline = [_device newComputePipelineStateWithFunction:function error:&error];
+        }
+        if (_textPipeline == nil) {
+            NSLog(@"Text-mode rendering unavailable, falling back on pixel uploads: %@", error);
+            _textPipelineUnavailable = YES;
+        }
+    }
+    return _textPipeline;
+}
+
+- (void)_uploadTextGrid:(BXTextGrid *)textGrid ofFrame:(BXVideoFrame *)frame fully:(BOOL)fully {
+    NSUInteger columns = textGrid.columns;
+    NSUInteger rows = textGrid.rows;
+    
+    if (_cellTexture == nil || _cellTexture.width != columns || _cellTexture.height != rows) {
+        MTLTextureDescriptor *td =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatR16Uint
+                                                           width:columns
+                                                          height:rows
+                                                       mipmapped:NO];
+        _cellTexture = [_device newTextureWithDescriptor:td];
+        fully = YES;
+    }
+    
+    const uint16_t *cells = textGrid.cells;
+    if (fully) {
+        [_cellTexture replaceRegion:MTLRegionMake2D(0, 0, columns, rows)
+                        mipmapLevel:0
+                          withBytes:cells
+                        bytesPerRow:columns * sizeof(uint16_t)];
+    } else {
+        // Upload each run of changed cells a row at a time.
+        NSUInteger r, numRuns = textGrid.numChangedRuns;
+        for (r = 0; r < numRuns; r++) {
+            NSRange run = [textGrid changedRunAtIndex:r];
+            NSUInteger cell = run.location, end = MIN(NSMaxRange(run), columns * rows);
+            while (cell < end) {
+                NSUInteger row = cell / columns, column = cell % columns;
+                NSUInteger length = MIN(end - cell, columns - column);
+                [_cellTexture replaceRegion:MTLRegionMake2D(column, row, length, 1)
+                                mipmapLevel:0
+                                  withBytes:cells + cell
+                                bytesPerRow:length * sizeof(uint16_t)];
+                cell += length;
+            }
+        }
+    }
+    
+    if (_glyphTexture == nil) {
+        MTLTextureDescriptor *td =
+        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatR8Uint
+                                                           width:BXTextGridGlyphStride
+                                                          height:BXTextGridNumGlyphs
+                                                       mipmapped:NO];
+        _glyphTexture = [_device newTextureWithDescriptor:td];
+        _uploadedFontVersion = NSNotFound;
+    }
+    if (textGrid.fontVersion != _uploadedFontVersion) {
+        [_glyphTexture replaceRegion:MTLRegionMake2D(0, 0, BXTextGridGlyphStride, BXTextGridNumGlyphs)
+                         mipmapLevel:0
+                           withBytes:textGrid.fontData
+                         bytesPerRow:BXTextGridGlyphStride];
+        _uploadedFontVersion = textGrid.fontVersion;
+    }
+    
+    _textUniforms.columns = (unsigned int)columns;
+    _textUniforms.rows = (unsigned int)rows;
+    _textUniforms.glyphWidth = (unsigned int)((NSUInteger)frame.size.width / columns);
+    _textUniforms.glyphHeight = (unsigned int)textGrid.glyphHeight;
+    _textUniforms.cursorCell = (textGrid.cursorCell != NSNotFound) ? (unsigned int)textGrid.cursorCell : 0xFFFFFFFF;
+    _textUniforms.cursorStartLine = (unsigned int)textGrid.cursorStartLine;
+    _textUniforms.cursorEndLine = (unsigned int)textGrid.cursorEndLine;
+    memcpy(_textUniforms.colors, textGrid.colors, sizeof(_textUniforms.colors));
+    
+    unsigned int flags = _textUniforms.flags & (BXTextGridShaderBlinkPhaseOn | BXTextGridShaderCursorPhaseOn);
+    if (textGrid.blinkEnabled)          flags |= BXTextGridShaderBlinkEnabled;
+    if (textGrid.lineGraphicsEnabled)   flags |= BXTextGridShaderLineGraphics;
+    _textUniforms.flags = flags;
+    
+    _needsTextComposite = YES;
+    _needsRedraw = YES;
+}
+
+/// Advances the cursor and character blink phases, flagging the text grid for recompositing
+/// if either has changed. Only redraws when something on screen actually blinks.
+- (void)_updateTextBlinkPhases {
+    CFTimeInterval now = CACurrentMediaTime();
+    BOOL cursorOn = ((NSUInteger)(now / BXTextCursorBlinkInterval) % 2) == 0;
+    BOOL blinkOn = ((NSUInteger)(now / BXTextCharacterBlinkInterval) % 2) == 0;
+    
+    unsigned int flags = _textUniforms.flags & ~(BXTextGridShaderBlinkPhaseOn | BXTextGridShaderCursorPhaseOn);
+    if (cursorOn)   flags |= BXTextGridShaderCursorPhaseOn;
+    if (blinkOn)    flags |= BXTextGridShaderBlinkPhaseOn;
+    
+    unsigned int changedFlags = flags ^ _textUniforms.flags;
+    _textUniforms.flags = flags;
+    
+    BOOL cursorChanged = (changedFlags & BXTextGridShaderCursorPhaseOn) && _textUniforms.cursorCell != 0xFFFFFFFF;
+    BOOL blinkChanged = (changedFlags & BXTextGridShaderBlinkPhaseOn) && (flags & BXTextGridShaderBlinkEnabled);
+    if (cursorChanged || blinkChanged) {
+        _needsTextComposite = YES;
+        _needsRedraw = YES;
+    }
+}
+
+- (void)_encodeTextCompositeWithCommandBuffer:(id<MTLCommandBuffer>)commandBuffer {
+    id<MTLComputeCommandEncoder> encoder = [commandBuffer computeCommandEncoder];
+    encoder.label = @"text grid";
+    [encoder setComputePipelineState:_textPipeline];
+    [encoder setTexture:_cellTexture atIndex:0];
+    [encoder setTexture:_glyphTexture atIndex:1];
+    [encoder setTexture:_texture atIndex:2];
+    [encoder setBytes:&_textUniforms length:sizeof(_textUniforms) atIndex:0];
+    
+    MTLSize threadgroupSize = MTLSizeMake(16, 16, 1);
+    MTLSize threadgroups = MTLSizeMake((_texture.width + 15) / 16, (_texture.height + 15) / 16, 1);
+    [encoder dispatchThreadgroups:threadgroups threadsPerThreadgroup:threadgroupSize];
+    [encoder endEncoding];
+}
+
+#pragma mark - Pixel uploads
+
+- (void)_uploadDirtyRegionsOfFrame:(BXVideoFrame *)frame {
+    NSUInteger i, numRegions = frame.numDirtyRegions;
+    for (i = 0; i < numRegions; i++) {
+        [self _uploadLines:[frame dirtyRegionAtIndex:i] ofFrame:frame];
+    }
+}
+
+- (void)_uploadLines:(NSRange)lines ofFrame:(BXVideoFrame *)frame {
+    NSUInteger width    = frame.size.width;
+    NSUInteger height   = frame.size.height;
+    
+    // DOSBox's dirty blocks can overshoot the bottom of the frame on the last block.
+    if (lines.location >= height) {
+        return;
+    }
+    NSUInteger numLines = MIN(lines.length, height - lines.location);
+    if (numLines == 0) {
+        return;
+    }
+    
+    const uint8_t *bytes;
+    NSUInteger pitch;
+    if (frame.isIndexed) {
+        // Indexed frames get expanded to BGRA here rather than on the emulation thread,
+        // and only for the lines we actually need to upload.
+        pitch = width * 4;
+        if (_expandedFrameData.length != pitch * height) {
+            _expandedFrameData = [[NSMutableData alloc] initWithLength:pitch * height];
+        }
+        [frame expandLines:NSMakeRange(lines.location, numLines)
+                intoBuffer:_expandedFrameData.mutableBytes
+                     pitch:pitch];
+        bytes = _expandedFrameData.bytes;
+    } else {
+        pitch = frame.pitch;
+        bytes = frame.bytes;
+    }
+    
+    [_texture replaceRegion:MTLRegionMake2D(0, lines.location, width, numLines)
+                mipmapLevel:0
+                  withBytes:bytes + (lines.location * pitch)
+                bytesPerRow:pitch];
+    _uploadedBytes += numLines * width * 4;
+    _needsRedraw = YES;
+}
+
 - (void)drawRect:(NSRect)dirtyRect {
-    if (_texture == nil) {
+    // Nothing has changed since the last frame we presented: the layer is still
+    // showing that frame, so there's no need to run the filter chain again.
+    if (_renderingText) {
+        [self _updateTextBlinkPhases];
+    }
+    if (_texture == nil || !_needsRedraw) {
         return;
     }
     
     @autoreleasepool {
         if (dispatch_semaphore_wait(_inflightSemaphore, DISPATCH_TIME_NOW) != 0) {
             _skippedFrames++;
+            [[BXFrameTimeline sharedTimeline] recordSkippedFrame];
         } else {
+            CFTimeInterval startTime = CACurrentMediaTime();
+            
             id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
             commandBuffer.label = @"offscreen";
             [commandBuffer enqueue];
+            if (_renderingText && _needsTextComposite) {
+                [self _encodeTextCompositeWithCommandBuffer:commandBuffer];
+                _needsTextComposite = NO;
+            }
             [_filterChain renderOffscreenPassesWithCommandBuffer:commandBuffer];
             [commandBuffer commit];
             
+            _needsRedraw = NO;
+            
             id<CAMetalDrawable> drawable = _videoLayer.nextDrawable;
             if (drawable != nil) {
                 MTLRenderPassDescriptor *rpd = [MTLRenderPassDescriptor new];
@@ -210,11 +496,30 @@
                     dispatch_semaphore_signal(inflight);
                 }];
                 
+                BXFrameTimeline *timeline = [BXFrameTimeline sharedTimeline];
+                NSUInteger frameNumber = _currentFrame.frameNumber;
+                if (timeline.isEnabled) {
+                    if (@available(macOS 10.15.4, *)) {
+                        [drawable addPresentedHandler:^(id<MTLDrawable> presentedDrawable) {
+                            // A presentedTime of 0 means the drawable was dropped without reaching the screen.
+                            if (presentedDrawable.presentedTime > 0) {
+                                [timeline recordStage:BXFrameStagePresented ofFrame:frameNumber atTime:presentedDrawable.presentedTime];
+                            }
+                        }];
+                    }
+                }
+                
                 [commandBuffer presentDrawable:drawable];
                 [commandBuffer commit];
+                [timeline recordStage:BXFrameStageCommitted ofFrame:frameNumber];
+                _presentedFrames++;
             } else {
+                // We didn't get to present, so try again next time round.
+                _needsRedraw = YES;
                 dispatch_semaphore_signal(self->_inflightSemaphore);
             }
+            
+            _presentationTime += CACurrentMediaTime() - startTime;
         }
     }
 }
@@ -226,6 +531,7 @@
     NSRect rect = [self convertRectToBacking:self.bounds];
     _videoLayer.drawableSize = NSSizeToCGSize(rect.size);
     [_filterChain setDrawableSize:_videoLayer.drawableSize];
+    _needsRedraw = YES;
     if (self.currentFrame) {
         [self setViewportRect:[self viewportForFrame:self.currentFrame] animated:NO];
     }
@@ -233,6 +539,7 @@
 
 - (void)setFrameSize:(NSSize)newSize {
     [super setFrameSize:newSize];
+    _needsRedraw = YES;
     if (!self.inLiveResize) {
         [self updateRenderState];
     }
@@ -320,6 +627,7 @@
     if (!NSEqualRects(newRect, _viewportRect))
     {
         _viewportRect = newRect;
+        _needsRedraw = YES;
         [self needsDisplay];
     }
 }
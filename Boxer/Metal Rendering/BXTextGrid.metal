@@ -0,0 +1,66 @@
+//
+//  BXTextGrid.metal
+//  Boxer
+//
+//  Draws a VGA text-mode character grid into a frame-sized texture, from a cell texture
+//  of character/attribute pairs and a bitmap font atlas.
+//
+
+#include <metal_stdlib>
+#include "BXTextGridShaderTypes.h"
+
+using namespace metal;
+
+kernel void BXRenderTextGrid(texture2d<uint, access::read>      cells       [[texture(0)]],
+                             texture2d<uint, access::read>      glyphs      [[texture(1)]],
+                             texture2d<float, access::write>    output      [[texture(2)]],
+                             constant BXTextGridUniforms        &uniforms   [[buffer(0)]],
+                             uint2                              gid         [[thread_position_in_grid]])
+{
+    if (gid.x >= output.get_width() || gid.y >= output.get_height()) {
+        return;
+    }
+
+    uint column = gid.x / uniforms.glyphWidth;
+    uint row    = gid.y / uniforms.glyphHeight;
+    uint dot    = gid.x % uniforms.glyphWidth;
+    uint line   = gid.y % uniforms.glyphHeight;
+
+    uint cell       = cells.read(uint2(column, row)).r;
+    uint character  = cell & 0xFF;
+    uint attribute  = (cell >> 8) & 0xFF;
+    uint foreground = attribute & 0x0F;
+    uint background = attribute >> 4;
+
+    bool blinks = false;
+    if (uniforms.flags & BXTextGridShaderBlinkEnabled) {
+        blinks = (background & 0x08) != 0;
+        background &= 0x07;
+    }
+
+    // Bit 3 of the attribute selects between the two character sets, as on real hardware.
+    uint glyph      = character + (((attribute >> 3) & 1) * 256);
+    uint glyphLine  = glyphs.read(uint2(line, glyph)).r;
+
+    bool lit;
+    if (dot < 8) {
+        lit = ((glyphLine >> (7 - dot)) & 1) != 0;
+    } else {
+        // The ninth column repeats the eighth for line-drawing characters, and is blank otherwise.
+        lit = (uniforms.flags & BXTextGridShaderLineGraphics) && character >= 0xC0 && character <= 0xDF && (glyphLine & 1);
+    }
+
+    if (blinks && !(uniforms.flags & BXTextGridShaderBlinkPhaseOn)) {
+        lit = false;
+    }
+
+    uint cellIndex = (row * uniforms.columns) + column;
+    if (cellIndex == uniforms.cursorCell && (uniforms.flags & BXTextGridShaderCursorPhaseOn) &&
+        line >= uniforms.cursorStartLine && line <= uniforms.cursorEndLine) {
+        lit = true;
+    }
+
+    uint color = uniforms.colors[lit ? foreground : background];
+    float4 rgba = float4((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255) / 255.0;
+    output.write(rgba, gid);
+}
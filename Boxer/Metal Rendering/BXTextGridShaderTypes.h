@@ -0,0 +1,32 @@
+//
+//  BXTextGridShaderTypes.h
+//  Boxer
+//
+//  Types shared between BXMetalRenderingView and the text grid compute kernel.
+//
+
+#ifndef BXTextGridShaderTypes_h
+#define BXTextGridShaderTypes_h
+
+typedef enum {
+    BXTextGridShaderBlinkEnabled        = 1 << 0,
+    BXTextGridShaderBlinkPhaseOn        = 1 << 1,
+    BXTextGridShaderCursorPhaseOn       = 1 << 2,
+    BXTextGridShaderLineGraphics        = 1 << 3,
+} BXTextGridShaderFlags;
+
+typedef struct {
+    unsigned int columns;
+    unsigned int rows;
+    unsigned int glyphWidth;
+    unsigned int glyphHeight;
+    /// The index of the cell containing the cursor, or 0xFFFFFFFF if the cursor is hidden.
+    unsigned int cursorCell;
+    unsigned int cursorStartLine;
+    unsigned int cursorEndLine;
+    unsigned int flags;
+    /// BGRA colors, as packed into a little-endian 32-bit value.
+    unsigned int colors[16];
+} BXTextGridUniforms;
+
+#endif /* BXTextGridShaderTypes_h */
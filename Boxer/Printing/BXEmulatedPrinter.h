@@ -135,12 +135,16 @@ typedef NS_ENUM(uint8_t, BXESCPCharset) {
 #define BXEmulatedPrinterMaxVerticalTabs 16
 #define BXEmulatedPrinterMaxHorizontalTabs 32
 
+/// How many bytes sent through the parallel port the printer will collect before handling them.
+#define BXEmulatedPrinterPendingDataSize 4096
+
 
 #pragma mark -
 #pragma mark Interface declaration
 
 @protocol BXEmulatedPrinterDelegate;
 @class BXPrintSession;
+@class BXPrinterGlyphMetrics;
 
 /// \c BXEmulatedPrinter emulates a color dot-matrix printer compatible with the ESC/P command set.
 /// Adapted from Gulikoza's Megabuild printer patch.
@@ -158,6 +162,10 @@ typedef NS_ENUM(uint8_t, BXESCPCharset) {
     BOOL _autoFeed;
     BOOL _hasReadData;
     
+    //Bytes strobed in through the parallel port that have not been handled yet.
+    uint8_t _pendingData[BXEmulatedPrinterPendingDataSize];
+    NSUInteger _numPendingDataBytes;
+    
     BOOL _expectingESCCommand;
     BOOL _expectingFSCommand;
     uint16_t _currentESCPCommand;
@@ -236,6 +244,20 @@ typedef NS_ENUM(uint8_t, BXESCPCharset) {
     NSMutableDictionary *_textAttributes;
     BOOL _textAttributesNeedUpdate;
     
+    //The run of characters printed since the run was last drawn to the page.
+    //Characters are batched up like this so that a whole line of text can be drawn at once.
+    NSMutableData *_glyphRunCharacters; //!< The unicode characters in the run, as unichars.
+    NSMutableData *_glyphRunOffsets;    //!< The X position of each character in the run (in inches), as doubles.
+    NSDictionary *_glyphRunAttributes;  //!< The text attributes the run will be drawn with.
+    BOOL _glyphRunDoubleStrike;         //!< Whether the run will be drawn in doublestrike.
+    double _glyphRunY;                  //!< The vertical position of the run's print head (in inches).
+    NSPoint _glyphRunOrigin;            //!< Where the run will be drawn from, in Quartz points.
+    double _glyphRunNextX;              //!< Where the print head will be if the run continues uninterrupted.
+    
+    //Cached glyph advances for each font used so far, keyed by font.
+    NSMutableDictionary *_glyphMetricsCache;
+    BXPrinterGlyphMetrics *_currentGlyphMetrics;
+    
     BXPrintSession *_currentSession;
 }
 
@@ -366,9 +388,19 @@ typedef NS_ENUM(uint8_t, BXESCPCharset) {
 /// or \c NO subsequent times (or if no data has been sent since the printer was last reset.)
 - (BOOL) acknowledge;
 
-/// Called by the parallel port subsystem to feed each byte of data to the printer.
+/// Feeds a single byte of data to the printer.
 - (void) handleDataByte: (uint8_t)byte;
 
+/// Feeds the specified bytes of data to the printer. Runs of text and bitmap data are consumed
+/// in bulk, so this is much cheaper per byte than feeding the same data in one byte at a time.
+- (void) handleData: (const uint8_t *)bytes length: (NSUInteger)length;
+
+/// Handles any bytes that have been sent through the parallel port but not yet handled.
+/// The parallel port subsystem sends data one byte at a time: the printer collects these bytes up
+/// and handles them in bulk whenever this is called, or as soon as it has collected
+/// @c BXEmulatedPrinterPendingDataSize bytes. Called once per emulated millisecond.
+- (void) flushPendingData;
+
 /// Called by the parallel port subsystem to set/retrieve the bits on the printer's parallel port.
 @property (readonly, nonatomic) uint8_t statusRegister;
 @property (assign, nonatomic) uint8_t controlRegister;
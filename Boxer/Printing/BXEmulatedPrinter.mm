@@ -10,6 +10,10 @@
 #import "printer_charmaps.h"
 #import "BXCoalface.h"
 #import "BXPrintSession.h"
+#import "BXPrintDisplayList.h"
+#import <CoreText/CoreText.h>
+#import <unordered_map>
+#import <vector>
 
 
 #pragma mark -
@@ -59,6 +63,153 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 #define VERTICAL_TABS_UNDEFINED 255
 #define UNIT_SIZE_UNDEFINED -1
 
+//! Special parameter counts for commands in the ESC/P command table.
+#define BXESCPParamsVariadic 0xFD       //!< Parameters continue until a NUL sentinel.
+#define BXESCPParamsUserDefined 0xFE    //!< User-defined character commands, which are unsupported.
+#define BXESCPParamsUnknown 0xFF        //!< Commands we don't recognise at all.
+
+//! The number of parameter bytes that follow each ESC/P and FS command we recognise.
+//! FS commands are flagged with IBM_FLAG.
+typedef struct {
+    uint16_t command;
+    uint8_t numParams;
+} BXESCPCommandInfo;
+
+static const BXESCPCommandInfo BXESCPCommands[] = {
+    { 0x0a, 0 },                      // Reverse line feed (ESC LF)
+    { 0x0c, 0 },                      // Return to top of current page (ESC FF)
+    { 0x0e, 0 },                      // Select double-width printing (one line) (ESC SO)
+    { 0x0f, 0 },                      // Select condensed printing (ESC SI)
+    { '#', 0 },                       // Cancel MSB control (ESC #)
+    { '0', 0 },                       // Select 1/8-inch line spacing (ESC 0)
+    { '1', 0 },                       // Select 7/60-inch line spacing (ESC 1)
+    { '2', 0 },                       // Select 1/6-inch line spacing (ESC 2)
+    { '4', 0 },                       // Select italic font (ESC 4)
+    { '5', 0 },                       // Cancel italic font (ESC 5)
+    { '6', 0 },                       // Enable printing of upper control codes (ESC 6)
+    { '7', 0 },                       // Enable upper control codes (ESC 7)
+    { '8', 0 },                       // Disable paper-out detector (ESC 8)
+    { '9', 0 },                       // Enable paper-out detector (ESC 9)
+    { '<', 0 },                       // Unidirectional mode (one line) (ESC <)
+    { '=', 0 },                       // Set MSB to 0 (ESC =)
+    { '>', 0 },                       // Set MSB to 1 (ESC >)
+    { '@', 0 },                       // Initialize printer (ESC @)
+    { 'E', 0 },                       // Select bold font (ESC E)
+    { 'F', 0 },                       // Cancel bold font (ESC F)
+    { 'G', 0 },                       // Select double-strike printing (ESC G)
+    { 'H', 0 },                       // Cancel double-strike printing (ESC H)
+    { 'M', 0 },                       // Select 10.5-point, 12-cpi (ESC M)
+    { 'O', 0 },                       // Cancel bottom margin [conflict] (ESC O)
+    { 'P', 0 },                       // Select 10.5-point, 10-cpi (ESC P)
+    { 'T', 0 },                       // Cancel superscript/subscript printing (ESC T)
+    { '^', 0 },                       // Enable printing of all character codes on next character (ESC ^)
+    { 'g', 0 },                       // Select 10.5-point, 15-cpi (ESC g)
+    { IBM_FLAG | '4', 0 },            // Select italic font (FS 4) (= ESC 4)
+    { IBM_FLAG | '5', 0 },            // Cancel italic font (FS 5) (= ESC 5)
+    { IBM_FLAG | 'F', 0 },            // Select forward feed mode (FS F)
+    { IBM_FLAG | 'R', 0 },            // Select reverse feed mode (FS R)
+    { 0x19, 1 },                      // Control paper loading/ejecting (ESC EM)
+    { ' ', 1 },                       // Set intercharacter space (ESC SP)
+    { '!', 1 },                       // Master select (ESC !)
+    { '+', 1 },                       // Set n/360-inch line spacing (ESC +)
+    { '-', 1 },                       // Turn underline on/off (ESC -)
+    { '/', 1 },                       // Select vertical tab channel (ESC /)
+    { '3', 1 },                       // Set n/180-inch line spacing (ESC 3)
+    { 'A', 1 },                       // Set n/60-inch line spacing (ESC A)
+    { 'C', 1 },                       // Set page length in lines (ESC C)
+    { 'I', 1 },                       // Select character type and print pitch (ESC I)
+    { 'J', 1 },                       // Advance print position vertically (ESC J)
+    { 'N', 1 },                       // Set bottom margin (ESC N)
+    { 'Q', 1 },                       // Set right margin (ESC Q)
+    { 'R', 1 },                       // Select an international character set (ESC R)
+    { 'S', 1 },                       // Select superscript/subscript printing (ESC S)
+    { 'U', 1 },                       // Turn unidirectional mode on/off (ESC U)
+    { 'W', 1 },                       // Turn double-width printing on/off (ESC W)
+    { 'a', 1 },                       // Select justification (ESC a)
+    { 'f', 1 },                       // Absolute horizontal tab in columns [conflict] (ESC f)
+    { 'h', 1 },                       // Select double or quadruple size (ESC h)
+    { 'i', 1 },                       // Immediate print (ESC i)
+    { 'j', 1 },                       // Reverse paper feed (ESC j)
+    { 'k', 1 },                       // Select typeface (ESC k)
+    { 'l', 1 },                       // Set left margin (ESC l)
+    { 'p', 1 },                       // Turn proportional mode on/off (ESC p)
+    { 'r', 1 },                       // Select printing color (ESC r)
+    { 's', 1 },                       // Low-speed mode on/off (ESC s)
+    { 't', 1 },                       // Select character table (ESC t)
+    { 'w', 1 },                       // Turn double-height printing on/off (ESC w)
+    { 'x', 1 },                       // Select LQ or draft (ESC x)
+    { '~', 1 },                       // Select/Deselect slash zero (ESC ~)
+    { IBM_FLAG | '2', 1 },            // Select 1/6-inch line spacing (FS 2) (= ESC 2)
+    { IBM_FLAG | '3', 1 },            // Set n/360-inch line spacing (FS 3) (= ESC +)
+    { IBM_FLAG | 'A', 1 },            // Set n/60-inch line spacing (FS A) (= ESC A)
+    { IBM_FLAG | 'C', 1 },            // Select LQ type style (FS C) (= ESC k)
+    { IBM_FLAG | 'E', 1 },            // Select character width (FS E)
+    { IBM_FLAG | 'I', 1 },            // Select character table (FS I) (= ESC t)
+    { IBM_FLAG | 'S', 1 },            // Select High Speed/High Density elite pitch (FS S)
+    { IBM_FLAG | 'V', 1 },            // Turn double-height printing on/off (FS V) (= ESC w)
+    { '$', 2 },                       // Set absolute horizontal print position (ESC $)
+    { '?', 2 },                       // Reassign bit-image mode (ESC ?)
+    { 'K', 2 },                       // Select 60-dpi graphics (ESC K)
+    { 'L', 2 },                       // Select 120-dpi graphics (ESC L)
+    { 'Y', 2 },                       // Select 120-dpi, double-speed graphics (ESC Y)
+    { 'Z', 2 },                       // Select 240-dpi graphics (ESC Z)
+    { '\\', 2 },                      // Set relative horizontal print position (ESC \)
+    { 'c', 2 },                       // Set horizontal motion index (HMI) [conflict] (ESC c)
+    { 'e', 2 },                       // Set vertical tab stops every n lines (ESC e)
+    { IBM_FLAG | 'Z', 2 },            // Print 24-bit hex-density graphics (FS Z)
+    { '*', 3 },                       // Select bit image (ESC *)
+    { 'X', 3 },                       // Select font by pitch and point [conflict] (ESC X)
+    { '[', 7 },                       // Select character height, width, line spacing
+    { 'b', BXESCPParamsVariadic },    // Set vertical tabs in VFU channels (ESC b)
+    { 'B', BXESCPParamsVariadic },    // Set vertical tabs (ESC B)
+    { 'D', BXESCPParamsVariadic },    // Set horizontal tabs (ESC D)
+    { '%', BXESCPParamsUserDefined }, // Select user-defined set (ESC %)
+    { '&', BXESCPParamsUserDefined }, // Define user-defined characters (ESC &)
+    { ':', BXESCPParamsUserDefined }, // Copy ROM to RAM (ESC :)
+    { '(', 1 },                       // Extended ESCP/2 two-byte sequence (ESC ()
+};
+
+//! Returns the number of parameter bytes that follow the specified ESC/P (or FS) command code,
+//! or one of the special parameter counts above. Looked up in a table built from BXESCPCommands.
+static uint8_t BXESCPParameterCount(uint16_t command)
+{
+    static uint8_t paramCounts[2][256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        memset(paramCounts, BXESCPParamsUnknown, sizeof(paramCounts));
+        for (size_t i=0; i < sizeof(BXESCPCommands) / sizeof(BXESCPCommandInfo); i++)
+        {
+            uint16_t code = BXESCPCommands[i].command;
+            paramCounts[(code & IBM_FLAG) ? 1 : 0][code & 0xFF] = BXESCPCommands[i].numParams;
+        }
+    });
+    
+    return paramCounts[(command & IBM_FLAG) ? 1 : 0][command & 0xFF];
+}
+
+//! A bitmask of the control characters handled by _parseControlCharacter:, all of which are below 0x20.
+//! Any other byte outside of a command is printed as a character.
+//! This must be kept in sync with _parseControlCharacter:.
+static const uint32_t BXESCPControlCharacterMask =
+    (1 << 0x00) | (1 << '\a') | (1 << '\b') | (1 << '\t') | (1 << '\n') | (1 << '\v') | (1 << '\f') | (1 << '\r') |
+    (1 << 0x0e) | (1 << 0x0f) | (1 << 0x11) | (1 << 0x12) | (1 << 0x13) | (1 << 0x14) | (1 << 0x18) | (1 << 0x1b) | (1 << 0x1c);
+
+NS_INLINE BOOL BXESCPIsControlCharacter(uint8_t byte)
+{
+    return byte < 0x20 && (BXESCPControlCharacterMask & (1 << byte)) != 0;
+}
+
+//! Rewrites the most significant bit (bit 7) of the specified byte to be 0 or 1, according to the specified MSB control mode.
+NS_INLINE uint8_t BXApplyMSBControl(uint8_t byte, BXESCPMSBControl mode)
+{
+    if (mode == BXMSB0)
+        return byte & ~(1 << 7);
+    else if (mode == BXMSB1)
+        return byte | (1 << 7);
+    else
+        return byte;
+}
+
 #pragma mark -
 #pragma mark Private interface declaration
 
@@ -129,7 +280,7 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 - (void) _prepareForBitmapWithDensity: (NSUInteger)density columns: (NSUInteger)numColumns;
 
 //! Draws the specified bitmap data (expected to be 8-bits-per-pixel black and white) as a bitmap image
-//! into the preview and PDF contexts. This gives slightly fuzzier output than the vectorized technique
+//! into the current page. This gives slightly fuzzier output than the vectorized technique
 //! below, but better rendering speeds and smaller PDF filesizes.
 - (void) _drawImageWithBitmapData: (NSData *)bitmapData
                             width: (NSUInteger)pixelWidth
@@ -138,7 +289,7 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
                             color: (CGColorRef)color;
 
 //! Draws the specified bitmap data (expected to be 8-bits-per-pixel black and white) as a series of
-//! horizontal vector lines into the preview and PDF contexts. This is crisper than the bitmap technique
+//! horizontal vector lines into the current page. This is crisper than the bitmap technique
 //! above at large magnifications, but slower and produces larger PDF files.
 - (void) _drawVectorizedBitmapData: (NSData *)bitmapData
                              width: (NSUInteger)pixelWidth
@@ -164,16 +315,27 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 #pragma mark -
 #pragma mark Input handling
 
-//! Returns YES if the specified byte was handled as part of a bitmap,
-//! or NO otherwise.
-- (BOOL) _handleBitmapData: (uint8_t)byte;
+//! Pours as many of the specified bytes as it needs into the bitmap currently being loaded,
+//! drawing the bitmap once it is complete. Returns the number of bytes consumed.
+- (NSUInteger) _handleBitmapData: (const uint8_t *)bytes length: (NSUInteger)length;
+
+//! Draws the bitmap that has just finished loading into the current page, and advances the print head past it.
+- (void) _finishBitmap;
 
 //! Returns YES if the specified byte was handled as part of a control command,
 //! or NO if it should be treated as character data to print.
 - (BOOL) _handleControlCharacter: (uint8_t)byte;
 
-//! Prints the specified character to the page.
-- (void) _printCharacter: (uint8_t)byte;
+//! Adds the specified characters to the current run of glyphs, advancing the print head past each one.
+//! The run is drawn to the page once the line ends, or the text attributes change, or a command arrives.
+- (void) _printCharacters: (const uint8_t *)characters length: (NSUInteger)length;
+
+//! Draws the current run of glyphs into the current page, then clears the run.
+//! Does nothing if the run is empty.
+- (void) _drawGlyphRun;
+
+//! Returns the cached glyph metrics for the specified font, creating them if they don't yet exist.
+- (BXPrinterGlyphMetrics *) _glyphMetricsForFont: (NSFont *)font;
 
 
 #pragma mark -
@@ -189,6 +351,14 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 - (void) _endESCPCommand;
 
 
+#pragma mark -
+#pragma mark Parallel port handling
+
+//! Adds the specified byte to the data waiting to be handled by flushPendingData.
+//! Called whenever the parallel port strobes in a new byte.
+- (void) _queueDataByte: (uint8_t)byte;
+
+
 #pragma mark -
 #pragma mark Geometry
 
@@ -200,6 +370,64 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 @end
 
 
+#pragma mark -
+#pragma mark Glyph metrics
+
+//! \c BXPrinterGlyphMetrics caches the advance widths of characters in a single font,
+//! so that printing a character doesn't mean laying out a string just to measure it.
+@interface BXPrinterGlyphMetrics : NSObject
+
+@property (readonly, strong, nonatomic) NSFont *font;
+
+- (instancetype) initWithFont: (NSFont *)font;
+
+//! Returns the distance in points that the specified character advances the text.
+- (CGFloat) advanceForCharacter: (unichar)character;
+
+@end
+
+@implementation BXPrinterGlyphMetrics
+{
+    std::unordered_map<unichar, CGFloat> _advances;
+}
+
+- (instancetype) initWithFont: (NSFont *)font
+{
+    self = [super init];
+    if (self)
+    {
+        _font = font;
+    }
+    return self;
+}
+
+- (CGFloat) advanceForCharacter: (unichar)character
+{
+    auto cachedAdvance = _advances.find(character);
+    if (cachedAdvance != _advances.end())
+        return cachedAdvance->second;
+    
+    CGFloat advance;
+    CGGlyph glyph;
+    if (CTFontGetGlyphsForCharacters((__bridge CTFontRef)self.font, &character, &glyph, 1))
+    {
+        advance = [self.font advancementForCGGlyph: glyph].width;
+    }
+    //If the font has no glyph for this character, AppKit will substitute one from another font
+    //when it's drawn: so measure it the slow way to find out how wide that substitute will be.
+    else
+    {
+        NSString *string = [NSString stringWithCharacters: &character length: 1];
+        advance = [string sizeWithAttributes: @{ NSFontAttributeName: self.font }].width;
+    }
+    
+    _advances[character] = advance;
+    return advance;
+}
+
+@end
+
+
 #pragma mark -
 #pragma mark Implementation
 
@@ -268,6 +496,10 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
         _controlRegister = BXEmulatedPrinterControlReset;
         _initialized = NO;
         
+        _glyphRunCharacters = [[NSMutableData alloc] init];
+        _glyphRunOffsets = [[NSMutableData alloc] init];
+        _glyphMetricsCache = [[NSMutableDictionary alloc] init];
+        
         //IMPLEMENTATION NOTE: we do most of our real initialization in _prepareForPrinting,
         //which is only called once printing support has actually been requested.
     }
@@ -666,9 +898,21 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
                                 forKey: NSSuperscriptAttributeName];
     }
     
+    _currentGlyphMetrics = [self _glyphMetricsForFont: font];
     _textAttributesNeedUpdate = NO;
 }
 
+- (BXPrinterGlyphMetrics *) _glyphMetricsForFont: (NSFont *)font
+{
+    BXPrinterGlyphMetrics *metrics = [_glyphMetricsCache objectForKey: font];
+    if (!metrics)
+    {
+        metrics = [[BXPrinterGlyphMetrics alloc] initWithFont: font];
+        [_glyphMetricsCache setObject: metrics forKey: font];
+    }
+    return metrics;
+}
+
 + (NSFontDescriptor *) _fontDescriptorForEmulatedTypeface: (BXESCPTypeface)typeface
                                                      bold: (BOOL)bold
                                                    italic: (BOOL)italic
@@ -948,6 +1192,8 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 
 - (void) _startNewLine
 {
+    [self _drawGlyphRun];
+    
     [self _moveHeadToX: self.leftMargin];
     [self _moveHeadToY: self.headPosition.y + self.lineSpacing];
     
@@ -967,6 +1213,9 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 
 - (void) finishPrintSession
 {
+    //Print anything that's still waiting to be handled
+    [self flushPendingData];
+    
     //Commit the current page as long as it's not entirely blank
     [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
     
@@ -984,6 +1233,9 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 
 - (void) cancelPrintSession
 {
+    //Handle anything that's still waiting, so that it goes into the cancelled session and not the next one
+    [self flushPendingData];
+    
     //Commit the current page as long as it's not entirely blank
     [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
     
@@ -1001,6 +1253,9 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 {
     BOOL addedPage = NO;
     
+    //Get any text still waiting to be printed onto the page before we finish it.
+    [self _drawGlyphRun];
+    
     //If a page is in progress, finish it up.
     if (self.currentSession.pageInProgress)
     {
@@ -1050,33 +1305,77 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
 
 - (void) handleDataByte: (uint8_t)byte
 {
+    [self handleData: &byte length: 1];
+}
+
+- (void) handleData: (const uint8_t *)bytes length: (NSUInteger)length
+{
+    if (!length)
+        return;
+    
     if (!_initialized)
         [self _prepareForPrinting];
     
     _hasReadData = YES;
     
-    //For some unsupported ESC/P commands, we know ahead of time that we can ignore
-    //all of the bytes making up that command.
-    if (_numDataBytesToIgnore > 0)
+    NSUInteger offset = 0;
+    while (offset < length)
     {
-        _numDataBytesToIgnore--;
-        return;
-    }
+        NSUInteger remaining = length - offset;
         
-    //If an MSB control mode is active, rewrite the most significant bit (bit 7) to be 0 or 1.
-    if (_msbMode == BXMSB0)
-        byte &= ~(1 << 7);
-    else if (_msbMode == BXMSB1)
-        byte |= (1 << 7);
-    
-    //If we're in the middle of loading up bitmap data, handle this byte as part of the bitmap.
-    if ([self _handleBitmapData: byte]) return;
-    
-    //Check if we should handle the byte as a control character.
-    if ([self _handleControlCharacter: byte]) return;
-    
-    //If we get this far, we should treat the byte as a regular character and print it to the page.
-    [self _printCharacter: byte];
+        //For some unsupported ESC/P commands, we know ahead of time that we can ignore
+        //all of the bytes making up that command.
+        if (_numDataBytesToIgnore > 0)
+        {
+            NSUInteger numToIgnore = MIN(remaining, _numDataBytesToIgnore);
+            _numDataBytesToIgnore -= numToIgnore;
+            offset += numToIgnore;
+            continue;
+        }
+        
+        //If we're in the middle of loading up bitmap data, pour as much as we can into the bitmap.
+        if (self.bitmapData)
+        {
+            offset += [self _handleBitmapData: bytes + offset length: remaining];
+            continue;
+        }
+        
+        //Gather up as many bytes as we can that should be printed as regular characters, and print them together.
+        //Outside of a command, that's every byte up to the next control character. Bytes we've been told to print
+        //regardless of what they are get printed even in the middle of a command.
+        BOOL expectingCommandBytes = (_expectingESCCommand || _expectingFSCommand || _numParamsExpected > 0);
+        uint8_t characters[256];
+        NSUInteger numCharacters = 0, maxCharacters = MIN(remaining, sizeof(characters));
+        while (numCharacters < maxCharacters)
+        {
+            //If an MSB control mode is active, rewrite the most significant bit (bit 7) to be 0 or 1.
+            uint8_t byte = BXApplyMSBControl(bytes[offset + numCharacters], _msbMode);
+            
+            if (_numDataBytesToPrint > 0)
+                _numDataBytesToPrint--;
+            else if (expectingCommandBytes || BXESCPIsControlCharacter(byte))
+                break;
+            
+            characters[numCharacters++] = byte;
+        }
+        
+        if (numCharacters > 0)
+        {
+            [self _printCharacters: characters length: numCharacters];
+            offset += numCharacters;
+            continue;
+        }
+        
+        //If we get this far, the next byte is a control character or part of a command.
+        //Any command ends the current run of text, so that the text is drawn to the page
+        //before anything the command goes on to draw.
+        uint8_t byte = BXApplyMSBControl(bytes[offset], _msbMode);
+        if ([self _handleControlCharacter: byte])
+            [self _drawGlyphRun];
+        else
+            [self _printCharacters: &byte length: 1];
+        offset++;
+    }
 }
 
 - (void) _prepareForBitmapWithDensity: (NSUInteger)density
@@ -1182,21 +1481,8 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
     CGFloat rangeMapping[2] = { 255, 0 };
     CGImageRef image = CGImageMaskCreate(pixelWidth, pixelHeight, 1, 8, pixelWidth, provider, rangeMapping, YES);
     
-    //Draw into the preview and PDF context in turn.
-    NSArray *contexts = [NSArray arrayWithObjects:
-                         self.currentSession.previewContext,
-                         self.currentSession.PDFContext,
-                         nil];
-    
-    for (NSGraphicsContext *context in contexts)
-    {
-        CGContextRef ctx = context.CGContext;
-        CGContextSaveGState(ctx);
-            CGContextClipToMask(ctx, imageRect, image);
-            CGContextSetFillColorWithColor(ctx, color);
-            CGContextFillRect(ctx, imageRect);
-        CGContextRestoreGState(ctx);
-    }
+    //Record the image as a mask to fill with the print color.
+    [self.currentSession.currentPageDisplayList addMask: image inRect: imageRect color: color];
     
     CGDataProviderRelease(provider);
     CGImageRelease(image);
@@ -1215,18 +1501,8 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
                                 imageRect.size.height / (CGFloat)pixelHeight);
     CGFloat topOffset = CGRectGetMaxY(imageRect);
     
-    //Draw into the preview and PDF context in turn.
-    NSArray *contexts = [NSArray arrayWithObjects:
-                         self.currentSession.previewContext,
-                         self.currentSession.PDFContext,
-                         nil];
-    
-    for (NSGraphicsContext *context in contexts)
-    {
-        CGContextRef ctx = context.CGContext;
-        CGContextSaveGState(ctx);
-        CGContextSetFillColorWithColor(ctx, color);
-    }
+    //The lines we find are collected up and recorded onto the page together.
+    std::vector<CGRect> lines;
     
     //Loop over each row of the bitmap looking for runs of pixels.
     //We draw each run as a single rectangle, which results in a much tidier
@@ -1270,12 +1546,7 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
                                          topOffset - (dotSize.height * (row + 1)),
                                          dotSize.width * lineWidth,
                                          dotSize.height);
-                
-                for (NSGraphicsContext *context in contexts)
-                {
-                    CGContextRef ctx = context.CGContext;
-                    CGContextFillRect(ctx, line);
-                }
+                lines.push_back(line);
                 
                 lineWidth = 0;
             }
@@ -1284,19 +1555,17 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
         }
     }
     
-    for (NSGraphicsContext *context in contexts)
-    {
-        CGContextRef ctx = context.CGContext;
-        CGContextRestoreGState(ctx);
-    }
+    [self.currentSession.currentPageDisplayList addRects: lines.data() count: lines.size() color: color];
 }
 
-- (BOOL) _handleBitmapData: (uint8_t)byte
+- (NSUInteger) _handleBitmapData: (const uint8_t *)bytes length: (NSUInteger)length
 {
-    if (self.bitmapData)
+    uint8_t *pixels = (uint8_t *)self.bitmapData.mutableBytes;
+    
+    NSUInteger numConsumed = 0;
+    while (numConsumed < length && _bitmapCurrentColumn < _bitmapWidth)
     {
-        //Draw the specified byte into the current column.
-        uint8_t *pixels = (uint8_t *)self.bitmapData.mutableBytes;
+        uint8_t byte = BXApplyMSBControl(bytes[numConsumed++], _msbMode);
         
         //Bitmap pixels are fed in as a column of 8 bits, ordered with the most significant bit at the top.
         //We want to pour these columns into a regular 2-dimensional byte array, ordered from left to right
@@ -1319,148 +1588,180 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
                 _bitmapCurrentColumn++;
             }
         }
-        
-        //Once we've got all the pixels for this image, render it into the page.
-        if (_bitmapCurrentColumn >= _bitmapWidth)
-        {
-            //Convert the current color into a CGColor for our draw methods to use.
-            NSColor *printColor = [self.class _colorForColorCode: self.color];
-            CGColorRef cgColor = CGColorCreateGenericCMYK(printColor.cyanComponent,
-                                                          printColor.magentaComponent,
-                                                          printColor.yellowComponent,
-                                                          printColor.blackComponent,
-                                                          printColor.alphaComponent);
-            
-            NSSize dotSize = NSMakeSize(72.0 / _bitmapDPI.width,
-                                        72.0 / _bitmapDPI.height);
-            
-            NSPoint offset = [self convertPointFromPage: self.headPosition];
-            NSSize bitmapSize = NSMakeSize(dotSize.width * _bitmapWidth,
-                                           dotSize.height * _bitmapHeight);
-            CGRect imageRect = CGRectMake(offset.x, offset.y - bitmapSize.height,
-                                          bitmapSize.width, bitmapSize.height);
-            
-            [self _prepareCanvasForPrinting];
-            
-            //Draw the bitmap into our rendering contexts, either as a straight image or as a vectorised path.
-            [self _drawVectorizedBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
-            //[self _drawImageWithBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
-            
-            //Discard the bitmap once we're done with it
-            self.bitmapData = nil;
-            
-            CGColorRelease(cgColor);
-            
-            //Advance the print head beyond the bitmap data
-            CGFloat newX = self.headPosition.x + (_bitmapWidth * (1 / _bitmapDPI.width));
-            [self _moveHeadToX: newX];
-            
-            //Let the context know we printed something
-            if ([self.delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
-                [self.delegate printer: self didPrintToPageInSession: self.currentSession];
-        }
-        
-        return YES;
-    }
-    else
-    {
-        return NO;
     }
+    
+    //Once we've got all the pixels for this image, render it into the page.
+    if (_bitmapCurrentColumn >= _bitmapWidth)
+        [self _finishBitmap];
+    
+    return numConsumed;
 }
 
-- (void) _printCharacter: (uint8_t)character
+- (void) _finishBitmap
 {
-    //FIXME: this routine naively prints each glyph one by one, which prevents OSX from doing kerning or ligatures.
-    //Instead, when in proportional mode we could batch up characters into strings and print them once we hit the
-    //end of the line (or are interrupted by other commands.)
-    
-    //I have no real idea why this is here, it was just in the original implementation with no explanation given.
-    //Perhaps there's some DOS programs that send 1s instead of spaces??
-    if (character == 0x01)
-        character = ' ';
-    
-    //If our text attributes are dirty, rebuild them now
-    if (_textAttributesNeedUpdate)
-        [self _updateTextAttributes];
-    
-    //Locate the unicode character to print
-    unichar codepoint = _charMap[character];
-    
-    //Construct a string for drawing the glyph and work out how big it will be rendered.
-    NSString *stringToPrint = [NSString stringWithCharacters: &codepoint length: 1];
-    NSSize stringSize = [stringToPrint sizeWithAttributes: self.textAttributes];
+    //Convert the current color into a CGColor for our draw methods to use.
+    NSColor *printColor = [self.class _colorForColorCode: self.color];
+    CGColorRef cgColor = CGColorCreateGenericCMYK(printColor.cyanComponent,
+                                                  printColor.magentaComponent,
+                                                  printColor.yellowComponent,
+                                                  printColor.blackComponent,
+                                                  printColor.alphaComponent);
+    
+    NSSize dotSize = NSMakeSize(72.0 / _bitmapDPI.width,
+                                72.0 / _bitmapDPI.height);
+    
+    NSPoint offset = [self convertPointFromPage: self.headPosition];
+    NSSize bitmapSize = NSMakeSize(dotSize.width * _bitmapWidth,
+                                   dotSize.height * _bitmapHeight);
+    CGRect imageRect = CGRectMake(offset.x, offset.y - bitmapSize.height,
+                                  bitmapSize.width, bitmapSize.height);
     
-    double stringWidth = stringSize.width / 72.0;
-    double descenderHeight = [[self.textAttributes objectForKey: NSFontAttributeName] descender] / 72.0;
-    
-    //If we're printing in fixed-width, work out how big a space the string should fill
-    double advance = 0;
-    if (self.proportional)
-    {
-        advance = stringWidth;
-    }
-    else
-    {
-        advance = self.effectiveCharacterWidth;
-    }
+    [self _prepareCanvasForPrinting];
     
-    //Draw the glyph at the current position off the print head,
-    //centered within the space it is expected to occupy.
-    NSPoint textOrigin = self.headPosition;
+    //Draw the bitmap into our rendering contexts, either as a straight image or as a vectorised path.
+    [self _drawVectorizedBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
+    //[self _drawImageWithBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
     
-    //The virtual head position is positioned at the top of the line to print,
-    //but ESC/P printers print text on a baseline that's 20/180 inch below this point
-    //(regardless of the current font size.) This ensures that baselines always line
-    //up regardless of font size.
-    //(Also note that we have to take the descender height into consideration because
-    //AppKit's drawAtPoint: function draws from the bottom of the descender, not the baseline.)
-    textOrigin.y += BXESCPBaselineOffset - descenderHeight;
+    //Discard the bitmap once we're done with it
+    self.bitmapData = nil;
     
-    //Position the glyph in the middle of the expected character width.
-    //This prevents characters in proportional-but-monospaced fonts bunching up together.
-    textOrigin.x += (advance - stringWidth) * 0.5;
+    CGColorRelease(cgColor);
     
+    //Advance the print head beyond the bitmap data
+    CGFloat newX = self.headPosition.x + (_bitmapWidth * (1 / _bitmapDPI.width));
+    [self _moveHeadToX: newX];
     
-    NSPoint drawPos = [self convertPointFromPage: textOrigin];
+    //Let the context know we printed something
+    if ([self.delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
+        [self.delegate printer: self didPrintToPageInSession: self.currentSession];
+}
+
+- (void) _printCharacters: (const uint8_t *)characters length: (NSUInteger)length
+{
+    //If our text attributes are dirty, rebuild them now.
+    //Nothing we do while printing changes them, so they'll hold for all of these characters.
+    if (_textAttributesNeedUpdate)
+        [self _updateTextAttributes];
     
-    //Draw into the preview and PDF context in turn.
-    [self _prepareCanvasForPrinting];
-    NSArray *contexts = [NSArray arrayWithObjects:
-                         self.currentSession.previewContext,
-                         self.currentSession.PDFContext,
-                         nil];
+    BOOL proportional = self.proportional;
+    double characterWidth = self.effectiveCharacterWidth;
+    double letterSpacing = self.effectiveLetterSpacing;
     
-    for (NSGraphicsContext *context in contexts)
+    for (NSUInteger i=0; i < length; i++)
     {
-        [NSGraphicsContext saveGraphicsState];
-            [NSGraphicsContext setCurrentContext: context];
+        uint8_t character = characters[i];
         
-            [stringToPrint drawAtPoint: drawPos
-                        withAttributes: self.textAttributes];
+        //I have no real idea why this is here, it was just in the original implementation with no explanation given.
+        //Perhaps there's some DOS programs that send 1s instead of spaces??
+        if (character == 0x01)
+            character = ' ';
         
-            //In doublestrike mode, reprint the same string shifted slightly down to 'thicken' it.
-            if (self.doubleStrike)
-            {
-                [stringToPrint drawAtPoint: NSMakePoint(drawPos.x, drawPos.y + 0.5)
-                            withAttributes: self.textAttributes];
-            }
-        [NSGraphicsContext restoreGraphicsState];
+        //Locate the unicode character to print and look up how wide it will be rendered.
+        unichar codepoint = _charMap[character];
+        double glyphWidth = [_currentGlyphMetrics advanceForCharacter: codepoint] / 72.0;
+        
+        //If we're printing in fixed-width, work out how big a space the glyph should fill
+        double advance = (proportional) ? glyphWidth : characterWidth;
+        
+        //(The previous character may have wrapped us onto a new page.)
+        [self _prepareCanvasForPrinting];
+        
+        //If this character can't carry on from the end of the current run - because the text attributes
+        //have changed or the print head has been moved in the meantime - then draw that run and start a new one.
+        BOOL continuesRun = (_glyphRunAttributes == self.textAttributes &&
+                             _glyphRunDoubleStrike == self.doubleStrike &&
+                             _glyphRunY == self.headPosition.y &&
+                             _glyphRunNextX == self.headPosition.x);
+        
+        if (_glyphRunCharacters.length && !continuesRun)
+            [self _drawGlyphRun];
+        
+        if (!_glyphRunCharacters.length)
+        {
+            _glyphRunAttributes = self.textAttributes;
+            _glyphRunDoubleStrike = self.doubleStrike;
+            _glyphRunY = self.headPosition.y;
+            
+            //The virtual head position is positioned at the top of the line to print,
+            //but ESC/P printers print text on a baseline that's 20/180 inch below this point
+            //(regardless of the current font size.) This ensures that baselines always line
+            //up regardless of font size.
+            //(Also note that we have to take the descender height into consideration because
+            //AppKit's drawAtPoint: function draws from the bottom of the descender, not the baseline.)
+            //We work out the drawing origin now rather than when the run is drawn, in case a command
+            //changes the page geometry in the meantime.
+            double descenderHeight = [[self.textAttributes objectForKey: NSFontAttributeName] descender] / 72.0;
+            NSPoint textOrigin = NSMakePoint(0, self.headPosition.y + BXESCPBaselineOffset - descenderHeight);
+            _glyphRunOrigin = [self convertPointFromPage: textOrigin];
+        }
+        
+        //Position the glyph in the middle of the expected character width.
+        //This prevents characters in proportional-but-monospaced fonts bunching up together.
+        double glyphOffset = self.headPosition.x + ((advance - glyphWidth) * 0.5);
+        
+        [_glyphRunCharacters appendBytes: &codepoint length: sizeof(unichar)];
+        [_glyphRunOffsets appendBytes: &glyphOffset length: sizeof(double)];
+        
+        //Advance the head past the glyph.
+        CGFloat newX = self.headPosition.x + advance + letterSpacing;
+        
+        //Wrap the line if the character after this one would go over the right margin.
+        //(This may also trigger a new page.)
+        if (newX + advance > self.rightMargin)
+        {
+            [self _startNewLine];
+        }
+        else
+        {
+            [self _moveHeadToX: newX];
+        }
+        
+        _glyphRunNextX = self.headPosition.x;
     }
+}
+
+- (void) _drawGlyphRun
+{
+    NSUInteger numGlyphs = _glyphRunCharacters.length / sizeof(unichar);
+    if (!numGlyphs)
+        return;
     
-    //Advance the head past the string.
-    CGFloat newX = self.headPosition.x + advance + self.effectiveLetterSpacing;
-    
-    //Wrap the line if the character after this one would go over the right margin.
-    //(This may also trigger a new page.)
-	if (newX + advance > self.rightMargin)
+    const unichar *characters = (const unichar *)_glyphRunCharacters.bytes;
+    const double *offsets = (const double *)_glyphRunOffsets.bytes;
+    NSFont *font = [_glyphRunAttributes objectForKey: NSFontAttributeName];
+    BXPrinterGlyphMetrics *metrics = [self _glyphMetricsForFont: font];
+    
+    //Kern each glyph so that the one after it lands exactly where the print head placed it.
+    //This lets us lay out and draw the whole run in one go, rather than one glyph at a time.
+    //Ligatures are turned off since they would throw off the glyph positions.
+    //The run's string is only built here, once the whole run is known.
+    NSString *runString = [[NSString alloc] initWithCharacters: characters length: numGlyphs];
+    NSMutableAttributedString *runToPrint = [[NSMutableAttributedString alloc] initWithString: runString
+                                                                                   attributes: _glyphRunAttributes];
+    [runToPrint addAttribute: NSLigatureAttributeName value: @(0) range: NSMakeRange(0, numGlyphs)];
+    NSUInteger i;
+    for (i=0; i < numGlyphs - 1; i++)
     {
-        [self _startNewLine];
-	}
-    else
+        CGFloat glyphWidth = [metrics advanceForCharacter: characters[i]];
+        CGFloat kerning = ((offsets[i+1] - offsets[i]) * 72.0) - glyphWidth;
+        [runToPrint addAttribute: NSKernAttributeName value: @(kerning) range: NSMakeRange(i, 1)];
+    }
+    
+    NSPoint drawPos = NSMakePoint(offsets[0] * 72.0, _glyphRunOrigin.y);
+    
+    BXPrintDisplayList *page = self.currentSession.currentPageDisplayList;
+    [page addText: runToPrint atPoint: drawPos];
+    
+    //In doublestrike mode, reprint the same run shifted slightly down to 'thicken' it.
+    if (_glyphRunDoubleStrike)
     {
-        [self _moveHeadToX: newX];
+        [page addText: runToPrint atPoint: NSMakePoint(drawPos.x, drawPos.y + 0.5)];
     }
     
+    [_glyphRunCharacters setLength: 0];
+    [_glyphRunOffsets setLength: 0];
+    _glyphRunAttributes = nil;
+    
     if ([self.delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
         [self.delegate printer: self didPrintToPageInSession: self.currentSession];
 }
@@ -1511,140 +1812,34 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
     _numParamsRead = 0;
     
     //Work out how many extra bytes we should expect for this command
-    switch (_currentESCPCommand)
-    {
-        case 0x0a: // Reverse line feed											(ESC LF)
-        case 0x0c: // Return to top of current page								(ESC FF)
-        case 0x0e: // Select double-width printing (one line)					(ESC SO)
-        case 0x0f: // Select condensed printing									(ESC SI)
-        case '#': // Cancel MSB control                                         (ESC #)
-        case '0': // Select 1/8-inch line spacing								(ESC 0)
-        case '1': // Select 7/60-inch line spacing								(ESC 1)
-        case '2': // Select 1/6-inch line spacing								(ESC 2)
-        case '4': // Select italic font                                         (ESC 4)
-        case '5': // Cancel italic font                                         (ESC 5)
-        case '6': // Enable printing of upper control codes                     (ESC 6)
-        case '7': // Enable upper control codes                                 (ESC 7)
-        case '8': // Disable paper-out detector                                 (ESC 8)
-        case '9': // Enable paper-out detector									(ESC 9)
-        case '<': // Unidirectional mode (one line)                             (ESC <)
-        case '=': // Set MSB to 0												(ESC =)
-        case '>': // Set MSB to 1												(ESC >)
-        case '@': // Initialize printer                                         (ESC @)
-        case 'E': // Select bold font											(ESC E)
-        case 'F': // Cancel bold font											(ESC F)
-        case 'G': // Select double-strike printing								(ESC G)
-        case 'H': // Cancel double-strike printing								(ESC H)
-        case 'M': // Select 10.5-point, 12-cpi									(ESC M)
-        case 'O': // Cancel bottom margin [conflict]							(ESC O)
-        case 'P': // Select 10.5-point, 10-cpi									(ESC P)
-        case 'T': // Cancel superscript/subscript printing						(ESC T)
-        case '^': // Enable printing of all character codes on next character	(ESC ^)
-        case 'g': // Select 10.5-point, 15-cpi									(ESC g)
-            
-        case IBM_FLAG | '4': // Select italic font								(FS 4)	(= ESC 4)
-        case IBM_FLAG | '5': // Cancel italic font								(FS 5)	(= ESC 5)
-        case IBM_FLAG | 'F': // Select forward feed mode						(FS F)
-        case IBM_FLAG | 'R': // Select reverse feed mode						(FS R)
-            _numParamsExpected = 0;
-            break;
-            
-        case 0x19: // Control paper loading/ejecting							(ESC EM)
-        case ' ': // Set intercharacter space									(ESC SP)
-        case '!': // Master select												(ESC !)
-        case '+': // Set n/360-inch line spacing								(ESC +)
-        case '-': // Turn underline on/off										(ESC -)
-        case '/': // Select vertical tab channel								(ESC /)
-        case '3': // Set n/180-inch line spacing								(ESC 3)
-        case 'A': // Set n/60-inch line spacing								(ESC A)
-        case 'C': // Set page length in lines									(ESC C)
-        case 'I': // Select character type and print pitch						(ESC I)
-        case 'J': // Advance print position vertically							(ESC J)
-        case 'N': // Set bottom margin											(ESC N)
-        case 'Q': // Set right margin											(ESC Q)
-        case 'R': // Select an international character set						(ESC R)
-        case 'S': // Select superscript/subscript printing						(ESC S)
-        case 'U': // Turn unidirectional mode on/off							(ESC U)
-            //case 0x56: // Repeat data												(ESC V)
-        case 'W': // Turn double-width printing on/off							(ESC W)
-        case 'a': // Select justification										(ESC a)
-        case 'f': // Absolute horizontal tab in columns [conflict]				(ESC f)
-        case 'h': // Select double or quadruple size							(ESC h)
-        case 'i': // Immediate print											(ESC i)
-        case 'j': // Reverse paper feed										(ESC j)
-        case 'k': // Select typeface											(ESC k)
-        case 'l': // Set left margin											(ESC l)
-        case 'p': // Turn proportional mode on/off								(ESC p)
-        case 'r': // Select printing color										(ESC r)
-        case 's': // Low-speed mode on/off										(ESC s)
-        case 't': // Select character table									(ESC t)
-        case 'w': // Turn double-height printing on/off						(ESC w)
-        case 'x': // Select LQ or draft										(ESC x)
-        case '~': // Select/Deselect slash zero								(ESC ~)
-            
-        case IBM_FLAG | '2': // Select 1/6-inch line spacing					(FS 2)	(= ESC 2)
-        case IBM_FLAG | '3': // Set n/360-inch line spacing						(FS 3)	(= ESC +)
-        case IBM_FLAG | 'A': // Set n/60-inch line spacing						(FS A)	(= ESC A)
-        case IBM_FLAG | 'C':	// Select LQ type style							(FS C)	(= ESC k)
-        case IBM_FLAG | 'E': // Select character width							(FS E)
-        case IBM_FLAG | 'I': // Select character table							(FS I)	(= ESC t)
-        case IBM_FLAG | 'S': // Select High Speed/High Density elite pitch		(FS S)
-        case IBM_FLAG | 'V': // Turn double-height printing on/off				(FS V)	(= ESC w)
-            _numParamsExpected = 1;
-            break;
-            
-        case '$': // Set absolute horizontal print position                     (ESC $)
-        case '?': // Reassign bit-image mode									(ESC ?)
-        case 'K': // Select 60-dpi graphics                                     (ESC K)
-        case 'L': // Select 120-dpi graphics									(ESC L)
-        case 'Y': // Select 120-dpi, double-speed graphics						(ESC Y)
-        case 'Z': // Select 240-dpi graphics									(ESC Z)
-        case '\\': // Set relative horizontal print position					(ESC \)
-        case 'c': // Set horizontal motion index (HMI)	[conflict]				(ESC c)
-        case 'e': // Set vertical tab stops every n lines						(ESC e)
-        case IBM_FLAG | 'Z': // Print 24-bit hex-density graphics				(FS Z)
-            _numParamsExpected = 2;
-            break;
-            
-        case '*': // Select bit image											(ESC *)
-        case 'X': // Select font by pitch and point [conflict]					(ESC X)
-            _numParamsExpected = 3;
-            break;
-            
-        case '[': // Select character height, width, line spacing
-            _numParamsExpected = 7;
-            break;
-            
-        case 'b': // Set vertical tabs in VFU channels							(ESC b)
-        case 'B': // Set vertical tabs											(ESC B)
-            _numParamsExpected = UINT_MAX;
-            _numVerticalTabs = 0;
-            break;
-            
-        case 'D': // Set horizontal tabs										(ESC D)
+    uint8_t numParams = BXESCPParameterCount(_currentESCPCommand);
+    switch (numParams)
+    {
+        case BXESCPParamsVariadic:
             _numParamsExpected = UINT_MAX;
-            _numHorizontalTabs = 0;
+            if (_currentESCPCommand == 'D')
+                _numHorizontalTabs = 0;
+            else
+                _numVerticalTabs = 0;
             break;
             
-        case '%': // Select user-defined set									(ESC %)
-        case '&': // Define user-defined characters                             (ESC &)
-        case ':': // Copy ROM to RAM											(ESC :)
+        case BXESCPParamsUserDefined:
             NSLog(@"PRINTER: User-defined characters not supported.");
             //TODO: we should at least parse these commands so that
             //we're not treating their parameters as garbage data
             [self _endESCPCommand];
             break;
             
-        case '(': // Extended ESCP/2 two-byte sequence
-            _numParamsExpected = 1;
-            break;
-            
-        default:
+        case BXESCPParamsUnknown:
             NSLog(@"PRINTER: Unknown command %@ %c, unable to skip parameters.",
                   (_currentESCPCommand & IBM_FLAG) ? @"FS" : @"ESC", _currentESCPCommand);
             
             [self _endESCPCommand];
             break;
+            
+        default:
+            _numParamsExpected = numParams;
+            break;
     }
     
     //If we don't need any parameters for this command, execute it straight away
@@ -2507,26 +2702,62 @@ typedef NS_OPTIONS(uint8_t, BXEmulatedPrinterStatus) {
     return status;
 }
 
+- (void) _queueDataByte: (uint8_t)byte
+{
+    //Prepare the printer straight away, so that the status register reflects that we've started printing.
+    if (!_initialized)
+        [self _prepareForPrinting];
+    
+    if (_numPendingDataBytes >= BXEmulatedPrinterPendingDataSize)
+        [self flushPendingData];
+    
+    _pendingData[_numPendingDataBytes++] = byte;
+    
+    //Acknowledge the byte now, even though we won't handle it until later.
+    _hasReadData = YES;
+}
+
+- (void) flushPendingData
+{
+    if (!_numPendingDataBytes) return;
+    
+    //Reset the count first, in case handling the data leads back here.
+    NSUInteger numBytes = _numPendingDataBytes;
+    _numPendingDataBytes = 0;
+    [self handleData: _pendingData length: numBytes];
+}
+
 - (void) setControlRegister: (uint8_t)controlFlags
 {
     BOOL resetWasOn = (_controlRegister & BXEmulatedPrinterControlReset) == BXEmulatedPrinterControlReset;
     BOOL resetIsOn  = (controlFlags & BXEmulatedPrinterControlReset) == BXEmulatedPrinterControlReset;
 	if (_initialized && resetIsOn && !resetWasOn)
+    {
+        //Handle everything sent before the reset, before resetting.
+        [self flushPendingData];
         [self resetHard];
+    }
     
-	//When the strobe signal flicks on then off, read the next byte
-    //from the data register and print it.
+	//When the strobe signal flicks on then off, read the next byte from the data register
+    //and queue it up to be printed.
     BOOL strobeWasOn = (_controlRegister & BXEmulatedPrinterControlStrobe);
     BOOL strobeIsOn = (controlFlags & BXEmulatedPrinterControlStrobe);
 	if (strobeWasOn && !strobeIsOn)
     {
-        [self handleDataByte: self.dataRegister];
+        [self _queueDataByte: self.dataRegister];
 	}
     
     //CHECKME: shouldn't we toggle the auto-linefeed behaviour *before* processing the data?
 	if (_initialized)
     {
-        self.autoFeed = (controlFlags & BXEmulatedPrinterControlAutoFeed) == BXEmulatedPrinterControlAutoFeed;
+        BOOL autoFeed = (controlFlags & BXEmulatedPrinterControlAutoFeed) == BXEmulatedPrinterControlAutoFeed;
+        
+        //Auto-linefeed affects how carriage returns are handled, so handle everything
+        //sent so far under the old setting before changing it.
+        if (autoFeed != self.autoFeed)
+            [self flushPendingData];
+        
+        self.autoFeed = autoFeed;
     }
     
 	_controlRegister = controlFlags;
@@ -0,0 +1,48 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Cocoa/Cocoa.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// @brief BXPrintDisplayList records everything printed onto a single page, so that it can be
+/// drawn later into as many contexts as needed.
+///
+/// @discussion An emulated printer adds runs of text, bitmap masks and filled rules to the list
+/// as it prints them. The print session replays the list into its PDF once the page is finished,
+/// and into page previews whenever they are displayed. All coordinates are in Quartz points,
+/// with the origin at the bottom left of the page.
+@interface BXPrintDisplayList : NSObject
+
+/// The size of the page in inches.
+@property (readonly, nonatomic) NSSize pageSize;
+
+/// The number of items recorded so far.
+@property (readonly, nonatomic) NSUInteger count;
+
+- (instancetype) initWithPageSize: (NSSize)pageSize;
+
+/// Records a run of text drawn from the specified point, as if by @c -[NSAttributedString drawAtPoint:].
+- (void) addText: (NSAttributedString *)text atPoint: (NSPoint)point;
+
+/// Records a fill of the specified rectangle in the specified color, masked by the specified image mask.
+- (void) addMask: (CGImageRef)mask inRect: (CGRect)rect color: (CGColorRef)color;
+
+/// Records a fill of each of the specified rectangles in the specified color.
+- (void) addRects: (const CGRect *)rects count: (NSUInteger)numRects color: (CGColorRef)color;
+
+/// Draws every recorded item into the specified context.
+- (void) drawInContext: (NSGraphicsContext *)context;
+
+/// Draws the recorded items in the specified range into the specified context, in the order they
+/// were recorded. Used to bring an existing rendering of the page up to date with newer items.
+- (void) drawItemsInRange: (NSRange)range inContext: (NSGraphicsContext *)context;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,143 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXPrintDisplayList.h"
+#import <vector>
+
+
+#pragma mark -
+#pragma mark Private types
+
+typedef NS_ENUM(uint8_t, BXPrintDisplayListItemType) {
+    BXPrintDisplayListItemText,
+    BXPrintDisplayListItemMask,
+    BXPrintDisplayListItemRects,
+};
+
+//! A single recorded drawing operation. Only the fields relevant to the item's type are used.
+//! The CoreGraphics objects are held as ids so that ARC takes care of retaining them.
+struct BXPrintDisplayListItem {
+    BXPrintDisplayListItemType type;
+
+    NSAttributedString *text;
+    NSPoint point;
+
+    id color;                   //!< A CGColorRef.
+    id mask;                    //!< A CGImageRef.
+    CGRect rect;
+    std::vector<CGRect> rects;
+};
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXPrintDisplayList
+{
+    std::vector<BXPrintDisplayListItem> _items;
+}
+
+- (instancetype) initWithPageSize: (NSSize)pageSize
+{
+    self = [super init];
+    if (self)
+    {
+        _pageSize = pageSize;
+    }
+    return self;
+}
+
+- (NSUInteger) count
+{
+    return _items.size();
+}
+
+
+#pragma mark -
+#pragma mark Recording
+
+- (void) addText: (NSAttributedString *)text atPoint: (NSPoint)point
+{
+    BXPrintDisplayListItem item;
+    item.type = BXPrintDisplayListItemText;
+    item.text = [text copy];
+    item.point = point;
+    _items.push_back(item);
+}
+
+- (void) addMask: (CGImageRef)mask inRect: (CGRect)rect color: (CGColorRef)color
+{
+    BXPrintDisplayListItem item;
+    item.type = BXPrintDisplayListItemMask;
+    item.mask = (__bridge id)mask;
+    item.rect = rect;
+    item.color = (__bridge id)color;
+    _items.push_back(item);
+}
+
+- (void) addRects: (const CGRect *)rects count: (NSUInteger)numRects color: (CGColorRef)color
+{
+    if (!numRects)
+        return;
+
+    BXPrintDisplayListItem item;
+    item.type = BXPrintDisplayListItemRects;
+    item.rects.assign(rects, rects + numRects);
+    item.color = (__bridge id)color;
+    _items.push_back(item);
+}
+
+
+#pragma mark -
+#pragma mark Drawing
+
+- (void) drawInContext: (NSGraphicsContext *)context
+{
+    [self drawItemsInRange: NSMakeRange(0, self.count) inContext: context];
+}
+
+- (void) drawItemsInRange: (NSRange)range inContext: (NSGraphicsContext *)context
+{
+    NSAssert(NSMaxRange(range) <= self.count, @"Range %@ out of bounds for display list of %lu items.",
+             NSStringFromRange(range), (unsigned long)self.count);
+
+    CGContextRef ctx = context.CGContext;
+
+    //Text is drawn with AppKit, so make the context current for the duration.
+    [NSGraphicsContext saveGraphicsState];
+    [NSGraphicsContext setCurrentContext: context];
+
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++)
+    {
+        const BXPrintDisplayListItem &item = _items[i];
+        switch (item.type)
+        {
+            case BXPrintDisplayListItemText:
+                [item.text drawAtPoint: item.point];
+                break;
+
+            case BXPrintDisplayListItemMask:
+                CGContextSaveGState(ctx);
+                    CGContextClipToMask(ctx, item.rect, (__bridge CGImageRef)item.mask);
+                    CGContextSetFillColorWithColor(ctx, (__bridge CGColorRef)item.color);
+                    CGContextFillRect(ctx, item.rect);
+                CGContextRestoreGState(ctx);
+                break;
+
+            case BXPrintDisplayListItemRects:
+                CGContextSaveGState(ctx);
+                    CGContextSetFillColorWithColor(ctx, (__bridge CGColorRef)item.color);
+                    CGContextFillRects(ctx, item.rects.data(), item.rects.size());
+                CGContextRestoreGState(ctx);
+                break;
+        }
+    }
+
+    [NSGraphicsContext restoreGraphicsState];
+}
+
+@end
@@ -8,6 +8,8 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class BXPrintDisplayList;
+
 /// BXPrintSession represents a single multi-page session into which an emulated printer
 /// (such as <code>BXEmulatedPrinter</code>) may print.
 @interface BXPrintSession : NSObject
@@ -15,7 +17,8 @@
 #pragma mark -
 #pragma mark Properties
 
-/// The DPI at which to generate page previews.
+/// The DPI at which to size page previews.
+/// Previews are only rasterised when they are drawn, at whatever size they are drawn at.
 /// Changing this will only take effect on the next page preview generated.
 @property (assign, nonatomic) NSSize previewDPI;
 
@@ -29,22 +32,21 @@
 @property (readonly, nonatomic) NSUInteger numPages;
 
 /// An array of NSImages containing previews of each page, including the current page.
+/// These are rendered from each page's display list when they are drawn.
 @property (readonly, nonatomic, nonnull) NSArray<NSImage*> *pagePreviews;
 
 /// A preview of the current page. Will be nil if no page is in progress.
+/// Each call returns a new image reflecting everything printed to the page so far.
 @property (readonly, nonatomic, nullable) NSImage *currentPagePreview;
 
 /// An @c NSData object representing a PDF of the session.
 /// Not usable until finishSession is called.
 @property (readonly, nonatomic, nullable) NSData *PDFData;
 
-/// The graphics context into which page content should be drawn for page preview images.
-/// Should only be used between calls to beginPage and finishPage.
-@property (readonly, strong, nonatomic, nullable) NSGraphicsContext *previewContext;
-
-/// The graphics context into which page content should be drawn for PDF data.
-/// Should only be used between calls to beginPage and finishPage.
-@property (readonly, strong, nonatomic, nullable) NSGraphicsContext *PDFContext;
+/// The display list into which page content should be recorded for the current page.
+/// It is drawn into the session's PDF when the page is finished, and into page previews on demand.
+/// Will be nil if no page is in progress.
+@property (readonly, strong, nonatomic, nullable) BXPrintDisplayList *currentPageDisplayList;
 
 
 #pragma mark -
@@ -6,6 +6,7 @@
  */
 
 #import "BXPrintSession.h"
+#import "BXPrintDisplayList.h"
 
 @interface BXPrintSession ()
 
@@ -13,23 +14,29 @@
 @property (assign, nonatomic) BOOL pageInProgress;
 @property (assign, nonatomic, getter=isFinished) BOOL finished;
 @property (assign, nonatomic) NSUInteger numPages;
-@property (strong, nonatomic) NSGraphicsContext *previewContext;
+@property (strong, nonatomic) BXPrintDisplayList *currentPageDisplayList;
+
+/// The graphics context into which finished pages are drawn for PDF data.
 @property (strong, nonatomic) NSGraphicsContext *PDFContext;
 
 /// Mutable internal versions of the readonly accessors we've exposed in the public API.
 @property (strong, nonatomic) NSMutableData *_mutablePDFData;
-@property (strong, nonatomic) NSMutableArray<NSImage*> *_mutablePagePreviews;
 
-/// The bitmap canvas into which to draw the current page preview.
-@property (strong, nonatomic) NSBitmapImageRep *_previewCanvas;
+/// The display lists of every page in the session, including the current page.
+@property (strong, nonatomic) NSMutableArray<BXPrintDisplayList *> *_pageDisplayLists;
 
 
 /// Called when the session is created to create a PDF context and data backing.
 - (void) _preparePDFContext;
 
-/// Called when the preview context is first accessed or the preview backing has changed,
-/// to create a new bitmap context that will write to the backing.
-- (void) _preparePreviewContext;
+/// Returns an image that renders a preview of the specified page whenever it is drawn.
+- (NSImage *) _previewOfPage: (BXPrintDisplayList *)page;
+
+/// Draws a preview of the specified page into the specified rect of the current graphics context.
+- (void) _drawPreviewOfPage: (BXPrintDisplayList *)page inRect: (NSRect)rect;
+
+/// Discards the cached preview rendering of the current page.
+- (void) _discardPreviewCache;
 
 @end
 
@@ -40,12 +47,17 @@
 	CGDataConsumerRef _PDFDataConsumer;
 	NSMutableData *_PDFData;
 	
-	NSMutableArray<NSImage*> *_pagePreviews;
-	void *_previewCanvasBacking;
+	NSMutableArray<BXPrintDisplayList *> *_pageDisplayLists;
+    
+    //A rendering of the current page at the size its preview was last drawn,
+    //along with how many of the page's display list items it includes so far.
+    //This lets us bring the preview up to date by drawing only what has been printed since.
+    CGContextRef _previewCache;
+    NSUInteger _previewCacheItemCount;
 }
 
 @synthesize _mutablePDFData = _PDFData;
-@synthesize _mutablePagePreviews = _pagePreviews;
+@synthesize _pageDisplayLists = _pageDisplayLists;
 
 #pragma mark -
 #pragma mark Starting and ending sessions
@@ -65,8 +77,8 @@
         //Generate 72dpi previews by default.
         self.previewDPI = NSMakeSize(72.0, 72.0);
         
-        //Create a catching array for our page previews.
-        self._mutablePagePreviews = [NSMutableArray arrayWithCapacity: 1];
+        //Create a catching array for our pages.
+        self._pageDisplayLists = [NSMutableArray arrayWithCapacity: 1];
         
         //Create the PDF context for this session.
         [self _preparePDFContext];
@@ -85,25 +97,6 @@
     
     self.PDFContext = [NSGraphicsContext graphicsContextWithCGContext: _CGPDFContext
                                                               flipped: NO];
-    
-    //While we're here, set up some properties of the context.
-    //Use multiply blending so that overlapping printed colors will darken each other.
-    CGContextSetBlendMode(_CGPDFContext, kCGBlendModeMultiply);
-}
-
-- (void) _preparePreviewContext
-{
-    self.previewContext = [NSGraphicsContext graphicsContextWithBitmapImageRep: self._previewCanvas];
-    _previewCanvasBacking = self._previewCanvas.bitmapData;
-    
-    //While we're here, set some properties of the context.
-    //Use multiply blending so that overlapping printed colors will darken each other
-    CGContextSetBlendMode(_previewContext.CGContext, kCGBlendModeMultiply);
-    
-    //If previewDPI does not match the default number of points per inch (72x72),
-    //scale the context transform to compensate.
-    CGPoint scale = CGPointMake(self.previewDPI.width / 72.0, self.previewDPI.height / 72.0);
-    CGContextScaleCTM(_previewContext.CGContext, scale.x, scale.y);
 }
 
 - (void) finishSession
@@ -131,6 +124,8 @@
 {
     if (!self.isFinished)
         [self finishSession];
+    
+    [self _discardPreviewCache];
 }
 
 #pragma mark -
@@ -144,34 +139,10 @@
     if (NSEqualSizes(size, NSZeroSize))
         size = NSMakeSize(8.5, 11.0);
     
-    //Start a new page in the PDF context.
-    //N.B: we could use CGPDFContextBeginPage but that has a more complicated
-    //calling structure for specifying art, crop etc. boxes, and we only care
-    //about the media box.
-    CGRect mediaBox = CGRectMake(0, 0, size.width * 72.0, size.height * 72.0);
-    CGContextBeginPage(_CGPDFContext, &mediaBox);
-    
-    //Prepare a bitmap context into which we'll render a page preview.
-    NSSize canvasSize = NSMakeSize(ceil(size.width * self.previewDPI.width),
-                                   ceil(size.height * self.previewDPI.height));
-    
-    self._previewCanvas = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
-                                                                   pixelsWide: canvasSize.width
-                                                                   pixelsHigh: canvasSize.height
-                                                                bitsPerSample: 8
-                                                              samplesPerPixel: 4
-                                                                     hasAlpha: YES
-                                                                     isPlanar: NO
-                                                               colorSpaceName: NSDeviceRGBColorSpace
-                                                                  bytesPerRow: 0
-                                                                 bitsPerPixel: 0];
-    
-    //Wrap this in an NSImage so upstream contexts can display the preview easily.
-    NSImage *preview = [[NSImage alloc] initWithSize: canvasSize];
-    [preview addRepresentation: self._previewCanvas];
-    
-    //Add the new image into our array of page previews.
-    [self._mutablePagePreviews addObject: preview];
+    //Start a new display list to record the page's content. Nothing gets drawn until
+    //the page is finished or someone asks to see a preview of it.
+    self.currentPageDisplayList = [[BXPrintDisplayList alloc] initWithPageSize: size];
+    [self._pageDisplayLists addObject: self.currentPageDisplayList];
     
     self.pageInProgress = YES;
     self.numPages++;
@@ -181,14 +152,27 @@
 {
     NSAssert(self.pageInProgress, @"finishPage called while no page was in progress.");
     
-    //Close the page in the current PDF context.
+    BXPrintDisplayList *page = self.currentPageDisplayList;
+    
+    //Draw the whole page into the PDF context in one go.
+    //N.B: we could use CGPDFContextBeginPage but that has a more complicated
+    //calling structure for specifying art, crop etc. boxes, and we only care
+    //about the media box.
+    CGRect mediaBox = CGRectMake(0, 0, page.pageSize.width * 72.0, page.pageSize.height * 72.0);
+    CGContextBeginPage(_CGPDFContext, &mediaBox);
+    
+    //Use multiply blending so that overlapping printed colors will darken each other.
+    //(This has to be set for each page, since each page starts with a fresh graphics state.)
+    CGContextSetBlendMode(_CGPDFContext, kCGBlendModeMultiply);
+    [page drawInContext: self.PDFContext];
+    
     CGPDFContextEndPage(_CGPDFContext);
     
-    //Tear down the current preview context.
-    self.previewContext = nil;
-    self._previewCanvas = nil;
-    _previewCanvasBacking = NULL;
+    //Previews of finished pages will be rendered afresh whenever they're needed,
+    //so we no longer need to hang onto our rendering of this one.
+    [self _discardPreviewCache];
     
+    self.currentPageDisplayList = nil;
     self.pageInProgress = NO;
 }
 
@@ -199,6 +183,90 @@
 }
 
 
+#pragma mark -
+#pragma mark Page previews
+
+- (NSImage *) _previewOfPage: (BXPrintDisplayList *)page
+{
+    NSSize previewSize = NSMakeSize(ceil(page.pageSize.width * self.previewDPI.width),
+                                    ceil(page.pageSize.height * self.previewDPI.height));
+    
+    __weak BXPrintSession *weakSelf = self;
+    return [NSImage imageWithSize: previewSize flipped: NO drawingHandler: ^BOOL(NSRect dstRect) {
+        [weakSelf _drawPreviewOfPage: page inRect: dstRect];
+        return YES;
+    }];
+}
+
+- (void) _drawPreviewOfPage: (BXPrintDisplayList *)page inRect: (NSRect)rect
+{
+    CGContextRef destination = [NSGraphicsContext currentContext].CGContext;
+    CGSize pageSizeInPoints = CGSizeMake(page.pageSize.width * 72.0, page.pageSize.height * 72.0);
+    
+    //Finished pages won't change anymore, so just draw them directly:
+    //NSImage will cache the results for us.
+    if (page != self.currentPageDisplayList)
+    {
+        CGContextSaveGState(destination);
+            CGContextTranslateCTM(destination, rect.origin.x, rect.origin.y);
+            CGContextScaleCTM(destination, rect.size.width / pageSizeInPoints.width, rect.size.height / pageSizeInPoints.height);
+            CGContextSetBlendMode(destination, kCGBlendModeMultiply);
+            [page drawInContext: [NSGraphicsContext currentContext]];
+        CGContextRestoreGState(destination);
+        return;
+    }
+    
+    //The current page will be redrawn every time something more is printed to it, so we keep
+    //a rendering of it at the size it's being displayed and only draw what's new each time.
+    CGRect deviceRect = CGContextConvertRectToDeviceSpace(destination, rect);
+    size_t pixelsWide = (size_t)ceil(ABS(deviceRect.size.width));
+    size_t pixelsHigh = (size_t)ceil(ABS(deviceRect.size.height));
+    
+    if (!pixelsWide || !pixelsHigh)
+        return;
+    
+    if (!_previewCache || CGBitmapContextGetWidth(_previewCache) != pixelsWide || CGBitmapContextGetHeight(_previewCache) != pixelsHigh)
+    {
+        [self _discardPreviewCache];
+        
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        _previewCache = CGBitmapContextCreate(NULL, pixelsWide, pixelsHigh, 8, 0, colorSpace, kCGImageAlphaPremultipliedLast);
+        CGColorSpaceRelease(colorSpace);
+        
+        if (!_previewCache)
+            return;
+        
+        //Use multiply blending so that overlapping printed colors will darken each other
+        CGContextSetBlendMode(_previewCache, kCGBlendModeMultiply);
+        CGContextScaleCTM(_previewCache, pixelsWide / pageSizeInPoints.width, pixelsHigh / pageSizeInPoints.height);
+        _previewCacheItemCount = 0;
+    }
+    
+    NSUInteger numItems = page.count;
+    if (_previewCacheItemCount < numItems)
+    {
+        NSGraphicsContext *cacheContext = [NSGraphicsContext graphicsContextWithCGContext: _previewCache flipped: NO];
+        [page drawItemsInRange: NSMakeRange(_previewCacheItemCount, numItems - _previewCacheItemCount)
+                     inContext: cacheContext];
+        _previewCacheItemCount = numItems;
+    }
+    
+    CGImageRef rendering = CGBitmapContextCreateImage(_previewCache);
+    CGContextDrawImage(destination, rect, rendering);
+    CGImageRelease(rendering);
+}
+
+- (void) _discardPreviewCache
+{
+    if (_previewCache)
+    {
+        CGContextRelease(_previewCache);
+        _previewCache = NULL;
+    }
+    _previewCacheItemCount = 0;
+}
+
+
 #pragma mark -
 #pragma mark Property accessors
 
@@ -213,32 +281,18 @@
 
 - (NSArray *) pagePreviews
 {
-    return self._mutablePagePreviews;
-}
-
-//Dynamically create a new preview context the first time we need one,
-//or if the backing canvas has changed location since we last checked.
-- (NSGraphicsContext *) previewContext
-{
-    if (!self.pageInProgress)
-        return NULL;
-    
-    //Create a new graphics context with which we can draw into the canvas image.
-    //IMPLEMENTATION NOTE: in 10.8, NSBitmapImageRep may sometimes change its backing on the fly
-    //without telling the graphics context about it. So we also check if the backing appears to have
-    //changed since the last time and if it has, we recreate the context.
-    if (!_previewContext || _previewCanvasBacking != self._previewCanvas.bitmapData)
+    NSMutableArray *previews = [NSMutableArray arrayWithCapacity: self._pageDisplayLists.count];
+    for (BXPrintDisplayList *page in self._pageDisplayLists)
     {
-        [self _preparePreviewContext];
+        [previews addObject: [self _previewOfPage: page]];
     }
-    
-    return _previewContext;
+    return previews;
 }
 
 - (NSImage *) currentPagePreview
 {
     if (self.pageInProgress)
-        return self.pagePreviews.lastObject;
+        return [self _previewOfPage: self.currentPageDisplayList];
     else
         return nil;
 }
@@ -0,0 +1,21 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <QuartzCore/QuartzCore.h>
+
+@class BXAudioSourceStatistics;
+
+/// \c BXAudioStatisticsLayer is a CATextLayer that formats a set of audio source statistics
+/// as a few lines of text, for overlaying on the DOS view while diagnosing audio problems.
+/// The DOS window shows one if the showAudioStatistics user default is set.
+@interface BXAudioStatisticsLayer : CATextLayer
+
+/// The statistics to display, keyed by source name, as returned by @c -[BXEmulator audioStatistics].
+@property (copy, nonatomic) NSDictionary<NSString *, BXAudioSourceStatistics *> *statistics;
+
+@end
@@ -0,0 +1,60 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXAudioStatisticsLayer.h"
+#import "BXAudioStatistics.h"
+#import <AppKit/AppKit.h>
+
+@implementation BXAudioStatisticsLayer
+
+- (instancetype) init
+{
+    if ((self = [super init]))
+    {
+        self.font = (__bridge CFTypeRef)[NSFont monospacedDigitSystemFontOfSize: 11 weight: NSFontWeightRegular];
+        self.fontSize = 11;
+        self.foregroundColor = [NSColor whiteColor].CGColor;
+        self.backgroundColor = [NSColor colorWithCalibratedWhite: 0 alpha: 0.6].CGColor;
+        self.cornerRadius = 4;
+        self.alignmentMode = kCAAlignmentLeft;
+    }
+    return self;
+}
+
+- (void) setStatistics: (NSDictionary<NSString *, BXAudioSourceStatistics *> *)statistics
+{
+    _statistics = [statistics copy];
+    
+    NSMutableArray *lines = [NSMutableArray arrayWithCapacity: statistics.count * 3];
+    for (NSString *name in [statistics.allKeys sortedArrayUsingSelector: @selector(compare:)])
+    {
+        BXAudioSourceStatistics *stats = statistics[name];
+        [lines addObject: [NSString stringWithFormat: @"%@: %lu silent, %lu underruns, %lu events queued",
+                           name,
+                           (unsigned long)stats.silenceInsertions,
+                           (unsigned long)stats.underrunCount,
+                           (unsigned long)stats.pendingEventCount]];
+        
+        [lines addObject: [NSString stringWithFormat: @"  render %.0f/%.0f/%.0fµs (p50/p99/max), load %.1f%%",
+                           [stats renderTimeAtPercentile: 50] * 1000000.0,
+                           [stats renderTimeAtPercentile: 99] * 1000000.0,
+                           stats.maxRenderTime * 1000000.0,
+                           stats.renderLoad * 100.0]];
+        
+        [lines addObject: [NSString stringWithFormat: @"  latency %.1fms (buffered %.1f + resampler %.1f + block %.1f), max %.1fms",
+                           stats.estimatedLatency * 1000.0,
+                           stats.sourceLatency * 1000.0,
+                           stats.resamplerLatency * 1000.0,
+                           stats.blockLatency * 1000.0,
+                           stats.maxEstimatedLatency * 1000.0]];
+    }
+    
+    self.string = [lines componentsJoinedByString: @"\n"];
+}
+
+@end
@@ -72,4 +72,11 @@ typedef NS_ENUM(NSInteger, BXRenderingStyle) {
 /// Called whenever the window changes color space or scaling factor.
 - (void) windowDidChangeBackingProperties: (NSNotification *)notification;
 
+/// Running totals of the redraws the view has presented, the redraws it has had to skip
+/// because it was still busy with the last one, and the time in seconds it has spent uploading
+/// and drawing frames. Used to decide whether the emulator should skip more frames.
+@property (readonly) NSUInteger presentedFrameCount;
+@property (readonly) NSUInteger skippedFrameCount;
+@property (readonly) CFTimeInterval presentationTime;
+
 @end
@@ -0,0 +1,31 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BXVideoFrame;
+
+/// \c BXFrameSink is a protocol for objects that consume the frames a session's emulator produces
+/// in place of the DOS window, such as a headless output for automated testing.
+@protocol BXFrameSink <NSObject>
+
+/// Called on the emulation thread with every frame the emulator renders, including frames whose
+/// content did not change. Frames arrive in the order they were emulated, and can be identified by
+/// their @c emulatedFrameNumber. The frame is only valid for the duration of this call and still belongs
+/// to the emulator: sinks must copy anything they want to keep, and should return quickly.
+- (void) consumeFrame: (BXVideoFrame *)frame;
+
+@optional
+/// Called on the main thread when the emulator has finished and no more frames will be delivered.
+- (void) finishConsumingFrames;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,88 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The stages each frame passes through on its way from DOSBox to the screen, in order.
+typedef NS_ENUM(NSUInteger, BXFrameStage) {
+    /// DOSBox began rendering the frame. (Emulation thread.)
+    BXFrameStageStarted,
+    /// DOSBox finished rendering the frame and it was published. (Emulation thread.)
+    BXFrameStageFinished,
+    /// The frame was passed to the emulator's delegate. (Main thread.)
+    BXFrameStageDelivered,
+    /// The frame's changes were uploaded to the rendering view's texture. (Main thread.)
+    BXFrameStageUploaded,
+    /// The command buffer that draws the frame was committed to the GPU. (Main thread.)
+    BXFrameStageCommitted,
+    /// The frame reached the screen. (Metal callback thread.)
+    BXFrameStagePresented,
+    //---
+    BXNumFrameStages
+};
+
+/// The number of recent frames whose individual timings are kept for exporting.
+#define BXFrameTimelineCapacity 1024
+
+/// @brief BXFrameTimeline records when each frame reaches each stage of the rendering pipeline,
+/// to help diagnose frame latency and pacing problems.
+///
+/// @discussion Each stage's latency is measured from the moment DOSBox finished the frame
+/// (or, for the finished stage itself, from when DOSBox started it) and accumulated into
+/// a log-linear histogram that keeps about 6% precision across microseconds to minutes.
+/// The timings of the most recent frames are also kept and can be exported as a Chrome
+/// trace file, viewable in chrome://tracing or Perfetto.
+///
+/// Recording is thread-safe and does nothing unless the timeline is enabled, which it is
+/// at launch if the recordFrameTimeline user default is set. When enabled, each session logs
+/// a latency summary and saves a trace to the recordings folder once its emulator finishes.
+@interface BXFrameTimeline : NSObject
+
+/// The process-wide timeline shared by the emulator and the rendering view.
++ (BXFrameTimeline *) sharedTimeline;
+
+/// Whether stage timings are currently being recorded.
+@property (assign, getter=isEnabled) BOOL enabled;
+
+/// The number of times the rendering view had to skip drawing because the GPU was still busy.
+@property (readonly) NSUInteger skippedFrameCount;
+
+/// The current time in the timebase used by the timeline, which is that of CACurrentMediaTime().
++ (CFTimeInterval) currentTime;
+
+/// Records that the specified frame reached the specified stage now, or at the specified time.
+/// Only the first time a frame reaches each stage is recorded.
+- (void) recordStage: (BXFrameStage)stage ofFrame: (NSUInteger)frameNumber;
+- (void) recordStage: (BXFrameStage)stage ofFrame: (NSUInteger)frameNumber atTime: (CFTimeInterval)time;
+
+/// Records that the rendering view skipped a redraw.
+- (void) recordSkippedFrame;
+
+/// Returns the latency of the specified stage at the specified percentile (0-100) across every
+/// frame recorded so far, in seconds. Returns 0 if no frames have reached that stage.
+- (NSTimeInterval) latencyOfStage: (BXFrameStage)stage atPercentile: (double)percentile;
+
+/// The number of frames that have been recorded reaching the specified stage.
+- (NSUInteger) sampleCountForStage: (BXFrameStage)stage;
+
+/// A human-readable summary of the median, 95th and 99th percentile latency of each stage
+/// after DOSBox started the frame, one line per stage that any frame has reached.
+@property (readonly) NSString *latencySummary;
+
+/// Clears all recorded timings, histograms and counts.
+- (void) reset;
+
+/// Writes the timings of the most recent frames to the specified URL as a Chrome trace JSON file.
+/// Returns NO and populates outError if the file could not be written.
+- (BOOL) writeChromeTraceToURL: (NSURL *)URL error: (out NSError **)outError;
+
+@end
+
+NS_ASSUME_NONNULL_END
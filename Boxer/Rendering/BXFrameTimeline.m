@@ -0,0 +1,325 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXFrameTimeline.h"
+#import <QuartzCore/QuartzCore.h>
+#import <os/lock.h>
+
+
+#pragma mark - Histogram buckets
+
+//Latencies are bucketed in microseconds. Values below BXHistogramSubBuckets get a bucket each;
+//above that, each power of two is split into BXHistogramSubBuckets linear buckets.
+#define BXHistogramSubBucketBits 4
+#define BXHistogramSubBuckets (1 << BXHistogramSubBucketBits)
+#define BXHistogramMaxExponent 35
+#define BXHistogramNumBuckets (BXHistogramSubBuckets + ((BXHistogramMaxExponent - BXHistogramSubBucketBits + 1) * BXHistogramSubBuckets))
+
+static NSUInteger BXHistogramBucketForValue(uint64_t value)
+{
+    if (value < BXHistogramSubBuckets)
+        return (NSUInteger)value;
+
+    NSUInteger exponent = 63 - __builtin_clzll(value);
+    if (exponent > BXHistogramMaxExponent)
+        return BXHistogramNumBuckets - 1;
+
+    NSUInteger subBucket = (NSUInteger)(value >> (exponent - BXHistogramSubBucketBits)) & (BXHistogramSubBuckets - 1);
+    return BXHistogramSubBuckets + ((exponent - BXHistogramSubBucketBits) * BXHistogramSubBuckets) + subBucket;
+}
+
+//Returns the value in the middle of the specified bucket.
+static double BXHistogramValueForBucket(NSUInteger bucket)
+{
+    if (bucket < BXHistogramSubBuckets)
+        return (double)bucket;
+
+    NSUInteger exponent = ((bucket - BXHistogramSubBuckets) / BXHistogramSubBuckets) + BXHistogramSubBucketBits;
+    NSUInteger subBucket = (bucket - BXHistogramSubBuckets) % BXHistogramSubBuckets;
+    double bucketWidth = (double)(1ULL << (exponent - BXHistogramSubBucketBits));
+
+    return ((BXHistogramSubBuckets + subBucket) * bucketWidth) + (bucketWidth / 2);
+}
+
+
+#pragma mark - Frame records
+
+typedef struct {
+    NSUInteger frameNumber;
+    CFTimeInterval times[BXNumFrameStages];
+} BXFrameRecord;
+
+//The names and threads under which each stage's span appears in exported traces.
+//Each span runs from the previous stage to the named stage.
+static NSString * const BXFrameStageSpanNames[BXNumFrameStages] = {
+    nil,
+    @"Emulate",
+    @"Handoff",
+    @"Upload",
+    @"Encode",
+    @"Present",
+};
+
+static const NSUInteger BXFrameStageThreadIDs[BXNumFrameStages] = { 1, 1, 2, 2, 2, 3 };
+
+//The names under which each stage's latency appears in summaries.
+static NSString * const BXFrameStageNames[BXNumFrameStages] = {
+    @"Started",
+    @"Finished",
+    @"Delivered",
+    @"Uploaded",
+    @"Committed",
+    @"Presented",
+};
+
+
+@implementation BXFrameTimeline
+{
+    os_unfair_lock _lock;
+
+    BXFrameRecord _records[BXFrameTimelineCapacity];
+    uint64_t _histograms[BXNumFrameStages][BXHistogramNumBuckets];
+    NSUInteger _sampleCounts[BXNumFrameStages];
+
+    CFTimeInterval _skipTimes[BXFrameTimelineCapacity];
+    NSUInteger _skippedFrameCount;
+}
+
+@synthesize enabled = _enabled;
+
++ (BXFrameTimeline *) sharedTimeline
+{
+    static BXFrameTimeline *sharedTimeline;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedTimeline = [[self alloc] init];
+    });
+    return sharedTimeline;
+}
+
++ (CFTimeInterval) currentTime
+{
+    return CACurrentMediaTime();
+}
+
+- (instancetype) init
+{
+    if ((self = [super init]))
+    {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _enabled = [[NSUserDefaults standardUserDefaults] boolForKey: @"recordFrameTimeline"];
+    }
+    return self;
+}
+
+- (NSUInteger) skippedFrameCount
+{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _skippedFrameCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+
+#pragma mark - Recording
+
+- (void) recordStage: (BXFrameStage)stage ofFrame: (NSUInteger)frameNumber
+{
+    if (!self.isEnabled) return;
+    [self recordStage: stage ofFrame: frameNumber atTime: [self.class currentTime]];
+}
+
+- (void) recordStage: (BXFrameStage)stage ofFrame: (NSUInteger)frameNumber atTime: (CFTimeInterval)time
+{
+    if (!self.isEnabled || stage >= BXNumFrameStages) return;
+
+    os_unfair_lock_lock(&_lock);
+
+    BXFrameRecord *record = &_records[frameNumber % BXFrameTimelineCapacity];
+    if (record->frameNumber != frameNumber)
+    {
+        memset(record, 0, sizeof(BXFrameRecord));
+        record->frameNumber = frameNumber;
+    }
+
+    if (record->times[stage] == 0)
+    {
+        record->times[stage] = time;
+
+        //Measure finishing from when the frame was started, and every later stage from when it was finished.
+        BXFrameStage origin = (stage == BXFrameStageFinished) ? BXFrameStageStarted : BXFrameStageFinished;
+        CFTimeInterval originTime = record->times[origin];
+        if (stage > origin && originTime > 0 && time >= originTime)
+        {
+            uint64_t microseconds = (uint64_t)((time - originTime) * 1000000.0);
+            _histograms[stage][BXHistogramBucketForValue(microseconds)]++;
+            _sampleCounts[stage]++;
+        }
+    }
+
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void) recordSkippedFrame
+{
+    if (!self.isEnabled) return;
+
+    CFTimeInterval time = [self.class currentTime];
+
+    os_unfair_lock_lock(&_lock);
+    _skipTimes[_skippedFrameCount % BXFrameTimelineCapacity] = time;
+    _skippedFrameCount++;
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void) reset
+{
+    os_unfair_lock_lock(&_lock);
+    memset(_records, 0, sizeof(_records));
+    memset(_histograms, 0, sizeof(_histograms));
+    memset(_sampleCounts, 0, sizeof(_sampleCounts));
+    memset(_skipTimes, 0, sizeof(_skipTimes));
+    _skippedFrameCount = 0;
+    os_unfair_lock_unlock(&_lock);
+}
+
+
+#pragma mark - Statistics
+
+- (NSUInteger) sampleCountForStage: (BXFrameStage)stage
+{
+    if (stage >= BXNumFrameStages) return 0;
+
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = _sampleCounts[stage];
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (NSTimeInterval) latencyOfStage: (BXFrameStage)stage atPercentile: (double)percentile
+{
+    if (stage >= BXNumFrameStages) return 0;
+
+    NSTimeInterval latency = 0;
+
+    os_unfair_lock_lock(&_lock);
+    NSUInteger total = _sampleCounts[stage];
+    if (total > 0)
+    {
+        double clampedPercentile = MAX(0.0, MIN(percentile, 100.0));
+        uint64_t target = (uint64_t)ceil((clampedPercentile / 100.0) * total);
+        if (target == 0) target = 1;
+
+        uint64_t cumulative = 0;
+        NSUInteger bucket;
+        for (bucket = 0; bucket < BXHistogramNumBuckets; bucket++)
+        {
+            cumulative += _histograms[stage][bucket];
+            if (cumulative >= target)
+            {
+                latency = BXHistogramValueForBucket(bucket) / 1000000.0;
+                break;
+            }
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    return latency;
+}
+
+- (NSString *) latencySummary
+{
+    NSMutableString *summary = [NSMutableString string];
+    NSUInteger stage;
+    for (stage = BXFrameStageFinished; stage < BXNumFrameStages; stage++)
+    {
+        NSUInteger count = [self sampleCountForStage: stage];
+        if (!count) continue;
+
+        [summary appendFormat: @"%@ p50 %7.2fms  p95 %7.2fms  p99 %7.2fms  (%lu frames)\n",
+         [BXFrameStageNames[stage] stringByPaddingToLength: 10 withString: @" " startingAtIndex: 0],
+         [self latencyOfStage: stage atPercentile: 50] * 1000.0,
+         [self latencyOfStage: stage atPercentile: 95] * 1000.0,
+         [self latencyOfStage: stage atPercentile: 99] * 1000.0,
+         (unsigned long)count];
+    }
+    if (self.skippedFrameCount)
+        [summary appendFormat: @"Skipped redraws: %lu\n", (unsigned long)self.skippedFrameCount];
+
+    return summary;
+}
+
+
+#pragma mark - Exporting
+
+- (BOOL) writeChromeTraceToURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity: BXFrameTimelineCapacity * BXNumFrameStages];
+
+    NSDictionary *threadNames = @{ @1: @"Emulation", @2: @"Main", @3: @"Display" };
+    [threadNames enumerateKeysAndObjectsUsingBlock: ^(NSNumber *threadID, NSString *name, BOOL *stop) {
+        [events addObject: @{ @"name": @"thread_name", @"ph": @"M", @"pid": @1, @"tid": threadID,
+                              @"args": @{ @"name": name } }];
+    }];
+
+    os_unfair_lock_lock(&_lock);
+
+    NSUInteger i;
+    for (i = 0; i < BXFrameTimelineCapacity; i++)
+    {
+        const BXFrameRecord *record = &_records[i];
+        if (record->frameNumber == 0) continue;
+
+        //Emit one span for each pair of consecutive stages the frame reached.
+        CFTimeInterval previousTime = record->times[BXFrameStageStarted];
+        BXFrameStage stage;
+        for (stage = BXFrameStageFinished; stage < BXNumFrameStages; stage++)
+        {
+            CFTimeInterval time = record->times[stage];
+            if (time == 0) continue;
+
+            if (previousTime > 0 && time >= previousTime)
+            {
+                [events addObject: @{
+                    @"name": BXFrameStageSpanNames[stage],
+                    @"cat": @"frame",
+                    @"ph": @"X",
+                    @"pid": @1,
+                    @"tid": @(BXFrameStageThreadIDs[stage]),
+                    @"ts": @(previousTime * 1000000.0),
+                    @"dur": @((time - previousTime) * 1000000.0),
+                    @"args": @{ @"frame": @(record->frameNumber) },
+                }];
+            }
+            previousTime = time;
+        }
+    }
+
+    NSUInteger numSkips = MIN(_skippedFrameCount, (NSUInteger)BXFrameTimelineCapacity);
+    NSUInteger firstSkip = _skippedFrameCount - numSkips;
+    for (i = firstSkip; i < _skippedFrameCount; i++)
+    {
+        [events addObject: @{
+            @"name": @"Skipped frames",
+            @"ph": @"C",
+            @"pid": @1,
+            @"ts": @(_skipTimes[i % BXFrameTimelineCapacity] * 1000000.0),
+            @"args": @{ @"count": @(i + 1) },
+        }];
+    }
+
+    os_unfair_lock_unlock(&_lock);
+
+    NSDictionary *trace = @{ @"traceEvents": events, @"displayTimeUnit": @"ms" };
+    NSData *data = [NSJSONSerialization dataWithJSONObject: trace options: 0 error: outError];
+    if (!data) return NO;
+
+    return [data writeToURL: URL options: NSDataWritingAtomic error: outError];
+}
+
+@end
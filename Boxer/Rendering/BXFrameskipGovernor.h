@@ -0,0 +1,96 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Why the governor changed the frameskip level.
+typedef NS_ENUM(NSUInteger, BXFrameskipDecisionReason) {
+    /// Emulation was running slower than the emulated display's refresh rate.
+    BXFrameskipDecisionEmulationBehind,
+    /// The rendering view was skipping redraws or spending too long presenting frames.
+    BXFrameskipDecisionPresentationBehind,
+    /// Emulation and presentation have kept up comfortably for long enough to try a lower level.
+    BXFrameskipDecisionRecovered,
+    /// The last increase did not help emulation keep up, so it was undone.
+    BXFrameskipDecisionIneffective,
+};
+
+/// A record of one change the governor made to the frameskip level, and the measurements that led to it.
+@interface BXFrameskipDecision : NSObject
+
+/// When the decision was made, in the timebase of CACurrentMediaTime().
+@property (readonly) CFTimeInterval timestamp;
+
+@property (readonly) NSUInteger previousFrameskip;
+@property (readonly) NSUInteger frameskip;
+@property (readonly) BXFrameskipDecisionReason reason;
+
+/// How long emulated frames took in wall time, as a multiple of how long they should have taken.
+/// 1.0 means emulation was keeping pace with the emulated display.
+@property (readonly) double emulationLoad;
+
+/// The proportion of wall time the rendering view spent uploading and drawing frames.
+@property (readonly) double presentationLoad;
+
+/// The proportion of redraws that the rendering view had to skip because the GPU was still busy.
+@property (readonly) double skippedPresentationRatio;
+
+@end
+
+
+/// @brief BXFrameskipGovernor adjusts DOSBox's frameskip level on the fly, so that emulation
+/// can keep to its cycle budget on hosts too slow to render and present every frame.
+///
+/// @discussion The governor is fed the wall time at which DOSBox finishes rendering each frame,
+/// and periodic presentation statistics from the rendering view. Every half-second or so it
+/// compares these against the emulated display's refresh rate: it raises the frameskip level
+/// by one if emulation or presentation is falling behind, and lowers it by one once both have
+/// kept up comfortably for a while. Increases that don't help are undone, and the governor
+/// waits progressively longer before retrying a level that it has had to back off from.
+///
+/// Frame timings are recorded on the emulation thread and presentation statistics on the main
+/// thread. @c frameskip and @c lastDecision are KVO-observable and change on the main thread.
+/// If the logFrameskipDecisions user default is set, each decision is also logged to the console.
+@interface BXFrameskipGovernor : NSObject
+
+/// The range within which the governor may set the frameskip level.
+/// The minimum is usually the level the user chose by hand.
+@property (assign) NSUInteger minimumFrameskip;
+@property (assign) NSUInteger maximumFrameskip;
+
+/// The frameskip level the governor has currently chosen.
+@property (readonly) NSUInteger frameskip;
+
+/// The most recent change the governor made, or nil if it has not changed the level yet.
+@property (readonly, nullable) BXFrameskipDecision *lastDecision;
+
+/// The governor's most recent decisions, oldest first. Only the last few hundred are kept.
+@property (readonly) NSArray<BXFrameskipDecision *> *decisionLog;
+
+- (instancetype) initWithMinimumFrameskip: (NSUInteger)minimum maximumFrameskip: (NSUInteger)maximum;
+
+/// Called on the emulation thread whenever DOSBox finishes rendering a frame, whether or not
+/// that frame is delivered. refreshRate is that of the emulated display. Returns the frameskip
+/// level that should now be applied, which may have changed as a result of this frame.
+- (NSUInteger) recordRenderedFrameAtTime: (CFTimeInterval)time refreshRate: (double)refreshRate;
+
+/// Called on the main thread with the rendering view's running totals of frames presented,
+/// redraws skipped and time spent presenting. The governor works from the change since the last call.
+- (void) recordPresentedFrames: (NSUInteger)presentedFrames
+                 skippedFrames: (NSUInteger)skippedFrames
+              presentationTime: (CFTimeInterval)presentationTime;
+
+/// Called on the emulation thread to discard any measurements in progress, e.g. after a video mode change.
+/// Does not change the current frameskip level.
+- (void) reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
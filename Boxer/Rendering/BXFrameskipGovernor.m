@@ -0,0 +1,399 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXFrameskipGovernor.h"
+#import <QuartzCore/QuartzCore.h>
+#import <os/lock.h>
+
+
+/// How much wall time each set of measurements covers before the governor makes a decision.
+#define BXFrameskipGovernorWindow 0.5
+
+/// The fewest rendered frames a window must contain for its measurements to be trusted.
+#define BXFrameskipGovernorMinWindowFrames 4
+
+/// Gaps between frames more than this many times longer than they should be mean emulation was paused
+/// or stalled by something other than rendering, and the current window's measurements are discarded.
+#define BXFrameskipGovernorStallFactor 4.0
+
+/// Emulation counts as falling behind when frames take this many times longer than they should.
+#define BXFrameskipGovernorBehindLoad 1.10
+
+/// Emulation counts as keeping up comfortably when frames take no longer than this multiple.
+#define BXFrameskipGovernorComfortableLoad 1.03
+
+/// Presentation counts as falling behind when more than this proportion of redraws are skipped,
+/// or when more than this proportion of wall time is spent presenting.
+#define BXFrameskipGovernorBehindSkipRatio 0.15
+#define BXFrameskipGovernorBehindPresentationLoad 0.5
+#define BXFrameskipGovernorComfortablePresentationLoad 0.25
+
+/// An increase must improve emulation load by at least this factor to be kept.
+#define BXFrameskipGovernorMinImprovement 0.97
+
+/// How many comfortable windows the governor waits before lowering the level, and how far that
+/// wait may grow when the governor keeps having to raise the level straight back up again.
+#define BXFrameskipGovernorInitialHoldoff 2
+#define BXFrameskipGovernorMaxHoldoff 16
+
+/// After this many windows without an increase, the holdoff returns to its initial length.
+#define BXFrameskipGovernorStableWindows 20
+
+/// The number of decisions kept in the decision log.
+#define BXFrameskipGovernorLogCapacity 256
+
+
+@interface BXFrameskipDecision ()
+
+- (instancetype) initWithTimestamp: (CFTimeInterval)timestamp
+                 previousFrameskip: (NSUInteger)previousFrameskip
+                         frameskip: (NSUInteger)frameskip
+                            reason: (BXFrameskipDecisionReason)reason
+                     emulationLoad: (double)emulationLoad
+                  presentationLoad: (double)presentationLoad
+          skippedPresentationRatio: (double)skippedPresentationRatio;
+
+@end
+
+
+@implementation BXFrameskipDecision
+
+@synthesize timestamp = _timestamp;
+@synthesize previousFrameskip = _previousFrameskip;
+@synthesize frameskip = _frameskip;
+@synthesize reason = _reason;
+@synthesize emulationLoad = _emulationLoad;
+@synthesize presentationLoad = _presentationLoad;
+@synthesize skippedPresentationRatio = _skippedPresentationRatio;
+
+- (instancetype) initWithTimestamp: (CFTimeInterval)timestamp
+                 previousFrameskip: (NSUInteger)previousFrameskip
+                         frameskip: (NSUInteger)frameskip
+                            reason: (BXFrameskipDecisionReason)reason
+                     emulationLoad: (double)emulationLoad
+                  presentationLoad: (double)presentationLoad
+          skippedPresentationRatio: (double)skippedPresentationRatio
+{
+    if ((self = [super init]))
+    {
+        _timestamp = timestamp;
+        _previousFrameskip = previousFrameskip;
+        _frameskip = frameskip;
+        _reason = reason;
+        _emulationLoad = emulationLoad;
+        _presentationLoad = presentationLoad;
+        _skippedPresentationRatio = skippedPresentationRatio;
+    }
+    return self;
+}
+
+- (NSString *) description
+{
+    static NSString * const reasonNames[] = {
+        @"emulation behind",
+        @"presentation behind",
+        @"recovered",
+        @"ineffective",
+    };
+
+    return [NSString stringWithFormat: @"Frameskip %lu -> %lu (%@): emulation load %.2f, presentation load %.2f, %.0f%% redraws skipped",
+            (unsigned long)self.previousFrameskip,
+            (unsigned long)self.frameskip,
+            reasonNames[self.reason],
+            self.emulationLoad,
+            self.presentationLoad,
+            self.skippedPresentationRatio * 100.0];
+}
+
+@end
+
+
+@interface BXFrameskipGovernor ()
+
+@property (readwrite) NSUInteger frameskip;
+@property (readwrite, nullable) BXFrameskipDecision *lastDecision;
+
+@end
+
+
+@implementation BXFrameskipGovernor
+{
+    os_unfair_lock _lock;
+    NSMutableArray<BXFrameskipDecision *> *_decisionLog;
+
+    //Emulation thread state.
+    NSUInteger _appliedFrameskip;
+    CFTimeInterval _lastFrameTime;
+    CFTimeInterval _windowStart;
+    NSUInteger _windowFrames;
+    CFTimeInterval _windowActualTime;
+    CFTimeInterval _windowExpectedTime;
+
+    NSUInteger _windowIndex;
+    NSUInteger _calmWindows;
+    NSUInteger _holdoff;
+    NSUInteger _lastIncreaseWindow;
+    NSUInteger _lastDecreaseWindow;
+
+    BOOL _checkingIncrease;
+    double _loadBeforeIncrease;
+    NSUInteger _blockedFrameskip;
+    NSUInteger _blockedUntilWindow;
+
+    //Presentation state, shared with the main thread and guarded by _lock.
+    BOOL _hasPresentationBaseline;
+    NSUInteger _lastPresentedFrames;
+    NSUInteger _lastSkippedFrames;
+    CFTimeInterval _lastPresentationTime;
+    NSUInteger _windowPresentedFrames;
+    NSUInteger _windowSkippedFrames;
+    CFTimeInterval _windowPresentationTime;
+}
+
+@synthesize minimumFrameskip = _minimumFrameskip;
+@synthesize maximumFrameskip = _maximumFrameskip;
+@synthesize frameskip = _frameskip;
+@synthesize lastDecision = _lastDecision;
+
+- (instancetype) initWithMinimumFrameskip: (NSUInteger)minimum maximumFrameskip: (NSUInteger)maximum
+{
+    if ((self = [super init]))
+    {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _decisionLog = [[NSMutableArray alloc] initWithCapacity: BXFrameskipGovernorLogCapacity];
+
+        _minimumFrameskip = minimum;
+        _maximumFrameskip = MAX(minimum, maximum);
+        _frameskip = _appliedFrameskip = minimum;
+        _holdoff = BXFrameskipGovernorInitialHoldoff;
+    }
+    return self;
+}
+
+- (instancetype) init
+{
+    return [self initWithMinimumFrameskip: 0 maximumFrameskip: 0];
+}
+
+- (NSArray<BXFrameskipDecision *> *) decisionLog
+{
+    return [_decisionLog copy];
+}
+
+
+#pragma mark - Recording
+
+- (NSUInteger) recordRenderedFrameAtTime: (CFTimeInterval)time refreshRate: (double)refreshRate
+{
+    //Keep the level within bounds if they were changed behind our backs.
+    NSUInteger minimum = self.minimumFrameskip, maximum = MAX(minimum, self.maximumFrameskip);
+    NSUInteger clampedFrameskip = MIN(MAX(_appliedFrameskip, minimum), maximum);
+    if (clampedFrameskip != _appliedFrameskip)
+    {
+        _appliedFrameskip = clampedFrameskip;
+        _checkingIncrease = NO;
+        [self _publishFrameskip: clampedFrameskip decision: nil];
+    }
+
+    CFTimeInterval interval = time - _lastFrameTime;
+    BOOL hasPreviousFrame = (_lastFrameTime > 0);
+    _lastFrameTime = time;
+
+    //DOSBox only renders one in every frameskip+1 frames, so that's how far apart rendered frames should be.
+    CFTimeInterval expectedInterval = (refreshRate > 0) ? (_appliedFrameskip + 1) / refreshRate : 0;
+
+    if (!hasPreviousFrame || expectedInterval <= 0 || interval <= 0 ||
+        interval > expectedInterval * BXFrameskipGovernorStallFactor)
+    {
+        [self _startWindowAtTime: time];
+        return _appliedFrameskip;
+    }
+
+    _windowActualTime += interval;
+    _windowExpectedTime += expectedInterval;
+    _windowFrames++;
+
+    if ((time - _windowStart) >= BXFrameskipGovernorWindow && _windowFrames >= BXFrameskipGovernorMinWindowFrames)
+    {
+        [self _evaluateWindowEndingAtTime: time minimum: minimum maximum: maximum];
+        [self _startWindowAtTime: time];
+    }
+
+    return _appliedFrameskip;
+}
+
+- (void) recordPresentedFrames: (NSUInteger)presentedFrames
+                 skippedFrames: (NSUInteger)skippedFrames
+              presentationTime: (CFTimeInterval)presentationTime
+{
+    os_unfair_lock_lock(&_lock);
+
+    //Counters going backwards mean the rendering view was replaced: start again from its new totals.
+    if (_hasPresentationBaseline &&
+        presentedFrames >= _lastPresentedFrames &&
+        skippedFrames >= _lastSkippedFrames &&
+        presentationTime >= _lastPresentationTime)
+    {
+        _windowPresentedFrames  += presentedFrames - _lastPresentedFrames;
+        _windowSkippedFrames    += skippedFrames - _lastSkippedFrames;
+        _windowPresentationTime += presentationTime - _lastPresentationTime;
+    }
+
+    _lastPresentedFrames = presentedFrames;
+    _lastSkippedFrames = skippedFrames;
+    _lastPresentationTime = presentationTime;
+    _hasPresentationBaseline = YES;
+
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void) reset
+{
+    _lastFrameTime = 0;
+    _checkingIncrease = NO;
+    _calmWindows = 0;
+    [self _startWindowAtTime: 0];
+}
+
+- (void) _startWindowAtTime: (CFTimeInterval)time
+{
+    _windowStart = time;
+    _windowFrames = 0;
+    _windowActualTime = 0;
+    _windowExpectedTime = 0;
+
+    os_unfair_lock_lock(&_lock);
+    _windowPresentedFrames = 0;
+    _windowSkippedFrames = 0;
+    _windowPresentationTime = 0;
+    os_unfair_lock_unlock(&_lock);
+}
+
+
+#pragma mark - Policy
+
+- (void) _evaluateWindowEndingAtTime: (CFTimeInterval)time
+                             minimum: (NSUInteger)minimum
+                             maximum: (NSUInteger)maximum
+{
+    os_unfair_lock_lock(&_lock);
+    NSUInteger presentedFrames = _windowPresentedFrames;
+    NSUInteger skippedFrames = _windowSkippedFrames;
+    CFTimeInterval presentationTime = _windowPresentationTime;
+    os_unfair_lock_unlock(&_lock);
+
+    _windowIndex++;
+
+    double emulationLoad = _windowActualTime / _windowExpectedTime;
+    double presentationLoad = presentationTime / (time - _windowStart);
+    NSUInteger redraws = presentedFrames + skippedFrames;
+    double skipRatio = (redraws > 0) ? (double)skippedFrames / redraws : 0;
+
+    BOOL emulationBehind = (emulationLoad > BXFrameskipGovernorBehindLoad);
+    BOOL presentationBehind = (skipRatio > BXFrameskipGovernorBehindSkipRatio ||
+                               presentationLoad > BXFrameskipGovernorBehindPresentationLoad);
+    BOOL comfortable = (emulationLoad <= BXFrameskipGovernorComfortableLoad &&
+                        skippedFrames == 0 &&
+                        presentationLoad <= BXFrameskipGovernorComfortablePresentationLoad);
+
+    NSUInteger current = _appliedFrameskip;
+    NSUInteger chosen = current;
+    BXFrameskipDecisionReason reason = BXFrameskipDecisionRecovered;
+
+    if ((_windowIndex - _lastIncreaseWindow) >= BXFrameskipGovernorStableWindows)
+        _holdoff = BXFrameskipGovernorInitialHoldoff;
+
+    //If we raised the level because emulation was behind and it's no better for it,
+    //then emulation is bound by something other than rendering: undo the increase,
+    //and don't try that level again for a while.
+    if (_checkingIncrease)
+    {
+        _checkingIncrease = NO;
+        if (emulationBehind && !presentationBehind &&
+            emulationLoad > _loadBeforeIncrease * BXFrameskipGovernorMinImprovement &&
+            current > minimum)
+        {
+            chosen = current - 1;
+            reason = BXFrameskipDecisionIneffective;
+
+            _holdoff = MIN(_holdoff * 2, (NSUInteger)BXFrameskipGovernorMaxHoldoff);
+            _blockedFrameskip = current;
+            _blockedUntilWindow = _windowIndex + (_holdoff * 4);
+        }
+    }
+
+    if (chosen == current)
+    {
+        BOOL increaseBlocked = (current + 1 == _blockedFrameskip && _windowIndex < _blockedUntilWindow);
+        if ((emulationBehind || presentationBehind) && current < maximum && !increaseBlocked)
+        {
+            chosen = current + 1;
+            reason = presentationBehind ? BXFrameskipDecisionPresentationBehind : BXFrameskipDecisionEmulationBehind;
+
+            //Raising the level straight after lowering it means we lowered it too eagerly.
+            if ((_windowIndex - _lastDecreaseWindow) <= 2)
+                _holdoff = MIN(_holdoff * 2, (NSUInteger)BXFrameskipGovernorMaxHoldoff);
+
+            _lastIncreaseWindow = _windowIndex;
+            _checkingIncrease = (reason == BXFrameskipDecisionEmulationBehind);
+            _loadBeforeIncrease = emulationLoad;
+            _calmWindows = 0;
+        }
+        else if (comfortable)
+        {
+            _calmWindows++;
+            if (_calmWindows >= _holdoff && current > minimum)
+            {
+                chosen = current - 1;
+                reason = BXFrameskipDecisionRecovered;
+                _lastDecreaseWindow = _windowIndex;
+                _calmWindows = 0;
+            }
+        }
+        else
+        {
+            _calmWindows = 0;
+        }
+    }
+
+    if (chosen != current)
+    {
+        _appliedFrameskip = chosen;
+
+        BXFrameskipDecision *decision = [[BXFrameskipDecision alloc] initWithTimestamp: time
+                                                                     previousFrameskip: current
+                                                                             frameskip: chosen
+                                                                                reason: reason
+                                                                         emulationLoad: emulationLoad
+                                                                      presentationLoad: presentationLoad
+                                                              skippedPresentationRatio: skipRatio];
+        [self _publishFrameskip: chosen decision: decision];
+    }
+}
+
+//Updates our observable properties on the main thread, where our observers expect them to change.
+- (void) _publishFrameskip: (NSUInteger)frameskip decision: (nullable BXFrameskipDecision *)decision
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self.frameskip = frameskip;
+
+        if (decision)
+        {
+            if (self->_decisionLog.count >= BXFrameskipGovernorLogCapacity)
+                [self->_decisionLog removeObjectAtIndex: 0];
+            [self->_decisionLog addObject: decision];
+
+            self.lastDecision = decision;
+
+            if ([[NSUserDefaults standardUserDefaults] boolForKey: @"logFrameskipDecisions"])
+                NSLog(@"%@", decision);
+        }
+    });
+}
+
+@end
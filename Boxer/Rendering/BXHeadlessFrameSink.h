@@ -0,0 +1,66 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "BXFrameSink.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// What a headless frame sink writes to its output folder.
+typedef NS_OPTIONS(NSUInteger, BXHeadlessFrameOutput) {
+    /// A line in frames.tsv for every frame received, with its emulated frame number and time and a hash of its 32bpp image.
+    BXHeadlessFrameOutputHashes = 1 << 0,
+    /// A PNG image of each captured frame.
+    BXHeadlessFrameOutputPNG    = 1 << 1,
+    /// The raw 32bpp BGRA pixels of each captured frame, with no header.
+    BXHeadlessFrameOutputRaw    = 1 << 2,
+};
+
+/// @brief BXHeadlessFrameSink records emulator output to disk without drawing it, for checking
+/// rendering output and measuring emulation throughput in automated runs.
+///
+/// @discussion Every frame received can be hashed, and selected frames can be written out as images.
+/// Nothing is drawn and no window server or GPU resources are used. Frames are received on the emulation
+/// thread and hashed there; images are encoded and written on a background queue.
+/// When finished, the sink writes a summary.json file with the frame count and throughput.
+@interface BXHeadlessFrameSink : NSObject <BXFrameSink>
+
+/// The folder that output is written to.
+@property (readonly, copy) NSURL *outputURL;
+
+/// What the sink writes.
+@property (readonly) BXHeadlessFrameOutput outputs;
+
+/// Images are written for every frame whose index is a multiple of this. Defaults to 0, which disables
+/// periodic capture. Frame indexes are the frames' emulated frame numbers, counting every frame the
+/// emulator rendered from 0: so the same frames are captured however fast the host runs.
+@property (assign) NSUInteger captureInterval;
+
+/// Specific frame indexes to write images of, in addition to those selected by @c captureInterval.
+@property (copy, nullable) NSIndexSet *capturedFrameIndexes;
+
+/// The number of frames received so far.
+@property (readonly) NSUInteger framesReceived;
+
+/// The rate at which frames have been received since the first one, in frames per second.
+@property (readonly) double framesPerSecond;
+
+/// Creates a new sink writing the specified outputs into the specified folder, creating it if necessary.
+/// Returns @c nil and populates @c outError if the folder or hash file could not be created.
+- (nullable instancetype) initWithOutputURL: (NSURL *)outputURL
+                                    outputs: (BXHeadlessFrameOutput)outputs
+                                      error: (out NSError **)outError;
+
+/// Creates a sink configured from the headlessFrameOutputPath, headlessFrameOutputFormats and
+/// headlessFrameCaptureInterval user defaults, which can also be passed as command-line arguments.
+/// Returns @c nil if no output path is set or the sink could not be created.
++ (nullable instancetype) sinkFromUserDefaults;
+
+@end
+
+NS_ASSUME_NONNULL_END
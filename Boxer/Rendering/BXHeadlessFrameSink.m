@@ -0,0 +1,272 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXHeadlessFrameSink.h"
+#import "BXVideoFrame.h"
+#import <ImageIO/ImageIO.h>
+#import <QuartzCore/QuartzCore.h>
+
+
+//A 64-bit hash of the visible pixels of a 32bpp image, ignoring any padding at the end of each line.
+//This only needs to tell frames apart reliably, not resist tampering.
+static uint64_t BXHashImage(const uint8_t *bytes, NSUInteger width, NSUInteger height, NSUInteger pitch)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint64_t prime = 0x100000001b3ULL;
+    NSUInteger rowBytes = width * 4;
+
+    NSUInteger line;
+    for (line = 0; line < height; line++)
+    {
+        const uint8_t *row = bytes + (line * pitch);
+        NSUInteger i = 0;
+        for (; i + 8 <= rowBytes; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, row + i, 8);
+            hash = (hash ^ word) * prime;
+            hash ^= hash >> 32;
+        }
+        for (; i < rowBytes; i++)
+            hash = (hash ^ row[i]) * prime;
+    }
+    return hash;
+}
+
+
+@implementation BXHeadlessFrameSink
+{
+    FILE *_hashFile;
+    dispatch_queue_t _writeQueue;
+
+    //Indexed frames are expanded into this before hashing and writing.
+    NSMutableData *_expandedFrame;
+
+    CFTimeInterval _firstFrameTime;
+    CFTimeInterval _lastFrameTime;
+}
+
+@synthesize outputURL = _outputURL;
+@synthesize outputs = _outputs;
+@synthesize captureInterval = _captureInterval;
+@synthesize capturedFrameIndexes = _capturedFrameIndexes;
+@synthesize framesReceived = _framesReceived;
+
++ (instancetype) sinkFromUserDefaults
+{
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSString *path = [defaults stringForKey: @"headlessFrameOutputPath"];
+    if (!path.length) return nil;
+
+    BXHeadlessFrameOutput outputs = 0;
+    NSString *formats = [defaults stringForKey: @"headlessFrameOutputFormats"] ?: @"hashes";
+    for (NSString *format in [formats.lowercaseString componentsSeparatedByString: @","])
+    {
+        NSString *trimmedFormat = [format stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+        if ([trimmedFormat isEqualToString: @"hashes"])     outputs |= BXHeadlessFrameOutputHashes;
+        else if ([trimmedFormat isEqualToString: @"png"])   outputs |= BXHeadlessFrameOutputPNG;
+        else if ([trimmedFormat isEqualToString: @"raw"])   outputs |= BXHeadlessFrameOutputRaw;
+    }
+
+    NSURL *outputURL = [NSURL fileURLWithPath: path.stringByExpandingTildeInPath isDirectory: YES];
+    NSError *sinkError = nil;
+    BXHeadlessFrameSink *sink = [[self alloc] initWithOutputURL: outputURL outputs: outputs error: &sinkError];
+    if (!sink)
+    {
+        NSLog(@"Could not create headless frame output at %@: %@", outputURL.path, sinkError);
+        return nil;
+    }
+
+    sink.captureInterval = (NSUInteger)MAX([defaults integerForKey: @"headlessFrameCaptureInterval"], 0);
+    return sink;
+}
+
+- (instancetype) initWithOutputURL: (NSURL *)outputURL
+                           outputs: (BXHeadlessFrameOutput)outputs
+                             error: (out NSError **)outError
+{
+    if ((self = [super init]))
+    {
+        _outputURL = [outputURL copy];
+        _outputs = outputs;
+        _writeQueue = dispatch_queue_create("com.boxer.headlessframesink", DISPATCH_QUEUE_SERIAL);
+
+        BOOL createdFolder = [[NSFileManager defaultManager] createDirectoryAtURL: outputURL
+                                                      withIntermediateDirectories: YES
+                                                                       attributes: nil
+                                                                            error: outError];
+        if (!createdFolder)
+            return nil;
+
+        if (outputs & BXHeadlessFrameOutputHashes)
+        {
+            NSURL *hashURL = [outputURL URLByAppendingPathComponent: @"frames.tsv"];
+            _hashFile = fopen(hashURL.fileSystemRepresentation, "w");
+            if (!_hashFile)
+            {
+                if (outError)
+                    *outError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: hashURL }];
+                return nil;
+            }
+            fputs("frame\ttime\twidth\theight\thash\n", _hashFile);
+        }
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_hashFile)
+    {
+        fclose(_hashFile);
+        _hashFile = NULL;
+    }
+}
+
+- (double) framesPerSecond
+{
+    CFTimeInterval elapsed = _lastFrameTime - _firstFrameTime;
+    if (_framesReceived < 2 || elapsed <= 0) return 0;
+    return (_framesReceived - 1) / elapsed;
+}
+
+
+#pragma mark - Consuming frames
+
+- (BOOL) _shouldCaptureFrameAtIndex: (NSUInteger)index
+{
+    if (!(self.outputs & (BXHeadlessFrameOutputPNG | BXHeadlessFrameOutputRaw)))
+        return NO;
+
+    if (self.captureInterval && (index % self.captureInterval) == 0)
+        return YES;
+
+    return [self.capturedFrameIndexes containsIndex: index];
+}
+
+- (void) consumeFrame: (BXVideoFrame *)frame
+{
+    CFTimeInterval now = CACurrentMediaTime();
+    if (!_framesReceived)
+        _firstFrameTime = now;
+    _lastFrameTime = now;
+
+    //Key everything by emulated frame number, so that runs can be compared frame for frame
+    //however fast the host happened to run them.
+    _framesReceived++;
+    NSUInteger index = frame.emulatedFrameNumber;
+    BOOL shouldCapture = [self _shouldCaptureFrameAtIndex: index];
+    if (!_hashFile && !shouldCapture)
+        return;
+
+    NSUInteger width = (NSUInteger)frame.size.width;
+    NSUInteger height = (NSUInteger)frame.size.height;
+
+    //Bring indexed frames up to 32bpp, so that hashes and images don't depend on how DOSBox delivered them.
+    const uint8_t *pixels;
+    NSUInteger pitch;
+    if (frame.isIndexed)
+    {
+        pitch = width * 4;
+        if (_expandedFrame.length != pitch * height)
+            _expandedFrame = [NSMutableData dataWithLength: pitch * height];
+
+        [frame expandLines: NSMakeRange(0, height) intoBuffer: _expandedFrame.mutableBytes pitch: pitch];
+        pixels = _expandedFrame.bytes;
+    }
+    else
+    {
+        pitch = frame.pitch;
+        pixels = frame.bytes;
+    }
+
+    if (_hashFile)
+    {
+        uint64_t hash = BXHashImage(pixels, width, height, pitch);
+        fprintf(_hashFile, "%lu\t%.6f\t%lu\t%lu\t%016llx\n",
+                (unsigned long)index, frame.emulatedTime,
+                (unsigned long)width, (unsigned long)height, (unsigned long long)hash);
+    }
+
+    if (shouldCapture)
+    {
+        //Copy the visible pixels out tightly-packed for writing in the background.
+        NSUInteger rowBytes = width * 4;
+        NSMutableData *image = [NSMutableData dataWithLength: rowBytes * height];
+        uint8_t *dest = image.mutableBytes;
+        NSUInteger line;
+        for (line = 0; line < height; line++)
+            memcpy(dest + (line * rowBytes), pixels + (line * pitch), rowBytes);
+
+        NSString *baseName = [NSString stringWithFormat: @"frame-%06lu", (unsigned long)index];
+        dispatch_async(_writeQueue, ^{
+            [self _writeImage: image width: width height: height baseName: baseName];
+        });
+    }
+}
+
+- (void) finishConsumingFrames
+{
+    if (_hashFile)
+    {
+        fclose(_hashFile);
+        _hashFile = NULL;
+    }
+
+    //Wait for any images still being written, so that the output is complete once we return.
+    dispatch_sync(_writeQueue, ^{});
+
+    NSDictionary *summary = @{
+        @"framesReceived": @(self.framesReceived),
+        @"elapsedSeconds": @(MAX(_lastFrameTime - _firstFrameTime, 0)),
+        @"framesPerSecond": @(self.framesPerSecond),
+    };
+    NSData *summaryData = [NSJSONSerialization dataWithJSONObject: summary options: NSJSONWritingPrettyPrinted error: NULL];
+    [summaryData writeToURL: [self.outputURL URLByAppendingPathComponent: @"summary.json"] atomically: YES];
+}
+
+
+#pragma mark - Writing images
+
+- (void) _writeImage: (NSData *)image
+               width: (NSUInteger)width
+              height: (NSUInteger)height
+            baseName: (NSString *)baseName
+{
+    if (self.outputs & BXHeadlessFrameOutputRaw)
+    {
+        NSString *fileName = [NSString stringWithFormat: @"%@-%lux%lu.bgra", baseName, (unsigned long)width, (unsigned long)height];
+        [image writeToURL: [self.outputURL URLByAppendingPathComponent: fileName] atomically: NO];
+    }
+
+    if (self.outputs & BXHeadlessFrameOutputPNG)
+    {
+        NSURL *imageURL = [self.outputURL URLByAppendingPathComponent: [baseName stringByAppendingPathExtension: @"png"]];
+
+        CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)image);
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+        CGImageRef cgImage = CGImageCreate(width, height, 8, 32, width * 4, colorSpace,
+                                           kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst,
+                                           provider, NULL, false, kCGRenderingIntentDefault);
+
+        CGImageDestinationRef destination = CGImageDestinationCreateWithURL((__bridge CFURLRef)imageURL, CFSTR("public.png"), 1, NULL);
+        if (destination && cgImage)
+        {
+            CGImageDestinationAddImage(destination, cgImage, NULL);
+            if (!CGImageDestinationFinalize(destination))
+                NSLog(@"Could not write headless frame output to %@", imageURL.path);
+        }
+
+        if (destination) CFRelease(destination);
+        CGImageRelease(cgImage);
+        CGColorSpaceRelease(colorSpace);
+        CGDataProviderRelease(provider);
+    }
+}
+
+@end
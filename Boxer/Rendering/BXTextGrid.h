@@ -0,0 +1,95 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The largest text grid we will capture: 132 columns by 60 rows covers every standard VGA text mode.
+#define BXTextGridMaxColumns 132
+#define BXTextGridMaxRows 60
+
+/// Glyphs are stored as one byte per line, with room for 32 lines per glyph as in VGA font memory.
+#define BXTextGridGlyphStride 32
+
+/// The number of glyphs in the font: two character sets of 256 glyphs each,
+/// selected between by bit 3 of each character's attribute.
+#define BXTextGridNumGlyphs 512
+
+/// The number of colors an attribute byte can refer to.
+#define BXTextGridNumColors 16
+
+/// The maximum number of changed runs that can be recorded for a single grid.
+#define BXTextGridMaxChangedRuns 256
+
+/// @brief BXTextGrid is a snapshot of an emulated text-mode display: a grid of character and
+/// attribute cells, plus the font, colors and cursor state needed to draw them.
+///
+/// @discussion Text grids ride along with the video frames they were captured from, so that
+/// presenters can draw text-mode frames from their cells instead of their pixels. Like frames,
+/// they record which cells changed since the previously published grid.
+@interface BXTextGrid : NSObject
+
+/// The dimensions of the grid in characters.
+@property (readonly) NSUInteger columns;
+@property (readonly) NSUInteger rows;
+
+/// The height of each character cell in pixels.
+@property (assign) NSUInteger glyphHeight;
+
+/// The grid's cells, row by row: each has the character in its low byte and the attribute in its high byte.
+@property (readonly) const uint16_t *cells;
+@property (readonly) uint16_t *mutableCells;
+
+/// The font the grid should be drawn with, as @c BXTextGridNumGlyphs glyphs of @c BXTextGridGlyphStride bytes.
+/// The most significant bit of each byte is the leftmost dot of that line of the glyph.
+@property (readonly) const uint8_t *fontData;
+
+/// A counter that changes whenever the font changes, so that consumers can tell
+/// whether they need to upload it again.
+@property (readonly) NSUInteger fontVersion;
+
+/// The BGRA colors that the 16 attribute color values refer to.
+@property (readonly) const uint32_t *colors;
+
+/// The index of the cell containing the text cursor, or @c NSNotFound if the cursor is hidden.
+@property (assign) NSUInteger cursorCell;
+
+/// The first and last lines of the character cell that the cursor covers.
+@property (assign) NSUInteger cursorStartLine;
+@property (assign) NSUInteger cursorEndLine;
+
+/// Whether bit 7 of the attribute makes characters blink rather than selecting bright backgrounds.
+@property (assign) BOOL blinkEnabled;
+
+/// Whether line-drawing characters (0xC0-0xDF) extend into the ninth column of 9-dot-wide cells.
+@property (assign) BOOL lineGraphicsEnabled;
+
+/// The number of runs of changed cells. Runs are ranges of cell indexes.
+@property (readonly) NSUInteger numChangedRuns;
+
+/// Resizes the grid. Returns YES if the dimensions changed, in which case the cell contents are undefined.
+- (BOOL) setColumns: (NSUInteger)columns rows: (NSUInteger)rows;
+
+/// Replaces the font with the specified pair of 256-glyph character sets, if the version differs from the current one.
+- (void) setFontWithCharacterSet: (const uint8_t *)firstSet
+                    characterSet: (const uint8_t *)secondSet
+                         version: (NSUInteger)version;
+
+/// Replaces the 16 attribute colors.
+- (void) setColors: (const uint32_t *)colors;
+
+/// Flagging runs of cells as changed. Once the maximum number of runs has been recorded,
+/// later runs extend the last one.
+- (void) addChangedRun: (NSRange)run;
+- (void) clearChangedRuns;
+- (NSRange) changedRunAtIndex: (NSUInteger)index;
+
+@end
+
+NS_ASSUME_NONNULL_END
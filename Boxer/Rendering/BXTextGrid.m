@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXTextGrid.h"
+
+
+@implementation BXTextGrid
+{
+    uint16_t _cells[BXTextGridMaxColumns * BXTextGridMaxRows];
+    uint8_t _fontData[BXTextGridNumGlyphs * BXTextGridGlyphStride];
+    uint32_t _colors[BXTextGridNumColors];
+
+    NSRange _changedRuns[BXTextGridMaxChangedRuns];
+}
+
+@synthesize columns = _columns;
+@synthesize rows = _rows;
+@synthesize glyphHeight = _glyphHeight;
+@synthesize fontVersion = _fontVersion;
+@synthesize cursorCell = _cursorCell;
+@synthesize cursorStartLine = _cursorStartLine;
+@synthesize cursorEndLine = _cursorEndLine;
+@synthesize blinkEnabled = _blinkEnabled;
+@synthesize lineGraphicsEnabled = _lineGraphicsEnabled;
+@synthesize numChangedRuns = _numChangedRuns;
+
+- (instancetype) init
+{
+    if ((self = [super init]))
+    {
+        _cursorCell = NSNotFound;
+        _fontVersion = NSNotFound;
+    }
+    return self;
+}
+
+- (const uint16_t *) cells          { return _cells; }
+- (uint16_t *) mutableCells         { return _cells; }
+- (const uint8_t *) fontData        { return _fontData; }
+- (const uint32_t *) colors         { return _colors; }
+
+- (BOOL) setColumns: (NSUInteger)columns rows: (NSUInteger)rows
+{
+    columns = MIN(columns, (NSUInteger)BXTextGridMaxColumns);
+    rows    = MIN(rows, (NSUInteger)BXTextGridMaxRows);
+
+    if (columns == _columns && rows == _rows)
+        return NO;
+
+    _columns = columns;
+    _rows = rows;
+    return YES;
+}
+
+- (void) setFontWithCharacterSet: (const uint8_t *)firstSet
+                    characterSet: (const uint8_t *)secondSet
+                         version: (NSUInteger)version
+{
+    if (version == _fontVersion)
+        return;
+
+    NSUInteger setLength = (BXTextGridNumGlyphs / 2) * BXTextGridGlyphStride;
+    memcpy(_fontData, firstSet, setLength);
+    memcpy(_fontData + setLength, secondSet, setLength);
+    _fontVersion = version;
+}
+
+- (void) setColors: (const uint32_t *)colors
+{
+    memcpy(_colors, colors, sizeof(_colors));
+}
+
+
+#pragma mark - Changed cells
+
+- (void) addChangedRun: (NSRange)run
+{
+    if (!run.length) return;
+
+    if (_numChangedRuns == BXTextGridMaxChangedRuns)
+    {
+        NSRange *lastRun = &_changedRuns[_numChangedRuns - 1];
+        lastRun->length = NSMaxRange(run) - lastRun->location;
+    }
+    else
+    {
+        _changedRuns[_numChangedRuns++] = run;
+    }
+}
+
+- (void) clearChangedRuns
+{
+    _numChangedRuns = 0;
+}
+
+- (NSRange) changedRunAtIndex: (NSUInteger)index
+{
+    NSAssert(index < _numChangedRuns, @"Changed run index out of bounds.");
+    return _changedRuns[index];
+}
+
+@end
@@ -18,6 +18,11 @@ extern const CGFloat BX4by3AspectRatio;
 /// This is set to the maximum vertical resolution expected from a DOS game.
 #define MAX_DIRTY_REGIONS 1024
 
+/// The number of entries in the palette of an indexed-color frame.
+#define BXVideoFramePaletteSize 256
+
+@class BXTextGrid;
+
 /// @brief BXVideoFrame is a renderer-agnostic framebuffer for DOSBox to draw frames into.
 ///
 /// @discussion It keeps track of the frame's resolution, bit depth and intended
@@ -35,6 +40,14 @@ extern const CGFloat BX4by3AspectRatio;
     NSUInteger _numDirtyRegions;
     
     NSTimeInterval _timestamp;
+    NSTimeInterval _emulatedTime;
+    NSUInteger _emulatedFrameNumber;
+    NSUInteger _frameNumber;
+    
+    uint32_t _palette[BXVideoFramePaletteSize];
+    NSUInteger _paletteVersion;
+    
+    BXTextGrid *_textGrid;
 }
 
 #pragma mark -
@@ -47,6 +60,11 @@ extern const CGFloat BX4by3AspectRatio;
 /// is bytesPerPixel * size.width * size.height.
 @property (readonly) NSUInteger bytesPerPixel;
 
+/// Whether this is an 8-bit palettised frame, whose pixels are indexes into the frame's palette
+/// rather than BGRA colors. Indexed frames must be expanded with expandLines:intoBuffer:pitch:
+/// before they can be displayed.
+@property (readonly, getter=isIndexed) BOOL indexed;
+
 /// The width in bytes of one scanline in the buffer.
 /// This is equal to size.width * bytesPerPixel.
 @property (readonly) NSUInteger pitch;
@@ -77,6 +95,33 @@ extern const CGFloat BX4by3AspectRatio;
 /// The absolute time which this frame represents. Updated each time a frame update is completed by the emulator.
 @property (assign) CFAbsoluteTime timestamp;
 
+/// The emulated time at which the emulator finished this frame, in seconds since emulation began.
+/// Unlike @c timestamp this only advances while the emulator is running, and is updated for every
+/// frame the emulator renders: including frames that are not published because nothing changed.
+@property (assign) NSTimeInterval emulatedTime;
+
+/// The number of frames the emulator had rendered before this one since emulation began.
+/// Like @c emulatedTime, this counts frames that were not published because nothing changed.
+@property (assign) NSUInteger emulatedFrameNumber;
+
+/// The sequence number of this frame, assigned each time the frame is published by the emulator.
+/// Consecutive frames have consecutive numbers: if a consumer sees a gap, it has missed
+/// the dirty regions of the intervening frames and should treat the whole frame as dirty.
+@property (assign) NSUInteger frameNumber;
+
+/// For frames of VGA text modes, the character grid the frame was rendered from.
+/// Presenters may draw the frame from this instead of from its pixels.
+/// This is @c nil for graphical frames, and for text modes whose grid could not be captured.
+@property (strong) BXTextGrid *textGrid;
+
+/// For indexed frames, the 256 BGRA colors that the frame's pixel values refer to.
+@property (readonly) const uint32_t *palette;
+
+/// For indexed frames, a counter that changes whenever the contents of the palette change.
+/// Consumers can compare this against the version they last expanded with, to tell whether
+/// lines that haven't been flagged as dirty still need to be expanded again.
+@property (readonly) NSUInteger paletteVersion;
+
 /// Read-only/mutable pointers to the frame's data.
 @property (readonly) NSMutableData *frameData;
 @property (readonly) const void *bytes;
@@ -112,6 +157,18 @@ extern const CGFloat BX4by3AspectRatio;
 - (void) useSquarePixels;
 
 
+#pragma mark -
+#pragma mark Indexed-color frames
+
+/// Replaces the frame's palette with the specified 256 BGRA entries.
+- (void) setPalette: (const uint32_t *)entries version: (NSUInteger)version;
+
+/// Expands the specified scanlines of an indexed frame through the frame's palette,
+/// writing the resulting 32bpp BGRA lines into the same lines of the destination buffer.
+/// The destination must be at least size.height lines of the specified pitch.
+- (void) expandLines: (NSRange)lines intoBuffer: (void *)buffer pitch: (NSUInteger)pitch;
+
+
 #pragma mark -
 #pragma mark Flagging scanlines of the frame as dirty.
 
@@ -24,6 +24,10 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 @synthesize numDirtyRegions = _numDirtyRegions;
 @synthesize containsText = _containsText;
 @synthesize timestamp = _timestamp;
+@synthesize emulatedTime = _emulatedTime;
+@synthesize emulatedFrameNumber = _emulatedFrameNumber;
+@synthesize frameNumber = _frameNumber;
+@synthesize textGrid = _textGrid;
 
 
 + (NSSize) scalingFactorForSize: (NSSize)frameSize toAspectRatio: (CGFloat)aspectRatio
@@ -69,6 +73,11 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 	return self;
 }
 
+- (BOOL) isIndexed
+{
+    return self.bytesPerPixel == 1;
+}
+
 - (NSUInteger) pitch
 {
 	return self.size.width * self.bytesPerPixel;
@@ -120,6 +129,67 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 	return _frameData.mutableBytes;
 }
 
+#pragma mark Indexed color
+
+- (const uint32_t *) palette
+{
+    return _palette;
+}
+
+- (NSUInteger) paletteVersion
+{
+    return _paletteVersion;
+}
+
+- (void) setPalette: (const uint32_t *)entries version: (NSUInteger)version
+{
+    memcpy(_palette, entries, sizeof(_palette));
+    _paletteVersion = version;
+}
+
+- (void) expandLines: (NSRange)lines intoBuffer: (void *)buffer pitch: (NSUInteger)destPitch
+{
+    NSAssert(self.isIndexed, @"expandLines:intoBuffer:pitch: called on a frame that is not indexed.");
+    
+    NSUInteger width        = (NSUInteger)self.size.width;
+    NSUInteger numLines     = (NSUInteger)self.size.height;
+    NSUInteger sourcePitch  = self.pitch;
+    
+    if (lines.location >= numLines) return;
+    NSUInteger lastLine = MIN(NSMaxRange(lines), numLines);
+    
+    const uint32_t *palette = _palette;
+    const uint8_t *sourceBytes = (const uint8_t *)self.bytes;
+    uint8_t *destBytes = (uint8_t *)buffer;
+    
+    NSUInteger line;
+    for (line = lines.location; line < lastLine; line++)
+    {
+        const uint8_t *source = sourceBytes + (line * sourcePitch);
+        uint32_t *dest = (uint32_t *)(destBytes + (line * destPitch));
+        
+        //Unrolled so that the compiler can interleave the table lookups and write
+        //the results out four pixels at a time.
+        NSUInteger x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            uint32_t p0 = palette[source[x]];
+            uint32_t p1 = palette[source[x+1]];
+            uint32_t p2 = palette[source[x+2]];
+            uint32_t p3 = palette[source[x+3]];
+            dest[x]     = p0;
+            dest[x+1]   = p1;
+            dest[x+2]   = p2;
+            dest[x+3]   = p3;
+        }
+        for (; x < width; x++)
+        {
+            dest[x] = palette[source[x]];
+        }
+    }
+}
+
+
 #pragma mark Region-dirtying
 
 - (void) setNeedsDisplayInRegion: (NSRange)range
@@ -0,0 +1,63 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The number of framebuffers in a ring: one being written by the emulator,
+/// one being presented and one waiting in between.
+#define BXVideoFrameRingSize 3
+
+@class BXVideoFrame;
+
+/// @brief BXVideoFrameRing is a triple-buffered set of identically-sized @c BXVideoFrame s
+/// for handing frames from the emulation thread to the presenter without either side waiting on the other.
+///
+/// @discussion The ring is safe for exactly one producer thread and one consumer thread.
+/// The producer renders into @c writeFrame between calls to @c prepareWriteFrame and @c publishWriteFrame;
+/// the consumer calls @c acquireLatestFrame to take ownership of the newest published frame.
+/// Neither side ever blocks: if the producer publishes faster than the consumer acquires,
+/// intermediate frames are simply superseded.
+///
+/// Because DOSBox only redraws the lines that changed since its previous frame, the ring keeps track
+/// of which lines each buffer has missed while it was out of the producer's hands, and copies
+/// them over from the last published frame before the buffer is written to again.
+@interface BXVideoFrameRing : NSObject
+
+/// The pixel size and bytes per pixel of every frame in the ring.
+@property (readonly) NSSize size;
+@property (readonly) NSUInteger bytesPerPixel;
+
+/// Producer-only: the frame the emulator should currently be rendering into.
+/// This will change after each call to @c publishWriteFrame.
+@property (readonly) BXVideoFrame *writeFrame;
+
+/// Consumer-only: the frame most recently returned by @c acquireLatestFrame,
+/// or nil if no frame has been acquired yet. This frame will not be touched by
+/// the producer until the consumer acquires another.
+@property (readonly, nullable) BXVideoFrame *readFrame;
+
++ (instancetype) ringWithSize: (NSSize)size depth: (NSUInteger)depth;
+- (instancetype) initWithSize: (NSSize)size depth: (NSUInteger)depth;
+
+/// Producer-only: brings @c writeFrame up to date with the last published frame and
+/// clears its dirty regions, ready for the emulator to start rendering the next frame into it.
+- (void) prepareWriteFrame;
+
+/// Producer-only: publishes @c writeFrame, along with its dirty regions, as the newest complete frame
+/// and swaps in a different buffer as @c writeFrame.
+- (void) publishWriteFrame;
+
+/// Consumer-only: returns the newest frame published since the last call to this method,
+/// or nil if no new frame has been published since then. The returned frame becomes @c readFrame.
+- (nullable BXVideoFrame *) acquireLatestFrame;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,187 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXVideoFrameRing.h"
+#import "BXVideoFrame.h"
+#import <stdatomic.h>
+
+
+//The shared middle slot is stored as a buffer index, plus this flag if the buffer
+//in that slot has been published but not yet picked up by the consumer.
+#define BXVideoFrameRingFreshFlag 0x4
+#define BXVideoFrameRingIndexMask 0x3
+
+//Frame numbers are drawn from a process-wide sequence, so that a consumer can never
+//mistake the first frame from a new ring for the successor of a frame from an old one.
+static atomic_uint_fast64_t BXVideoFrameRingNextFrameNumber = 1;
+
+
+@implementation BXVideoFrameRing
+{
+    NSArray<BXVideoFrame *> *_frames;
+
+    //Producer-owned state
+    NSUInteger _writeIndex;
+    NSInteger _lastPublishedIndex;
+    //For each buffer, a flag per scanline that has changed in a published frame
+    //since that buffer was last written.
+    uint8_t *_staleLines[BXVideoFrameRingSize];
+
+    //Consumer-owned state
+    NSUInteger _readIndex;
+    BOOL _hasAcquiredFrame;
+
+    //Shared state
+    atomic_uint _middle;
+}
+
+@synthesize size = _size;
+@synthesize bytesPerPixel = _bytesPerPixel;
+
++ (instancetype) ringWithSize: (NSSize)size depth: (NSUInteger)depth
+{
+    return [[self alloc] initWithSize: size depth: depth];
+}
+
+- (instancetype) initWithSize: (NSSize)size depth: (NSUInteger)depth
+{
+    if ((self = [super init]))
+    {
+        _size = size;
+        _bytesPerPixel = depth;
+
+        NSMutableArray *frames = [NSMutableArray arrayWithCapacity: BXVideoFrameRingSize];
+        NSUInteger i, numLines = (NSUInteger)size.height;
+        for (i = 0; i < BXVideoFrameRingSize; i++)
+        {
+            [frames addObject: [BXVideoFrame frameWithSize: size depth: depth]];
+            _staleLines[i] = calloc(MAX(numLines, 1U), sizeof(uint8_t));
+        }
+        _frames = frames;
+
+        //All three buffers start out zeroed and therefore identical.
+        _writeIndex = 0;
+        _middle = 1;
+        _readIndex = 2;
+        _lastPublishedIndex = -1;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    NSUInteger i;
+    for (i = 0; i < BXVideoFrameRingSize; i++)
+    {
+        free(_staleLines[i]);
+        _staleLines[i] = NULL;
+    }
+}
+
+- (BXVideoFrame *) writeFrame
+{
+    return _frames[_writeIndex];
+}
+
+- (BXVideoFrame *) readFrame
+{
+    return _hasAcquiredFrame ? _frames[_readIndex] : nil;
+}
+
+
+#pragma mark - Producer
+
+- (void) prepareWriteFrame
+{
+    BXVideoFrame *frame = self.writeFrame;
+
+    if (_lastPublishedIndex >= 0 && (NSUInteger)_lastPublishedIndex != _writeIndex)
+    {
+        //Copy over any runs of lines that changed in published frames while this buffer was
+        //away being presented. The last published frame is read-only from here on, so it's
+        //safe to read from it even if the consumer is reading it at the same time.
+        BXVideoFrame *source = _frames[_lastPublishedIndex];
+        uint8_t *stale = _staleLines[_writeIndex];
+        NSUInteger pitch = frame.pitch;
+        NSUInteger line = 0, numLines = (NSUInteger)self.size.height;
+
+        const uint8_t *sourceBytes = source.bytes;
+        uint8_t *destBytes = frame.mutableBytes;
+
+        while (line < numLines)
+        {
+            if (!stale[line])
+            {
+                line++;
+                continue;
+            }
+
+            NSUInteger runStart = line;
+            while (line < numLines && stale[line]) line++;
+
+            NSUInteger offset = runStart * pitch;
+            memcpy(destBytes + offset, sourceBytes + offset, (line - runStart) * pitch);
+        }
+    }
+
+    memset(_staleLines[_writeIndex], 0, (NSUInteger)self.size.height);
+    [frame clearDirtyRegions];
+}
+
+- (void) publishWriteFrame
+{
+    BXVideoFrame *frame = self.writeFrame;
+
+    //Mark the lines that changed in this frame as stale in every other buffer.
+    NSUInteger numLines = (NSUInteger)self.size.height;
+    NSUInteger r, numRegions = frame.numDirtyRegions;
+    for (r = 0; r < numRegions; r++)
+    {
+        NSRange region = [frame dirtyRegionAtIndex: r];
+        if (region.location >= numLines) continue;
+
+        NSUInteger length = MIN(region.length, numLines - region.location);
+        NSUInteger i;
+        for (i = 0; i < BXVideoFrameRingSize; i++)
+        {
+            if (i != _writeIndex)
+                memset(_staleLines[i] + region.location, 1, length);
+        }
+    }
+
+    frame.frameNumber = (NSUInteger)atomic_fetch_add_explicit(&BXVideoFrameRingNextFrameNumber, 1, memory_order_relaxed);
+
+    //Swap our finished buffer into the middle slot and take back whatever was there:
+    //either an older frame the consumer never got round to, or the consumer's previous read buffer.
+    _lastPublishedIndex = _writeIndex;
+    unsigned int previous = atomic_exchange_explicit(&_middle,
+                                                     (unsigned int)_writeIndex | BXVideoFrameRingFreshFlag,
+                                                     memory_order_acq_rel);
+    _writeIndex = previous & BXVideoFrameRingIndexMask;
+}
+
+
+#pragma mark - Consumer
+
+- (BXVideoFrame *) acquireLatestFrame
+{
+    if (!(atomic_load_explicit(&_middle, memory_order_acquire) & BXVideoFrameRingFreshFlag))
+        return nil;
+
+    //Swap our previous read buffer into the middle slot for the producer to reuse,
+    //and take the freshly-published buffer in its place.
+    unsigned int previous = atomic_exchange_explicit(&_middle,
+                                                     (unsigned int)_readIndex,
+                                                     memory_order_acq_rel);
+    _readIndex = previous & BXVideoFrameRingIndexMask;
+    _hasAcquiredFrame = YES;
+
+    return _frames[_readIndex];
+}
+
+@end
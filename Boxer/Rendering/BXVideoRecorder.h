@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BXVideoFrame;
+
+/// @brief BXVideoRecorder records emulator output to a lossless ZMBV-encoded AVI file.
+///
+/// @discussion Every frame the emulator renders is handed to the recorder on the emulation thread.
+/// The recorder copies only the lines that changed in each frame and hands them off to a background
+/// queue for encoding and writing, so recording never blocks emulation on compression or disk I/O.
+/// If the background queue falls more than @c maxQueuedFrames frames behind, further frames are dropped
+/// (and counted) until it catches up: the first frame accepted after a drop is copied in full.
+///
+/// The recording starts with the first frame handed to the recorder, and frames are placed in the video
+/// stream according to how much emulated time has passed since then: so the recording plays back at
+/// the speed the game ran at, whatever the host was doing. Gaps left by frames that were skipped or
+/// did not change are filled with empty repeat-frame chunks. Frames from a video mode of a different
+/// size than the first frame are scaled to fit.
+///
+/// Recordings have no audio stream: our DOSBox doesn't hand us its final mix.
+@interface BXVideoRecorder : NSObject
+
+/// The location of the AVI file being recorded.
+@property (readonly, copy) NSURL *URL;
+
+/// The frame rate of the recorded video stream.
+@property (readonly) double frameRate;
+
+/// The maximum number of frames that may be waiting to be encoded before new frames are dropped.
+/// Defaults to 8.
+@property (assign) NSUInteger maxQueuedFrames;
+
+/// The number of frames that have been encoded and written so far.
+@property (readonly) NSUInteger recordedFrameCount;
+
+/// The number of frames that have been dropped because the encoder could not keep up.
+@property (readonly) NSUInteger droppedFrameCount;
+
+/// Whether the recording has been finished.
+@property (readonly, getter=isFinished) BOOL finished;
+
+/// Creates a new recording at the specified URL, replacing any existing file there.
+/// Returns @c nil and populates @c outError if the file could not be created.
+- (nullable instancetype) initWithURL: (NSURL *)URL
+                            frameRate: (double)frameRate
+                                error: (out NSError **)outError;
+
+/// Queues the changed lines of the specified frame for recording, placing it by its emulated time.
+/// Should be called for every frame the emulator renders, whether or not it changed. The frame is not
+/// retained and may be reused once this returns. The first frame added determines the size of the video.
+- (void) addFrame: (BXVideoFrame *)frame;
+
+/// Writes out any queued frames, completes the AVI headers and index, and closes the file.
+/// Frames added after this are ignored. The completion handler is called on the main thread.
+- (void) finishWithCompletionHandler: (nullable void (^)(BOOL success, NSError * _Nullable error))completionHandler;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,530 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXVideoRecorder.h"
+#import "BXVideoFrame.h"
+#import "BXZMBVEncoder.h"
+#import <atomic>
+#import <vector>
+
+
+//RIFF chunk identifiers, in the little-endian order they appear in the file.
+#define BXFourCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define BXAVIVideoChunkID   BXFourCC('0', '0', 'd', 'c')
+#define BXAVIHasIndexFlag   0x10
+#define BXAVIKeyframeFlag   0x10
+
+//AVI 1.0 files cannot exceed 2GB: stop recording a little before then.
+#define BXAVIMaxMoviLength  0x7F000000
+
+//The scale applied to the video stream's rate, so that fractional frame rates survive intact.
+#define BXAVIFrameRateScale (1 << 24)
+
+
+//A copy of the lines that changed in one frame, waiting to be encoded.
+//The line data is a full-size 32bpp image, of which only the changed lines are valid.
+@interface BXVideoRecorderSnapshot : NSObject
+{
+@public
+    NSRange _regions[MAX_DIRTY_REGIONS];
+    NSUInteger _numRegions;
+}
+@property (strong) NSMutableData *lineData;
+//The emulated time of the frame, in seconds since the recording started.
+@property (assign) NSTimeInterval time;
+@end
+
+@implementation BXVideoRecorderSnapshot
+@end
+
+
+@implementation BXVideoRecorder
+{
+    dispatch_queue_t _queue;
+
+    //Producer-owned state
+    NSSize _frameSize;
+    NSSize _lastSourceSize;
+    BOOL _needsFullSnapshot;
+    NSUInteger _recordedPaletteVersion;
+    NSTimeInterval _startTime;
+    std::vector<uint32_t> _scaleLine;
+
+    //Shared state
+    NSMutableArray<BXVideoRecorderSnapshot *> *_snapshotPool;
+    std::atomic<NSUInteger> _pendingFrames;
+    std::atomic<NSUInteger> _droppedFrames;
+    std::atomic<NSUInteger> _recordedFrames;
+    std::atomic<bool> _finished;
+
+    //Queue-owned state
+    FILE *_file;
+    BXZMBVEncoder *_encoder;
+    NSMutableData *_encodedFrame;
+    NSMutableData *_index;
+    NSUInteger _moviLength;
+    NSUInteger _headerLength;
+    NSUInteger _videoChunkCount;
+    NSUInteger _largestVideoChunk;
+    NSInteger _lastFrameIndex;
+    BOOL _outOfSpace;
+    NSError *_writeError;
+}
+
+@synthesize URL = _URL;
+@synthesize frameRate = _frameRate;
+@synthesize maxQueuedFrames = _maxQueuedFrames;
+
+- (instancetype) initWithURL: (NSURL *)URL
+                   frameRate: (double)frameRate
+                       error: (out NSError **)outError
+{
+    if ((self = [super init]))
+    {
+        _URL = [URL copy];
+        _frameRate = (frameRate > 0) ? frameRate : 70.0;
+        _maxQueuedFrames = 8;
+        _needsFullSnapshot = YES;
+        _startTime = -1;
+        _lastFrameIndex = -1;
+        _snapshotPool = [NSMutableArray array];
+        _index = [NSMutableData data];
+        _encodedFrame = [NSMutableData data];
+        _queue = dispatch_queue_create("com.boxer.videorecorder", DISPATCH_QUEUE_SERIAL);
+
+        _file = fopen(URL.fileSystemRepresentation, "wb");
+        if (!_file)
+        {
+            if (outError)
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: URL }];
+            return nil;
+        }
+
+        //Reserve space for the headers, which can only be filled in once we know
+        //how long the streams are. Their size does not depend on their contents.
+        NSData *placeholder = [self _headerData];
+        _headerLength = placeholder.length;
+        fwrite(placeholder.bytes, placeholder.length, 1, _file);
+
+        //The first chunk offset is measured from the 'movi' identifier.
+        _moviLength = 4;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_file)
+    {
+        fclose(_file);
+        _file = NULL;
+    }
+}
+
+- (NSUInteger) recordedFrameCount
+{
+    return _recordedFrames.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger) droppedFrameCount
+{
+    return _droppedFrames.load(std::memory_order_relaxed);
+}
+
+- (BOOL) isFinished
+{
+    return _finished.load(std::memory_order_acquire);
+}
+
+
+#pragma mark - Producer
+
+- (void) addFrame: (BXVideoFrame *)frame
+{
+    if (self.isFinished) return;
+
+    //The recording starts with the first frame the emulator finishes after we were attached,
+    //and every frame after that is placed by how much emulated time has passed since then.
+    if (_startTime < 0)
+    {
+        _frameSize = frame.size;
+        _startTime = frame.emulatedTime;
+    }
+
+    //Frames from a different video mode are scaled to the size of the recording and replace the whole image.
+    //Whenever the mode changes, the first frame in the new mode must be copied whole.
+    BOOL matchesSize = NSEqualSizes(frame.size, _frameSize);
+    if (!NSEqualSizes(frame.size, _lastSourceSize))
+    {
+        _lastSourceSize = frame.size;
+        _needsFullSnapshot = YES;
+    }
+
+    //A palette change alters every line of an indexed frame, whether or not DOSBox flagged them.
+    if (frame.isIndexed && frame.paletteVersion != _recordedPaletteVersion)
+    {
+        _recordedPaletteVersion = frame.paletteVersion;
+        _needsFullSnapshot = YES;
+    }
+
+    //Nothing changed: the encoder will fill the gap with repeats once the next change arrives.
+    if (!_needsFullSnapshot && !frame.numDirtyRegions)
+        return;
+
+    //If the encoder is falling behind, drop this frame rather than holding up emulation.
+    //The frames after it are relative to this one, so the next frame we accept must be copied whole.
+    if (_pendingFrames.load(std::memory_order_acquire) >= self.maxQueuedFrames)
+    {
+        _droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        _needsFullSnapshot = YES;
+        return;
+    }
+
+    BXVideoRecorderSnapshot *snapshot = [self _dequeueSnapshot];
+    uint8_t *lineBytes = (uint8_t *)snapshot.lineData.mutableBytes;
+    NSUInteger numLines = (NSUInteger)_frameSize.height;
+    NSUInteger destPitch = (NSUInteger)_frameSize.width * 4;
+
+    if (_needsFullSnapshot || !matchesSize)
+    {
+        snapshot->_regions[0] = NSMakeRange(0, numLines);
+        snapshot->_numRegions = 1;
+        _needsFullSnapshot = NO;
+    }
+    else
+    {
+        NSUInteger r, numRegions = frame.numDirtyRegions;
+        for (r = 0; r < numRegions; r++)
+            snapshot->_regions[r] = [frame dirtyRegionAtIndex: r];
+        snapshot->_numRegions = numRegions;
+    }
+
+    if (matchesSize)
+    {
+        NSUInteger r;
+        for (r = 0; r < snapshot->_numRegions; r++)
+        {
+            NSRange region = snapshot->_regions[r];
+            if (region.location >= numLines) continue;
+            region.length = MIN(region.length, numLines - region.location);
+
+            if (frame.isIndexed)
+            {
+                [frame expandLines: region intoBuffer: lineBytes pitch: destPitch];
+            }
+            else
+            {
+                NSUInteger sourcePitch = frame.pitch;
+                const uint8_t *source = (const uint8_t *)frame.bytes + (region.location * sourcePitch);
+                uint8_t *dest = lineBytes + (region.location * destPitch);
+                NSUInteger line;
+                for (line = 0; line < region.length; line++)
+                    memcpy(dest + (line * destPitch), source + (line * sourcePitch), destPitch);
+            }
+        }
+    }
+    else
+    {
+        [self _scaleFrame: frame intoBuffer: lineBytes pitch: destPitch];
+    }
+    snapshot.time = frame.emulatedTime - _startTime;
+
+    _pendingFrames.fetch_add(1, std::memory_order_acq_rel);
+    dispatch_async(_queue, ^{
+        [self _encodeSnapshot: snapshot];
+        [self _recycleSnapshot: snapshot];
+        self->_pendingFrames.fetch_sub(1, std::memory_order_acq_rel);
+    });
+}
+
+//Copies the whole of the specified frame into the specified 32bpp buffer of the recording's size,
+//using nearest-neighbour scaling. Used for frames from a different video mode than the recording's.
+- (void) _scaleFrame: (BXVideoFrame *)frame intoBuffer: (uint8_t *)buffer pitch: (NSUInteger)pitch
+{
+    NSUInteger sourceWidth = (NSUInteger)frame.size.width, sourceHeight = (NSUInteger)frame.size.height;
+    NSUInteger destWidth = (NSUInteger)_frameSize.width, destHeight = (NSUInteger)_frameSize.height;
+    if (!sourceWidth || !sourceHeight) return;
+
+    _scaleLine.resize(sourceWidth);
+
+    NSUInteger y, x, lastSourceY = NSNotFound;
+    const uint32_t *sourceLine = NULL;
+    for (y = 0; y < destHeight; y++)
+    {
+        NSUInteger sourceY = (y * sourceHeight) / destHeight;
+        if (sourceY != lastSourceY)
+        {
+            if (frame.isIndexed)
+            {
+                //With a pitch of 0, every line is expanded into the start of the buffer.
+                [frame expandLines: NSMakeRange(sourceY, 1)
+                        intoBuffer: _scaleLine.data()
+                             pitch: 0];
+                sourceLine = _scaleLine.data();
+            }
+            else
+            {
+                sourceLine = (const uint32_t *)((const uint8_t *)frame.bytes + (sourceY * frame.pitch));
+            }
+            lastSourceY = sourceY;
+        }
+
+        uint32_t *destLine = (uint32_t *)(buffer + (y * pitch));
+        for (x = 0; x < destWidth; x++)
+            destLine[x] = sourceLine[(x * sourceWidth) / destWidth];
+    }
+}
+
+- (void) finishWithCompletionHandler: (void (^)(BOOL, NSError *))completionHandler
+{
+    if (_finished.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    dispatch_async(_queue, ^{
+        [self _finalizeFile];
+
+        BOOL succeeded = (self->_writeError == nil);
+        NSError *error = self->_writeError;
+        if (completionHandler)
+        {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionHandler(succeeded, error);
+            });
+        }
+    });
+}
+
+- (BXVideoRecorderSnapshot *) _dequeueSnapshot
+{
+    BXVideoRecorderSnapshot *snapshot = nil;
+    @synchronized(_snapshotPool)
+    {
+        snapshot = _snapshotPool.lastObject;
+        if (snapshot)
+            [_snapshotPool removeLastObject];
+    }
+
+    if (!snapshot)
+    {
+        snapshot = [[BXVideoRecorderSnapshot alloc] init];
+        snapshot.lineData = [NSMutableData dataWithLength: (NSUInteger)_frameSize.width * 4 * (NSUInteger)_frameSize.height];
+    }
+    return snapshot;
+}
+
+- (void) _recycleSnapshot: (BXVideoRecorderSnapshot *)snapshot
+{
+    @synchronized(_snapshotPool)
+    {
+        [_snapshotPool addObject: snapshot];
+    }
+}
+
+
+#pragma mark - Encoding and writing
+
+- (void) _encodeSnapshot: (BXVideoRecorderSnapshot *)snapshot
+{
+    if (!_file || _writeError || _outOfSpace) return;
+
+    if (!_encoder)
+    {
+        _encoder = [[BXZMBVEncoder alloc] initWithSize: _frameSize];
+        if (!_encoder) return;
+    }
+
+    //Bring the encoder's image up to date with the lines that changed.
+    NSUInteger pitch = _encoder.pitch;
+    NSUInteger numLines = (NSUInteger)_frameSize.height;
+    uint8_t *image = _encoder.currentImage;
+    const uint8_t *lineBytes = (const uint8_t *)snapshot.lineData.bytes;
+    NSUInteger r;
+    for (r = 0; r < snapshot->_numRegions; r++)
+    {
+        NSRange region = snapshot->_regions[r];
+        if (region.location >= numLines) continue;
+        NSUInteger length = MIN(region.length, numLines - region.location);
+        memcpy(image + (region.location * pitch), lineBytes + (region.location * pitch), length * pitch);
+    }
+
+    //Work out where this frame belongs in the stream. Frames that were never published
+    //because nothing changed are filled in by repeating the previous frame: in ZMBV,
+    //an empty chunk means no change.
+    NSInteger frameIndex = (NSInteger)llround(snapshot.time * self.frameRate);
+    if (frameIndex <= _lastFrameIndex)
+        frameIndex = _lastFrameIndex + 1;
+
+    while (_lastFrameIndex + 1 < frameIndex)
+    {
+        if (![self _writeChunk: BXAVIVideoChunkID bytes: NULL length: 0 flags: 0])
+            return;
+        _lastFrameIndex++;
+    }
+
+    _encodedFrame.length = 0;
+    if (![_encoder encodeFrameWithChangedLines: snapshot->_regions
+                                         count: snapshot->_numRegions
+                                      toBuffer: _encodedFrame])
+    {
+        return;
+    }
+
+    BOOL isKeyframe = (((const uint8_t *)_encodedFrame.bytes)[0] & 0x01) != 0;
+    if ([self _writeChunk: BXAVIVideoChunkID
+                    bytes: _encodedFrame.bytes
+                   length: _encodedFrame.length
+                    flags: isKeyframe ? BXAVIKeyframeFlag : 0])
+    {
+        _lastFrameIndex = frameIndex;
+        _recordedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+- (BOOL) _writeChunk: (uint32_t)chunkID bytes: (const void *)bytes length: (NSUInteger)length flags: (uint32_t)flags
+{
+    NSUInteger paddedLength = length + (length & 1);
+    if (_moviLength + 8 + paddedLength > BXAVIMaxMoviLength)
+    {
+        _outOfSpace = YES;
+        return NO;
+    }
+
+    uint32_t header[2] = { CFSwapInt32HostToLittle(chunkID), CFSwapInt32HostToLittle((uint32_t)length) };
+    BOOL wrote = fwrite(header, sizeof(header), 1, _file) == 1;
+    if (wrote && length)
+        wrote = fwrite(bytes, length, 1, _file) == 1;
+    if (wrote && paddedLength != length)
+        wrote = fputc(0, _file) != EOF;
+
+    if (!wrote)
+    {
+        _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+        return NO;
+    }
+
+    uint32_t entry[4] = {
+        CFSwapInt32HostToLittle(chunkID),
+        CFSwapInt32HostToLittle(flags),
+        CFSwapInt32HostToLittle((uint32_t)_moviLength),
+        CFSwapInt32HostToLittle((uint32_t)length),
+    };
+    [_index appendBytes: entry length: sizeof(entry)];
+
+    _moviLength += 8 + paddedLength;
+    if (chunkID == BXAVIVideoChunkID)
+    {
+        _videoChunkCount++;
+        _largestVideoChunk = MAX(_largestVideoChunk, length);
+    }
+    return YES;
+}
+
+- (void) _finalizeFile
+{
+    if (!_file) return;
+
+    if (!_writeError)
+    {
+        uint32_t indexHeader[2] = { CFSwapInt32HostToLittle(BXFourCC('i', 'd', 'x', '1')), CFSwapInt32HostToLittle((uint32_t)_index.length) };
+        NSData *header = [self _headerData];
+
+        BOOL wrote = fwrite(indexHeader, sizeof(indexHeader), 1, _file) == 1 &&
+                     (!_index.length || fwrite(_index.bytes, _index.length, 1, _file) == 1) &&
+                     fseeko(_file, 0, SEEK_SET) == 0 &&
+                     fwrite(header.bytes, header.length, 1, _file) == 1;
+
+        if (!wrote)
+            _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+    }
+
+    if (fclose(_file) != 0 && !_writeError)
+        _writeError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: @{ NSURLErrorKey: self.URL }];
+    _file = NULL;
+
+    _encoder = nil;
+    @synchronized(_snapshotPool)
+    {
+        [_snapshotPool removeAllObjects];
+    }
+}
+
+//Returns the RIFF, stream header and movi list headers that precede the recorded chunks,
+//describing the streams as they stand. The length of this data never changes.
+- (NSData *) _headerData
+{
+    NSMutableData *data = [NSMutableData dataWithCapacity: 256];
+
+    void (^put32)(uint32_t) = ^(uint32_t value) {
+        uint32_t swapped = CFSwapInt32HostToLittle(value);
+        [data appendBytes: &swapped length: 4];
+    };
+    void (^put16)(uint16_t) = ^(uint16_t value) {
+        uint16_t swapped = CFSwapInt16HostToLittle(value);
+        [data appendBytes: &swapped length: 2];
+    };
+
+    uint32_t width = (uint32_t)_frameSize.width;
+    uint32_t height = (uint32_t)_frameSize.height;
+    uint32_t indexLength = (uint32_t)_index.length;
+
+    //The headers up to the movi list header come to 8+4 (RIFF) + 8+4 (hdrl) + 8+56 (avih)
+    //+ 8+4+8+56+8+40 (video strl), followed by the movi list itself.
+    uint32_t hdrlLength = 4 + (8 + 56) + (8 + 4 + 8 + 56 + 8 + 40);
+    uint32_t riffLength = 4 + (8 + hdrlLength) + (8 + (uint32_t)_moviLength) + (8 + indexLength);
+
+    put32(BXFourCC('R', 'I', 'F', 'F')); put32(riffLength); put32(BXFourCC('A', 'V', 'I', ' '));
+    put32(BXFourCC('L', 'I', 'S', 'T')); put32(hdrlLength); put32(BXFourCC('h', 'd', 'r', 'l'));
+
+    //Main AVI header
+    put32(BXFourCC('a', 'v', 'i', 'h')); put32(56);
+    put32((uint32_t)(1000000.0 / self.frameRate));  //Microseconds per frame
+    put32(0);                                       //Max bytes per second
+    put32(0);                                       //Padding granularity
+    put32(BXAVIHasIndexFlag);
+    put32((uint32_t)_videoChunkCount);
+    put32(0);                                       //Initial frames
+    put32(1);                                       //Stream count
+    put32((uint32_t)_largestVideoChunk);
+    put32(width); put32(height);
+    put32(0); put32(0); put32(0); put32(0);         //Reserved
+
+    //Video stream
+    put32(BXFourCC('L', 'I', 'S', 'T')); put32(4 + 8 + 56 + 8 + 40); put32(BXFourCC('s', 't', 'r', 'l'));
+    put32(BXFourCC('s', 't', 'r', 'h')); put32(56);
+    put32(BXFourCC('v', 'i', 'd', 's'));
+    put32(BXZMBVFourCC);
+    put32(0);                                       //Flags
+    put32(0);                                       //Priority and language
+    put32(0);                                       //Initial frames
+    put32(BXAVIFrameRateScale);
+    put32((uint32_t)llround(self.frameRate * BXAVIFrameRateScale));
+    put32(0);                                       //Start
+    put32((uint32_t)_videoChunkCount);
+    put32((uint32_t)_largestVideoChunk);
+    put32(0xFFFFFFFF);                              //Quality: default
+    put32(0);                                       //Sample size: variable
+    put16(0); put16(0); put16((uint16_t)width); put16((uint16_t)height);
+
+    put32(BXFourCC('s', 't', 'r', 'f')); put32(40);
+    put32(40);                                      //BITMAPINFOHEADER size
+    put32(width); put32(height);
+    put16(1);                                       //Planes
+    put16(32);                                      //Bit count
+    put32(BXZMBVFourCC);
+    put32(width * height * 4);
+    put32(0); put32(0); put32(0); put32(0);
+
+    put32(BXFourCC('L', 'I', 'S', 'T')); put32((uint32_t)_moviLength); put32(BXFourCC('m', 'o', 'v', 'i'));
+
+    return data;
+}
+
+@end
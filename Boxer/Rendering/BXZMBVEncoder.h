@@ -0,0 +1,47 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The FourCC for ZMBV video, as used in AVI stream headers.
+extern const uint32_t BXZMBVFourCC;
+
+/// @brief BXZMBVEncoder encodes 32bpp frames into a lossless Zip Motion Blocks Video stream,
+/// the same format that DOSBox records its own video captures in.
+///
+/// @discussion Callers write each new frame's changed lines into @c currentImage and then encode
+/// the frame, telling the encoder which lines they changed. Delta frames only examine the
+/// blocks that overlap those lines: all other blocks are emitted as unchanged without being read.
+/// The encoder is not thread-safe, and is intended to be driven from a single background queue.
+@interface BXZMBVEncoder : NSObject
+
+/// The pixel dimensions of the video.
+@property (readonly) NSSize size;
+
+/// The image that will be encoded as the next frame, in 32bpp BGRA with a pitch of @c pitch.
+@property (readonly) uint8_t *currentImage;
+@property (readonly) NSUInteger pitch;
+
+/// Delta frames will be replaced with a keyframe after this many frames. Defaults to 300.
+@property (assign) NSUInteger keyframeInterval;
+
+- (nullable instancetype) initWithSize: (NSSize)size;
+
+/// Encodes @c currentImage as the next frame of the stream, and appends the encoded frame to @c output.
+/// @param regions  The ranges of lines in @c currentImage that have changed since the previous frame was encoded.
+/// @param count    The number of ranges in @c regions.
+/// @return YES if the frame was encoded, or NO if compression failed.
+- (BOOL) encodeFrameWithChangedLines: (const NSRange *)regions
+                               count: (NSUInteger)count
+                            toBuffer: (NSMutableData *)output;
+
+@end
+
+NS_ASSUME_NONNULL_END
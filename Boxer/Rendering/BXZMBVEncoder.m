@@ -0,0 +1,259 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXZMBVEncoder.h"
+#import <zlib.h>
+
+
+const uint32_t BXZMBVFourCC = 'Z' | ('M' << 8) | ('B' << 16) | ('V' << 24);
+
+//Frame header flags and keyframe header values, as defined by the ZMBV format.
+#define BXZMBVKeyframeFlag 0x01
+#define BXZMBVVersionHigh 0
+#define BXZMBVVersionLow 1
+#define BXZMBVCompressionZlib 1
+#define BXZMBVFormat32bpp 8
+
+#define BXZMBVBlockWidth 16
+#define BXZMBVBlockHeight 16
+#define BXZMBVBytesPerPixel 4
+
+
+@implementation BXZMBVEncoder
+{
+    uint8_t *_previousImage;
+    NSUInteger _width;
+    NSUInteger _height;
+    NSUInteger _blocksWide;
+    NSUInteger _blocksHigh;
+
+    //Which rows of blocks overlap a changed line in the frame being encoded.
+    uint8_t *_changedBlockRows;
+
+    //The uncompressed frame payload, reused between frames.
+    uint8_t *_work;
+    NSUInteger _workCapacity;
+
+    z_stream _zstream;
+    BOOL _zstreamInitialized;
+
+    NSUInteger _framesSinceKeyframe;
+    BOOL _hasEncodedFrame;
+}
+
+@synthesize size = _size;
+@synthesize currentImage = _currentImage;
+@synthesize pitch = _pitch;
+@synthesize keyframeInterval = _keyframeInterval;
+
+- (instancetype) initWithSize: (NSSize)size
+{
+    if ((self = [super init]))
+    {
+        _size = size;
+        _width = (NSUInteger)size.width;
+        _height = (NSUInteger)size.height;
+        if (!_width || !_height)
+            return nil;
+
+        _pitch = _width * BXZMBVBytesPerPixel;
+        _blocksWide = (_width + BXZMBVBlockWidth - 1) / BXZMBVBlockWidth;
+        _blocksHigh = (_height + BXZMBVBlockHeight - 1) / BXZMBVBlockHeight;
+        _keyframeInterval = 300;
+
+        _currentImage = calloc(_height, _pitch);
+        _previousImage = calloc(_height, _pitch);
+        _changedBlockRows = calloc(_blocksHigh, sizeof(uint8_t));
+
+        //Worst case for a delta frame is a motion vector for every block, followed by every pixel.
+        NSUInteger vectorBytes = ((_blocksWide * _blocksHigh * 2) + 3) & ~3U;
+        _workCapacity = MAX(_pitch * _height, vectorBytes + (_pitch * _height));
+        _work = malloc(_workCapacity);
+
+        if (deflateInit(&_zstream, 4) != Z_OK)
+            return nil;
+        _zstreamInitialized = YES;
+
+        if (!_currentImage || !_previousImage || !_changedBlockRows || !_work)
+            return nil;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_zstreamInitialized)
+        deflateEnd(&_zstream);
+
+    free(_currentImage);
+    free(_previousImage);
+    free(_changedBlockRows);
+    free(_work);
+}
+
+
+#pragma mark - Encoding
+
+- (BOOL) encodeFrameWithChangedLines: (const NSRange *)regions
+                               count: (NSUInteger)count
+                            toBuffer: (NSMutableData *)output
+{
+    BOOL isKeyframe = !_hasEncodedFrame || (_framesSinceKeyframe >= self.keyframeInterval);
+
+    //Frame header: a flag byte, followed by format details if this is a keyframe.
+    uint8_t header[6];
+    NSUInteger headerLength = 1;
+    header[0] = isKeyframe ? BXZMBVKeyframeFlag : 0;
+    [output appendBytes: header length: headerLength];
+
+    if (isKeyframe)
+    {
+        header[0] = BXZMBVVersionHigh;
+        header[1] = BXZMBVVersionLow;
+        header[2] = BXZMBVCompressionZlib;
+        header[3] = BXZMBVFormat32bpp;
+        header[4] = BXZMBVBlockWidth;
+        header[5] = BXZMBVBlockHeight;
+        [output appendBytes: header length: 6];
+
+        //Each keyframe starts a fresh compression stream, so that playback can seek to it.
+        deflateReset(&_zstream);
+    }
+
+    NSUInteger workLength;
+    if (isKeyframe)
+    {
+        memcpy(_work, _currentImage, _pitch * _height);
+        workLength = _pitch * _height;
+    }
+    else
+    {
+        workLength = [self _prepareDeltaWithChangedLines: regions count: count];
+    }
+
+    if (![self _compressWorkOfLength: workLength toBuffer: output])
+        return NO;
+
+    //The current image now becomes the basis for the next delta.
+    if (isKeyframe)
+    {
+        memcpy(_previousImage, _currentImage, _pitch * _height);
+        _framesSinceKeyframe = 0;
+    }
+    else
+    {
+        NSUInteger r;
+        for (r = 0; r < count; r++)
+        {
+            NSUInteger start = MIN(regions[r].location, _height);
+            NSUInteger end = MIN(NSMaxRange(regions[r]), _height);
+            if (end > start)
+                memcpy(_previousImage + (start * _pitch), _currentImage + (start * _pitch), (end - start) * _pitch);
+        }
+    }
+
+    _hasEncodedFrame = YES;
+    _framesSinceKeyframe++;
+    return YES;
+}
+
+//Fills the work buffer with a motion vector for every block, followed by the XOR of every
+//changed block against the previous frame. Boxer never moves blocks, so every vector is 0,0
+//and the low bit of each vector's first byte just marks whether XOR data follows.
+//Returns the length of the prepared payload.
+- (NSUInteger) _prepareDeltaWithChangedLines: (const NSRange *)regions count: (NSUInteger)count
+{
+    NSUInteger numBlocks = _blocksWide * _blocksHigh;
+    int8_t *vectors = (int8_t *)_work;
+    memset(vectors, 0, numBlocks * 2);
+
+    NSUInteger workLength = ((numBlocks * 2) + 3) & ~3U;
+    memset(_work + (numBlocks * 2), 0, workLength - (numBlocks * 2));
+
+    memset(_changedBlockRows, 0, _blocksHigh);
+    NSUInteger r;
+    for (r = 0; r < count; r++)
+    {
+        NSUInteger start = MIN(regions[r].location, _height);
+        NSUInteger end = MIN(NSMaxRange(regions[r]), _height);
+        if (end <= start) continue;
+
+        memset(_changedBlockRows + (start / BXZMBVBlockHeight), 1,
+               ((end - 1) / BXZMBVBlockHeight) - (start / BXZMBVBlockHeight) + 1);
+    }
+
+    NSUInteger blockRow, blockCol;
+    for (blockRow = 0; blockRow < _blocksHigh; blockRow++)
+    {
+        if (!_changedBlockRows[blockRow]) continue;
+
+        NSUInteger y = blockRow * BXZMBVBlockHeight;
+        NSUInteger blockHeight = MIN((NSUInteger)BXZMBVBlockHeight, _height - y);
+
+        for (blockCol = 0; blockCol < _blocksWide; blockCol++)
+        {
+            NSUInteger x = blockCol * BXZMBVBlockWidth;
+            NSUInteger blockWidth = MIN((NSUInteger)BXZMBVBlockWidth, _width - x);
+            NSUInteger rowBytes = blockWidth * BXZMBVBytesPerPixel;
+            NSUInteger offset = (y * _pitch) + (x * BXZMBVBytesPerPixel);
+
+            BOOL changed = NO;
+            NSUInteger line;
+            for (line = 0; line < blockHeight && !changed; line++)
+            {
+                NSUInteger lineOffset = offset + (line * _pitch);
+                changed = memcmp(_currentImage + lineOffset, _previousImage + lineOffset, rowBytes) != 0;
+            }
+            if (!changed) continue;
+
+            vectors[((blockRow * _blocksWide) + blockCol) * 2] |= 1;
+
+            for (line = 0; line < blockHeight; line++)
+            {
+                NSUInteger lineOffset = offset + (line * _pitch);
+                const uint32_t *current = (const uint32_t *)(_currentImage + lineOffset);
+                const uint32_t *previous = (const uint32_t *)(_previousImage + lineOffset);
+                uint32_t *xorOutput = (uint32_t *)(_work + workLength);
+
+                NSUInteger i;
+                for (i = 0; i < blockWidth; i++)
+                    xorOutput[i] = current[i] ^ previous[i];
+
+                workLength += rowBytes;
+            }
+        }
+    }
+
+    return workLength;
+}
+
+- (BOOL) _compressWorkOfLength: (NSUInteger)length toBuffer: (NSMutableData *)output
+{
+    NSUInteger startLength = output.length;
+    NSUInteger bound = deflateBound(&_zstream, (uLong)length) + 16;
+    output.length = startLength + bound;
+
+    _zstream.next_in = _work;
+    _zstream.avail_in = (uInt)length;
+    _zstream.next_out = (Bytef *)output.mutableBytes + startLength;
+    _zstream.avail_out = (uInt)bound;
+
+    //Sync-flushing ends each frame on a byte boundary without resetting the compression
+    //dictionary, which is what lets unchanged delta frames compress down to almost nothing.
+    int result = deflate(&_zstream, Z_SYNC_FLUSH);
+    if (result != Z_OK && result != Z_BUF_ERROR)
+    {
+        output.length = startLength;
+        return NO;
+    }
+
+    output.length = startLength + (bound - _zstream.avail_out);
+    return YES;
+}
+
+@end
@@ -6,8 +6,13 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#import "BXMT32RenderTool.h"
 
 int main(int argc, char *argv[])
 {
+    //Run headlessly instead if we were asked to render MT-32 output offline.
+    if (BXMT32RenderToolWasRequested(argc, (const char **) argv))
+        return BXMT32RenderToolMain(argc, (const char **) argv);
+    
     return NSApplicationMain(argc,  (const char **) argv);
 }
@@ -0,0 +1,369 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXAudioConversion.h"
+
+
+//Long enough to cover several vector blocks plus every possible leftover count.
+#define BXConversionTestMaxLength 67
+
+//How many frames each benchmark converts per pass: about a second and a half of 44.1kHz audio.
+#define BXConversionBenchmarkFrames 65536
+
+
+@interface BXAudioConversionTests : XCTestCase
+@end
+
+
+@implementation BXAudioConversionTests
+
+//The plain per-sample conversion that the vectorized path must match exactly.
+static int32_t BXReferenceMixerSample(float sample)
+{
+    if (isnan(sample)) return 0;
+    if (sample > 1.0f) sample = 1.0f;
+    else if (sample < -1.0f) sample = -1.0f;
+    return (int32_t)(sample * 32767.0f);
+}
+
+//Fills the buffer with a mix of in-range samples, out-of-range samples that must be clipped,
+//and the exact edges of the range.
+static void BXFillTestSamples(float *samples, NSUInteger count, unsigned int seed)
+{
+    static const float edges[] = {
+        1.0f, -1.0f, 0.0f, -0.0f, 1.0001f, -1.0001f, 2.0f, -2.0f, 1e9f, -1e9f, 0.99999f, -0.99999f,
+        NAN, -NAN, INFINITY, -INFINITY,
+    };
+    const NSUInteger numEdges = sizeof(edges) / sizeof(edges[0]);
+
+    srandom(seed);
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+    {
+        if (i % 3 == 0)
+            samples[i] = edges[(i / 3) % numEdges];
+        else
+            samples[i] = ((float)random() / (float)RAND_MAX) * 4.0f - 2.0f;
+    }
+}
+
+- (void) testVectorizedConversionMatchesScalarForEveryLength
+{
+    //One extra sample at the front so that odd offsets exercise unaligned loads and stores.
+    float source[BXConversionTestMaxLength + 1];
+    int32_t destination[BXConversionTestMaxLength + 1];
+
+    NSUInteger length, offset;
+    for (offset = 0; offset <= 1; offset++)
+    {
+        for (length = 0; length <= BXConversionTestMaxLength; length++)
+        {
+            BXFillTestSamples(source + offset, length, (unsigned int)(length * 2 + offset));
+            memset(destination, 0x55, sizeof(destination));
+
+            BXAudioConvertFloatToMixerSamples(source + offset, destination + offset, length);
+
+            NSUInteger i;
+            for (i = 0; i < length; i++)
+            {
+                int32_t expected = BXReferenceMixerSample(source[offset + i]);
+                XCTAssertEqual(destination[offset + i], expected,
+                               @"Sample %lu of %lu (offset %lu, input %f) differs from the scalar conversion.",
+                               (unsigned long)i, (unsigned long)length, (unsigned long)offset, source[offset + i]);
+            }
+
+            //Nothing outside the requested range should have been touched.
+            if (offset)
+                XCTAssertEqual(destination[0], (int32_t)0x55555555);
+            if (offset + length <= BXConversionTestMaxLength)
+                XCTAssertEqual(destination[offset + length], (int32_t)0x55555555);
+        }
+    }
+}
+
+- (void) testClippedSamplesLandOnTheMixerLimits
+{
+    float source[] = { 5.0f, -5.0f, 1.0f, -1.0f, INFINITY, -INFINITY, 1.5f, -1.5f, 3.0f };
+    NSUInteger count = sizeof(source) / sizeof(source[0]);
+    int32_t destination[sizeof(source) / sizeof(source[0])];
+
+    BXAudioConvertFloatToMixerSamples(source, destination, count);
+
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+        XCTAssertEqual(destination[i], (source[i] > 0) ? 32767 : -32767, @"Sample %lu was not clipped.", (unsigned long)i);
+}
+
+- (void) testNaNsConvertToSilence
+{
+    //Enough NaNs to fill a whole vector block, plus a leftover handled by the scalar path.
+    float source[9];
+    int32_t destination[9];
+    NSUInteger i;
+    for (i = 0; i < 9; i++)
+        source[i] = (i % 2) ? NAN : -NAN;
+
+    BXAudioConvertFloatToMixerSamples(source, destination, 9);
+    for (i = 0; i < 9; i++)
+        XCTAssertEqual(destination[i], 0, @"NaN at sample %lu was not converted to silence.", (unsigned long)i);
+}
+
+- (void) testInPlaceConversionMatchesScalar
+{
+    NSUInteger length;
+    for (length = 1; length <= BXConversionTestMaxLength; length += 2)
+    {
+        float samples[BXConversionTestMaxLength];
+        float original[BXConversionTestMaxLength];
+        BXFillTestSamples(original, length, (unsigned int)length);
+        memcpy(samples, original, length * sizeof(float));
+
+        BXAudioConvertFloatToMixerSamples(samples, (int32_t *)samples, length);
+
+        const int32_t *converted = (const int32_t *)samples;
+        NSUInteger i;
+        for (i = 0; i < length; i++)
+            XCTAssertEqual(converted[i], BXReferenceMixerSample(original[i]));
+    }
+}
+
+- (void) testFloatToStereo16AgreesWithMixerConversion
+{
+    float source[BXConversionTestMaxLength];
+    int32_t mixerSamples[BXConversionTestMaxLength];
+    int16_t stereo[BXConversionTestMaxLength * 2];
+
+    BXFillTestSamples(source, BXConversionTestMaxLength, 1);
+    BXAudioConvertFloatToMixerSamples(source, mixerSamples, BXConversionTestMaxLength);
+    BXAudioConvertToStereo16(source, BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatMono, stereo, BXConversionTestMaxLength);
+
+    NSUInteger i;
+    for (i = 0; i < BXConversionTestMaxLength; i++)
+    {
+        XCTAssertEqual((int32_t)stereo[i * 2], mixerSamples[i]);
+        XCTAssertEqual((int32_t)stereo[i * 2 + 1], mixerSamples[i]);
+    }
+}
+
+
+
+#pragma mark -
+#pragma mark Per-format conversion to 16-bit stereo
+
+static const BXAudioFormat BXTestFormats[] = {
+    BXAudioFormat8Bit   | BXAudioFormatUnsigned | BXAudioFormatMono,
+    BXAudioFormat8Bit   | BXAudioFormatUnsigned | BXAudioFormatStereo,
+    BXAudioFormat8Bit   | BXAudioFormatSigned   | BXAudioFormatMono,
+    BXAudioFormat8Bit   | BXAudioFormatSigned   | BXAudioFormatStereo,
+    BXAudioFormat16Bit  | BXAudioFormatUnsigned | BXAudioFormatMono,
+    BXAudioFormat16Bit  | BXAudioFormatUnsigned | BXAudioFormatStereo,
+    BXAudioFormat16Bit  | BXAudioFormatSigned   | BXAudioFormatMono,
+    BXAudioFormat16Bit  | BXAudioFormatSigned   | BXAudioFormatStereo,
+    BXAudioFormat32Bit  | BXAudioFormatSigned   | BXAudioFormatMono,
+    BXAudioFormat32Bit  | BXAudioFormatSigned   | BXAudioFormatStereo,
+    BXAudioFormat32Bit  | BXAudioFormatFloat    | BXAudioFormatMono,
+    BXAudioFormat32Bit  | BXAudioFormatFloat    | BXAudioFormatStereo,
+};
+
+static NSString *BXDescriptionOfFormat(BXAudioFormat format)
+{
+    NSString *type;
+    if (format & BXAudioFormatFloat)                type = @"float";
+    else if (format & BXAudioFormatUnsigned)        type = @"unsigned";
+    else                                            type = @"signed";
+
+    return [NSString stringWithFormat: @"%lu-bit %@ %@",
+            (unsigned long)((format & BXAudioFormatSizeMask) * 8),
+            type,
+            (format & BXAudioFormatStereo) ? @"stereo" : @"mono"];
+}
+
+static NSUInteger BXBytesPerSample(BXAudioFormat format)
+{
+    return format & BXAudioFormatSizeMask;
+}
+
+//The conversions DOSBox's mixer applies to each format as it takes samples, written out
+//arithmetically rather than with the bit tricks the conversion layer uses.
+static int16_t BXReferenceStereo16Sample(const void *buffer, NSUInteger index, BXAudioFormat format)
+{
+    BOOL isUnsigned = (format & BXAudioFormatUnsigned) != 0;
+    switch (format & BXAudioFormatSizeMask)
+    {
+        case BXAudioFormat8Bit:
+            if (isUnsigned) return (int16_t)(((int32_t)((const uint8_t *)buffer)[index] - 128) * 256);
+            else            return (int16_t)(((const int8_t *)buffer)[index] * 256);
+
+        case BXAudioFormat16Bit:
+            if (isUnsigned) return (int16_t)((int32_t)((const uint16_t *)buffer)[index] - 32768);
+            else            return ((const int16_t *)buffer)[index];
+
+        case BXAudioFormat32Bit:
+            if (format & BXAudioFormatFloat)
+                return (int16_t)BXReferenceMixerSample(((const float *)buffer)[index]);
+            else
+                return (int16_t)MAX(INT16_MIN, MIN(INT16_MAX, ((const int32_t *)buffer)[index]));
+
+        default:
+            return 0;
+    }
+}
+
+//Fills the buffer with random samples in the specified format, salted with the extremes of its range.
+static void BXFillTestBuffer(void *buffer, NSUInteger numSamples, BXAudioFormat format, unsigned int seed)
+{
+    srandom(seed);
+    NSUInteger i;
+    switch (format & BXAudioFormatSizeMask)
+    {
+        case BXAudioFormat8Bit:
+        {
+            static const uint8_t edges[] = { 0x00, 0x7F, 0x80, 0xFF, 0x01, 0x81 };
+            uint8_t *samples = buffer;
+            for (i = 0; i < numSamples; i++)
+                samples[i] = (i % 3 == 0) ? edges[(i / 3) % 6] : (uint8_t)random();
+            break;
+        }
+        case BXAudioFormat16Bit:
+        {
+            static const uint16_t edges[] = { 0x0000, 0x7FFF, 0x8000, 0xFFFF, 0x0001, 0x8001 };
+            uint16_t *samples = buffer;
+            for (i = 0; i < numSamples; i++)
+                samples[i] = (i % 3 == 0) ? edges[(i / 3) % 6] : (uint16_t)random();
+            break;
+        }
+        case BXAudioFormat32Bit:
+            if (format & BXAudioFormatFloat)
+            {
+                BXFillTestSamples(buffer, numSamples, seed);
+            }
+            else
+            {
+                static const int32_t edges[] = { INT32_MIN, INT32_MAX, 32767, 32768, -32768, -32769, 0, -1 };
+                int32_t *samples = buffer;
+                for (i = 0; i < numSamples; i++)
+                    samples[i] = (i % 3 == 0) ? edges[(i / 3) % 8] : (int32_t)(random() % 131072) - 65536;
+            }
+            break;
+    }
+}
+
+- (void) testStereo16ConversionMatchesMixerForEveryFormat
+{
+    //Room for the longest stereo 32-bit buffer, aligned for any of the sample types.
+    uint32_t source[BXConversionTestMaxLength * 2];
+    int16_t destination[BXConversionTestMaxLength * 2 + 1];
+
+    NSUInteger f, numFormats = sizeof(BXTestFormats) / sizeof(BXTestFormats[0]);
+    for (f = 0; f < numFormats; f++)
+    {
+        BXAudioFormat format = BXTestFormats[f];
+        BOOL isStereo = (format & BXAudioFormatStereo) != 0;
+        NSUInteger numFrames;
+        for (numFrames = 0; numFrames <= BXConversionTestMaxLength; numFrames++)
+        {
+            NSUInteger numSamples = isStereo ? numFrames * 2 : numFrames;
+            BXFillTestBuffer(source, numSamples, format, (unsigned int)(f * 100 + numFrames));
+            memset(destination, 0x55, sizeof(destination));
+
+            BXAudioConvertToStereo16(source, format, destination, numFrames);
+
+            NSUInteger i;
+            for (i = 0; i < numFrames; i++)
+            {
+                int16_t left    = BXReferenceStereo16Sample(source, isStereo ? i * 2 : i, format);
+                int16_t right   = BXReferenceStereo16Sample(source, isStereo ? i * 2 + 1 : i, format);
+                XCTAssertEqual(destination[i * 2], left, @"Left sample of frame %lu of %lu differs for %@.",
+                               (unsigned long)i, (unsigned long)numFrames, BXDescriptionOfFormat(format));
+                XCTAssertEqual(destination[i * 2 + 1], right, @"Right sample of frame %lu of %lu differs for %@.",
+                               (unsigned long)i, (unsigned long)numFrames, BXDescriptionOfFormat(format));
+            }
+
+            //Nothing past the converted frames should have been touched.
+            XCTAssertEqual(destination[numFrames * 2], (int16_t)0x5555, @"Wrote past the end for %@.", BXDescriptionOfFormat(format));
+        }
+    }
+}
+
+- (void) testStereo16ConversionClipsToTheRangeEdges
+{
+    float floats[] = { 1.0f, -1.0f, 2.0f, -2.0f, INFINITY, -INFINITY, NAN };
+    int16_t expectedFloats[] = { 32767, -32767, 32767, -32767, 32767, -32767, 0 };
+    int32_t ints[] = { INT32_MAX, INT32_MIN, 32768, -32769, 32767, -32768, 0 };
+    int16_t expectedInts[] = { 32767, -32768, 32767, -32768, 32767, -32768, 0 };
+    int16_t destination[7 * 2];
+
+    BXAudioConvertToStereo16(floats, BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatMono, destination, 7);
+    NSUInteger i;
+    for (i = 0; i < 7; i++)
+    {
+        XCTAssertEqual(destination[i * 2], expectedFloats[i], @"Float sample %lu was not clipped.", (unsigned long)i);
+        XCTAssertEqual(destination[i * 2 + 1], expectedFloats[i]);
+    }
+
+    BXAudioConvertToStereo16(ints, BXAudioFormat32Bit | BXAudioFormatSigned | BXAudioFormatMono, destination, 7);
+    for (i = 0; i < 7; i++)
+    {
+        XCTAssertEqual(destination[i * 2], expectedInts[i], @"32-bit sample %lu was not clipped.", (unsigned long)i);
+        XCTAssertEqual(destination[i * 2 + 1], expectedInts[i]);
+    }
+}
+
+
+#pragma mark -
+#pragma mark Benchmarks
+
+- (void) _measureStereo16ConversionOfFormat: (BXAudioFormat)format
+{
+    NSUInteger numSamples = BXConversionBenchmarkFrames * 2;
+    NSMutableData *source = [NSMutableData dataWithLength: numSamples * BXBytesPerSample(format)];
+    NSMutableData *destination = [NSMutableData dataWithLength: numSamples * sizeof(int16_t)];
+    BXFillTestBuffer(source.mutableBytes, numSamples, format, 1);
+
+    [self measureBlock: ^{
+        NSUInteger pass;
+        for (pass = 0; pass < 16; pass++)
+            BXAudioConvertToStereo16(source.bytes, format, destination.mutableBytes, BXConversionBenchmarkFrames);
+    }];
+}
+
+#define BXConversionBenchmark(name, flags) \
+- (void) testStereo16ConversionPerformance##name \
+{ \
+    [self _measureStereo16ConversionOfFormat: flags]; \
+}
+
+BXConversionBenchmark(Unsigned8Mono,    BXAudioFormat8Bit   | BXAudioFormatUnsigned | BXAudioFormatMono)
+BXConversionBenchmark(Unsigned8Stereo,  BXAudioFormat8Bit   | BXAudioFormatUnsigned | BXAudioFormatStereo)
+BXConversionBenchmark(Signed8Mono,      BXAudioFormat8Bit   | BXAudioFormatSigned   | BXAudioFormatMono)
+BXConversionBenchmark(Signed8Stereo,    BXAudioFormat8Bit   | BXAudioFormatSigned   | BXAudioFormatStereo)
+BXConversionBenchmark(Unsigned16Mono,   BXAudioFormat16Bit  | BXAudioFormatUnsigned | BXAudioFormatMono)
+BXConversionBenchmark(Unsigned16Stereo, BXAudioFormat16Bit  | BXAudioFormatUnsigned | BXAudioFormatStereo)
+BXConversionBenchmark(Signed16Mono,     BXAudioFormat16Bit  | BXAudioFormatSigned   | BXAudioFormatMono)
+BXConversionBenchmark(Signed16Stereo,   BXAudioFormat16Bit  | BXAudioFormatSigned   | BXAudioFormatStereo)
+BXConversionBenchmark(Signed32Mono,     BXAudioFormat32Bit  | BXAudioFormatSigned   | BXAudioFormatMono)
+BXConversionBenchmark(Signed32Stereo,   BXAudioFormat32Bit  | BXAudioFormatSigned   | BXAudioFormatStereo)
+BXConversionBenchmark(FloatMono,        BXAudioFormat32Bit  | BXAudioFormatFloat    | BXAudioFormatMono)
+BXConversionBenchmark(FloatStereo,      BXAudioFormat32Bit  | BXAudioFormatFloat    | BXAudioFormatStereo)
+
+- (void) testFloatToMixerConversionPerformance
+{
+    NSUInteger numSamples = BXConversionBenchmarkFrames * 2;
+    NSMutableData *source = [NSMutableData dataWithLength: numSamples * sizeof(float)];
+    NSMutableData *destination = [NSMutableData dataWithLength: numSamples * sizeof(int32_t)];
+    BXFillTestSamples(source.mutableBytes, numSamples, 1);
+
+    [self measureBlock: ^{
+        NSUInteger pass;
+        for (pass = 0; pass < 16; pass++)
+            BXAudioConvertFloatToMixerSamples(source.bytes, destination.mutableBytes, numSamples);
+    }];
+}
+
+@end
@@ -0,0 +1,181 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXAudioResampler.h"
+
+
+#define BXResamplerTestInputRate 32000
+#define BXResamplerTestOutputRate 44100
+#define BXResamplerTestBlockFrames 512
+
+//A 1kHz tone at half of full scale. At 44100Hz the tone repeats exactly every 441 frames,
+//so the measurement window is a whole number of cycles and its sine, cosine and DC
+//components can be separated by simple projection.
+#define BXResamplerTestToneFrequency 1000.0
+#define BXResamplerTestToneAmplitude 0.5
+#define BXResamplerTestSettleFrames 441
+#define BXResamplerTestMeasuredFrames 44100
+
+
+@interface BXAudioResamplerTests : XCTestCase
+@end
+
+
+@implementation BXAudioResamplerTests
+
+//Resamples the test tone in mixer-sized blocks, and returns the left channel of the output.
+//Fails the test if the channels ever differ, since the input is mono.
+- (NSData *) _resampledToneWithQuality: (BXAudioResamplerQuality)quality frames: (NSUInteger)totalFrames
+{
+    BXAudioResampler *resampler = [[BXAudioResampler alloc] initWithInputRate: BXResamplerTestInputRate
+                                                                   outputRate: BXResamplerTestOutputRate
+                                                                      quality: quality
+                                                              maxOutputFrames: BXResamplerTestBlockFrames];
+
+    NSMutableData *result = [NSMutableData dataWithLength: totalFrames * sizeof(double)];
+    double *samples = result.mutableBytes;
+
+    int32_t output[BXResamplerTestBlockFrames * 2];
+    NSUInteger inputFramesSoFar = 0, outputFramesSoFar = 0;
+    BOOL channelsMatch = YES;
+    while (outputFramesSoFar < totalFrames)
+    {
+        NSUInteger outputFrames = MIN((NSUInteger)BXResamplerTestBlockFrames, totalFrames - outputFramesSoFar);
+        NSUInteger inputFrames = [resampler inputFramesNeededForOutputFrames: outputFrames];
+
+        float *input = resampler.inputBuffer;
+        NSUInteger i;
+        for (i = 0; i < inputFrames; i++)
+        {
+            double t = (double)(inputFramesSoFar + i) / BXResamplerTestInputRate;
+            input[i] = (float)(BXResamplerTestToneAmplitude * sin(2.0 * M_PI * BXResamplerTestToneFrequency * t));
+        }
+        inputFramesSoFar += inputFrames;
+
+        [resampler resampleInputFrames: inputFrames
+                                format: BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatMono
+                        toMixerSamples: output
+                                frames: outputFrames];
+
+        for (i = 0; i < outputFrames; i++)
+        {
+            samples[outputFramesSoFar + i] = output[i * 2];
+            if (output[i * 2] != output[i * 2 + 1])
+                channelsMatch = NO;
+        }
+        outputFramesSoFar += outputFrames;
+    }
+
+    XCTAssertTrue(channelsMatch, @"Mono input should come out identically on both channels.");
+    return result;
+}
+
+//Measures the signal-to-noise-and-distortion ratio of the resampled tone in dB, along with the
+//gain of the tone relative to its input level.
+- (double) _SNRForQuality: (BXAudioResamplerQuality)quality gain: (double *)gain
+{
+    NSUInteger totalFrames = BXResamplerTestSettleFrames + BXResamplerTestMeasuredFrames;
+    NSData *resampled = [self _resampledToneWithQuality: quality frames: totalFrames];
+    const double *samples = (const double *)resampled.bytes + BXResamplerTestSettleFrames;
+
+    double sineSum = 0, cosineSum = 0, dcSum = 0;
+    NSUInteger i, n = BXResamplerTestMeasuredFrames;
+    for (i = 0; i < n; i++)
+    {
+        double angle = 2.0 * M_PI * BXResamplerTestToneFrequency * (double)(i + BXResamplerTestSettleFrames) / BXResamplerTestOutputRate;
+        sineSum += samples[i] * sin(angle);
+        cosineSum += samples[i] * cos(angle);
+        dcSum += samples[i];
+    }
+
+    double a = 2.0 * sineSum / n, b = 2.0 * cosineSum / n, dc = dcSum / n;
+    double signalPower = 0, noisePower = 0;
+    for (i = 0; i < n; i++)
+    {
+        double angle = 2.0 * M_PI * BXResamplerTestToneFrequency * (double)(i + BXResamplerTestSettleFrames) / BXResamplerTestOutputRate;
+        double fit = a * sin(angle) + b * cos(angle) + dc;
+        double residual = samples[i] - fit;
+        signalPower += fit * fit;
+        noisePower += residual * residual;
+    }
+
+    if (gain)
+        *gain = hypot(a, b) / (BXResamplerTestToneAmplitude * 32767.0);
+
+    return 10.0 * log10(signalPower / MAX(noisePower, DBL_MIN));
+}
+
+- (void) testToneSNRAtEachQuality
+{
+    //Minimum acceptable SNRs, with some headroom below what each tier actually achieves
+    //(about 58, 74, 90 and 92dB; the Best tier is limited by rounding to integer mixer samples).
+    static const double minimumSNRs[] = { 50.0, 65.0, 80.0, 85.0 };
+
+    BXAudioResamplerQuality quality;
+    for (quality = BXAudioResamplerQualityLow; quality <= BXAudioResamplerQualityBest; quality++)
+    {
+        double gain = 0;
+        double snr = [self _SNRForQuality: quality gain: &gain];
+        NSLog(@"Resampler quality %ld: %.1fdB SNR, gain %.5f", (long)quality, snr, gain);
+
+        XCTAssertGreaterThanOrEqual(snr, minimumSNRs[quality], @"SNR too low for quality %ld.", (long)quality);
+        XCTAssertEqualWithAccuracy(gain, 1.0, 0.005, @"Passband gain off for quality %ld.", (long)quality);
+    }
+}
+
+- (void) testResetReturnsToSilence
+{
+    BXAudioResampler *resampler = [[BXAudioResampler alloc] initWithInputRate: BXResamplerTestInputRate
+                                                                   outputRate: BXResamplerTestOutputRate
+                                                                      quality: BXAudioResamplerQualityHigh
+                                                              maxOutputFrames: BXResamplerTestBlockFrames];
+    int32_t output[BXResamplerTestBlockFrames * 2];
+
+    //Leave the filter's history full of a loud signal, then reset and feed it silence.
+    NSUInteger inputFrames = [resampler inputFramesNeededForOutputFrames: BXResamplerTestBlockFrames];
+    float *input = resampler.inputBuffer;
+    NSUInteger i;
+    for (i = 0; i < inputFrames; i++)
+        input[i] = (i % 2) ? 0.9f : -0.9f;
+    [resampler resampleInputFrames: inputFrames format: BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatMono toMixerSamples: output frames: BXResamplerTestBlockFrames];
+
+    [resampler reset];
+
+    inputFrames = [resampler inputFramesNeededForOutputFrames: BXResamplerTestBlockFrames];
+    memset(resampler.inputBuffer, 0, inputFrames * sizeof(float));
+    [resampler resampleInputFrames: inputFrames format: BXAudioFormat32Bit | BXAudioFormatFloat | BXAudioFormatMono toMixerSamples: output frames: BXResamplerTestBlockFrames];
+
+    for (i = 0; i < BXResamplerTestBlockFrames * 2; i++)
+        XCTAssertEqual(output[i], 0, @"Sample %lu was not silent after a reset.", (unsigned long)i);
+}
+
+- (void) testHighQualityThroughput
+{
+    BXAudioResampler *resampler = [[BXAudioResampler alloc] initWithInputRate: BXResamplerTestInputRate
+                                                                   outputRate: BXResamplerTestOutputRate
+                                                                      quality: BXAudioResamplerQualityHigh
+                                                              maxOutputFrames: BXResamplerTestBlockFrames];
+    int32_t output[BXResamplerTestBlockFrames * 2];
+
+    //About ten seconds of stereo output per measurement.
+    [self measureBlock: ^{
+        NSUInteger block;
+        for (block = 0; block < 860; block++)
+        {
+            NSUInteger inputFrames = [resampler inputFramesNeededForOutputFrames: BXResamplerTestBlockFrames];
+            memset(resampler.inputBuffer, 0, inputFrames * 2 * sizeof(int16_t));
+            [resampler resampleInputFrames: inputFrames
+                                    format: BXAudioFormat16Bit | BXAudioFormatSigned | BXAudioFormatStereo
+                            toMixerSamples: output
+                                    frames: BXResamplerTestBlockFrames];
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,269 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXEmulatedPrinter.h"
+#import "BXPrintSession.h"
+
+
+//Set this environment variable to the path of a raw printer spool captured from a DOS program
+//to benchmark against that instead of the generated job.
+#define BXPrinterTestSpoolEnvironmentKey @"BOXER_TEST_PRINTER_SPOOL"
+
+//The shape of the generated job.
+#define BXPrinterTestPages 6
+#define BXPrinterTestLinesPerPage 40
+#define BXPrinterTestBitmapColumns 480
+
+//Parallel port control flags, as defined privately in BXEmulatedPrinter.mm.
+//The reset flag is left on throughout, as the printer starts out that way.
+#define BXPrinterTestControlStrobe  (1 << 0)
+#define BXPrinterTestControlReset   (1 << 2)
+
+#define BXPrinterTestESC 0x1B
+
+
+@interface BXEmulatedPrinterBenchmarks : XCTestCase <BXEmulatedPrinterDelegate>
+{
+    NSUInteger _numFinishedPages;
+    BXPrintSession *_finishedSession;
+}
+@end
+
+
+@implementation BXEmulatedPrinterBenchmarks
+
+- (void) setUp
+{
+    [super setUp];
+    _numFinishedPages = 0;
+    _finishedSession = nil;
+}
+
+- (void) printer: (BXEmulatedPrinter *)printer didFinishPageInSession: (BXPrintSession *)session
+{
+    _numFinishedPages++;
+}
+
+- (void) printer: (BXEmulatedPrinter *)printer didFinishSession: (BXPrintSession *)session
+{
+    _finishedSession = session;
+}
+
+
+#pragma mark -
+#pragma mark Helpers
+
+//Generates a job in the style of a DOS word processor: runs of text with bold and underline
+//toggled mid-line, a band of 8-dot bitmap graphics per page, and a form feed after each page.
+static NSData *BXGeneratedPrintJob(void)
+{
+    NSMutableData *job = [NSMutableData data];
+
+    const uint8_t reset[] = { BXPrinterTestESC, '@' };
+    [job appendBytes: reset length: sizeof(reset)];
+
+    NSUInteger page, line, i;
+    for (page = 0; page < BXPrinterTestPages; page++)
+    {
+        for (line = 0; line < BXPrinterTestLinesPerPage; line++)
+        {
+            NSString *text = [NSString stringWithFormat: @"Page %lu line %02lu: The quick brown fox ",
+                              (unsigned long)page + 1, (unsigned long)line + 1];
+            [job appendData: [text dataUsingEncoding: NSASCIIStringEncoding]];
+
+            const uint8_t boldOn[] = { BXPrinterTestESC, 'E' }, boldOff[] = { BXPrinterTestESC, 'F' };
+            const uint8_t underlineOn[] = { BXPrinterTestESC, '-', 1 }, underlineOff[] = { BXPrinterTestESC, '-', 0 };
+            [job appendBytes: boldOn length: sizeof(boldOn)];
+            [job appendData: [@"jumps over" dataUsingEncoding: NSASCIIStringEncoding]];
+            [job appendBytes: boldOff length: sizeof(boldOff)];
+            [job appendData: [@" the " dataUsingEncoding: NSASCIIStringEncoding]];
+            [job appendBytes: underlineOn length: sizeof(underlineOn)];
+            [job appendData: [@"lazy dog" dataUsingEncoding: NSASCIIStringEncoding]];
+            [job appendBytes: underlineOff length: sizeof(underlineOff)];
+
+            const uint8_t lineBreak[] = { '\r', '\n' };
+            [job appendBytes: lineBreak length: sizeof(lineBreak)];
+        }
+
+        //ESC * 0 nL nH: single-density 8-dot bit image, one byte per column.
+        const uint8_t bitmapHeader[] = {
+            BXPrinterTestESC, '*', 0,
+            BXPrinterTestBitmapColumns & 0xFF, BXPrinterTestBitmapColumns >> 8,
+        };
+        [job appendBytes: bitmapHeader length: sizeof(bitmapHeader)];
+        for (i = 0; i < BXPrinterTestBitmapColumns; i++)
+        {
+            uint8_t column = (uint8_t)(0x81 | (1 << (1 + (i % 6))));
+            [job appendBytes: &column length: 1];
+        }
+
+        const uint8_t pageBreak[] = { '\r', '\n', '\f' };
+        [job appendBytes: pageBreak length: sizeof(pageBreak)];
+    }
+
+    return job;
+}
+
+- (NSData *) _printJob
+{
+    NSString *spoolPath = [NSProcessInfo processInfo].environment[BXPrinterTestSpoolEnvironmentKey];
+    if (spoolPath.length)
+    {
+        NSError *error = nil;
+        NSData *spool = [NSData dataWithContentsOfFile: spoolPath options: 0 error: &error];
+        XCTAssertNotNil(spool, @"Could not read printer spool at %@: %@", spoolPath, error);
+        if (spool.length)
+            return spool;
+    }
+    return BXGeneratedPrintJob();
+}
+
+- (BXEmulatedPrinter *) _printer
+{
+    BXEmulatedPrinter *printer = [[BXEmulatedPrinter alloc] init];
+    printer.delegate = self;
+    return printer;
+}
+
+static void BXFeedInBulk(BXEmulatedPrinter *printer, NSData *job)
+{
+    [printer handleData: job.bytes length: job.length];
+}
+
+static void BXFeedByteByByte(BXEmulatedPrinter *printer, NSData *job)
+{
+    const uint8_t *bytes = job.bytes;
+    NSUInteger i;
+    for (i = 0; i < job.length; i++)
+        [printer handleDataByte: bytes[i]];
+}
+
+//Feeds the job the way the parallel port does: strobing each byte in through the data register,
+//with the pending data flushed as the emulator would once per emulated millisecond.
+static void BXFeedThroughPort(BXEmulatedPrinter *printer, NSData *job)
+{
+    const uint8_t *bytes = job.bytes;
+    NSUInteger i;
+    for (i = 0; i < job.length; i++)
+    {
+        printer.dataRegister = bytes[i];
+        printer.controlRegister = BXPrinterTestControlReset | BXPrinterTestControlStrobe;
+        printer.controlRegister = BXPrinterTestControlReset;
+
+        if ((i % 1024) == 1023)
+            [printer flushPendingData];
+    }
+    [printer flushPendingData];
+}
+
+//Feeds the job to a fresh printer and returns how long the printer took to parse and print it.
+- (NSTimeInterval) _timeFeedingJob: (NSData *)job
+                        withFeeder: (void (*)(BXEmulatedPrinter *, NSData *))feeder
+                      headPosition: (NSPoint *)headPosition
+{
+    BXEmulatedPrinter *printer = [self _printer];
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    feeder(printer, job);
+    NSTimeInterval elapsed = [NSProcessInfo processInfo].systemUptime - start;
+
+    if (headPosition)
+        *headPosition = printer.headPosition;
+
+    _finishedSession = nil;
+    [printer finishPrintSession];
+    return elapsed;
+}
+
+
+#pragma mark -
+#pragma mark Tests
+
+- (void) testBulkAndByteFeedsPrintTheSameJob
+{
+    NSData *job = BXGeneratedPrintJob();
+
+    void (*feeders[])(BXEmulatedPrinter *, NSData *) = { BXFeedInBulk, BXFeedByteByByte, BXFeedThroughPort };
+    NSString *names[] = { @"bulk", @"byte by byte", @"parallel port" };
+    NSUInteger i, numFeeders = sizeof(feeders) / sizeof(feeders[0]);
+
+    NSUInteger expectedPages = 0, expectedFinishedPages = 0;
+    NSPoint expectedHeadPosition = NSZeroPoint;
+    for (i = 0; i < numFeeders; i++)
+    {
+        _numFinishedPages = 0;
+        NSPoint headPosition;
+        [self _timeFeedingJob: job withFeeder: feeders[i] headPosition: &headPosition];
+
+        XCTAssertNotNil(_finishedSession, @"No session was finished when feeding %@.", names[i]);
+        NSUInteger numPages = _finishedSession.numPages;
+        XCTAssertGreaterThanOrEqual(numPages, (NSUInteger)BXPrinterTestPages,
+                                    @"Too few pages printed when feeding %@.", names[i]);
+
+        if (i == 0)
+        {
+            expectedPages = numPages;
+            expectedFinishedPages = _numFinishedPages;
+            expectedHeadPosition = headPosition;
+        }
+        else
+        {
+            XCTAssertEqual(numPages, expectedPages, @"Page count differs when feeding %@.", names[i]);
+            XCTAssertEqual(_numFinishedPages, expectedFinishedPages,
+                           @"Finished page count differs when feeding %@.", names[i]);
+            XCTAssertEqualWithAccuracy(headPosition.x, expectedHeadPosition.x, 1e-9,
+                                       @"Head position differs when feeding %@.", names[i]);
+            XCTAssertEqualWithAccuracy(headPosition.y, expectedHeadPosition.y, 1e-9,
+                                       @"Head position differs when feeding %@.", names[i]);
+        }
+    }
+}
+
+- (void) testParserThroughput
+{
+    NSData *job = [self _printJob];
+
+    void (*feeders[])(BXEmulatedPrinter *, NSData *) = { BXFeedInBulk, BXFeedByteByByte, BXFeedThroughPort };
+    NSString *names[] = { @"bulk", @"byte by byte", @"parallel port" };
+    NSUInteger i, numFeeders = sizeof(feeders) / sizeof(feeders[0]);
+
+    NSTimeInterval bulkTime = 0;
+    for (i = 0; i < numFeeders; i++)
+    {
+        NSTimeInterval elapsed = [self _timeFeedingJob: job withFeeder: feeders[i] headPosition: NULL];
+        if (i == 0)
+            bulkTime = elapsed;
+
+        NSLog(@"Printer fed %@: %lu bytes in %.1fms, %.2f MB/s (%.2fx the bulk time)",
+              names[i], (unsigned long)job.length, elapsed * 1000.0,
+              job.length / elapsed / (1024.0 * 1024.0), elapsed / bulkTime);
+    }
+}
+
+- (void) testBulkFeedPerformance
+{
+    NSData *job = [self _printJob];
+    [self measureBlock: ^{
+        BXEmulatedPrinter *printer = [[BXEmulatedPrinter alloc] init];
+        BXFeedInBulk(printer, job);
+        [printer cancelPrintSession];
+    }];
+}
+
+- (void) testByteFeedPerformance
+{
+    NSData *job = [self _printJob];
+    [self measureBlock: ^{
+        BXEmulatedPrinter *printer = [[BXEmulatedPrinter alloc] init];
+        BXFeedByteByByte(printer, job);
+        [printer cancelPrintSession];
+    }];
+}
+
+@end
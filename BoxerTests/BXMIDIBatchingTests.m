@@ -0,0 +1,348 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXEmulator.h"
+#import "BXEmulator+BXAudio.h"
+#import "BXMIDIDevice.h"
+
+
+//BXEmulatorPrivate.h pulls in DOSBox's C++ headers, so just declare the internal methods we need.
+@interface BXEmulator (BXMIDIBatchingTestInternals)
+- (void) _queueMIDIMessage: (const UInt8 *)bytes
+                    length: (NSUInteger)length
+            atEmulatedTime: (NSTimeInterval)emulatedTime;
+- (void) _flushPendingMIDIEvents;
+@end
+
+
+#pragma mark -
+#pragma mark Test devices
+
+//Records everything it receives as a flat log: each standard message is packed into
+//the low 3 bytes of a number with its length in the top byte, and each sysex is logged as -1.
+@interface BXRecordingMIDIDevice : NSObject <BXMIDIDevice>
+@property (readonly) NSMutableArray<NSNumber *> *log;
+@property (readonly) NSMutableArray<NSNumber *> *times;
+@property (assign) NSUInteger numDeliveries;
+@end
+
+//As above, but takes messages in bulk.
+@interface BXRecordingBatchMIDIDevice : BXRecordingMIDIDevice
+@property (assign) NSUInteger largestBatch;
+@end
+
+//Counts the messages it receives by either route and otherwise ignores them, for benchmarking.
+@interface BXCountingMIDIDevice : BXRecordingMIDIDevice
+@property (assign) NSUInteger numMessages;
+@end
+
+
+@implementation BXRecordingMIDIDevice
+@synthesize volume = _volume;
+
+- (instancetype) init
+{
+    if ((self = [super init]))
+    {
+        _log = [NSMutableArray array];
+        _times = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (BOOL) supportsMT32Music          { return NO; }
+- (BOOL) supportsGeneralMIDIMusic   { return YES; }
+- (BOOL) isProcessing               { return NO; }
+- (NSDate *) dateWhenReady          { return [NSDate distantPast]; }
+
+- (void) _logBytes: (const UInt8 *)bytes length: (NSUInteger)length time: (NSTimeInterval)time
+{
+    uint32_t packed = (uint32_t)length << 24;
+    NSUInteger i;
+    for (i = 0; i < length; i++)
+        packed |= (uint32_t)bytes[i] << (16 - (i * 8));
+
+    [self.log addObject: @(packed)];
+    [self.times addObject: @(time)];
+}
+
+- (void) handleMessage: (NSData *)message
+{
+    [self handleMessage: message atEmulatedTime: -1];
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    self.numDeliveries++;
+    [self _logBytes: message.bytes length: message.length time: emulatedTime];
+}
+
+- (void) handleSysex: (NSData *)message
+{
+    self.numDeliveries++;
+    [self.log addObject: @(-1)];
+    [self.times addObject: @(-1)];
+}
+
+- (void) pause  {}
+- (void) resume {}
+- (void) close  {}
+
+@end
+
+
+@implementation BXRecordingBatchMIDIDevice
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    self.numDeliveries++;
+    self.largestBatch = MAX(self.largestBatch, count);
+
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+        [self _logBytes: events[i].bytes length: events[i].length time: events[i].emulatedTime];
+}
+
+@end
+
+
+@implementation BXCountingMIDIDevice
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (NSTimeInterval)emulatedTime
+{
+    self.numMessages++;
+}
+
+- (void) handleEvents: (const BXMIDIEvent *)events count: (NSUInteger)count
+{
+    self.numMessages += count;
+}
+
+@end
+
+
+#pragma mark -
+#pragma mark Tests
+
+#define BXMIDIBatchingTestMessageCount 5000
+
+//How many messages each benchmark pass sends, and how many go out in each emulated millisecond:
+//a dense stretch of music with a lot of controller changes.
+#define BXMIDIBenchmarkMessageCount 100000
+#define BXMIDIBenchmarkMessagesPerFlush 16
+
+@interface BXMIDIBatchingTests : XCTestCase
+@end
+
+
+@implementation BXMIDIBatchingTests
+
+//Sends a long stream of 1-, 2- and 3-byte messages with a sysex every so often, and returns
+//the log that the device should end up with.
+static NSArray<NSNumber *> *BXSendTestStream(BXEmulator *emulator, NSUInteger count, NSUInteger sysexInterval)
+{
+    static const UInt8 sysexBytes[] = { 0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7 }; //General MIDI on
+    NSData *sysex = [NSData dataWithBytes: sysexBytes length: sizeof(sysexBytes)];
+
+    NSMutableArray *expected = [NSMutableArray arrayWithCapacity: count];
+    NSUInteger i;
+    for (i = 0; i < count; i++)
+    {
+        if (sysexInterval && i % sysexInterval == sysexInterval - 1)
+        {
+            [emulator sendMIDISysex: sysex];
+            [expected addObject: @(-1)];
+            continue;
+        }
+
+        UInt8 bytes[3];
+        NSUInteger length = (i % 3) + 1;
+        bytes[0] = (length == 1) ? 0xF8 : (length == 2) ? (0xC0 | (i & 0x0F)) : (0x90 | (i & 0x0F));
+        bytes[1] = (UInt8)(i & 0x7F);
+        bytes[2] = (UInt8)((i >> 7) & 0x7F);
+
+        [emulator sendMIDIMessage: [NSData dataWithBytes: bytes length: length]
+                   atEmulatedTime: (NSTimeInterval)i / 1000.0];
+
+        uint32_t packed = (uint32_t)length << 24;
+        NSUInteger b;
+        for (b = 0; b < length; b++)
+            packed |= (uint32_t)bytes[b] << (16 - (b * 8));
+        [expected addObject: @(packed)];
+    }
+    return expected;
+}
+
+- (BXEmulator *) _emulatorWithDevice: (id <BXMIDIDevice>)device
+{
+    BXEmulator *emulator = [[BXEmulator alloc] init];
+    emulator.autodetectsMT32 = NO;
+    emulator.activeMIDIDevice = device;
+    return emulator;
+}
+
+- (void) testBatchedMessagesArriveInOrderAroundSysex
+{
+    BXRecordingBatchMIDIDevice *device = [[BXRecordingBatchMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    NSArray *expected = BXSendTestStream(emulator, BXMIDIBatchingTestMessageCount, 97);
+    [emulator _flushPendingMIDIEvents];
+
+    XCTAssertEqualObjects(device.log, expected, @"Messages and sysexes should reach the device in the order they were sent.");
+    XCTAssertLessThan(device.numDeliveries, (NSUInteger)BXMIDIBatchingTestMessageCount / 10,
+                      @"Messages should have been delivered in batches, not one at a time.");
+}
+
+- (void) testFullBatchIsDeliveredWithoutAFlush
+{
+    BXRecordingBatchMIDIDevice *device = [[BXRecordingBatchMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    NSArray *expected = BXSendTestStream(emulator, BXMIDIBatchingTestMessageCount, 0);
+
+    //Everything but the last partial batch should already have been handed over.
+    XCTAssertGreaterThan(device.log.count, 0U);
+    XCTAssertLessThan(device.log.count, expected.count);
+    if (device.largestBatch)
+        XCTAssertEqual(device.log.count % device.largestBatch, 0U, @"Only whole batches should go out before a flush.");
+
+    [emulator _flushPendingMIDIEvents];
+    XCTAssertEqualObjects(device.log, expected);
+
+    //The emulated time of each message should survive batching.
+    NSUInteger i;
+    for (i = 0; i < device.times.count; i++)
+        XCTAssertEqualWithAccuracy(device.times[i].doubleValue, (double)i / 1000.0, 1e-9);
+}
+
+- (void) testImmediateMessagesAreDeliveredImmediately
+{
+    BXRecordingBatchMIDIDevice *device = [[BXRecordingBatchMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    UInt8 bytes[] = { 0x90, 0x3C, 0x7F };
+    [emulator sendMIDIMessage: [NSData dataWithBytes: bytes length: sizeof(bytes)]];
+
+    XCTAssertEqual(device.log.count, 1U);
+    XCTAssertLessThan(device.times[0].doubleValue, 0.0, @"Untimed messages should keep their immediate time.");
+}
+
+- (void) testDevicesWithoutBatchSupportGetEveryMessage
+{
+    BXRecordingMIDIDevice *device = [[BXRecordingMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    NSArray *expected = BXSendTestStream(emulator, BXMIDIBatchingTestMessageCount, 97);
+    [emulator _flushPendingMIDIEvents];
+
+    XCTAssertEqualObjects(device.log, expected);
+    XCTAssertEqual(device.numDeliveries, expected.count);
+}
+
+- (void) testQueuedMessagesBeyondBatchCapacityStayInOrder
+{
+    BXRecordingBatchMIDIDevice *device = [[BXRecordingBatchMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    //Queue several batches' worth within one emulated millisecond, without a flush in between.
+    NSUInteger i, count = (BXMIDIEventBatchCapacity * 3) + 17;
+    NSMutableArray *expected = [NSMutableArray arrayWithCapacity: count];
+    for (i = 0; i < count; i++)
+    {
+        UInt8 bytes[] = { (UInt8)(0xB0 | (i & 0x0F)), (UInt8)(i & 0x7F), (UInt8)((i >> 7) & 0x7F) };
+        [emulator _queueMIDIMessage: bytes length: sizeof(bytes) atEmulatedTime: 1.0 + (i / 1000000.0)];
+        [expected addObject: @((3U << 24) | ((uint32_t)bytes[0] << 16) | ((uint32_t)bytes[1] << 8) | bytes[2])];
+    }
+
+    //The full batches should have gone out as the queue filled up, and only the rest should be waiting.
+    XCTAssertEqual(device.log.count, (NSUInteger)BXMIDIEventBatchCapacity * 3);
+    XCTAssertEqual(device.largestBatch, (NSUInteger)BXMIDIEventBatchCapacity);
+    XCTAssertEqualObjects(device.log, [expected subarrayWithRange: NSMakeRange(0, device.log.count)]);
+
+    [emulator _flushPendingMIDIEvents];
+    XCTAssertEqualObjects(device.log, expected, @"Messages beyond the batch capacity should still arrive in order.");
+    XCTAssertEqual(device.numDeliveries, 4U);
+    for (i = 0; i < count; i++)
+        XCTAssertEqualWithAccuracy(device.times[i].doubleValue, 1.0 + (i / 1000000.0), 1e-12);
+    XCTAssertLessThanOrEqual(device.largestBatch, (NSUInteger)BXMIDIEventBatchCapacity);
+}
+
+//Sends the benchmark stream through the emulator's batching queue, flushing it as the emulator
+//does once per emulated millisecond. This allocates nothing per message.
+static void BXSendBatchedBenchmarkStream(BXEmulator *emulator)
+{
+    NSUInteger i;
+    for (i = 0; i < BXMIDIBenchmarkMessageCount; i++)
+    {
+        UInt8 bytes[] = { (UInt8)(0x90 | (i & 0x0F)), (UInt8)(i & 0x7F), 0x40 };
+        [emulator _queueMIDIMessage: bytes length: sizeof(bytes) atEmulatedTime: (NSTimeInterval)i / 1000.0];
+
+        if ((i % BXMIDIBenchmarkMessagesPerFlush) == BXMIDIBenchmarkMessagesPerFlush - 1)
+            [emulator _flushPendingMIDIEvents];
+    }
+    [emulator _flushPendingMIDIEvents];
+}
+
+//Sends the same stream the way the emulator did before batching: wrapping each message
+//in its own NSData and dispatching it to the device straight away.
+static void BXSendLegacyBenchmarkStream(id <BXMIDIDevice> device)
+{
+    NSUInteger i;
+    for (i = 0; i < BXMIDIBenchmarkMessageCount; i++)
+    {
+        UInt8 bytes[] = { (UInt8)(0x90 | (i & 0x0F)), (UInt8)(i & 0x7F), 0x40 };
+        @autoreleasepool {
+            [device handleMessage: [NSData dataWithBytes: bytes length: sizeof(bytes)]
+                   atEmulatedTime: (NSTimeInterval)i / 1000.0];
+        }
+    }
+}
+
+- (void) testBatchedVersusPerMessageDispatch
+{
+    BXCountingMIDIDevice *device = [[BXCountingMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    BXSendBatchedBenchmarkStream(emulator);
+    NSTimeInterval batchedTime = [NSProcessInfo processInfo].systemUptime - start;
+    XCTAssertEqual(device.numMessages, (NSUInteger)BXMIDIBenchmarkMessageCount);
+
+    device.numMessages = 0;
+    start = [NSProcessInfo processInfo].systemUptime;
+    BXSendLegacyBenchmarkStream(device);
+    NSTimeInterval legacyTime = [NSProcessInfo processInfo].systemUptime - start;
+    XCTAssertEqual(device.numMessages, (NSUInteger)BXMIDIBenchmarkMessageCount);
+
+    NSLog(@"%u MIDI messages: %.1fns each batched, %.1fns each dispatched one at a time (%.1fx faster)",
+          BXMIDIBenchmarkMessageCount,
+          batchedTime * 1e9 / BXMIDIBenchmarkMessageCount,
+          legacyTime * 1e9 / BXMIDIBenchmarkMessageCount,
+          legacyTime / batchedTime);
+}
+
+- (void) testBatchedDispatchPerformance
+{
+    BXCountingMIDIDevice *device = [[BXCountingMIDIDevice alloc] init];
+    BXEmulator *emulator = [self _emulatorWithDevice: device];
+    [self measureBlock: ^{
+        BXSendBatchedBenchmarkStream(emulator);
+    }];
+}
+
+- (void) testPerMessageDispatchPerformance
+{
+    BXCountingMIDIDevice *device = [[BXCountingMIDIDevice alloc] init];
+    [self measureBlock: ^{
+        BXSendLegacyBenchmarkStream(device);
+    }];
+}
+
+@end
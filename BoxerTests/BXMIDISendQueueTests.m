@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXMIDISendQueue.h"
+
+
+//How early a delivery may come compared to when it was due, to allow for clock granularity.
+#define BXSendQueueTestTolerance 0.002
+
+
+@interface BXMIDISendQueueTests : XCTestCase
+{
+    NSMutableArray<NSData *> *_deliveries;
+    NSMutableArray<NSNumber *> *_deliveryTimes;
+}
+@end
+
+
+@implementation BXMIDISendQueueTests
+
+- (void) setUp
+{
+    [super setUp];
+    _deliveries = [NSMutableArray array];
+    _deliveryTimes = [NSMutableArray array];
+}
+
+- (BXMIDISendQueue *) _recordingQueue
+{
+    NSMutableArray *deliveries = _deliveries, *deliveryTimes = _deliveryTimes;
+    return [[BXMIDISendQueue alloc] initWithSendHandler: ^(const UInt8 *bytes, NSUInteger length) {
+        @synchronized(deliveries)
+        {
+            [deliveries addObject: [NSData dataWithBytes: bytes length: length]];
+            [deliveryTimes addObject: @([NSProcessInfo processInfo].systemUptime)];
+        }
+    }];
+}
+
+static NSData *BXTestSysex(UInt8 index)
+{
+    UInt8 bytes[] = { 0xF0, 0x41, 0x10, 0x16, 0x12, index, 0xF7 };
+    return [NSData dataWithBytes: bytes length: sizeof(bytes)];
+}
+
+- (void) testSendsArriveInOrderAndArePaced
+{
+    BXMIDISendQueue *queue = [self _recordingQueue];
+    NSTimeInterval delays[] = { 0.02, 0.0, 0.03, 0.01, 0.02, 0.0, 0.0, 0.04 };
+    NSUInteger i, count = sizeof(delays) / sizeof(delays[0]);
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    for (i = 0; i < count; i++)
+    {
+        NSData *sysex = BXTestSysex((UInt8)i);
+        [queue sendBytes: sysex.bytes length: sysex.length processingDelay: delays[i]];
+    }
+    NSTimeInterval sendDuration = [NSProcessInfo processInfo].systemUptime - start;
+    XCTAssertLessThan(sendDuration, 0.02, @"Sending should not wait for the device.");
+
+    [queue close];
+
+    XCTAssertEqual(_deliveries.count, count);
+    for (i = 0; i < count; i++)
+    {
+        XCTAssertEqualObjects(_deliveries[i], BXTestSysex((UInt8)i));
+        if (i > 0)
+        {
+            NSTimeInterval gap = _deliveryTimes[i].doubleValue - _deliveryTimes[i - 1].doubleValue;
+            XCTAssertGreaterThanOrEqual(gap, delays[i - 1] - BXSendQueueTestTolerance,
+                                        @"Send %lu arrived before the device had finished processing the previous one.", (unsigned long)i);
+        }
+    }
+}
+
+- (void) testBacklogLimitAndCancellation
+{
+    BXMIDISendQueue *queue = [self _recordingQueue];
+    queue.maxBacklog = 0.3;
+    XCTAssertTrue(queue.isIdle);
+    XCTAssertFalse(queue.isOverLimit);
+    XCTAssertEqualObjects(queue.dateWhenBelowLimit, [NSDate distantPast]);
+
+    NSUInteger i;
+    for (i = 0; i < 5; i++)
+    {
+        NSData *sysex = BXTestSysex((UInt8)i);
+        [queue sendBytes: sysex.bytes length: sysex.length processingDelay: 0.2];
+    }
+
+    //A second of sends against a 0.3 second limit.
+    XCTAssertFalse(queue.isIdle);
+    XCTAssertTrue(queue.isOverLimit);
+    XCTAssertEqualWithAccuracy(queue.dateWhenBelowLimit.timeIntervalSinceNow, 0.7, 0.05);
+    XCTAssertEqualWithAccuracy(queue.dateWhenIdle.timeIntervalSinceNow, 1.0, 0.05);
+
+    //Wait for the first send to go out, then drop the rest: the device is still busy with the first.
+    while (YES)
+    {
+        @synchronized(_deliveries)
+        {
+            if (_deliveries.count) break;
+        }
+        usleep(1000);
+    }
+    [queue cancelPendingSends];
+
+    XCTAssertFalse(queue.isOverLimit);
+    XCTAssertFalse(queue.isIdle, @"The device should still be processing the send that went out.");
+    NSTimeInterval remaining = queue.dateWhenIdle.timeIntervalSinceNow;
+    XCTAssertGreaterThan(remaining, 0.0);
+    XCTAssertLessThanOrEqual(remaining, 0.2);
+
+    //Allow a little slack, as the queue measures time with a different clock from NSDate.
+    [NSThread sleepUntilDate: [queue.dateWhenIdle dateByAddingTimeInterval: 0.01]];
+    XCTAssertTrue(queue.isIdle);
+    XCTAssertEqualObjects(queue.dateWhenIdle, [NSDate distantPast]);
+
+    [queue close];
+    XCTAssertEqual(_deliveries.count, 1U, @"Cancelled sends should never be delivered.");
+}
+
+- (void) testCancelThenCloseDoesNotWaitForDevice
+{
+    BXMIDISendQueue *queue = [self _recordingQueue];
+
+    //A sysex the device will take a long time over, and another queued behind it.
+    NSData *first = BXTestSysex(1), *second = BXTestSysex(2);
+    [queue sendBytes: first.bytes length: first.length processingDelay: 5.0];
+    [queue sendBytes: second.bytes length: second.length processingDelay: 5.0];
+
+    while (YES)
+    {
+        @synchronized(_deliveries)
+        {
+            if (_deliveries.count) break;
+        }
+        usleep(1000);
+    }
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    [queue cancelPendingSends];
+    [queue close];
+    NSTimeInterval closeTime = [NSProcessInfo processInfo].systemUptime - start;
+
+    XCTAssertLessThan(closeTime, 0.1, @"Closing should not wait out the device's processing delay when nothing is left to send.");
+    XCTAssertEqual(_deliveries.count, 1U, @"Cancelled sends should never be delivered.");
+}
+
+- (void) testClosedQueueIgnoresSends
+{
+    BXMIDISendQueue *queue = [self _recordingQueue];
+    NSData *sysex = BXTestSysex(1);
+
+    [queue sendBytes: sysex.bytes length: 0 processingDelay: 1.0];
+    XCTAssertTrue(queue.isIdle, @"Empty sends should be ignored.");
+
+    [queue close];
+    [queue sendBytes: sysex.bytes length: sysex.length processingDelay: 1.0];
+
+    XCTAssertEqual(_deliveries.count, 0U);
+    XCTAssertTrue(queue.isIdle);
+}
+
+@end
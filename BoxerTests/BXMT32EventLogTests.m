@@ -0,0 +1,224 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import <libkern/OSByteOrder.h>
+#import "BXMT32EventLog.h"
+#import "BXEmulatedMT32.h"
+
+
+#define BXEventLogTestSampleRate 32000
+#define BXEventLogTestEventCount 2000
+
+//Every this many events, the generated performance sends a sysex instead of a short message.
+#define BXEventLogTestSysexInterval 37
+
+//The size of the header, and of each event before its sysex data: see BXMT32EventLog.h.
+#define BXEventLogTestHeaderSize 16
+#define BXEventLogTestEventSize 16
+
+
+@interface BXMT32EventLogTests : XCTestCase
+{
+    NSURL *_logURL;
+}
+@end
+
+
+@implementation BXMT32EventLogTests
+
+- (void) setUp
+{
+    [super setUp];
+    NSString *name = [NSString stringWithFormat: @"BXMT32EventLogTests-%@.log", [NSUUID UUID].UUIDString];
+    _logURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: name]];
+}
+
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL: _logURL error: NULL];
+    [super tearDown];
+}
+
+//Returns event i of a generated performance as an array of frame, packed message and sysex data,
+//with an empty sysex for short messages. Frames run past 32 bits to check they're stored in full.
+static NSArray *BXGeneratedEvent(NSUInteger i)
+{
+    uint64_t frame = ((uint64_t)i * 97) + ((i > BXEventLogTestEventCount / 2) ? 0x100000000ULL : 0);
+    if ((i % BXEventLogTestSysexInterval) == 0)
+    {
+        NSMutableData *sysex = [NSMutableData dataWithLength: 8 + (i % 300)];
+        UInt8 *bytes = sysex.mutableBytes;
+        NSUInteger b;
+        bytes[0] = 0xF0;
+        for (b = 1; b < sysex.length - 1; b++)
+            bytes[b] = (UInt8)((b + i) & 0x7F);
+        bytes[sysex.length - 1] = 0xF7;
+        return @[ @(frame), @0, sysex ];
+    }
+    else
+    {
+        UInt32 packedMessage = (UInt32)(0x90 | (i & 0x0F)) | (UInt32)((i & 0x7F) << 8) | (UInt32)(((i >> 7) & 0x7F) << 16);
+        return @[ @(frame), @(packedMessage), [NSData data] ];
+    }
+}
+
+- (NSArray *) _writeGeneratedLog
+{
+    NSError *error = nil;
+    BXMT32EventLogWriter *writer = [[BXMT32EventLogWriter alloc] initWithURL: _logURL
+                                                                  sampleRate: BXEventLogTestSampleRate
+                                                                       error: &error];
+    XCTAssertNotNil(writer, @"Could not create event log: %@", error);
+
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity: BXEventLogTestEventCount];
+    NSUInteger i;
+    for (i = 0; i < BXEventLogTestEventCount; i++)
+    {
+        NSArray *event = BXGeneratedEvent(i);
+        uint64_t frame = [event[0] unsignedLongLongValue];
+        NSData *sysex = event[2];
+        if (sysex.length)
+            [writer writeSysex: sysex.bytes length: sysex.length atFrame: frame];
+        else
+            [writer writeMessage: [event[1] unsignedIntValue] atFrame: frame];
+
+        [events addObject: event];
+    }
+    [writer close];
+    return events;
+}
+
+- (NSArray *) _readLogReturningError: (NSError **)outError
+{
+    BXMT32EventLogReader *reader = [[BXMT32EventLogReader alloc] initWithURL: _logURL error: outError];
+    if (!reader)
+        return nil;
+
+    XCTAssertEqual(reader.sampleRate, (UInt32)BXEventLogTestSampleRate);
+
+    NSMutableArray *events = [NSMutableArray array];
+    BOOL succeeded = [reader readEventsWithHandler: ^(uint64_t frame, UInt32 packedMessage, const UInt8 *sysex, NSUInteger sysexLength) {
+        NSData *sysexData = (sysex) ? [NSData dataWithBytes: sysex length: sysexLength] : [NSData data];
+        [events addObject: @[ @(frame), @(packedMessage), sysexData ]];
+    } error: outError];
+
+    return (succeeded) ? events : nil;
+}
+
+
+#pragma mark -
+#pragma mark Tests
+
+- (void) testEventsSurviveRoundTrip
+{
+    NSArray *written = [self _writeGeneratedLog];
+
+    NSError *error = nil;
+    NSArray *read = [self _readLogReturningError: &error];
+    XCTAssertNotNil(read, @"Could not read back event log: %@", error);
+    XCTAssertEqualObjects(read, written);
+}
+
+- (void) testLogLayoutMatchesVersion1
+{
+    NSArray *written = [self _writeGeneratedLog];
+    NSData *log = [NSData dataWithContentsOfURL: _logURL];
+    const UInt8 *bytes = log.bytes;
+
+    XCTAssertGreaterThanOrEqual(log.length, (NSUInteger)BXEventLogTestHeaderSize);
+    if (log.length < BXEventLogTestHeaderSize)
+        return;
+
+    XCTAssertEqual(memcmp(bytes, "BXMT32EV", 8), 0);
+    XCTAssertEqual(OSReadLittleInt32(bytes, 8), 1U, @"Format version should be 1.");
+    XCTAssertEqual(OSReadLittleInt32(bytes, 12), (UInt32)BXEventLogTestSampleRate);
+
+    NSUInteger expectedLength = BXEventLogTestHeaderSize;
+    for (NSArray *event in written)
+        expectedLength += BXEventLogTestEventSize + [event[2] length];
+    XCTAssertEqual(log.length, expectedLength);
+
+    //The first event is a sysex, so its length field should be filled in and its packed message empty.
+    NSData *firstSysex = written[0][2];
+    XCTAssertEqual(OSReadLittleInt64(bytes, 16), [written[0][0] unsignedLongLongValue]);
+    XCTAssertEqual(OSReadLittleInt32(bytes, 24), 0U);
+    XCTAssertEqual(OSReadLittleInt32(bytes, 28), (UInt32)firstSysex.length);
+}
+
+- (void) testEmptyLogHasNoEvents
+{
+    NSError *error = nil;
+    BXMT32EventLogWriter *writer = [[BXMT32EventLogWriter alloc] initWithURL: _logURL
+                                                                  sampleRate: BXEventLogTestSampleRate
+                                                                       error: &error];
+    XCTAssertNotNil(writer, @"Could not create event log: %@", error);
+    [writer close];
+
+    NSArray *read = [self _readLogReturningError: &error];
+    XCTAssertNotNil(read, @"Could not read back event log: %@", error);
+    XCTAssertEqual(read.count, 0U);
+}
+
+- (void) testTruncatedLogIsReported
+{
+    NSArray *written = [self _writeGeneratedLog];
+
+    //Cut the log off partway through its last event.
+    NSData *log = [NSData dataWithContentsOfURL: _logURL];
+    [[log subdataWithRange: NSMakeRange(0, log.length - 3)] writeToURL: _logURL atomically: NO];
+
+    BXMT32EventLogReader *reader = [[BXMT32EventLogReader alloc] initWithURL: _logURL error: NULL];
+    XCTAssertNotNil(reader);
+
+    __block NSUInteger numEvents = 0;
+    NSError *error = nil;
+    BOOL succeeded = [reader readEventsWithHandler: ^(uint64_t frame, UInt32 packedMessage, const UInt8 *sysex, NSUInteger sysexLength) {
+        numEvents++;
+    } error: &error];
+
+    XCTAssertFalse(succeeded);
+    XCTAssertEqualObjects(error.domain, BXEmulatedMT32ErrorDomain);
+    XCTAssertEqual(error.code, BXEmulatedMT32InvalidEventLog);
+    XCTAssertEqual(numEvents, written.count - 1, @"Every event before the truncated one should have been read.");
+}
+
+- (void) testOtherFilesAreRejected
+{
+    NSData *notALog = [@"BXMT32 is not quite the right signature" dataUsingEncoding: NSASCIIStringEncoding];
+    [notALog writeToURL: _logURL atomically: NO];
+
+    NSError *error = nil;
+    BXMT32EventLogReader *reader = [[BXMT32EventLogReader alloc] initWithURL: _logURL error: &error];
+    XCTAssertNil(reader);
+    XCTAssertEqualObjects(error.domain, BXEmulatedMT32ErrorDomain);
+    XCTAssertEqual(error.code, BXEmulatedMT32InvalidEventLog);
+}
+
+- (void) testFutureVersionsAreRejected
+{
+    [self _writeGeneratedLog];
+
+    NSMutableData *log = [NSMutableData dataWithContentsOfURL: _logURL];
+    OSWriteLittleInt32(log.mutableBytes, 8, 2);
+    [log writeToURL: _logURL atomically: NO];
+
+    NSError *error = nil;
+    XCTAssertNil([[BXMT32EventLogReader alloc] initWithURL: _logURL error: &error]);
+    XCTAssertEqual(error.code, BXEmulatedMT32InvalidEventLog);
+}
+
+- (void) testMissingLogReportsPOSIXError
+{
+    NSError *error = nil;
+    XCTAssertNil([[BXMT32EventLogReader alloc] initWithURL: _logURL error: &error]);
+    XCTAssertEqualObjects(error.domain, NSPOSIXErrorDomain);
+    XCTAssertEqual(error.code, ENOENT);
+}
+
+@end
@@ -0,0 +1,233 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXEmulatedMT32.h"
+#import "BXBaseAppController+BXSupportFiles.h"
+
+
+//MT-32 ROMs can't be distributed with Boxer, so these tests use the ROMs named by these
+//environment variables, or else whichever ROMs have been imported into Boxer itself.
+//If neither are available, the tests do nothing.
+#define BXMT32TestControlROMVariable @"BOXER_TEST_MT32_CONTROL_ROM"
+#define BXMT32TestPCMROMVariable @"BOXER_TEST_MT32_PCM_ROM"
+
+#define BXMT32TestSampleRate 32000
+#define BXMT32TestBlockFrames 256
+#define BXMT32TestTailSeconds 2
+#define BXMT32TestWAVHeaderSize 44
+
+
+@interface BXMT32OfflineRenderTests : XCTestCase
+{
+    NSURL *_controlROMURL;
+    NSURL *_PCMROMURL;
+    NSURL *_tempURL;
+}
+@end
+
+
+@implementation BXMT32OfflineRenderTests
+
+- (void) setUp
+{
+    [super setUp];
+
+    NSDictionary *environment = [NSProcessInfo processInfo].environment;
+    NSString *controlPath = environment[BXMT32TestControlROMVariable];
+    NSString *PCMPath = environment[BXMT32TestPCMROMVariable];
+    if (controlPath.length && PCMPath.length)
+    {
+        _controlROMURL = [NSURL fileURLWithPath: controlPath];
+        _PCMROMURL = [NSURL fileURLWithPath: PCMPath];
+    }
+    else if ([NSApp.delegate isKindOfClass: [BXBaseAppController class]])
+    {
+        BXBaseAppController *controller = (BXBaseAppController *)NSApp.delegate;
+        _controlROMURL = controller.MT32ControlROMURL;
+        _PCMROMURL = controller.MT32PCMROMURL;
+    }
+
+    _tempURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString]
+                          isDirectory: YES];
+    [[NSFileManager defaultManager] createDirectoryAtURL: _tempURL withIntermediateDirectories: YES attributes: nil error: NULL];
+}
+
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL: _tempURL error: NULL];
+    [super tearDown];
+}
+
+- (BOOL) _hasROMs
+{
+    if (_controlROMURL && _PCMROMURL)
+        return YES;
+
+    NSLog(@"Skipping %@: no MT-32 ROMs are available. Set %@ and %@ to run it.",
+          self.name, BXMT32TestControlROMVariable, BXMT32TestPCMROMVariable);
+    return NO;
+}
+
+- (BXEmulatedMT32 *) _offlineSynth
+{
+    NSError *error = nil;
+    BXEmulatedMT32 *synth = [[BXEmulatedMT32 alloc] initForOfflineRenderingWithPCMROM: _PCMROMURL
+                                                                           controlROM: _controlROMURL
+                                                                                error: &error];
+    XCTAssertNotNil(synth, @"Could not create offline synth: %@", error);
+    return synth;
+}
+
+
+#pragma mark - Event logs
+
+static void BXAppendEvent(NSMutableData *log, uint64_t frame, uint32_t packedMessage, NSData *sysex)
+{
+    uint64_t littleFrame = OSSwapHostToLittleInt64(frame);
+    uint32_t fields[2] = {
+        OSSwapHostToLittleInt32(sysex ? 0 : packedMessage),
+        OSSwapHostToLittleInt32((uint32_t)sysex.length),
+    };
+    [log appendBytes: &littleFrame length: sizeof(littleFrame)];
+    [log appendBytes: fields length: sizeof(fields)];
+    if (sysex)
+        [log appendData: sysex];
+}
+
+//Writes a log that puts a message on the MT-32's display, then plays a rising run of notes
+//on the first part's default channel. Returns the frame of the last event.
+- (uint64_t) _writeTestLogToURL: (NSURL *)URL
+{
+    NSMutableData *log = [NSMutableData dataWithBytes: "BXMT32EV" length: 8];
+    uint32_t header[2] = { OSSwapHostToLittleInt32(1), OSSwapHostToLittleInt32(BXMT32TestSampleRate) };
+    [log appendBytes: header length: sizeof(header)];
+
+    //Roland DT1 to the display address 20 00 00, with its checksum.
+    const char *text = "BOXER TEST";
+    NSMutableData *sysex = [NSMutableData dataWithBytes: (UInt8[]){ 0xF0, 0x41, 0x10, 0x16, 0x12, 0x20, 0x00, 0x00 } length: 8];
+    NSUInteger checksum = 0x20;
+    size_t i;
+    for (i = 0; i < strlen(text); i++)
+    {
+        UInt8 byte = (UInt8)text[i];
+        [sysex appendBytes: &byte length: 1];
+        checksum += byte;
+    }
+    UInt8 trailer[] = { (UInt8)((128 - (checksum % 128)) & 0x7F), 0xF7 };
+    [sysex appendBytes: trailer length: sizeof(trailer)];
+    BXAppendEvent(log, 0, 0, sysex);
+
+    uint64_t frame = 0;
+    UInt8 note;
+    for (note = 48; note < 72; note++)
+    {
+        //Note on, then note off a quarter of a second later, on MIDI channel 2.
+        BXAppendEvent(log, frame, 0x91 | (note << 8) | (0x64 << 16), nil);
+        frame += BXMT32TestSampleRate / 4;
+        BXAppendEvent(log, frame, 0x81 | (note << 8), nil);
+    }
+
+    [log writeToURL: URL atomically: NO];
+    return frame;
+}
+
+
+#pragma mark - Tests
+
+- (void) testRenderedLogProducesExpectedAudio
+{
+    if (![self _hasROMs])
+        return;
+
+    NSURL *logURL = [_tempURL URLByAppendingPathComponent: @"events.bxmt32"];
+    NSURL *outputURL = [_tempURL URLByAppendingPathComponent: @"output.wav"];
+    uint64_t lastFrame = [self _writeTestLogToURL: logURL];
+
+    BXEmulatedMT32 *synth = [self _offlineSynth];
+    NSError *error = nil;
+    BXMT32RenderStatistics *statistics = [synth renderEventLogAtURL: logURL
+                                                     toWAVFileAtURL: outputURL
+                                                        blockFrames: BXMT32TestBlockFrames
+                                                              error: &error];
+    [synth close];
+
+    XCTAssertNotNil(statistics, @"Render failed: %@", error);
+    NSLog(@"%@", statistics);
+
+    NSUInteger expectedFrames = (NSUInteger)lastFrame + BXMT32TestSampleRate * BXMT32TestTailSeconds;
+    XCTAssertEqual(statistics.renderedFrames, expectedFrames);
+    XCTAssertEqualWithAccuracy(statistics.audioDuration, expectedFrames / (double)BXMT32TestSampleRate, 1e-9);
+    XCTAssertGreaterThanOrEqual(statistics.blockCount, expectedFrames / BXMT32TestBlockFrames);
+    XCTAssertLessThanOrEqual(statistics.medianBlockTime, statistics.p95BlockTime);
+    XCTAssertLessThanOrEqual(statistics.p95BlockTime, statistics.p99BlockTime);
+    XCTAssertLessThanOrEqual(statistics.p99BlockTime, statistics.maxBlockTime);
+    XCTAssertGreaterThan(statistics.realtimeFactor, 1.0, @"The MT-32 should render faster than realtime.");
+
+    NSData *wav = [NSData dataWithContentsOfURL: outputURL];
+    XCTAssertEqual(wav.length, BXMT32TestWAVHeaderSize + expectedFrames * 4);
+
+    //The notes should actually have been heard.
+    const int16_t *samples = (const int16_t *)((const UInt8 *)wav.bytes + BXMT32TestWAVHeaderSize);
+    int peak = 0;
+    NSUInteger s;
+    for (s = 0; s < expectedFrames * 2; s++)
+        peak = MAX(peak, abs(samples[s]));
+    XCTAssertGreaterThan(peak, 256, @"The rendered notes were silent.");
+}
+
+- (void) testRenderingIsDeterministic
+{
+    if (![self _hasROMs])
+        return;
+
+    NSURL *logURL = [_tempURL URLByAppendingPathComponent: @"events.bxmt32"];
+    [self _writeTestLogToURL: logURL];
+
+    //Two fresh synths fed the same log should produce exactly the same audio.
+    NSData *outputs[2];
+    NSUInteger i;
+    for (i = 0; i < 2; i++)
+    {
+        NSURL *outputURL = [_tempURL URLByAppendingPathComponent: [NSString stringWithFormat: @"output%lu.wav", (unsigned long)i]];
+        BXEmulatedMT32 *synth = [self _offlineSynth];
+        NSError *error = nil;
+        XCTAssertNotNil([synth renderEventLogAtURL: logURL toWAVFileAtURL: outputURL blockFrames: BXMT32TestBlockFrames error: &error], @"%@", error);
+        [synth close];
+        outputs[i] = [NSData dataWithContentsOfURL: outputURL];
+    }
+
+    XCTAssertEqualObjects(outputs[0], outputs[1]);
+}
+
+- (void) testTruncatedLogIsRejected
+{
+    if (![self _hasROMs])
+        return;
+
+    NSURL *logURL = [_tempURL URLByAppendingPathComponent: @"events.bxmt32"];
+    [self _writeTestLogToURL: logURL];
+
+    NSMutableData *truncated = [NSMutableData dataWithContentsOfURL: logURL];
+    truncated.length -= 3;
+    [truncated writeToURL: logURL atomically: NO];
+
+    BXEmulatedMT32 *synth = [self _offlineSynth];
+    NSError *error = nil;
+    BXMT32RenderStatistics *statistics = [synth renderEventLogAtURL: logURL
+                                                     toWAVFileAtURL: [_tempURL URLByAppendingPathComponent: @"output.wav"]
+                                                        blockFrames: BXMT32TestBlockFrames
+                                                              error: &error];
+    [synth close];
+
+    XCTAssertNil(statistics);
+    XCTAssertEqualObjects(error.domain, BXEmulatedMT32ErrorDomain);
+    XCTAssertEqual(error.code, BXEmulatedMT32InvalidEventLog);
+}
+
+@end
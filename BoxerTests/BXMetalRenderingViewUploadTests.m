@@ -0,0 +1,307 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import <Metal/Metal.h>
+#import "BXMetalRenderingView.h"
+#import "BXVideoFrame.h"
+
+
+#define BXUploadTestWidth 640
+#define BXUploadTestHeight 480
+#define BXUploadTestFrameCount 600
+
+//The size of a full upload of one frame: the frame texture is always BGRA.
+#define BXUploadTestFullFrameBytes (BXUploadTestWidth * BXUploadTestHeight * 4)
+
+//Mode 13h, as drawn by a game animating most of the screen every frame.
+#define BXUploadTestMode13hWidth 320
+#define BXUploadTestMode13hHeight 200
+#define BXUploadTestMode13hFrameCount 700
+
+
+@interface BXMetalRenderingViewUploadTests : XCTestCase
+{
+    BXMetalRenderingView *_view;
+}
+@end
+
+
+@implementation BXMetalRenderingViewUploadTests
+
+- (void) setUp
+{
+    [super setUp];
+
+    //The view can't do anything without a GPU to upload to.
+    id <MTLDevice> device = MTLCreateSystemDefaultDevice();
+    if (device)
+        _view = [[BXMetalRenderingView alloc] initWithFrame: NSMakeRect(0, 0, BXUploadTestWidth, BXUploadTestHeight)];
+}
+
+- (void) tearDown
+{
+    _view = nil;
+    [super tearDown];
+}
+
+- (BOOL) _skipWithoutMetal
+{
+    if (_view)
+        return NO;
+
+    NSLog(@"Skipping %@: no Metal device is available.", self.name);
+    return YES;
+}
+
+//Returns the dirty lines of frame k of a recorded-style sequence: a game redrawing a sprite band
+//most frames, a status bar every tenth frame, and nothing at all every seventh frame.
+static NSUInteger BXDirtyBandsOfFrame(NSUInteger k, NSRange *bands)
+{
+    if ((k % 7) == 6)
+        return 0;
+
+    NSUInteger numBands = 0;
+    bands[numBands++] = NSMakeRange((k * 5) % (BXUploadTestHeight - 32), 32);
+    if ((k % 10) == 0)
+        bands[numBands++] = NSMakeRange(BXUploadTestHeight - 16, 16);
+    return numBands;
+}
+
+//Prepares the specified frame as frame k of the sequence and returns how many lines it marks dirty.
+static NSUInteger BXPrepareFrame(BXVideoFrame *frame, NSUInteger k)
+{
+    NSRange bands[2];
+    NSUInteger i, numBands = BXDirtyBandsOfFrame(k, bands), numLines = 0;
+
+    [frame clearDirtyRegions];
+    frame.frameNumber = k + 1;
+    for (i = 0; i < numBands; i++)
+    {
+        memset((uint8_t *)frame.mutableBytes + (bands[i].location * frame.pitch),
+               (int)(k & 0xFF),
+               bands[i].length * frame.pitch);
+        [frame setNeedsDisplayInRegion: bands[i]];
+        numLines += bands[i].length;
+    }
+    return numLines;
+}
+
+- (BXVideoFrame *) _frameWithDepth: (NSUInteger)depth
+{
+    BXVideoFrame *frame = [BXVideoFrame frameWithSize: NSMakeSize(BXUploadTestWidth, BXUploadTestHeight)
+                                                depth: depth];
+    if (frame.isIndexed)
+    {
+        uint32_t palette[256];
+        NSUInteger i;
+        for (i = 0; i < 256; i++)
+            palette[i] = 0xFF000000 | (uint32_t)(i * 0x00010101);
+        [frame setPalette: palette version: 1];
+    }
+    return frame;
+}
+
+//Replays the sequence into the view and returns the bytes it uploaded, populating expectedBytes
+//with what uploading only the dirty bands should have cost.
+- (NSUInteger) _replaySequenceWithFrame: (BXVideoFrame *)frame expectedBytes: (NSUInteger *)expectedBytes
+{
+    NSUInteger startBytes = _view.uploadedByteCount;
+    NSUInteger expected = 0;
+    NSUInteger k;
+    for (k = 0; k < BXUploadTestFrameCount; k++)
+    {
+        NSUInteger dirtyLines = BXPrepareFrame(frame, k);
+
+        //The first frame creates the texture, so it must go up whole.
+        expected += (k == 0) ? BXUploadTestFullFrameBytes : dirtyLines * BXUploadTestWidth * 4;
+        [_view updateWithFrame: frame];
+    }
+
+    if (expectedBytes)
+        *expectedBytes = expected;
+    return _view.uploadedByteCount - startBytes;
+}
+
+
+#pragma mark -
+#pragma mark Tests
+
+- (void) testDirtyBandReplayUploadsOnlyDirtyLines
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [self _frameWithDepth: 4];
+    NSUInteger expectedBytes = 0;
+    NSUInteger uploadedBytes = [self _replaySequenceWithFrame: frame expectedBytes: &expectedBytes];
+
+    XCTAssertEqual(uploadedBytes, expectedBytes);
+
+    NSUInteger fullBytes = BXUploadTestFullFrameBytes * BXUploadTestFrameCount;
+    NSLog(@"Replayed %u frames: %.1fKB uploaded per frame with dirty bands, %.1fKB with full uploads (%.1f%%)",
+          BXUploadTestFrameCount,
+          uploadedBytes / 1024.0 / BXUploadTestFrameCount,
+          fullBytes / 1024.0 / BXUploadTestFrameCount,
+          uploadedBytes * 100.0 / fullBytes);
+}
+
+- (void) testFrameNumberGapForcesFullUpload
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [self _frameWithDepth: 4];
+    BXPrepareFrame(frame, 0);
+    [_view updateWithFrame: frame];
+
+    //The next frame in sequence uploads only its dirty band.
+    NSUInteger dirtyLines = BXPrepareFrame(frame, 1);
+    NSUInteger before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, dirtyLines * BXUploadTestWidth * 4);
+
+    //Redelivering the same frame uploads nothing.
+    before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, (NSUInteger)0);
+
+    //Skipping a frame means we missed the lines it changed, so everything must go up again.
+    BXPrepareFrame(frame, 3);
+    before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, (NSUInteger)BXUploadTestFullFrameBytes);
+}
+
+- (void) testPaletteChangeForcesFullUpload
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [self _frameWithDepth: 1];
+    BXPrepareFrame(frame, 0);
+    [_view updateWithFrame: frame];
+
+    NSUInteger dirtyLines = BXPrepareFrame(frame, 1);
+    NSUInteger before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, dirtyLines * BXUploadTestWidth * 4);
+
+    //A palette change recolours every line, even though only one band was flagged as dirty.
+    uint32_t palette[256];
+    NSUInteger i;
+    for (i = 0; i < 256; i++)
+        palette[i] = 0xFF000000 | (uint32_t)((255 - i) * 0x00010101);
+    BXPrepareFrame(frame, 2);
+    [frame setPalette: palette version: frame.paletteVersion + 1];
+
+    before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, (NSUInteger)BXUploadTestFullFrameBytes);
+
+    //The frame after that is back to uploading only its band.
+    dirtyLines = BXPrepareFrame(frame, 3);
+    before = _view.uploadedByteCount;
+    [_view updateWithFrame: frame];
+    XCTAssertEqual(_view.uploadedByteCount - before, dirtyLines * BXUploadTestWidth * 4);
+}
+
+//Draws mode 13h content into the frame the way DOSBox would at the frame's depth, and presents it
+//to the view: either as palette indices, or as pixels DOSBox has already looked up in the palette.
+- (void) _drawMode13hSequenceIntoFrame: (BXVideoFrame *)frame palette: (const uint32_t *)palette
+{
+    NSUInteger k, line, x;
+    for (k = 0; k < BXUploadTestMode13hFrameCount; k++)
+    {
+        [frame clearDirtyRegions];
+        frame.frameNumber = _view.currentFrame.frameNumber + 1;
+
+        for (line = 0; line < BXUploadTestMode13hHeight; line++)
+        {
+            uint8_t *row = (uint8_t *)frame.mutableBytes + (line * frame.pitch);
+            for (x = 0; x < BXUploadTestMode13hWidth; x++)
+            {
+                uint8_t index = (uint8_t)((x ^ line) + k);
+                if (frame.isIndexed)
+                    row[x] = index;
+                else
+                    ((uint32_t *)row)[x] = palette[index];
+            }
+        }
+        [frame setNeedsDisplayInRegion: NSMakeRange(0, BXUploadTestMode13hHeight)];
+        [_view updateWithFrame: frame];
+    }
+}
+
+- (void) testMode13hIndexedVersus32bpp
+{
+    if ([self _skipWithoutMetal]) return;
+
+    uint32_t palette[256];
+    NSUInteger i;
+    for (i = 0; i < 256; i++)
+        palette[i] = 0xFF000000 | (uint32_t)(i * 0x00030507);
+
+    NSUInteger depths[] = { 1, 4 };
+    NSTimeInterval times[2];
+    for (i = 0; i < 2; i++)
+    {
+        BXVideoFrame *frame = [BXVideoFrame frameWithSize: NSMakeSize(BXUploadTestMode13hWidth, BXUploadTestMode13hHeight)
+                                                    depth: depths[i]];
+        if (frame.isIndexed)
+            [frame setPalette: palette version: 1];
+
+        NSUInteger startBytes = _view.uploadedByteCount;
+        NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+        [self _drawMode13hSequenceIntoFrame: frame palette: palette];
+        times[i] = [NSProcessInfo processInfo].systemUptime - start;
+
+        //The texture is BGRA either way, so both depths upload the same amount.
+        XCTAssertEqual(_view.uploadedByteCount - startBytes,
+                       (NSUInteger)(BXUploadTestMode13hWidth * BXUploadTestMode13hHeight * 4 * BXUploadTestMode13hFrameCount));
+
+        NSLog(@"Mode 13h at %lu byte(s) per pixel: %.1fus per frame, %lu bytes of frame data",
+              (unsigned long)depths[i], times[i] * 1000000.0 / BXUploadTestMode13hFrameCount,
+              (unsigned long)frame.frameData.length);
+    }
+    NSLog(@"Indexed output took %.2fx the time of 32bpp output.", times[0] / times[1]);
+}
+
+- (void) testMode13hIndexedPerformance
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [BXVideoFrame frameWithSize: NSMakeSize(BXUploadTestMode13hWidth, BXUploadTestMode13hHeight)
+                                                depth: 1];
+    uint32_t palette[256] = { 0 };
+    [frame setPalette: palette version: 1];
+    [self measureBlock: ^{
+        [self _drawMode13hSequenceIntoFrame: frame palette: palette];
+    }];
+}
+
+- (void) testMode13h32bppPerformance
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [BXVideoFrame frameWithSize: NSMakeSize(BXUploadTestMode13hWidth, BXUploadTestMode13hHeight)
+                                                depth: 4];
+    uint32_t palette[256] = { 0 };
+    [self measureBlock: ^{
+        [self _drawMode13hSequenceIntoFrame: frame palette: palette];
+    }];
+}
+
+- (void) testDirtyBandReplayPerformance
+{
+    if ([self _skipWithoutMetal]) return;
+
+    BXVideoFrame *frame = [self _frameWithDepth: 4];
+    [self measureBlock: ^{
+        [self _replaySequenceWithFrame: frame expectedBytes: NULL];
+    }];
+}
+
+@end
@@ -0,0 +1,271 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXSoundFontSynth.h"
+
+
+#define BXSoundFontTestSampleRate 44100
+#define BXSoundFontTestBlockFrames 512
+
+//The test bank's only sample: a sine wave of exactly 44 cycles, looped end to end.
+#define BXSoundFontTestSamplePoints 4400
+#define BXSoundFontTestSamplePeriod 100
+
+//The SoundFont 2 specification asks for 46 zero points after each sample.
+#define BXSoundFontTestSamplePadding 46
+
+
+@interface BXSoundFontSynthBenchmarks : XCTestCase
+{
+    NSURL *_soundFontURL;
+}
+@end
+
+
+@implementation BXSoundFontSynthBenchmarks
+
+#pragma mark - Test soundfont
+
+static void BXAppendUInt16(NSMutableData *data, UInt16 value)
+{
+    UInt16 little = OSSwapHostToLittleInt16(value);
+    [data appendBytes: &little length: sizeof(little)];
+}
+
+static void BXAppendUInt32(NSMutableData *data, UInt32 value)
+{
+    UInt32 little = OSSwapHostToLittleInt32(value);
+    [data appendBytes: &little length: sizeof(little)];
+}
+
+static void BXAppendName(NSMutableData *data, const char *name)
+{
+    char padded[20] = {0};
+    strncpy(padded, name, sizeof(padded) - 1);
+    [data appendBytes: padded length: sizeof(padded)];
+}
+
+static NSData *BXChunk(const char *chunkID, NSData *contents)
+{
+    NSMutableData *chunk = [NSMutableData dataWithBytes: chunkID length: 4];
+    BXAppendUInt32(chunk, (UInt32)contents.length);
+    [chunk appendData: contents];
+    if (contents.length & 1)
+        [chunk increaseLengthBy: 1];
+    return chunk;
+}
+
+static NSData *BXListChunk(const char *listType, NSArray<NSData *> *subchunks)
+{
+    NSMutableData *contents = [NSMutableData dataWithBytes: listType length: 4];
+    for (NSData *subchunk in subchunks)
+        [contents appendData: subchunk];
+    return BXChunk("LIST", contents);
+}
+
+//Builds the smallest complete bank we can: one General MIDI piano preset, made of one instrument
+//that plays a looping sine wave across the whole keyboard.
+static NSData *BXTestSoundFont(void)
+{
+    NSMutableData *ifil = [NSMutableData data];
+    BXAppendUInt16(ifil, 2);
+    BXAppendUInt16(ifil, 1);
+
+    NSMutableData *smpl = [NSMutableData data];
+    NSUInteger i;
+    for (i = 0; i < BXSoundFontTestSamplePoints; i++)
+        BXAppendUInt16(smpl, (UInt16)(SInt16)lrint(16000.0 * sin(2.0 * M_PI * i / BXSoundFontTestSamplePeriod)));
+    [smpl increaseLengthBy: BXSoundFontTestSamplePadding * sizeof(SInt16)];
+
+    //Presets: ours, then the terminal record.
+    NSMutableData *phdr = [NSMutableData data];
+    BXAppendName(phdr, "Sine"); BXAppendUInt16(phdr, 0); BXAppendUInt16(phdr, 0); BXAppendUInt16(phdr, 0);
+    BXAppendUInt32(phdr, 0); BXAppendUInt32(phdr, 0); BXAppendUInt32(phdr, 0);
+    BXAppendName(phdr, "EOP"); BXAppendUInt16(phdr, 0); BXAppendUInt16(phdr, 0); BXAppendUInt16(phdr, 1);
+    BXAppendUInt32(phdr, 0); BXAppendUInt32(phdr, 0); BXAppendUInt32(phdr, 0);
+
+    NSMutableData *pbag = [NSMutableData data];
+    BXAppendUInt16(pbag, 0); BXAppendUInt16(pbag, 0);
+    BXAppendUInt16(pbag, 1); BXAppendUInt16(pbag, 0);
+
+    NSMutableData *pmod = [NSMutableData dataWithLength: 10];
+
+    NSMutableData *pgen = [NSMutableData data];
+    BXAppendUInt16(pgen, 41); BXAppendUInt16(pgen, 0);      //instrument 0
+    BXAppendUInt16(pgen, 0); BXAppendUInt16(pgen, 0);
+
+    NSMutableData *inst = [NSMutableData data];
+    BXAppendName(inst, "Sine"); BXAppendUInt16(inst, 0);
+    BXAppendName(inst, "EOI"); BXAppendUInt16(inst, 1);
+
+    NSMutableData *ibag = [NSMutableData data];
+    BXAppendUInt16(ibag, 0); BXAppendUInt16(ibag, 0);
+    BXAppendUInt16(ibag, 2); BXAppendUInt16(ibag, 0);
+
+    NSMutableData *imod = [NSMutableData dataWithLength: 10];
+
+    NSMutableData *igen = [NSMutableData data];
+    BXAppendUInt16(igen, 54); BXAppendUInt16(igen, 1);      //sampleModes: loop continuously
+    BXAppendUInt16(igen, 53); BXAppendUInt16(igen, 0);      //sampleID 0
+    BXAppendUInt16(igen, 0); BXAppendUInt16(igen, 0);
+
+    NSMutableData *shdr = [NSMutableData data];
+    BXAppendName(shdr, "Sine");
+    BXAppendUInt32(shdr, 0); BXAppendUInt32(shdr, BXSoundFontTestSamplePoints);
+    BXAppendUInt32(shdr, 0); BXAppendUInt32(shdr, BXSoundFontTestSamplePoints);
+    BXAppendUInt32(shdr, BXSoundFontTestSampleRate);
+    UInt8 pitch[] = { 69, 0 }; //441Hz is close enough to A4.
+    [shdr appendBytes: pitch length: sizeof(pitch)];
+    BXAppendUInt16(shdr, 0); BXAppendUInt16(shdr, 1);       //Mono sample
+    BXAppendName(shdr, "EOS");
+    [shdr increaseLengthBy: 26];
+
+    NSMutableData *body = [NSMutableData dataWithBytes: "sfbk" length: 4];
+    [body appendData: BXListChunk("INFO", @[ BXChunk("ifil", ifil) ])];
+    [body appendData: BXListChunk("sdta", @[ BXChunk("smpl", smpl) ])];
+    [body appendData: BXListChunk("pdta", @[
+        BXChunk("phdr", phdr), BXChunk("pbag", pbag), BXChunk("pmod", pmod), BXChunk("pgen", pgen),
+        BXChunk("inst", inst), BXChunk("ibag", ibag), BXChunk("imod", imod), BXChunk("igen", igen),
+        BXChunk("shdr", shdr),
+    ])];
+
+    return BXChunk("RIFF", body);
+}
+
+- (void) setUp
+{
+    [super setUp];
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent: [NSUUID UUID].UUIDString];
+    _soundFontURL = [NSURL fileURLWithPath: [path stringByAppendingPathExtension: @"sf2"]];
+    [BXTestSoundFont() writeToURL: _soundFontURL atomically: NO];
+}
+
+- (void) tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL: _soundFontURL error: NULL];
+    [super tearDown];
+}
+
+
+#pragma mark - Helpers
+
+- (BXSoundFontSynth *) _synth
+{
+    NSError *error = nil;
+    BXSoundFontSynth *synth = [[BXSoundFontSynth alloc] initWithSoundFontAtURL: _soundFontURL error: &error];
+    XCTAssertNotNil(synth, @"Could not load the test soundfont: %@", error);
+    return synth;
+}
+
+//Starts the specified number of distinct notes, spread across the non-drum channels.
+static void BXStartNotes(BXSoundFontSynth *synth, NSUInteger numNotes)
+{
+    NSUInteger i;
+    for (i = 0; i < numNotes; i++)
+    {
+        UInt8 channel = (UInt8)(i / 64);
+        UInt8 key = (UInt8)(32 + (i % 64));
+        UInt8 message[] = { (UInt8)(0x90 | channel), key, 100 };
+        [synth handleMessage: [NSData dataWithBytes: message length: sizeof(message)]];
+    }
+}
+
+//Renders the specified number of frames in mixer-sized blocks, and returns how long that took.
+static NSTimeInterval BXRenderFrames(BXSoundFontSynth *synth, NSUInteger numFrames, float *peak)
+{
+    float buffer[BXSoundFontTestBlockFrames * 2];
+    NSUInteger sampleRate;
+    BXAudioFormat format;
+
+    NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+    NSUInteger framesRendered = 0;
+    while (framesRendered < numFrames)
+    {
+        NSUInteger frames = MIN(numFrames - framesRendered, (NSUInteger)BXSoundFontTestBlockFrames);
+        [synth renderOutputToBuffer: buffer frames: frames sampleRate: &sampleRate format: &format];
+
+        if (peak)
+        {
+            NSUInteger i;
+            for (i = 0; i < frames * 2; i++)
+                *peak = MAX(*peak, fabsf(buffer[i]));
+        }
+        framesRendered += frames;
+    }
+    return [NSProcessInfo processInfo].systemUptime - start;
+}
+
+
+#pragma mark - Tests
+
+- (void) testTestSoundFontPlays
+{
+    BXSoundFontSynth *synth = [self _synth];
+    BXStartNotes(synth, 1);
+
+    float peak = 0;
+    BXRenderFrames(synth, BXSoundFontTestSampleRate / 10, &peak);
+
+    XCTAssertEqual(synth.activeVoiceCount, 1U);
+    XCTAssertGreaterThan(peak, 0.01f, @"The note was silent.");
+}
+
+- (void) testPolyphonyLimitsActiveVoices
+{
+    BXSoundFontSynth *synth = [self _synth];
+    synth.polyphony = 32;
+    BXStartNotes(synth, 64);
+    BXRenderFrames(synth, BXSoundFontTestBlockFrames, NULL);
+
+    XCTAssertEqual(synth.activeVoiceCount, 32U, @"Notes beyond the polyphony limit should steal voices.");
+}
+
+//Measures how many voices a single core could keep playing in realtime, from how long it takes
+//to render a second of audio with each number of voices sounding.
+- (void) testVoicesPerCore
+{
+    NSUInteger voiceCounts[] = { 16, 64, 128, BXSoundFontSynthMaxVoices };
+    NSUInteger i, count = sizeof(voiceCounts) / sizeof(voiceCounts[0]);
+    for (i = 0; i < count; i++)
+    {
+        NSUInteger numVoices = voiceCounts[i];
+        BXSoundFontSynth *synth = [self _synth];
+        synth.polyphony = BXSoundFontSynthMaxVoices;
+        BXStartNotes(synth, numVoices);
+
+        //Let the notes start and settle before timing anything.
+        BXRenderFrames(synth, BXSoundFontTestBlockFrames, NULL);
+        XCTAssertEqual(synth.activeVoiceCount, numVoices);
+
+        NSTimeInterval renderTime = BXRenderFrames(synth, BXSoundFontTestSampleRate, NULL);
+        double realtimeFactor = 1.0 / MAX(renderTime, 1e-9);
+        double voicesPerCore = numVoices * realtimeFactor;
+
+        NSLog(@"%lu voices: rendered 1s of audio in %.2fms, %.1fx realtime, about %.0f voices per core",
+              (unsigned long)numVoices, renderTime * 1000, realtimeFactor, voicesPerCore);
+
+        //Only the default polyphony has to keep up, as Debug builds are unoptimized.
+        if (numVoices <= 64)
+            XCTAssertGreaterThan(realtimeFactor, 1.0, @"%lu voices could not be rendered in realtime.", (unsigned long)numVoices);
+    }
+}
+
+- (void) testRenderPerformanceWith64Voices
+{
+    BXSoundFontSynth *synth = [self _synth];
+    BXStartNotes(synth, 64);
+    BXRenderFrames(synth, BXSoundFontTestBlockFrames, NULL);
+
+    [self measureBlock: ^{
+        BXRenderFrames(synth, BXSoundFontTestSampleRate, NULL);
+    }];
+}
+
+@end
@@ -0,0 +1,134 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "BXVideoFrameRing.h"
+#import "BXVideoFrame.h"
+
+
+#define BXFrameRingTestWidth 64
+#define BXFrameRingTestHeight 48
+#define BXFrameRingTestFrameCount 200000
+
+
+@interface BXVideoFrameRingTests : XCTestCase
+@end
+
+
+@implementation BXVideoFrameRingTests
+
+//Frame k stamps k into line 0, and into one line of the remaining lines in rotation;
+//every other line must still hold whatever the most recent frame to touch it wrote.
+static uint32_t BXExpectedStamp(uint32_t frame, NSUInteger line)
+{
+    if (line == 0)
+        return frame;
+
+    uint32_t cycle = BXFrameRingTestHeight - 1;
+    uint32_t slot = (uint32_t)(line - 1);
+    if (frame < slot)
+        return 0;
+
+    uint32_t stamp = frame - ((frame - slot) % cycle);
+    return (stamp >= 1) ? stamp : 0;
+}
+
+static void BXStampLine(BXVideoFrame *frame, NSUInteger line, uint32_t stamp)
+{
+    uint32_t *pixels = (uint32_t *)((uint8_t *)frame.mutableBytes + (line * frame.pitch));
+    NSUInteger i;
+    for (i = 0; i < BXFrameRingTestWidth; i++)
+        pixels[i] = stamp;
+
+    [frame setNeedsDisplayInRegion: NSMakeRange(line, 1)];
+}
+
+- (void) testConsumerAlwaysSeesWholeFrames
+{
+    BXVideoFrameRing *ring = [BXVideoFrameRing ringWithSize: NSMakeSize(BXFrameRingTestWidth, BXFrameRingTestHeight)
+                                                      depth: 4];
+
+    __block atomic_bool producerFinished = false;
+    dispatch_semaphore_t producerDone = dispatch_semaphore_create(0);
+
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        uint32_t k;
+        for (k = 1; k <= BXFrameRingTestFrameCount; k++)
+        {
+            [ring prepareWriteFrame];
+            BXVideoFrame *frame = ring.writeFrame;
+            BXStampLine(frame, 0, k);
+            BXStampLine(frame, 1 + (k % (BXFrameRingTestHeight - 1)), k);
+            [ring publishWriteFrame];
+        }
+        atomic_store(&producerFinished, true);
+        dispatch_semaphore_signal(producerDone);
+    });
+
+    NSUInteger framesAcquired = 0, mismatches = 0;
+    NSUInteger lastFrameNumber = 0;
+    uint32_t lastStamp = 0;
+    BOOL finished = NO;
+    while (!finished)
+    {
+        //Check once more after the producer finishes, to pick up its final frame.
+        finished = atomic_load(&producerFinished);
+
+        BXVideoFrame *frame = [ring acquireLatestFrame];
+        if (!frame)
+            continue;
+
+        framesAcquired++;
+        XCTAssertGreaterThan(frame.frameNumber, lastFrameNumber, @"Frames should be acquired in publication order.");
+        lastFrameNumber = frame.frameNumber;
+
+        const uint8_t *bytes = frame.bytes;
+        uint32_t stamp = *(const uint32_t *)bytes;
+        XCTAssertGreaterThan(stamp, lastStamp, @"Each acquired frame should be newer than the last.");
+        lastStamp = stamp;
+
+        NSUInteger line, i;
+        for (line = 0; line < BXFrameRingTestHeight; line++)
+        {
+            const uint32_t *pixels = (const uint32_t *)(bytes + (line * frame.pitch));
+            uint32_t expected = BXExpectedStamp(stamp, line);
+            for (i = 0; i < BXFrameRingTestWidth; i++)
+            {
+                if (pixels[i] != expected)
+                {
+                    mismatches++;
+                    break;
+                }
+            }
+        }
+    }
+
+    dispatch_semaphore_wait(producerDone, DISPATCH_TIME_FOREVER);
+
+    XCTAssertEqual(mismatches, 0U, @"Acquired frames should never contain torn or stale lines.");
+    XCTAssertEqual(lastStamp, (uint32_t)BXFrameRingTestFrameCount, @"The consumer should end up with the final frame.");
+    XCTAssertGreaterThan(framesAcquired, 1U);
+}
+
+- (void) testAcquireReturnsNilWithoutANewFrame
+{
+    BXVideoFrameRing *ring = [BXVideoFrameRing ringWithSize: NSMakeSize(8, 8) depth: 4];
+    XCTAssertNil([ring acquireLatestFrame]);
+    XCTAssertNil(ring.readFrame);
+
+    [ring prepareWriteFrame];
+    [ring publishWriteFrame];
+
+    BXVideoFrame *frame = [ring acquireLatestFrame];
+    XCTAssertNotNil(frame);
+    XCTAssertEqualObjects(ring.readFrame, frame);
+    XCTAssertNil([ring acquireLatestFrame], @"A frame should only be handed out once.");
+}
+
+@end
@@ -0,0 +1,181 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import <XCTest/XCTest.h>
+#import "BXVideoRecorder.h"
+#import "BXVideoFrame.h"
+
+
+//Mode 13h dimensions, at the VGA refresh rate.
+#define BXRecorderTestWidth 320
+#define BXRecorderTestHeight 200
+#define BXRecorderTestFrameRate 70.0
+
+#define BXRecorderTestFrameCount 420
+#define BXRecorderTestDirtyLines 16
+
+//How often the generated sequence cycles the palette, in frames.
+#define BXRecorderTestPaletteInterval 70
+
+
+@interface BXVideoRecorderBenchmarks : XCTestCase
+@end
+
+
+@implementation BXVideoRecorderBenchmarks
+
+- (NSURL *) _temporaryRecordingURL
+{
+    NSString *name = [NSString stringWithFormat: @"BXVideoRecorderBenchmarks-%@.avi", [NSUUID UUID].UUIDString];
+    return [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: name]];
+}
+
+//Draws the next frame of a scrolling band of colour into the specified frame, marking only
+//the band's lines as dirty, the way a game redrawing part of the screen would.
+static void BXDrawTestFrame(BXVideoFrame *frame, NSUInteger k)
+{
+    [frame clearDirtyRegions];
+    frame.emulatedTime = k / BXRecorderTestFrameRate;
+
+    NSUInteger firstLine = (k * 3) % (BXRecorderTestHeight - BXRecorderTestDirtyLines);
+    NSUInteger line, x;
+    for (line = firstLine; line < firstLine + BXRecorderTestDirtyLines; line++)
+    {
+        uint8_t *row = (uint8_t *)frame.mutableBytes + (line * frame.pitch);
+        if (frame.isIndexed)
+        {
+            for (x = 0; x < BXRecorderTestWidth; x++)
+                row[x] = (uint8_t)(x + line + k);
+        }
+        else
+        {
+            uint32_t *pixels = (uint32_t *)row;
+            for (x = 0; x < BXRecorderTestWidth; x++)
+                pixels[x] = 0xFF000000 | (uint32_t)((x + line + k) * 0x010203);
+        }
+    }
+    [frame setNeedsDisplayInRegion: NSMakeRange(firstLine, BXRecorderTestDirtyLines)];
+
+    if (frame.isIndexed && (k % BXRecorderTestPaletteInterval) == 0)
+    {
+        uint32_t palette[256];
+        NSUInteger i;
+        for (i = 0; i < 256; i++)
+            palette[i] = 0xFF000000 | (uint32_t)((i + k) * 0x00010101);
+        [frame setPalette: palette version: k / BXRecorderTestPaletteInterval + 1];
+    }
+}
+
+//Records the test sequence at the specified depth, waits for the recording to be written out
+//and returns the recorder. Populates producerTime with the time spent in addFrame:, which is
+//what the emulation thread pays.
+- (BXVideoRecorder *) _recordFramesWithDepth: (NSUInteger)depth
+                                       toURL: (NSURL *)URL
+                                producerTime: (NSTimeInterval *)producerTime
+{
+    NSError *error = nil;
+    BXVideoRecorder *recorder = [[BXVideoRecorder alloc] initWithURL: URL
+                                                           frameRate: BXRecorderTestFrameRate
+                                                               error: &error];
+    XCTAssertNotNil(recorder, @"Could not create recording: %@", error);
+
+    //Don't let the benchmark depend on how far the encoder happens to fall behind.
+    recorder.maxQueuedFrames = BXRecorderTestFrameCount;
+
+    BXVideoFrame *frame = [BXVideoFrame frameWithSize: NSMakeSize(BXRecorderTestWidth, BXRecorderTestHeight)
+                                                depth: depth];
+
+    NSTimeInterval addTime = 0;
+    NSUInteger k;
+    for (k = 0; k < BXRecorderTestFrameCount; k++)
+    {
+        BXDrawTestFrame(frame, k);
+
+        NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+        [recorder addFrame: frame];
+        addTime += [NSProcessInfo processInfo].systemUptime - start;
+    }
+
+    XCTestExpectation *finished = [self expectationWithDescription: @"Recording finished"];
+    [recorder finishWithCompletionHandler: ^(BOOL success, NSError *finishError) {
+        XCTAssertTrue(success, @"Recording failed: %@", finishError);
+        [finished fulfill];
+    }];
+    [self waitForExpectationsWithTimeout: 30 handler: nil];
+
+    if (producerTime)
+        *producerTime = addTime;
+    return recorder;
+}
+
+
+#pragma mark -
+#pragma mark Tests
+
+- (void) testRecordsEveryChangedFrame
+{
+    NSUInteger depths[] = { 1, 4 };
+    NSUInteger i;
+    for (i = 0; i < 2; i++)
+    {
+        NSURL *URL = [self _temporaryRecordingURL];
+        BXVideoRecorder *recorder = [self _recordFramesWithDepth: depths[i] toURL: URL producerTime: NULL];
+
+        XCTAssertEqual(recorder.recordedFrameCount, (NSUInteger)BXRecorderTestFrameCount,
+                       @"Not every frame was recorded at depth %lu.", (unsigned long)depths[i]);
+        XCTAssertEqual(recorder.droppedFrameCount, (NSUInteger)0);
+
+        NSData *file = [NSData dataWithContentsOfURL: URL];
+        XCTAssertGreaterThan(file.length, (NSUInteger)12);
+        if (file.length >= 12)
+        {
+            XCTAssertEqual(memcmp(file.bytes, "RIFF", 4), 0);
+            XCTAssertEqual(memcmp((const uint8_t *)file.bytes + 8, "AVI ", 4), 0);
+
+            uint32_t riffLength = CFSwapInt32LittleToHost(*(const uint32_t *)((const uint8_t *)file.bytes + 4));
+            XCTAssertEqual((NSUInteger)riffLength + 8, file.length, @"RIFF length does not cover the file.");
+        }
+
+        [[NSFileManager defaultManager] removeItemAtURL: URL error: NULL];
+    }
+}
+
+- (void) testRecordingThroughput
+{
+    NSUInteger depths[] = { 1, 4 };
+    NSUInteger i;
+    for (i = 0; i < 2; i++)
+    {
+        NSURL *URL = [self _temporaryRecordingURL];
+        NSTimeInterval producerTime = 0;
+
+        NSTimeInterval start = [NSProcessInfo processInfo].systemUptime;
+        [self _recordFramesWithDepth: depths[i] toURL: URL producerTime: &producerTime];
+        NSTimeInterval totalTime = [NSProcessInfo processInfo].systemUptime - start;
+
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath: URL.path error: NULL];
+        NSLog(@"Recorded %u frames at depth %lu: %.1f frames/s overall, %.1fus per frame on the emulation thread, %llu bytes",
+              BXRecorderTestFrameCount, (unsigned long)depths[i],
+              BXRecorderTestFrameCount / totalTime,
+              producerTime * 1000000.0 / BXRecorderTestFrameCount,
+              attributes.fileSize);
+
+        [[NSFileManager defaultManager] removeItemAtURL: URL error: NULL];
+    }
+}
+
+- (void) testIndexedRecordingPerformance
+{
+    [self measureBlock: ^{
+        NSURL *URL = [self _temporaryRecordingURL];
+        [self _recordFramesWithDepth: 1 toURL: URL producerTime: NULL];
+        [[NSFileManager defaultManager] removeItemAtURL: URL error: NULL];
+    }];
+}
+
+@end